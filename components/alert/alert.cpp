@@ -46,7 +46,7 @@ namespace display {
             entry.severity = severity_t::WARNING;
             strncpy(entry.title, "VOLTAGE HIGH!", sizeof(entry.title) - 1);
             snprintf(entry.body, sizeof(entry.body) - 1,
-                "%.1fV  threshold: 12.6V\nPossible overcharge.", data.battery_voltage);
+                "%.1fV  threshold: 12.6V\nPossible overcharge.", data.battery_voltage_max);
             push_alert(entry);
             last_active_alert = total_alerts_t::VOLTAGE_HIGH;
             return;
@@ -66,7 +66,7 @@ namespace display {
             entry.severity = severity_t::CRITICAL;
             strncpy(entry.title, "CHARGE CURRENT TOO HIGH!", sizeof(entry.title) - 1);
             snprintf(entry.body, sizeof(entry.body) - 1,
-                "%.1fA  threshold: -15.0A\nCharger overcurrent.\nCheck charger.", data.load_current_drawn);
+                "%.1fA  threshold: -15.0A\nCharger overcurrent.\nCheck charger.", data.load_current_min);
             push_alert(entry);
             last_active_alert = total_alerts_t::CURRENT_CHARGE_TOO_HIGH;
             return;
@@ -76,7 +76,7 @@ namespace display {
             entry.severity = severity_t::WARNING;
             strncpy(entry.title, "CHARGE CURRENT HIGH!", sizeof(entry.title) - 1);
             snprintf(entry.body, sizeof(entry.body) - 1,
-                "%.1fA  threshold: -10.0A\nCharger current elevated.", data.load_current_drawn);
+                "%.1fA  threshold: -10.0A\nCharger current elevated.", data.load_current_min);
             push_alert(entry);
             last_active_alert = total_alerts_t::CURRENT_CHARGE_HIGH;
             return;
@@ -86,7 +86,7 @@ namespace display {
             entry.severity = severity_t::WARNING;
             strncpy(entry.title, "LOAD CURRENT HIGH!", sizeof(entry.title) - 1);
             snprintf(entry.body, sizeof(entry.body) - 1,
-                "%.1fA  threshold: 20.0A\nLoad approaching limit.", data.load_current_drawn);
+                "%.1fA  threshold: 20.0A\nLoad approaching limit.", data.load_current_max);
             push_alert(entry);
             last_active_alert = total_alerts_t::CURRENT_HIGH;
             return;
@@ -96,7 +96,7 @@ namespace display {
             entry.severity = severity_t::CRITICAL;
             strncpy(entry.title, "LOAD CURRENT TOO HIGH!", sizeof(entry.title) - 1);
             snprintf(entry.body, sizeof(entry.body) - 1,
-                "%.1fA  threshold: 25.0A\nLoad overcurrent.\nReduce load now.", data.load_current_drawn);
+                "%.1fA  threshold: 25.0A\nLoad overcurrent.\nReduce load now.", data.load_current_max);
             push_alert(entry);
             last_active_alert = total_alerts_t::CURRENT_TOO_HIGH;
             return;
@@ -260,8 +260,11 @@ namespace display {
 
         bool alerts_present = false;
 
-        // Voltage classification
-        if (data.battery_voltage > 12.6f) {
+        // Voltage classification, on the peak so a short overvoltage isn't averaged away
+        if (!data.is_valid(sys::field_t::VOLTAGE)) {
+            // Nothing to classify
+            alerts.voltage = voltage_t::OK;
+        } else if (data.battery_voltage_max > 12.6f) {
             alerts.voltage = voltage_t::HIGH;
             alerts_present = true;
         } else {
@@ -269,17 +272,19 @@ namespace display {
             alerts.voltage = voltage_t::OK;
         }
         
-        // Current classification
-        if (data.load_current_drawn <= -15.0f) {
+        // Current classification, on the peaks so a short overcurrent isn't averaged away
+        if (!data.is_valid(sys::field_t::CURRENT)) {
+            alerts.current = current_t::OK;
+        } else if (data.load_current_min <= -15.0f) {
             alerts.current = current_t::CHARGE_TOO_HIGH;
             alerts_present = true;
-        } else if (data.load_current_drawn <= -10.0f) {
+        } else if (data.load_current_min <= -10.0f) {
             alerts.current = current_t::CHARGE_HIGH;
             alerts_present = true;
-        } else if (data.load_current_drawn >= 25.0f) {
+        } else if (data.load_current_max >= 25.0f) {
             alerts.current = current_t::TOO_HIGH;
             alerts_present = true;
-        } else if (data.load_current_drawn >= 20.0f) {
+        } else if (data.load_current_max >= 20.0f) {
             alerts.current = current_t::HIGH;
             alerts_present = true;
         } else {
@@ -289,7 +294,9 @@ namespace display {
         }
         
         // Temperature classification
-        if (data.inv_temp <= 0.0f) {
+        if (!data.is_valid(sys::field_t::TEMPERATURE)) {
+            alerts.temp = temp_t::OK;
+        } else if (data.inv_temp <= 0.0f) {
             alerts.temp = temp_t::TOO_LOW;
             alerts_present = true;
         } else if (data.inv_temp <= 10.0f) {
@@ -307,7 +314,9 @@ namespace display {
         }
         
         // Humidity classification
-        if (data.inv_hmdt <= 10.0f) {
+        if (!data.is_valid(sys::field_t::HUMIDITY)) {
+            alerts.hmdt = hmdt_t::OK;
+        } else if (data.inv_hmdt <= 10.0f) {
             alerts.hmdt = hmdt_t::TOO_LOW;
             alerts_present = true;
         } else if (data.inv_hmdt <= 20.0f) {
@@ -325,7 +334,9 @@ namespace display {
         }
         
         // Battery percentage classification
-        if (data.battery_percent <= 5.0f) {
+        if (!data.is_valid(sys::field_t::BATTERY)) {
+            alerts.batt = batt_t::OK;
+        } else if (data.battery_percent <= 5.0f) {
             alerts.batt = batt_t::BELOW_5;
             alerts_present = true;
         } else if (data.battery_percent <= 10.0f) {
@@ -20,6 +20,7 @@
 
 #include <cstdint>
 #include <array>
+#include <algorithm>
 
 
 // Debug logging levels
@@ -55,7 +56,7 @@ static constexpr const char* TAG = "BLE";
 
 
 // Set to 0 if nvs flash hasn't been initialized at the time of calling `ble::init()`
-#define NVS_ALREADY_INITIALIZED                 0
+#define NVS_ALREADY_INITIALIZED                 1
 
 // Set to 1 if you want `ble::deinit()` to deinitialize nvs flash
 #define DEINIT_NVS_FROM_BLE_DEINIT              0
@@ -90,6 +91,10 @@ namespace ble {
         uint16_t power_chr_handle;
         uint16_t battery_soc_chr_handle;
         uint16_t runtime_chr_handle;
+        uint16_t runtime_low_chr_handle;
+        uint16_t runtime_high_chr_handle;
+        uint16_t energy_in_chr_handle;
+        uint16_t energy_out_chr_handle;
 
         void clear_all() {
             is_advertising = false;
@@ -103,6 +108,10 @@ namespace ble {
             power_chr_handle = 0;
             battery_soc_chr_handle = 0;
             runtime_chr_handle = 0;
+            runtime_low_chr_handle = 0;
+            runtime_high_chr_handle = 0;
+            energy_in_chr_handle = 0;
+            energy_out_chr_handle = 0;
         }
     };
 
@@ -118,6 +127,10 @@ namespace ble {
             POWER,
             BATT_SoC,
             RUNTIME_S,
+            RUNTIME_LOW_S,
+            RUNTIME_HIGH_S,
+            ENERGY_IN_WH,
+            ENERGY_OUT_WH,
             COUNT
         };
 
@@ -149,7 +162,12 @@ namespace ble {
         template <typename T>
         esp_err_t send_notification(T val, uint16_t chr_handle, const char* name) {
             int16_t data = static_cast<int16_t>(val * 100);
-            os_mbuf_t* om = ble_hs_mbuf_from_flat(&data, sizeof(data));
+            return send_raw_notification(&data, sizeof(data), chr_handle, name);
+        }
+
+        // For values that don't fit the int16_t format, sent as they are
+        esp_err_t send_raw_notification(const void* data, uint16_t length, uint16_t chr_handle, const char* name) {
+            os_mbuf_t* om = ble_hs_mbuf_from_flat(data, length);
             if (om && (chr_handle != 0)) {
                 int rc = ble_gatts_notify_custom(connection_context.connection_handle, chr_handle, om);
                 if (rc == 0) {
@@ -181,12 +199,27 @@ namespace ble {
     static constexpr ble_uuid16_t VOLTAGE_CHAR_UUID          = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0x2B18 };
     static constexpr ble_uuid16_t CURRENT_CHAR_UUID          = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0x2AEE };
     static constexpr ble_uuid16_t POWER_CHAR_UUID            = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0x2B05 };
+    // Pipeline latency histograms, read only. One `sys::latency_histogram_t::snapshot_t` per stage in `sys::stage_t` order:
+    // 20 bucket counts, then the fresh, stale and skipped counts and the largest age in us, all uint32_t. Not SIG assigned
+    static constexpr ble_uuid16_t LATENCY_CHAR_UUID          = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0xFF05 };
 
     static constexpr ble_uuid16_t BATTERY_SERVICE_UUID       = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0x180F };
     static constexpr ble_uuid16_t SoC_CHAR_UUID              = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0x2A19 };
+    // The runtime and its band are uint32_t in whole seconds. In the int16_t format they'd wrap past 327s
     static constexpr ble_uuid16_t RUNTIME_CHAR_UUID          = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0x2B2E };
+    // Confidence band of the runtime. Not SIG assigned
+    static constexpr ble_uuid16_t RUNTIME_LOW_CHAR_UUID      = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0xFF01 };
+    static constexpr ble_uuid16_t RUNTIME_HIGH_CHAR_UUID     = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0xFF02 };
+    // Lifetime energy through the battery as uint32_t in whole Wh, as it outgrows the int16_t format. Not SIG assigned
+    static constexpr ble_uuid16_t ENERGY_IN_CHAR_UUID        = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0xFF03 };
+    static constexpr ble_uuid16_t ENERGY_OUT_CHAR_UUID       = { .u = { .type = BLE_UUID_TYPE_16 }, .value = 0xFF04 };
 
 
+    // Runtimes are capped at `RUNTIME_MAX_S`, well inside uint32_t, but saturate rather than wrap regardless
+    static uint32_t to_seconds_u32(uint64_t seconds) {
+        return static_cast<uint32_t>(std::min<uint64_t>(seconds, UINT32_MAX));
+    }
+
     // Forward declarations
     static int gatt_svr_init();
     static void ble_advertise();
@@ -304,6 +337,32 @@ namespace ble {
             .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
             .val_handle = &connection_context.power_chr_handle
         },
+        {
+            .uuid = &LATENCY_CHAR_UUID.u,
+            .access_cb = [](uint16_t conn_handle, uint16_t attr_handle, ble_gatt_access_ctxt_t* ctxt, void* arg) {
+                switch (ctxt->op) {
+                // Longer than the default MTU, so clients read it in several requests and a stage may straddle an update
+                case BLE_GATT_ACCESS_OP_READ_CHR: {
+                    for (size_t s = 0; s < static_cast<size_t>(sys::stage_t::COUNT); s++) {
+                        const auto snap = get_latency(static_cast<sys::stage_t>(s));
+                        const int rc = os_mbuf_append(ctxt->om, &snap, sizeof(snap));
+                        if (rc != 0) return BLE_ATT_ERR_INSUFFICIENT_RES;
+                    }
+                    return 0;
+                }
+                // Characteristics is read only
+                case BLE_GATT_ACCESS_OP_WRITE_CHR:
+                    return BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+                default:
+                    return BLE_ATT_ERR_UNLIKELY;
+                }
+                return BLE_ATT_ERR_UNLIKELY;
+            },
+            .arg = nullptr,
+            .descriptors = nullptr,
+            .flags = BLE_GATT_CHR_F_READ,
+            .val_handle = nullptr
+        },
         // AHT characteristics array termination
         {}
     };
@@ -335,7 +394,7 @@ namespace ble {
             .access_cb = [](uint16_t conn_handle, uint16_t attr_handle, ble_gatt_access_ctxt_t* ctxt, void* arg) {
                 switch (ctxt->op) {
                 case BLE_GATT_ACCESS_OP_READ_CHR: {
-                    int16_t runtime_s = static_cast<int16_t>(get_runtime() * 100);
+                    uint32_t runtime_s = to_seconds_u32(get_runtime());
                     return os_mbuf_append(ctxt->om, &runtime_s, sizeof(runtime_s));
                 }
                 // Characteristics is read only
@@ -351,6 +410,90 @@ namespace ble {
             .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
             .val_handle = &connection_context.runtime_chr_handle
         },
+        {
+            .uuid = &RUNTIME_LOW_CHAR_UUID.u,
+            .access_cb = [](uint16_t conn_handle, uint16_t attr_handle, ble_gatt_access_ctxt_t* ctxt, void* arg) {
+                switch (ctxt->op) {
+                case BLE_GATT_ACCESS_OP_READ_CHR: {
+                    uint32_t runtime_low_s = to_seconds_u32(get_runtime_low());
+                    return os_mbuf_append(ctxt->om, &runtime_low_s, sizeof(runtime_low_s));
+                }
+                // Characteristics is read only
+                case BLE_GATT_ACCESS_OP_WRITE_CHR:
+                    return BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+                default:
+                    return BLE_ATT_ERR_UNLIKELY;
+                }
+                return BLE_ATT_ERR_UNLIKELY;
+            },
+            .arg = nullptr,
+            .descriptors = nullptr,
+            .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+            .val_handle = &connection_context.runtime_low_chr_handle
+        },
+        {
+            .uuid = &RUNTIME_HIGH_CHAR_UUID.u,
+            .access_cb = [](uint16_t conn_handle, uint16_t attr_handle, ble_gatt_access_ctxt_t* ctxt, void* arg) {
+                switch (ctxt->op) {
+                case BLE_GATT_ACCESS_OP_READ_CHR: {
+                    uint32_t runtime_high_s = to_seconds_u32(get_runtime_high());
+                    return os_mbuf_append(ctxt->om, &runtime_high_s, sizeof(runtime_high_s));
+                }
+                // Characteristics is read only
+                case BLE_GATT_ACCESS_OP_WRITE_CHR:
+                    return BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+                default:
+                    return BLE_ATT_ERR_UNLIKELY;
+                }
+                return BLE_ATT_ERR_UNLIKELY;
+            },
+            .arg = nullptr,
+            .descriptors = nullptr,
+            .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+            .val_handle = &connection_context.runtime_high_chr_handle
+        },
+        {
+            .uuid = &ENERGY_IN_CHAR_UUID.u,
+            .access_cb = [](uint16_t conn_handle, uint16_t attr_handle, ble_gatt_access_ctxt_t* ctxt, void* arg) {
+                switch (ctxt->op) {
+                case BLE_GATT_ACCESS_OP_READ_CHR: {
+                    uint32_t energy_in_wh = static_cast<uint32_t>(get_energy_in());
+                    return os_mbuf_append(ctxt->om, &energy_in_wh, sizeof(energy_in_wh));
+                }
+                // Characteristics is read only
+                case BLE_GATT_ACCESS_OP_WRITE_CHR:
+                    return BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+                default:
+                    return BLE_ATT_ERR_UNLIKELY;
+                }
+                return BLE_ATT_ERR_UNLIKELY;
+            },
+            .arg = nullptr,
+            .descriptors = nullptr,
+            .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+            .val_handle = &connection_context.energy_in_chr_handle
+        },
+        {
+            .uuid = &ENERGY_OUT_CHAR_UUID.u,
+            .access_cb = [](uint16_t conn_handle, uint16_t attr_handle, ble_gatt_access_ctxt_t* ctxt, void* arg) {
+                switch (ctxt->op) {
+                case BLE_GATT_ACCESS_OP_READ_CHR: {
+                    uint32_t energy_out_wh = static_cast<uint32_t>(get_energy_out());
+                    return os_mbuf_append(ctxt->om, &energy_out_wh, sizeof(energy_out_wh));
+                }
+                // Characteristics is read only
+                case BLE_GATT_ACCESS_OP_WRITE_CHR:
+                    return BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+                default:
+                    return BLE_ATT_ERR_UNLIKELY;
+                }
+                return BLE_ATT_ERR_UNLIKELY;
+            },
+            .arg = nullptr,
+            .descriptors = nullptr,
+            .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+            .val_handle = &connection_context.energy_out_chr_handle
+        },
         // Battery characteristics array termination
         {}
     };
@@ -385,7 +528,7 @@ namespace ble {
 
 
     // Public APIs
-    esp_err_t init(const QueueHandle_t& ble_data_queue) {
+    esp_err_t init(const sys::data_bus_t& data_bus) {
 
         esp_err_t ret = ESP_OK;
 
@@ -409,7 +552,7 @@ namespace ble {
             return ret;
         }
 
-        ble_data_init(ble_data_queue);
+        ble_data_init(data_bus);
 
         // BLE Host settings
         // @brief This is called when the the host and controller get synced
@@ -581,54 +724,88 @@ namespace ble {
 
         esp_err_t ret = ESP_ERR_INVALID_STATE;
 
-        if (chr_notify.get_chr_notify_state(chr_notify_t::chr_t::TEMPERATURE)) {
+        // Only fresh readings are notified, so a client never takes a held value for a new one
+        if (data.is_fresh(sys::field_t::TEMPERATURE) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::TEMPERATURE)) {
             ret = chr_notify.send_notification(data.inv_temp, connection_context.temp_chr_handle, "Temperature");
             if (ret != ESP_OK) {
                 BLE_LOGE("Failed to send temperature notification");
             }
         }
 
-        if (chr_notify.get_chr_notify_state(chr_notify_t::chr_t::HUMIDITY)) {
+        if (data.is_fresh(sys::field_t::HUMIDITY) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::HUMIDITY)) {
             ret = chr_notify.send_notification(data.inv_hmdt, connection_context.hmdt_chr_handle, "Humidity");
             if (ret != ESP_OK) {
                 BLE_LOGE("Failed to send humidity notification");
             }
         }
 
-        if (chr_notify.get_chr_notify_state(chr_notify_t::chr_t::VOLTAGE)) {
+        if (data.is_fresh(sys::field_t::VOLTAGE) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::VOLTAGE)) {
             ret = chr_notify.send_notification(data.battery_voltage, connection_context.voltage_chr_handle, "Voltage");
             if (ret != ESP_OK) {
                 BLE_LOGE("Failed to send voltage notification");
             }
         }
 
-        if (chr_notify.get_chr_notify_state(chr_notify_t::chr_t::CURRENT)) {
+        if (data.is_fresh(sys::field_t::CURRENT) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::CURRENT)) {
             ret = chr_notify.send_notification(data.load_current_drawn, connection_context.current_chr_handle, "Current");
             if (ret != ESP_OK) {
                 BLE_LOGE("Failed to send current notification");
             }
         }
 
-        if (chr_notify.get_chr_notify_state(chr_notify_t::chr_t::POWER)) {
+        if (data.is_fresh(sys::field_t::POWER) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::POWER)) {
             ret = chr_notify.send_notification(data.power_drawn, connection_context.power_chr_handle, "Power");
             if (ret != ESP_OK) {
                 BLE_LOGE("Failed to send power notification");
             }
         }
 
-        if (chr_notify.get_chr_notify_state(chr_notify_t::chr_t::BATT_SoC)) {
+        if (data.is_fresh(sys::field_t::BATTERY) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::BATT_SoC)) {
             ret = chr_notify.send_notification(data.battery_percent, connection_context.battery_soc_chr_handle, "Battery SoC");
             if (ret != ESP_OK) {
                 BLE_LOGE("Failed to send battery soc notification");
             }
         }
 
-        if (chr_notify.get_chr_notify_state(chr_notify_t::chr_t::RUNTIME_S)) {
-            ret = chr_notify.send_notification(data.runtime_left_s, connection_context.runtime_chr_handle, "Runtime");
+        if (data.is_fresh(sys::field_t::RUNTIME) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::RUNTIME_S)) {
+            const uint32_t runtime_left_s = to_seconds_u32(data.runtime_left_s);
+            ret = chr_notify.send_raw_notification(&runtime_left_s, sizeof(runtime_left_s), connection_context.runtime_chr_handle, "Runtime");
             if (ret != ESP_OK) {
                 BLE_LOGE("Failed to send runtime notification");
             }
         }
+
+        if (data.is_fresh(sys::field_t::RUNTIME) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::RUNTIME_LOW_S)) {
+            const uint32_t runtime_low_s = to_seconds_u32(data.runtime_low_s);
+            ret = chr_notify.send_raw_notification(&runtime_low_s, sizeof(runtime_low_s), connection_context.runtime_low_chr_handle, "Runtime low");
+            if (ret != ESP_OK) {
+                BLE_LOGE("Failed to send runtime low notification");
+            }
+        }
+
+        if (data.is_fresh(sys::field_t::RUNTIME) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::RUNTIME_HIGH_S)) {
+            const uint32_t runtime_high_s = to_seconds_u32(data.runtime_high_s);
+            ret = chr_notify.send_raw_notification(&runtime_high_s, sizeof(runtime_high_s), connection_context.runtime_high_chr_handle, "Runtime high");
+            if (ret != ESP_OK) {
+                BLE_LOGE("Failed to send runtime high notification");
+            }
+        }
+
+        if (data.is_fresh(sys::field_t::BATTERY) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::ENERGY_IN_WH)) {
+            const uint32_t energy_in_wh = static_cast<uint32_t>(data.energy_in_wh);
+            ret = chr_notify.send_raw_notification(&energy_in_wh, sizeof(energy_in_wh), connection_context.energy_in_chr_handle, "Energy in");
+            if (ret != ESP_OK) {
+                BLE_LOGE("Failed to send energy in notification");
+            }
+        }
+
+        if (data.is_fresh(sys::field_t::BATTERY) && chr_notify.get_chr_notify_state(chr_notify_t::chr_t::ENERGY_OUT_WH)) {
+            const uint32_t energy_out_wh = static_cast<uint32_t>(data.energy_out_wh);
+            ret = chr_notify.send_raw_notification(&energy_out_wh, sizeof(energy_out_wh), connection_context.energy_out_chr_handle, "Energy out");
+            if (ret != ESP_OK) {
+                BLE_LOGE("Failed to send energy out notification");
+            }
+        }
         
         return ret;
     }
@@ -785,6 +962,18 @@ namespace ble {
             } else if (event->subscribe.attr_handle == connection_context.runtime_chr_handle) {
                 chr_notify.set_chr_notify_state(chr_notify_t::chr_t::RUNTIME_S);
                 BLE_LOGI("Client subscribed to runtime characteristic");
+            } else if (event->subscribe.attr_handle == connection_context.runtime_low_chr_handle) {
+                chr_notify.set_chr_notify_state(chr_notify_t::chr_t::RUNTIME_LOW_S);
+                BLE_LOGI("Client subscribed to runtime low characteristic");
+            } else if (event->subscribe.attr_handle == connection_context.runtime_high_chr_handle) {
+                chr_notify.set_chr_notify_state(chr_notify_t::chr_t::RUNTIME_HIGH_S);
+                BLE_LOGI("Client subscribed to runtime high characteristic");
+            } else if (event->subscribe.attr_handle == connection_context.energy_in_chr_handle) {
+                chr_notify.set_chr_notify_state(chr_notify_t::chr_t::ENERGY_IN_WH);
+                BLE_LOGI("Client subscribed to energy in characteristic");
+            } else if (event->subscribe.attr_handle == connection_context.energy_out_chr_handle) {
+                chr_notify.set_chr_notify_state(chr_notify_t::chr_t::ENERGY_OUT_WH);
+                BLE_LOGI("Client subscribed to energy out characteristic");
             } else {
                 BLE_LOGW("Client subsribed to unknown characteristic");
             }
@@ -11,13 +11,13 @@ namespace ble {
     /**
      * @brief Initializes the ble interface
      * 
-     * @param[in] ble_data_queue Queue to which data is passed to for notifications 
+     * @param[in] data_bus Bus the characteristics are read from
      * 
      * @return ESP_OK on success, error code otherwise
      * 
      * @note This also initializes nvs flash by default
      */
-    esp_err_t init(const QueueHandle_t& ble_data_queue);
+    esp_err_t init(const sys::data_bus_t& data_bus);
     
     /**
      * @brief Deinitializes the ble interface
@@ -1,6 +1,3 @@
-#include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
-
 #include "ble_data.hpp"
 #include "system.hpp"
 
@@ -9,49 +6,73 @@
 
 namespace ble {
     
-    static QueueHandle_t data_queue = nullptr;
+    static const sys::data_bus_t* bus = nullptr;
     static sys::data_t data{};
 
-    void ble_data_init(const QueueHandle_t& ble_data_queue) {
-        data_queue = ble_data_queue;
-        ASSERT(data_queue, "data_queue cannot be null");
+    void ble_data_init(const sys::data_bus_t& data_bus) {
+        bus = &data_bus;
     }
 
-    // We don't have to check the return value of `xQueuePeek`
+    // We don't have to check the return value of `peek()`
     // because we return the last cached data stored in data 
     float get_temperature() {
-        xQueuePeek(data_queue, &data, 0);
+        bus->peek(data);
         return data.inv_temp;
     }
 
     float get_humidity() {
-        xQueuePeek(data_queue, &data, 0);
+        bus->peek(data);
         return data.inv_hmdt;
     }
 
     float get_voltage() {
-        xQueuePeek(data_queue, &data, 0);
+        bus->peek(data);
         return data.battery_voltage;
     }
 
     float get_current() {
-        xQueuePeek(data_queue, &data, 0);
+        bus->peek(data);
         return data.load_current_drawn;
     }
 
     float get_power() {
-        xQueuePeek(data_queue, &data, 0);
+        bus->peek(data);
         return data.power_drawn;
     }
 
     float get_battery_soc() {
-        xQueuePeek(data_queue, &data, 0);
+        bus->peek(data);
         return data.battery_percent;
     }
 
     uint64_t get_runtime() {
-        xQueuePeek(data_queue, &data, 0);
+        bus->peek(data);
         return data.runtime_left_s;
     }
 
+    uint64_t get_runtime_low() {
+        bus->peek(data);
+        return data.runtime_low_s;
+    }
+
+    uint64_t get_runtime_high() {
+        bus->peek(data);
+        return data.runtime_high_s;
+    }
+
+    float get_energy_in() {
+        bus->peek(data);
+        return data.energy_in_wh;
+    }
+
+    float get_energy_out() {
+        bus->peek(data);
+        return data.energy_out_wh;
+    }
+
+    // Straight from the histograms, they aren't part of the bus data
+    sys::latency_histogram_t::snapshot_t get_latency(sys::stage_t stage) {
+        return sys::get_latency(stage);
+    }
+
 } // namespace ble
@@ -2,11 +2,13 @@
 #define _BLE_DATA_HPP_
 
 
+#include "system.hpp"
+
 #include <cstdint>
 
 namespace ble {
 
-    void ble_data_init(const QueueHandle_t& ble_data_queue);
+    void ble_data_init(const sys::data_bus_t& data_bus);
 
     float get_temperature();
 
@@ -22,6 +24,16 @@ namespace ble {
 
     uint64_t get_runtime();
 
+    uint64_t get_runtime_low();
+
+    uint64_t get_runtime_high();
+
+    float get_energy_in();
+
+    float get_energy_out();
+
+    sys::latency_histogram_t::snapshot_t get_latency(sys::stage_t stage);
+
 } // namespace ble
 
 
@@ -0,0 +1,154 @@
+#ifndef _BATTERY_PROFILE_HPP_
+#define _BATTERY_PROFILE_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <algorithm>
+
+
+namespace config {
+
+    /**
+    * @brief Point of an open circuit voltage table
+    */
+    struct ocv_point_t {
+        float soc;          // 0 - 1
+        float voltage;      // Open circuit voltage of the bank at 25°C, after a few hours of rest
+    };
+
+    /**
+    * @brief Battery chemistry profiles. Each is a type holding constexpr data for the whole bank, so it can be passed
+    * as a template parameter and everything derived from it, like `ocv_curve_t`, is worked out by the compiler
+    */
+    namespace battery {
+
+        // 12V AGM lead acid bank, 40Ah at C20
+        struct agm_12v_40ah_t {
+            static constexpr const char NAME[] = "AGM 12V 40Ah";
+            static constexpr std::array<ocv_point_t, 11> OCV_TABLE = {{
+                { 0.0f, 11.80f }, { 0.1f, 11.95f }, { 0.2f, 12.05f }, { 0.3f, 12.15f }, { 0.4f, 12.20f }, { 0.5f, 12.25f },
+                { 0.6f, 12.30f }, { 0.7f, 12.40f }, { 0.8f, 12.45f }, { 0.9f, 12.50f }, { 1.0f, 12.60f }
+            }};
+            static constexpr float OCV_TEMP_COEFF_V_PER_C       = 0.0012f;  // 0.2mV/°C per cell
+            static constexpr float CAPACITY_AH                  = 35;       // It's 40Ah, but this is to take losses into account
+            static constexpr float RATED_HOURS                  = 20;       // Discharge time the capacity is rated at
+            static constexpr float PEUKERT_EXPONENT             = 1.12f;
+            static constexpr float CAPACITY_TEMP_COEFF_PER_C    = 0.006f;   // Capacity lost per °C below 25°C
+            static constexpr float CHARGE_EFFICIENCY            = 0.95f;
+            static constexpr float INTERNAL_RESISTANCE          = 0.02f;    // Starting point in Ohms, then measured from current steps
+            static constexpr float CYCLE_LIFE                   = 300;      // Cycles to 80% capacity at 100% depth of discharge
+            static constexpr float CYCLE_LIFE_EXPONENT          = 1.3f;     // Cycle life grows as depth^-k for shallower cycles
+        };
+
+        // 12.8V (4S) LiFePO4 bank, 100Ah at 0.2C. The curve is flat in the middle, so the voltage says little there
+        struct lifepo4_12v_100ah_t {
+            static constexpr const char NAME[] = "LiFePO4 12.8V 100Ah";
+            static constexpr std::array<ocv_point_t, 13> OCV_TABLE = {{
+                { 0.00f, 10.00f }, { 0.05f, 12.00f }, { 0.10f, 12.80f }, { 0.20f, 12.90f }, { 0.30f, 13.00f },
+                { 0.40f, 13.05f }, { 0.50f, 13.10f }, { 0.60f, 13.15f }, { 0.70f, 13.20f }, { 0.80f, 13.25f },
+                { 0.90f, 13.30f }, { 0.95f, 13.40f }, { 1.00f, 13.60f }
+            }};
+            static constexpr float OCV_TEMP_COEFF_V_PER_C       = -0.0004f; // -0.1mV/°C per cell
+            static constexpr float CAPACITY_AH                  = 95;
+            static constexpr float RATED_HOURS                  = 5;
+            static constexpr float PEUKERT_EXPONENT             = 1.03f;
+            static constexpr float CAPACITY_TEMP_COEFF_PER_C    = 0.003f;
+            static constexpr float CHARGE_EFFICIENCY            = 0.99f;
+            static constexpr float INTERNAL_RESISTANCE          = 0.01f;
+            static constexpr float CYCLE_LIFE                   = 3000;
+            static constexpr float CYCLE_LIFE_EXPONENT          = 1.1f;
+        };
+
+    } // namespace battery
+
+    /**
+    * @brief Open circuit voltage curve resampled onto even grids at compile time, so looking up either direction is
+    * an index and a linear interpolation, without searching the table
+    * @tparam SOC_STEPS Intervals of the state of charge grid. 100 keeps every table point at a whole percent exact
+    * @tparam VOLTAGE_STEPS Intervals of the voltage grid of the inverse
+    */
+    template <size_t SOC_STEPS = 100, size_t VOLTAGE_STEPS = 255>
+    struct ocv_curve_t {
+        std::array<float, SOC_STEPS + 1> ocv;       // Open circuit voltage at soc = i / SOC_STEPS
+        std::array<float, VOLTAGE_STEPS + 1> soc;   // State of charge at voltage = min_voltage + i * voltage_step
+        float min_voltage;
+        float voltage_step;
+        float temp_coeff_v_per_c;                   // Shift of the whole curve per °C away from 25°C
+
+        /**
+        * @brief Open circuit voltage at 25°C
+        * @param[out] slope Change in voltage per unit of state of charge there
+        */
+        constexpr float ocv_at(float state, float& slope) const {
+            const float position = std::clamp(state, 0.0f, 1.0f) * SOC_STEPS;
+            const size_t index = std::min(static_cast<size_t>(position), SOC_STEPS - 1);
+            slope = (ocv[index + 1] - ocv[index]) * SOC_STEPS;
+            return ocv[index] + (ocv[index + 1] - ocv[index]) * (position - static_cast<float>(index));
+        }
+
+        /**
+        * @brief State of charge of an open circuit voltage at 25°C, clamped to the curve
+        */
+        constexpr float soc_at(float voltage) const {
+            if (!(voltage > min_voltage)) return 0.0f;
+            const float position = (voltage - min_voltage) / voltage_step;
+            if (position >= VOLTAGE_STEPS) return 1.0f;
+            const size_t index = static_cast<size_t>(position);
+            return soc[index] + (soc[index + 1] - soc[index]) * (position - static_cast<float>(index));
+        }
+    };
+
+    /**
+    * @brief Check a table runs from 0% to 100% with both columns strictly rising, which the inverse needs
+    */
+    template <size_t N>
+    consteval bool is_valid_ocv_table(const std::array<ocv_point_t, N>& table) {
+        if (N < 2 || table[0].soc != 0.0f || table[N - 1].soc != 1.0f) return false;
+        for (size_t i = 1; i < N; i++) {
+            if (table[i].soc <= table[i - 1].soc || table[i].voltage <= table[i - 1].voltage) return false;
+        }
+        return true;
+    }
+
+    /**
+    * @brief Resample a profile's table onto the grids of `ocv_curve_t`. Only ever evaluated by the compiler
+    */
+    template <typename PROFILE, size_t SOC_STEPS = 100, size_t VOLTAGE_STEPS = 255>
+    consteval ocv_curve_t<SOC_STEPS, VOLTAGE_STEPS> make_ocv_curve() {
+
+        constexpr auto& table = PROFILE::OCV_TABLE;
+        static_assert(is_valid_ocv_table(table), "OCV_TABLE must run from soc 0 to 1 with both columns strictly rising");
+
+        ocv_curve_t<SOC_STEPS, VOLTAGE_STEPS> curve{};
+        curve.min_voltage = table.front().voltage;
+        curve.voltage_step = (table.back().voltage - table.front().voltage) / VOLTAGE_STEPS;
+        curve.temp_coeff_v_per_c = PROFILE::OCV_TEMP_COEFF_V_PER_C;
+
+        // Piecewise linear through the table in both directions
+        size_t segment = 0;
+        for (size_t i = 0; i <= SOC_STEPS; i++) {
+            const float state = static_cast<float>(i) / SOC_STEPS;
+            while ((segment + 2 < table.size()) && (state > table[segment + 1].soc)) segment++;
+            const ocv_point_t& low = table[segment];
+            const ocv_point_t& high = table[segment + 1];
+            curve.ocv[i] = low.voltage + (high.voltage - low.voltage) * (state - low.soc) / (high.soc - low.soc);
+        }
+
+        segment = 0;
+        for (size_t i = 0; i <= VOLTAGE_STEPS; i++) {
+            const float voltage = curve.min_voltage + curve.voltage_step * i;
+            while ((segment + 2 < table.size()) && (voltage > table[segment + 1].voltage)) segment++;
+            const ocv_point_t& low = table[segment];
+            const ocv_point_t& high = table[segment + 1];
+            curve.soc[i] = std::clamp(low.soc + (high.soc - low.soc) * (voltage - low.voltage) / (high.voltage - low.voltage), 0.0f, 1.0f);
+        }
+
+        return curve;
+    }
+
+} // namespace config
+
+
+#endif // _BATTERY_PROFILE_HPP_
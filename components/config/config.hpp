@@ -5,7 +5,10 @@
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
 
+#include "battery_profile.hpp"
+
 #include <cstdint>
+#include <array>
 
 
 namespace config {
@@ -13,18 +16,19 @@ namespace config {
     // Tasks specifications
     constexpr inline uint16_t CALC_TASK_STACK_SIZE                   = 4 * 1024;
     constexpr inline uint16_t CALC_TASK_PRIORITY                     = 5;
-    constexpr inline uint16_t CALC_TASK_PERIOD_MS                    = 20;
+    constexpr inline uint16_t CALC_TASK_PERIOD_MS                    = 20;          // Least time between two runs. Woken by the ADC driver
+    constexpr inline uint16_t ADC_DATA_TIMEOUT_MS                    = 500;         // Longest wait for a new ADC measurement before warning
     
     constexpr inline uint16_t DISPLAY_TASK_STACK_SIZE                = 8 * 1024;
     constexpr inline uint16_t DISPLAY_TASK_PRIORITY                  = 4;
+    constexpr inline uint32_t DISPLAY_MISS_REPORT_PERIOD_US          = 1'000'000;   // Missed display updates are summed up once a second
     
     constexpr inline uint16_t AHT_TASK_STACK_SIZE                    = 3 * 1024;
     constexpr inline uint16_t AHT_TASK_PRIORITY                      = 6;
     constexpr inline uint16_t AHT_READ_PERIOD_MS                     = 2100;
+    constexpr inline int64_t AHT_DATA_TIMEOUT_US                     = 3 * AHT_READ_PERIOD_MS * 1'000LL; // Older readings are marked stale
     
-    constexpr inline uint16_t ADC_TASK_STACK_SIZE                    = 3 * 1024;
-    constexpr inline uint16_t ADC_TASK_PRIORITY                      = 7;
-    constexpr inline uint16_t ADC_READ_PERIOD_MS                     = 15;
+    constexpr inline uint32_t ADC_LOW_POWER_IDLE_TIME_US             = 60'000'000;  // 60s of inverter idle time before sampling slows down
     
     constexpr inline uint16_t LVGL_TASK_STACK_SIZE                   = 8 * 1024;
     constexpr inline uint16_t LVGL_TASK_PRIORITY                     = 4;
@@ -33,6 +37,8 @@ namespace config {
     constexpr inline uint16_t LOG_TASK_STACK_SIZE                    = 4 * 1024;
     constexpr inline uint16_t LOG_TASK_PRIORITY                      = 2;
     constexpr inline uint16_t LOG_TASK_PERIOD_MS                     = 5'000; // 5s
+    constexpr inline uint32_t LATENCY_REPORT_PERIOD_US               = 60'000'000;  // Pipeline latency summary every minute
+    constexpr inline int64_t ENERGY_REPORT_PERIOD_US                 = 3'600'000'000LL; // Energy totals every hour
 
     constexpr inline uint16_t BLE_TASK_STACK_SIZE                    = 4 * 1024;
     constexpr inline uint16_t BLE_TASK_PRIORITY                      = 2;
@@ -62,12 +68,16 @@ namespace config {
     constexpr inline uint32_t BUTTON_EXTRA_LONG_PRESS_US             = 10'000'000;  // 10s
 
     // File data
-    constexpr inline uint8_t NUM_OF_ITEMS_TO_STORE_TEMP              = 50;
+    constexpr inline uint8_t NUM_OF_ITEMS_TO_STORE_TEMP              = 50;   // Samples between two writes of the open log block
     constexpr inline uint8_t MAX_FILE_IO_ERRORS                      = 20;
     constexpr inline uint8_t GRAPH_SAMPLES                           = 100;
-    constexpr inline uint16_t MAX_SAMPLES_TO_LOG                     = 50'000;
     constexpr inline const char DATA_FILE_NAME[]                     = "/storage/file_data.log";
-    constexpr inline const char META_DATA_FILE_NAME[]                = "/storage/file_meta_data.log";
+    constexpr inline const char META_DATA_FILE_NAME[]                = "/storage/file_meta_data.log"; // Index of the old raw log, removed at boot
+    // Compressed log: the 800KB the raw log took hold about 15 days at LOG_TASK_PERIOD_MS instead of 69 hours
+    constexpr inline size_t LOG_BLOCK_SIZE                           = 2048;
+    constexpr inline size_t LOG_BLOCK_COUNT                          = 400;
+    // Logged voltage (V), current (A), temperature (°C) and humidity (%RH) are rounded to these steps
+    constexpr inline std::array<float, 4> LOG_STEPS                  = { 0.001, 0.01, 0.01, 0.1 };
 
     // LED brightness control
     constexpr inline uint32_t TIME_TO_LED_50_PERCENT_BRIGHTNESS_US   = 30'000'000;   // 30s
@@ -87,15 +97,46 @@ namespace config {
     constexpr inline uint8_t TIMEOUT_MS                              = 100;
     
     // Inverter and battery specifications
-    constexpr inline float BATT_ZERO_PERCENT_VOLTAGE                 = 6;
-    constexpr inline float BATT_MAX_PERCENT_VOLTAGE                  = 12.6;
+    // Chemistry of the monitored bank, one of `config::battery`. Everything derived from it is worked out at compile time
+    using battery_profile_t                                          = battery::agm_12v_40ah_t;
+    constexpr inline auto BATTERY_OCV_CURVE                          = make_ocv_curve<battery_profile_t>();
     constexpr inline float INVERTER_ACTIVE_THRESHOLD                 = 2;
     constexpr inline float BATTERY_RECHARGING_THRESHOLD              = -1.5;
     constexpr inline float BATTERY_DISCHARGING_THRESHOLD             = INVERTER_ACTIVE_THRESHOLD;
-    constexpr inline float BATTERY_CAPACITY_AH                       = 35;   // It's 40Ah, but this is to take losses into account
-
-
-    static_assert((MAX_SAMPLES_TO_LOG % NUM_OF_ITEMS_TO_STORE_TEMP) == 0, "MAX_SAMPLES_TO_LOG must be evenly divisible by NUM_OF_ITEMS_TO_STORE_TEMP");
+    constexpr inline float BATTERY_CAPACITY_AH                       = battery_profile_t::CAPACITY_AH;
+    constexpr inline float BATTERY_RATED_CURRENT                     = battery_profile_t::CAPACITY_AH / battery_profile_t::RATED_HOURS;
+    constexpr inline float BATTERY_CHARGE_EFFICIENCY                 = battery_profile_t::CHARGE_EFFICIENCY;
+    constexpr inline float BATTERY_INTERNAL_RESISTANCE               = battery_profile_t::INTERNAL_RESISTANCE;
+    constexpr inline float BATTERY_MIN_RESISTANCE                    = 0.002;
+    constexpr inline float BATTERY_MAX_RESISTANCE                    = 0.5;
+    constexpr inline float BATTERY_RESISTANCE_STEP_CURRENT           = 2;    // Least current step the internal resistance is measured from
+    constexpr inline int64_t BATTERY_SETTLE_TIME_US                  = 60 * 1'000'000LL; // No voltage corrections for 60s after a current step
+    constexpr inline int64_t BATTERY_POLARISATION_TIME_US            = 150 * 1'000'000LL; // Voltage error left by a load fades over about 2.5 minutes
+    constexpr inline int64_t SOC_CHECKPOINT_INTERVAL_US              = 5 * 60 * 1'000'000LL;  // At most one NVS write every 5 minutes
+    constexpr inline float SOC_CHECKPOINT_MIN_CHANGE_AH              = 0.1;
+    // Energy ledger: 2 days of hourly and a month of daily buckets, saved every 15 minutes and whenever an hour closes
+    constexpr inline size_t ENERGY_LEDGER_HOURS                      = 48;
+    constexpr inline size_t ENERGY_LEDGER_DAYS                       = 31;
+    constexpr inline int64_t ENERGY_CHECKPOINT_INTERVAL_US           = 15 * 60 * 1'000'000LL;
+    constexpr inline float ENERGY_CHECKPOINT_MIN_CHANGE_WH           = 5;
+    // Battery health history, kept on the storage partition and saved every hour
+    constexpr inline const char HEALTH_FILE_NAME[]                   = "/storage/battery_health.bin";
+    constexpr inline const char HEALTH_TEMP_FILE_NAME[]              = "/storage/battery_health.tmp"; // Written first, then renamed over it
+    constexpr inline int64_t HEALTH_CHECKPOINT_INTERVAL_US           = 3'600'000'000LL;
+    constexpr inline float HEALTH_REST_CURRENT                       = 0.3;  // Below this the battery counts as resting
+    constexpr inline int64_t HEALTH_REST_TIME_US                     = 30 * 60 * 1'000'000LL; // Rest before the voltage is taken as the OCV
+    // Rollups: a day of minutes, a month of hours and a year of days (about 270KB on the storage partition)
+    constexpr inline const char ROLLUP_MINUTE_FILE_NAME[]            = "/storage/rollup_minute.bin";
+    constexpr inline const char ROLLUP_HOUR_FILE_NAME[]              = "/storage/rollup_hour.bin";
+    constexpr inline const char ROLLUP_DAY_FILE_NAME[]               = "/storage/rollup_day.bin";
+    constexpr inline size_t ROLLUP_MINUTES                           = 1440;
+    constexpr inline size_t ROLLUP_HOURS                             = 720;
+    constexpr inline size_t ROLLUP_DAYS                              = 366;
+    constexpr inline uint8_t ROLLUP_FLUSH_MINUTES                    = 10;   // Closed minutes written at once, and lost at most on a reset
+    // Load averaging horizons of the runtime prediction, 1 minute, 15 minutes and 1 hour, and their share of the blend
+    constexpr inline std::array<float, 3> RUNTIME_HORIZONS_S         = { 60, 900, 3600 };
+    constexpr inline std::array<float, 3> RUNTIME_HORIZON_WEIGHTS    = { 0.2, 0.3, 0.5 };
+    constexpr inline uint64_t RUNTIME_MAX_S                          = 7 * 86'400; // Cap on the predicted runtime: 7 days
 
 }
 
@@ -0,0 +1,48 @@
+#ifndef _ADC_HAL_HPP_
+#define _ADC_HAL_HPP_
+
+
+/**
+* Thin shim over the ESP-IDF ADC types used by the processing code, so `frame_processor.cpp` also builds off-target.
+* On the ESP32 it's just the IDF headers. Anywhere else it declares the same types with the ESP32's layout
+*/
+
+#ifdef ESP_PLATFORM
+
+#include "esp_adc/adc_continuous.h"
+#include "esp_attr.h"
+
+#else
+
+#include <cstdint>
+
+typedef enum {
+    ADC_CHANNEL_0,
+    ADC_CHANNEL_1,
+    ADC_CHANNEL_2,
+    ADC_CHANNEL_3,
+    ADC_CHANNEL_4,
+    ADC_CHANNEL_5,
+    ADC_CHANNEL_6,
+    ADC_CHANNEL_7,
+    ADC_CHANNEL_8,
+    ADC_CHANNEL_9,
+} adc_channel_t;
+
+// ADC_DIGI_OUTPUT_FORMAT_TYPE1, as produced by the ESP32's DMA
+typedef struct {
+    union {
+        struct {
+            uint16_t data: 12;
+            uint16_t channel: 4;
+        } type1;
+        uint16_t val;
+    };
+} adc_digi_output_data_t;
+
+#define IRAM_BSS_ATTR
+
+#endif // ESP_PLATFORM
+
+
+#endif // _ADC_HAL_HPP_
@@ -0,0 +1,181 @@
+#ifndef _CAPTURE_HPP_
+#define _CAPTURE_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+
+
+namespace adc {
+
+    /**
+    * @brief What made a capture trigger
+    */
+    enum class capture_reason_t : uint8_t {
+        THRESHOLD = 0,  // Current magnitude crossed the threshold
+        SLOPE = 1       // Current changed faster than the slope limit
+    };
+
+    /**
+    * @brief Header written in front of the samples of every persisted capture
+    */
+    struct capture_header_t {
+        uint32_t magic;                     // `CAPTURE_MAGIC`
+        uint32_t sequence;                  // Capture number since the first capture ever stored
+        int64_t timestamp_us;               // esp_timer time of the trigger
+        uint32_t sample_rate_hz;            // Rate of the interleaved samples (both channels)
+        uint32_t sample_count;              // Raw samples following the header
+        uint32_t trigger_index;             // Index of the trigger sample in the capture
+        float trigger_current;              // Current that fired the trigger, in Amperes
+        float zero_current_offset_voltage;  // Offset in use when the capture was taken, in Volts
+        uint8_t current_channel;            // Channel field of the primary current sensor's samples
+        uint8_t voltage_channel;            // Channel field of the primary voltage sensor's samples
+        capture_reason_t reason;
+        uint8_t channel_count;              // Channels interleaved in the samples. 0 in older captures, which always had 2
+    };
+
+    static constexpr uint32_t CAPTURE_MAGIC = 0x50414343; // "CCAP"
+
+    /**
+    * @brief Pre/post trigger ring of raw interleaved ADC words, like an oscilloscope's single shot mode.
+    * While armed it keeps the last N words. A trigger lets `N - PRE` more words in and then freezes the ring
+    * until `rearm()`, so a capture holds `PRE` words from before the event and the rest from after it.
+    * Storage is fixed, so nothing is allocated while sampling
+    *
+    * @note `push()` and `trigger()` must be called from a single task. Once `is_frozen()` returns true
+    * another task may read the capture until it calls `rearm()`
+    * @tparam N Capture length in words. Must be a power of 2
+    * @tparam PRE Words kept from before the trigger
+    */
+    template <size_t N, size_t PRE>
+    class capture_ring_t {
+        static_assert((N > 0) && ((N & (N - 1)) == 0), "capture_ring_t length must be a power of 2");
+        static_assert(PRE < N, "capture_ring_t needs room for post trigger samples");
+
+    private:
+        enum class state_t : uint8_t { ARMED, TRIGGERED, FROZEN };
+
+        std::array<uint16_t, N> ring{};
+        std::atomic<state_t> state{state_t::ARMED};
+        size_t head{};          // Next slot to write
+        size_t filled{};        // Valid words, up to N
+        size_t post_remaining{};
+        size_t trigger_pos{};   // Ring slot of the trigger word
+        size_t start_pos{};     // Ring slot of the oldest word of a frozen capture
+        bool restart{};         // Set while frozen: the words before the freeze don't connect with the next ones
+
+        void freeze() {
+            post_remaining = 0;
+            start_pos = (filled < N) ? 0 : head;
+            state.store(state_t::FROZEN, std::memory_order_release);
+        }
+
+    public:
+        static constexpr size_t LENGTH = N;
+        static constexpr size_t PRE_TRIGGER = PRE;
+
+        /**
+        * @brief Append raw words. Ignored while frozen
+        */
+        void push(const uint16_t* words, size_t count) {
+
+            const state_t current = state.load(std::memory_order_relaxed);
+            if (current == state_t::FROZEN) {
+                restart = true;
+                return;
+            }
+            if (restart) {
+                filled = 0;
+                restart = false;
+            }
+
+            for (size_t n = 0; n < count; n++) {
+                ring[head] = words[n];
+                head = (head + 1) & (N - 1);
+            }
+            filled = (filled + count < N) ? (filled + count) : N;
+
+            if (current != state_t::TRIGGERED) return;
+
+            if (count >= post_remaining) {
+                // Words past the end of the window overwrote the oldest pre trigger words, so the capture
+                // keeps a few more post trigger words than planned instead
+                freeze();
+            } else {
+                post_remaining -= count;
+            }
+        }
+
+        /**
+        * @brief Mark a word already pushed as the trigger point. Ignored unless armed
+        * @param words_ago How many words before the last pushed one the event happened
+        * @return true if the capture was triggered
+        */
+        bool trigger(size_t words_ago) {
+
+            if (state.load(std::memory_order_relaxed) != state_t::ARMED) return false;
+            if (words_ago >= filled) words_ago = filled ? (filled - 1) : 0;
+
+            trigger_pos = (head - 1 - words_ago) & (N - 1);
+
+            // Words after the trigger already in the ring count towards the post trigger part
+            const size_t post = N - PRE;
+            if (words_ago + 1 >= post) {
+                freeze();
+            } else {
+                post_remaining = post - (words_ago + 1);
+                state.store(state_t::TRIGGERED, std::memory_order_relaxed);
+            }
+            return true;
+        }
+
+        [[nodiscard]] bool is_armed() const {
+            return state.load(std::memory_order_relaxed) == state_t::ARMED;
+        }
+
+        [[nodiscard]] bool is_frozen() const {
+            return state.load(std::memory_order_acquire) == state_t::FROZEN;
+        }
+
+        /**
+        * @brief Ring slot of the oldest word of the frozen capture
+        */
+        [[nodiscard]] size_t first_slot() const {
+            return start_pos;
+        }
+
+        /**
+        * @brief Words in the frozen capture. Captures taken before the ring filled up once are shorter than N
+        */
+        [[nodiscard]] size_t size() const {
+            return filled;
+        }
+
+        /**
+        * @brief Index of the trigger word counted from `first_slot()`
+        */
+        [[nodiscard]] size_t trigger_index() const {
+            return (trigger_pos - first_slot()) & (N - 1);
+        }
+
+        /**
+        * @brief Raw ring storage, for copying out a frozen capture without an intermediate buffer
+        */
+        [[nodiscard]] const std::array<uint16_t, N>& data() const {
+            return ring;
+        }
+
+        /**
+        * @brief Release a frozen capture and start recording again. Called by the reader when done
+        */
+        void rearm() {
+            state.store(state_t::ARMED, std::memory_order_release);
+        }
+    };
+
+} // namespace adc
+
+
+#endif // _CAPTURE_HPP_
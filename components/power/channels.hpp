@@ -0,0 +1,81 @@
+#ifndef _CHANNELS_HPP_
+#define _CHANNELS_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <tuple>
+
+
+namespace adc {
+
+    // The ESP32's ADC1 has 8 channels, and only ADC1 can be used in continuous mode alongside WiFi/BLE
+    static constexpr size_t MAX_CHANNELS = 8;
+
+    /**
+    * @brief What a channel measures. The first channel of each role is the primary one, which the power,
+    * ripple, capture and offset tracking figures are computed from
+    */
+    enum class channel_role_t : uint8_t {
+        CURRENT = 0,    // Hall effect current sensor output, offset around mid supply
+        VOLTAGE = 1     // Divided down voltage, DC or AC
+    };
+
+    /**
+    * @brief Compile-time descriptor of one ADC channel
+    * @tparam GPIO Input pin. Must be an ADC1 pin
+    * @tparam ROLE What the channel measures
+    * @tparam SCALE Engineering units (Amperes or Volts) per Volt at the pin
+    * @tparam OFFSET Pin voltage that reads as 0. For the primary current channel this is only the starting point,
+    *                the offset is measured at boot and tracked after that
+    * @tparam FILTER `filter_chain_t` run on the channel's raw counts
+    */
+    template <int GPIO, channel_role_t ROLE, float SCALE, float OFFSET, typename FILTER>
+    struct channel_t {
+        static constexpr int gpio = GPIO;
+        static constexpr channel_role_t role = ROLE;
+        static constexpr float scale = SCALE;
+        static constexpr float offset = OFFSET;
+        using filter_t = FILTER;
+    };
+
+    /**
+    * @brief Compile-time table of the sampled channels, in ADC pattern order
+    * @tparam CH `channel_t` descriptors
+    */
+    template <typename... CH>
+    struct channel_list_t {
+        static constexpr size_t COUNT = sizeof...(CH);
+        static_assert((COUNT >= 2) && (COUNT <= MAX_CHANNELS), "Channel list needs between 2 and MAX_CHANNELS channels");
+
+        static constexpr std::array<int, COUNT> GPIOS{ CH::gpio... };
+        static constexpr std::array<channel_role_t, COUNT> ROLES{ CH::role... };
+        static constexpr std::array<float, COUNT> SCALES{ CH::scale... };
+        static constexpr std::array<float, COUNT> OFFSETS{ CH::offset... };
+
+        using filters_t = std::tuple<typename CH::filter_t...>;
+
+        // Samples of all channels are paired by index, so the filters must all decimate by the same ratio
+        static constexpr uint32_t DECIMATION = std::tuple_element_t<0, filters_t>::DECIMATION;
+        static_assert(((CH::filter_t::DECIMATION == DECIMATION) && ...), "All channels must decimate by the same ratio");
+
+    private:
+        static constexpr size_t first_of(channel_role_t role) {
+            for (size_t c = 0; c < COUNT; c++) {
+                if (ROLES[c] == role) return c;
+            }
+            return COUNT;
+        }
+
+    public:
+        static constexpr size_t PRIMARY_CURRENT = first_of(channel_role_t::CURRENT);
+        static constexpr size_t PRIMARY_VOLTAGE = first_of(channel_role_t::VOLTAGE);
+        static_assert(PRIMARY_CURRENT < COUNT, "Channel list needs a current channel");
+        static_assert(PRIMARY_VOLTAGE < COUNT, "Channel list needs a voltage channel");
+    };
+
+} // namespace adc
+
+
+#endif // _CHANNELS_HPP_
@@ -0,0 +1,232 @@
+#ifndef _DSP_FILTER_HPP_
+#define _DSP_FILTER_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <tuple>
+
+
+namespace adc {
+
+    /**
+    * Filter stages for raw ADC counts. Every stage has the same shape:
+    *   - `DECIMATION`: how many input samples it takes to produce one output sample
+    *   - `process(in, out)`: feeds one sample, returns true when `out` holds a new output sample
+    *   - `reset()`: returns the stage to its power-up state
+    * Stages are composed with `filter_chain_t` at compile time, so a whole chain inlines into the sampling loop.
+    * All stages have unity DC gain, so a chain never shifts the average of the counts it filters
+    */
+
+    /**
+    * @brief Boxcar moving average over the last N samples
+    * @tparam N Window length. Must be a power of 2 so the division is a shift
+    */
+    template <size_t N>
+    class moving_average_t {
+        static_assert((N > 0) && ((N & (N - 1)) == 0), "moving_average_t window must be a power of 2");
+
+    private:
+        std::array<int32_t, N> window{};
+        int32_t sum{};
+        size_t head{};
+        bool primed{};
+
+        static constexpr uint8_t shift() {
+            uint8_t bits = 0;
+            while ((static_cast<size_t>(1) << bits) < N) bits++;
+            return bits;
+        }
+
+    public:
+        static constexpr uint32_t DECIMATION = 1;
+
+        bool process(int32_t in, int32_t& out) {
+            // Prime the window with the first sample so the output doesn't ramp up from 0
+            if (!primed) {
+                window.fill(in);
+                sum = in * static_cast<int32_t>(N);
+                primed = true;
+            }
+            sum += in - window[head];
+            window[head] = in;
+            head = (head + 1) & (N - 1);
+            out = sum >> shift();
+            return true;
+        }
+
+        void reset() {
+            window.fill(0);
+            sum = 0;
+            head = 0;
+            primed = false;
+        }
+    };
+
+    /**
+    * @brief Single pole low pass IIR: y += (x - y) / 2^SHIFT
+    * The state keeps 8 fractional bits so small steps aren't truncated away
+    * @tparam SHIFT Smoothing factor. Cut off is about fs / (2 * pi * 2^SHIFT)
+    */
+    template <uint8_t SHIFT>
+    class iir_single_pole_t {
+        static_assert((SHIFT > 0) && (SHIFT < 16), "iir_single_pole_t shift must be in [1, 15]");
+
+    private:
+        static constexpr uint8_t FRAC_BITS = 8;
+        int32_t state{};
+        bool primed{};
+
+    public:
+        static constexpr uint32_t DECIMATION = 1;
+
+        bool process(int32_t in, int32_t& out) {
+            if (!primed) {
+                state = in << FRAC_BITS;
+                primed = true;
+            }
+            state += ((in << FRAC_BITS) - state) >> SHIFT;
+            out = state >> FRAC_BITS;
+            return true;
+        }
+
+        void reset() {
+            state = 0;
+            primed = false;
+        }
+    };
+
+    /**
+    * @brief Cascaded integrator comb decimator with a differential delay of 1
+    * Integrators run at the input rate and wrap around on purpose; combs run at the output rate
+    * @tparam R Decimation ratio. Must be a power of 2 so the gain can be removed with a shift
+    * @tparam ORDER Number of integrator and comb sections
+    */
+    template <uint32_t R, uint8_t ORDER>
+    class cic_decimator_t {
+        static_assert((R > 1) && ((R & (R - 1)) == 0), "cic_decimator_t ratio must be a power of 2");
+        static_assert(ORDER > 0, "cic_decimator_t needs at least one section");
+
+    private:
+        static constexpr uint8_t log2_r() {
+            uint8_t bits = 0;
+            while ((static_cast<uint32_t>(1) << bits) < R) bits++;
+            return bits;
+        }
+
+        // Gain is R^ORDER. 12 bit counts plus the bit growth has to fit in the 32 bit state
+        static constexpr uint8_t GAIN_BITS = ORDER * log2_r();
+        static_assert((12 + GAIN_BITS) < 32, "cic_decimator_t bit growth overflows 32 bits");
+
+        // Unsigned so the integrator wrap around is well defined
+        std::array<uint32_t, ORDER> integrators{};
+        std::array<uint32_t, ORDER> combs{};
+        uint32_t phase{};
+
+    public:
+        static constexpr uint32_t DECIMATION = R;
+
+        bool process(int32_t in, int32_t& out) {
+            uint32_t acc = static_cast<uint32_t>(in);
+            for (auto& integrator : integrators) {
+                integrator += acc;
+                acc = integrator;
+            }
+
+            if (++phase < R) return false;
+            phase = 0;
+
+            for (auto& comb : combs) {
+                const uint32_t delayed = comb;
+                comb = acc;
+                acc -= delayed;
+            }
+            out = static_cast<int32_t>(acc) >> GAIN_BITS;
+            return true;
+        }
+
+        void reset() {
+            integrators.fill(0);
+            combs.fill(0);
+            phase = 0;
+        }
+    };
+
+    /**
+    * @brief Direct form FIR filter with Q(SHIFT) fixed point taps
+    * @tparam SHIFT Fractional bits of the taps. The taps should sum to 2^SHIFT for unity DC gain
+    * @tparam TAPS Filter coefficients, oldest sample last
+    */
+    template <uint8_t SHIFT, int16_t... TAPS>
+    class fir_t {
+        static_assert(sizeof...(TAPS) > 0, "fir_t needs at least one tap");
+
+    private:
+        static constexpr size_t N = sizeof...(TAPS);
+        static constexpr std::array<int16_t, N> taps{ TAPS... };
+
+        // The delay line is stored twice so the convolution reads a contiguous window without wrapping
+        std::array<int32_t, 2 * N> delay{};
+        size_t head{};
+
+    public:
+        static constexpr uint32_t DECIMATION = 1;
+
+        bool process(int32_t in, int32_t& out) {
+            head = (head == 0) ? (N - 1) : (head - 1);
+            delay[head] = in;
+            delay[head + N] = in;
+
+            int32_t acc = 0;
+            for (size_t k = 0; k < N; k++) {
+                acc += taps[k] * delay[head + k];
+            }
+            out = acc >> SHIFT;
+            return true;
+        }
+
+        void reset() {
+            delay.fill(0);
+            head = 0;
+        }
+    };
+
+    /**
+    * @brief Compile time composition of filter stages. Samples flow from the first stage to the last;
+    * a decimating stage ends the walk early when it has no output for the current input.
+    * An empty chain passes samples through unchanged
+    */
+    template <typename... STAGES>
+    class filter_chain_t {
+    private:
+        std::tuple<STAGES...> stages{};
+
+        template <size_t I>
+        bool run(int32_t in, int32_t& out) {
+            if constexpr (I == sizeof...(STAGES)) {
+                out = in;
+                return true;
+            } else {
+                int32_t stage_out = 0;
+                if (!std::get<I>(stages).process(in, stage_out)) return false;
+                return run<I + 1>(stage_out, out);
+            }
+        }
+
+    public:
+        static constexpr uint32_t DECIMATION = (STAGES::DECIMATION * ... * 1);
+
+        bool process(int32_t in, int32_t& out) {
+            return run<0>(in, out);
+        }
+
+        void reset() {
+            std::apply([](auto&... stage) { (stage.reset(), ...); }, stages);
+        }
+    };
+
+} // namespace adc
+
+
+#endif // _DSP_FILTER_HPP_
@@ -0,0 +1,108 @@
+#include "frame_processor.hpp"
+
+
+namespace adc {
+
+    static constexpr uint16_t ADC_RESOLUTION                    = frame_processor_base_t::ADC_RESOLUTION;
+
+    // Shared by the processors of every channel list
+#if ADC_CALI_LUT_IN_IRAM == 1
+    IRAM_BSS_ATTR frame_processor_base_t::cali_entry_t frame_processor_base_t::cali_lut_mv[ADC_RESOLUTION];
+#else
+    frame_processor_base_t::cali_entry_t frame_processor_base_t::cali_lut_mv[ADC_RESOLUTION];
+#endif
+
+    // Fallback until `set_calibration()` is called: linear conversion
+    static int linear_raw_to_mv(uint32_t raw, [[maybe_unused]] void* ctx) {
+        return static_cast<int>((raw * 3300) / ADC_RESOLUTION);
+    }
+
+    frame_processor_base_t::frame_processor_base_t(float zero_current_offset): cali_fn(linear_raw_to_mv), cali_ctx(nullptr),
+                                            zero_current_offset_voltage(zero_current_offset), hw_sample_rate_hz(0),
+                                            frame_stride(1), temperature_c(NAN), offset_updated(false), capture_current_threshold(0),
+                                            capture_slope_threshold(0), capture_prev_current(NAN) {}
+
+    void frame_processor_base_t::set_calibration(cali_fn_t fn, void* ctx) {
+
+        cali_fn = fn ? fn : linear_raw_to_mv;
+        cali_ctx = ctx;
+
+        // Build the calibration table so the hot path costs a single indexed load per sample
+        for (uint32_t raw = 0; raw < ADC_RESOLUTION; raw++) {
+            cali_lut_mv[raw] = static_cast<uint16_t>(cali_fn(raw, cali_ctx));
+        }
+    }
+
+    void frame_processor_base_t::set_timing(uint32_t rate_hz, uint32_t stride) {
+        hw_sample_rate_hz = rate_hz;
+        frame_stride = stride ? stride : 1;
+    }
+
+    void frame_processor_base_t::set_zero_current_offset(float voltage) {
+        zero_current_offset_voltage = voltage;
+    }
+
+    float frame_processor_base_t::get_zero_current_offset() const {
+        return zero_current_offset_voltage;
+    }
+
+    void frame_processor_base_t::set_temperature(float celsius) {
+        temperature_c.store(celsius, std::memory_order_relaxed);
+    }
+
+    void frame_processor_base_t::seed_offset(float voltage) {
+        offset_estimator.seed(voltage, temperature_c.load(std::memory_order_relaxed));
+        zero_current_offset_voltage = voltage;
+    }
+
+    bool frame_processor_base_t::restore_offset_state(const offset_estimator_t::state_t& state) {
+
+        if (!offset_estimator.restore(state)) return false;
+        zero_current_offset_voltage = predicted_offset();
+
+        return true;
+    }
+
+    const offset_estimator_t::state_t& frame_processor_base_t::get_offset_state() const {
+        return offset_estimator.get_state();
+    }
+
+    float frame_processor_base_t::predicted_offset() const {
+        return offset_estimator.offset_at(temperature_c.load(std::memory_order_relaxed));
+    }
+
+    bool frame_processor_base_t::take_offset_update() {
+        const bool updated = offset_updated;
+        offset_updated = false;
+        return updated;
+    }
+
+    void frame_processor_base_t::set_capture_trigger(float current_a, float slope_a_per_ms) {
+        capture_current_threshold.store(current_a, std::memory_order_relaxed);
+        capture_slope_threshold.store(slope_a_per_ms, std::memory_order_relaxed);
+    }
+
+    void frame_processor_base_t::setup_ripple_analysis(float channel_rate_hz) {
+
+        std::array<float, RIPPLE_HARMONICS> freqs_hz{};
+        for (size_t k = 0; k < RIPPLE_HARMONICS; k++) {
+            freqs_hz[k] = RIPPLE_FUNDAMENTAL_HZ * (k + 1);
+        }
+
+        // A failed setup leaves the bins reading 0, which is what a rate too low for the ripple would show anyway
+        ripple_analyser.setup(channel_rate_hz, RIPPLE_RESOLUTION_HZ, freqs_hz);
+    }
+
+    void frame_processor_base_t::track_offset(float current_avg, float current_std_dev, float sensitivity) {
+
+        // Refine the zero current offset while the current is small and steady. The frame's sensor output
+        // voltage is recovered from the average current, which saves a separate sum in the hot loop
+        const float pin_voltage = zero_current_offset_voltage + current_avg * sensitivity;
+        const float temp_c = temperature_c.load(std::memory_order_relaxed);
+        if (offset_estimator.observe(pin_voltage, current_avg, current_std_dev, temp_c)) {
+            zero_current_offset_voltage = offset_estimator.offset_at(temp_c);
+            offset_updated = true;
+        }
+    }
+
+} // namespace adc
@@ -0,0 +1,526 @@
+#ifndef _FRAME_PROCESSOR_HPP_
+#define _FRAME_PROCESSOR_HPP_
+
+
+#include "adc_hal.hpp"
+#include "dsp_filter.hpp"
+#include "goertzel.hpp"
+#include "capture.hpp"
+#include "offset_estimator.hpp"
+#include "running_stats.hpp"
+#include "channels.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <array>
+#include <atomic>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+
+
+// Set to 0 to call the calibration function per sample instead of using the calibration table.
+// Both calibration switches can also be set on the compiler command line, which `tools/adc_replay.cpp` uses to compare them
+#ifndef ADC_USE_CALI_LUT
+#define ADC_USE_CALI_LUT 1
+#endif
+
+// Set to 1 to place the calibration table in IRAM instead of DRAM
+#ifndef ADC_CALI_LUT_IN_IRAM
+#define ADC_CALI_LUT_IN_IRAM 0
+#endif
+
+// Set to 0 to skip the Goertzel ripple and harmonic analysis of the current channel
+#define ADC_RIPPLE_ANALYSIS 1
+
+// Set to 0 to freeze the zero current offset after boot instead of refining it while idle
+#define ADC_OFFSET_TRACKING 1
+
+
+namespace adc {
+
+    // Ripple components tracked on the current channel: the ripple fundamental and its harmonics
+    static constexpr size_t RIPPLE_HARMONICS = 4;
+
+    // 100Hz is the ripple of 50Hz mains after full wave rectification; use 120Hz for 60Hz mains
+    static constexpr float RIPPLE_FUNDAMENTAL_HZ = 100;
+    static constexpr float RIPPLE_RESOLUTION_HZ = 10;   // Bin spacing. Sets a 100ms analysis block
+
+    /**
+    * @brief Measurements of one channel
+    */
+    struct channel_data_t {
+        float avg;                  // Average of the filtered samples, in Amperes or Volts
+        float rms;                  // True RMS of the unfiltered samples, in Amperes or Volts
+        running_stats_t window;     // Filtered sample statistics over the same window as `data_t::current_window`
+    };
+
+    /**
+    * @brief Measurement data structure
+    */
+    struct data_t {
+        float current_avg;          // Average current in Amperes, from the filtered samples
+        float voltage_avg;          // Average voltage in Volts, from the filtered samples
+        // RMS and power figures come from the unfiltered samples, so the filter chains can't shift the phase of one channel
+        // against the other or take the ripple out of the RMS
+        float current_rms;          // True RMS current in Amperes
+        float voltage_rms;          // True RMS voltage in Volts
+        float real_power;           // Real power in Watts, mean of v * i. Negative while charging
+        float apparent_power;       // Apparent power in VA, Vrms * Irms
+        float power_factor;         // Real power / apparent power. 0 if there is no apparent power
+        float current_ripple_rms;   // RMS of the AC part of the current over the last analysis block, in Amperes
+        std::array<float, RIPPLE_HARMONICS> current_harmonics; // Peak amplitude of the ripple fundamental and harmonics, in Amperes
+        // Sample statistics over the window since the last `adc::driver::get_measurement_data()` call, so short peaks
+        // between reads aren't averaged away. `frame_processor_t` fills in those of the frame alone
+        running_stats_t current_window;     // In Amperes
+        running_stats_t voltage_window;     // In Volts
+        // Every sampled channel in channel list order, the primary current and voltage channels included
+        std::array<channel_data_t, MAX_CHANNELS> channels;
+        uint8_t channel_count;
+        // Charge and energy through the current sensor since boot, filled in by `adc::driver`. Integrated over every frame
+        // the ADC produced, skipped and dropped ones included, on the ADC's sample clock. Never reset, consumers take differences
+        double charge_in_ah;                // While charging (negative current)
+        double charge_out_ah;               // While discharging (positive current)
+        double energy_in_wh;                // While charging (negative real power)
+        double energy_out_wh;               // While discharging (positive real power)
+        int64_t timestamp_us;       // esp_timer time the ADC completed the frame, filled in by `adc::driver`
+        uint32_t seq;               // Sequence id, one per published measurement, filled in by `adc::driver`
+        bool valid;                 // Data validity flag
+    };
+
+    /**
+    * @brief Default filter chains of the board's channels. They run on raw counts before calibration, and feed the averages,
+    * the window statistics, the ripple analysis, the capture trigger and the offset tracking. The RMS and power figures
+    * bypass them. The light defaults knock down ADC noise while keeping the 100/120Hz ripple.
+    * See `dsp_filter.hpp` for the available stages
+    */
+    using current_filter_t = filter_chain_t<moving_average_t<4>>;
+    using voltage_filter_t = filter_chain_t<iir_single_pole_t<3>>;
+
+    /**
+    * @brief Channel independent part of `frame_processor_t`: calibration, the zero current offset model
+    * and the capture trigger settings
+    */
+    class frame_processor_base_t {
+    public:
+        // Largest frame `process_adc_data()` handles, in samples. Longer frames are truncated
+        static constexpr size_t MAX_FRAME_SAMPLES = 512;
+
+        // ADC codes are 12 bits wide
+        static constexpr uint16_t ADC_RESOLUTION = 4096;
+
+        /**
+        * @brief Converts one raw ADC code to millivolts. Used to build the calibration table
+        */
+        using cali_fn_t = int (*)(uint32_t raw, void* ctx);
+
+        /**
+        * @brief Capture trigger found while processing a frame
+        */
+        struct trigger_t {
+            bool fired;
+            size_t words_ago;           // Position of the trigger sample, counted back from the last word of the frame
+            float current;              // Current that fired the trigger, in Amperes
+            capture_reason_t reason;
+        };
+
+        /**
+        * @brief Build the raw to millivolt calibration table
+        * @param fn Conversion for a single code, also used directly when the table is compiled out
+        * @param ctx Passed through to `fn`
+        */
+        void set_calibration(cali_fn_t fn, void* ctx);
+
+        void set_zero_current_offset(float voltage);
+        [[nodiscard]] float get_zero_current_offset() const;
+
+        /**
+        * @brief Report the current sensor's temperature for the offset model. Safe to call from any task
+        * @param celsius Temperature in degrees Celsius, NaN if unknown
+        */
+        void set_temperature(float celsius);
+
+        /**
+        * @brief Start the offset model from a single boot measurement and use it as the offset
+        */
+        void seed_offset(float voltage);
+
+        /**
+        * @brief Restore a saved offset model and switch to the offset it predicts
+        * @return false if the saved model isn't usable
+        */
+        bool restore_offset_state(const offset_estimator_t::state_t& state);
+
+        [[nodiscard]] const offset_estimator_t::state_t& get_offset_state() const;
+
+        /**
+        * @brief Offset predicted by the model for the last reported temperature
+        */
+        [[nodiscard]] float predicted_offset() const;
+
+        /**
+        * @brief Check, and clear, whether the offset model changed since the last call
+        */
+        bool take_offset_update();
+
+        /**
+        * @brief Set when a waveform capture triggers. A value of 0 disables that condition.
+        * Safe to call from any task
+        * @param current_a Absolute current that triggers a capture, in Amperes
+        * @param slope_a_per_ms Current slope that triggers a capture, in Amperes per millisecond
+        */
+        void set_capture_trigger(float current_a, float slope_a_per_ms);
+
+        /**
+        * @brief Convert one raw code to Volts at the ADC pin
+        */
+        float raw_to_voltage(uint32_t raw);
+
+    protected:
+        // Raw to millivolt calibration table, built once in `set_calibration()`
+        // IRAM can only be read 32 bits at a time on the ESP32, so the entries are widened when placed there
+#if ADC_CALI_LUT_IN_IRAM == 1
+        using cali_entry_t = uint32_t;
+#else
+        using cali_entry_t = uint16_t;
+#endif
+        static cali_entry_t cali_lut_mv[ADC_RESOLUTION];
+
+        cali_fn_t cali_fn;
+        void* cali_ctx;
+
+        float zero_current_offset_voltage;
+
+        uint32_t hw_sample_rate_hz;
+        uint32_t frame_stride;
+
+        // Ripple and harmonic analysis of the primary current channel
+        goertzel_bank_t<RIPPLE_HARMONICS> ripple_analyser;
+
+        // Zero current offset tracking
+        offset_estimator_t offset_estimator;
+        std::atomic<float> temperature_c;
+        bool offset_updated;
+
+        // Capture trigger state
+        std::atomic<float> capture_current_threshold;
+        std::atomic<float> capture_slope_threshold;
+        float capture_prev_current;     // Last current sample seen by the slope trigger, NaN after a gap
+
+        /**
+        * @param zero_current_offset Offset used until one is measured
+        */
+        explicit frame_processor_base_t(float zero_current_offset);
+
+        void set_timing(uint32_t hw_sample_rate_hz, uint32_t frame_stride);
+
+        /**
+        * @param channel_rate_hz Rate of the samples of one channel, after decimation
+        */
+        void setup_ripple_analysis(float channel_rate_hz);
+
+        /**
+        * @brief Feed the current figures of a frame to the offset model, and switch to its offset when it changes
+        * @param sensitivity Current sensor output per Ampere, in Volts
+        */
+        void track_offset(float current_avg, float current_std_dev, float sensitivity);
+
+        uint32_t clamp_raw(int32_t raw) {
+            // FIR stages with negative taps can overshoot the 12 bit range
+            return static_cast<uint32_t>(std::clamp<int32_t>(raw, 0, ADC_RESOLUTION - 1));
+        }
+
+        uint32_t raw_to_millivolts(uint32_t raw) {
+            // The mask keeps the index in range without a branch; raw data is 12 bits wide anyway
+            return cali_lut_mv[raw & (ADC_RESOLUTION - 1)];
+        }
+    };
+
+    inline float frame_processor_base_t::raw_to_voltage(uint32_t raw) {
+
+        static constexpr float MV_TO_V = 0.001f;
+
+#if ADC_USE_CALI_LUT == 1
+        return static_cast<float>(raw_to_millivolts(raw)) * MV_TO_V;
+#else
+        return static_cast<float>(cali_fn(raw, cali_ctx)) * MV_TO_V;
+#endif
+    }
+
+    /**
+    * @brief The ADC hot path: turns DMA frames of raw interleaved samples into measurements.
+    * It has no ESP-IDF dependencies beyond the types in `adc_hal.hpp`, so the exact production code
+    * can also be built and fed recorded frames off-target. `adc::driver` owns one and feeds it from its processing task
+    *
+    * A frame is reduced in a single pass straight from the DMA buffer, without intermediate sample buffers.
+    * Each word is routed through a channel field to slot table. Its calibrated value goes straight into the RMS and power
+    * sums once every channel has a sample in the round, and its channel's filter chain runs alongside. Each filtered sample
+    * goes into its channel's statistics as it's emitted, and once every chain has emitted, the round's current is analysed
+    *
+    * @note Not thread safe. Everything but `set_capture_trigger()` and `set_temperature()` must be called
+    * from the task that calls `process_adc_data()`
+    * @tparam CHANNELS `channel_list_t` of the sampled channels, in ADC pattern order
+    */
+    template <typename CHANNELS>
+    class frame_processor_t : public frame_processor_base_t {
+    public:
+        static constexpr size_t CHANNEL_COUNT = CHANNELS::COUNT;
+        static constexpr size_t PRIMARY_CURRENT = CHANNELS::PRIMARY_CURRENT;
+        static constexpr size_t PRIMARY_VOLTAGE = CHANNELS::PRIMARY_VOLTAGE;
+
+        frame_processor_t(): frame_processor_base_t(CHANNELS::OFFSETS[PRIMARY_CURRENT]) {
+            slot_lut.fill(CHANNEL_COUNT);
+        }
+
+        /**
+        * @brief Select which channel field identifies each channel's samples
+        * @param channels ADC channel of each entry of the channel list
+        */
+        void set_channels(const std::array<adc_channel_t, CHANNEL_COUNT>& channels) {
+            // Channel fields not in the list map past the last slot, and their words are skipped
+            slot_lut.fill(CHANNEL_COUNT);
+            for (size_t c = 0; c < CHANNEL_COUNT; c++) {
+                slot_lut[channels[c] & (slot_lut.size() - 1)] = static_cast<uint8_t>(c);
+            }
+        }
+
+        /**
+        * @brief Tell the processor how its frames are spaced in time. Clears all filter and analysis state
+        * @param rate_hz Rate of the interleaved samples inside a frame (all channels)
+        * @param stride 1 if consecutive frames are contiguous, N if only one frame in N gets processed
+        */
+        void set_sample_rate(uint32_t rate_hz, uint32_t stride) {
+
+            set_timing(rate_hz, stride);
+
+            // Filter and ripple state belong to the old sample stream
+            std::apply([](auto&... filter) { (filter.reset(), ...); }, filters);
+            capture_prev_current = NAN;
+            setup_ripple_analysis((hw_sample_rate_hz / static_cast<float>(CHANNEL_COUNT)) / CHANNELS::DECIMATION);
+        }
+
+        /**
+        * @brief Filter, calibrate and reduce one DMA frame
+        * @param frame Raw interleaved samples
+        * @param num_samples Samples in the frame
+        * @param capture_armed Look for a capture trigger in this frame
+        * @param[out] data Measurements of the frame
+        * @param[out] trigger First capture trigger of the frame, if `capture_armed`
+        * @return true if the frame produced measurements
+        */
+        bool process_adc_data(const adc_digi_output_data_t* frame, size_t num_samples, bool capture_armed,
+                              data_t& data, trigger_t& trigger) {
+
+            frame_sums = frame_sums_t{};
+            trigger.fired = false;
+            accumulate(frame, std::min(num_samples, MAX_FRAME_SAMPLES), capture_armed, frame_sums, trigger);
+            if (frame_sums.stats[PRIMARY_CURRENT].count == 0) return false;
+
+            update_measurements(frame_sums, data);
+
+            return true;
+        }
+
+        /**
+        * @brief Unfiltered average voltage on the primary current channel of one frame, for zero current offset calibration
+        * @return Average voltage in Volts, NaN if the frame has no current samples
+        */
+        float current_channel_voltage(const adc_digi_output_data_t* frame, size_t num_samples) {
+
+            num_samples = std::min(num_samples, MAX_FRAME_SAMPLES);
+
+            float sum = 0.0f;
+            size_t count = 0;
+            for (size_t w = 0; w < num_samples; w++) {
+                if (slot_lut[frame[w].type1.channel] != PRIMARY_CURRENT) continue;
+                sum += raw_to_voltage(frame[w].type1.data);
+                count++;
+            }
+
+            return (count > 0) ? (sum / count) : NAN;
+        }
+
+    private:
+        // Every channel's bit set in the round mask
+        static constexpr uint32_t ROUND_COMPLETE = (1u << CHANNEL_COUNT) - 1;
+
+        // Running sums of one frame, filled in a single pass by `accumulate()`. Everything in Amperes or Volts
+        struct frame_sums_t {
+            std::array<running_stats_t, CHANNEL_COUNT> stats;   // Filtered samples
+            std::array<float, CHANNEL_COUNT> sum_sq;            // Unfiltered samples, from here on
+            float vi;               // Sum of the primary voltage times the primary current
+            uint32_t rounds;        // Rounds of unfiltered samples
+        };
+
+        // Sums of the frame being processed. Kept here rather than on the processing task's stack
+        frame_sums_t frame_sums{};
+
+        // Channel field (4 bits) to slot. CHANNEL_COUNT for fields that aren't sampled
+        std::array<uint8_t, 16> slot_lut{};
+
+        // Filter state carried across frames
+        typename CHANNELS::filters_t filters{};
+
+        /**
+        * @brief Run one raw sample through the filter chain of channel C
+        * @return true if the chain emitted a sample, written to `volts` as Volts at the pin
+        */
+        template <size_t C>
+        bool filter_sample(uint16_t raw, float& volts) {
+            int32_t filtered = 0;
+            if (!std::get<C>(filters).process(raw, filtered)) return false;
+            volts = raw_to_voltage(clamp_raw(filtered));
+            return true;
+        }
+
+        /**
+        * @brief Run one raw sample through the filter chain of the given slot, which must be below CHANNEL_COUNT.
+        * Expands to a comparison per slot at compile time, so each chain is inlined instead of called through a pointer
+        */
+        bool filter_slot(size_t slot, uint16_t raw, float& volts) {
+            return [&]<size_t... C>(std::index_sequence<C...>) {
+                bool emitted = false;
+                (void)((slot == C ? (emitted = filter_sample<C>(raw, volts), true) : false) || ...);
+                return emitted;
+            }(std::make_index_sequence<CHANNEL_COUNT>{});
+        }
+
+        /**
+        * @brief Pin voltage that reads as 0 on a channel. The primary current channel's offset is measured and tracked,
+        * the other offsets are fixed
+        */
+        float channel_offset(size_t slot) const {
+            return (slot == PRIMARY_CURRENT) ? zero_current_offset_voltage : CHANNELS::OFFSETS[slot];
+        }
+
+        /**
+        * @brief Add a round of unfiltered samples, in Amperes or Volts, to the RMS and power sums
+        */
+        void add_round(const std::array<float, CHANNEL_COUNT>& x, frame_sums_t& sums) {
+            for (size_t c = 0; c < CHANNEL_COUNT; c++) {
+                sums.sum_sq[c] += x[c] * x[c];
+            }
+            sums.vi += x[PRIMARY_VOLTAGE] * x[PRIMARY_CURRENT];
+            sums.rounds++;
+        }
+
+        void accumulate(const adc_digi_output_data_t* frame, size_t words, bool capture_armed, frame_sums_t& sums, trigger_t& trigger);
+        void update_measurements(const frame_sums_t& sums, data_t& data);
+    };
+
+    template <typename CHANNELS>
+    void frame_processor_t<CHANNELS>::accumulate(const adc_digi_output_data_t* frame, size_t words, bool capture_armed,
+                                                 frame_sums_t& sums, trigger_t& trigger) {
+
+        // Capture trigger settings, loaded once per frame. The slope limit is converted to Amperes per round of samples
+        const float current_threshold = capture_current_threshold.load(std::memory_order_relaxed);
+        const float slope_threshold = capture_slope_threshold.load(std::memory_order_relaxed) *
+                                      (1000.0f * CHANNEL_COUNT * CHANNELS::DECIMATION) / static_cast<float>(hw_sample_rate_hz);
+        // Skipped frames leave a gap, so the slope can't be taken across frames then
+        float prev_i = (frame_stride == 1) ? capture_prev_current : NAN;
+
+        // Latest unfiltered sample of each channel, for the products of a round. Filtered samples go into their channel's
+        // statistics as they're emitted, so only the primary current's is held until its round ends
+        std::array<float, CHANNEL_COUNT> raw_x{};
+        float i = 0.0f;
+        uint32_t raw_round = 0;
+        uint32_t round = 0;
+
+        for (size_t w = 0; w < words; w++) {
+            const size_t slot = slot_lut[frame[w].type1.channel];
+            if (slot >= CHANNEL_COUNT) continue;
+            const uint16_t raw = frame[w].type1.data;
+
+            // The conversion happens before squaring so the sums don't suffer from cancellation around the offset
+            const float offset = channel_offset(slot);
+            raw_x[slot] = (raw_to_voltage(raw) - offset) * CHANNELS::SCALES[slot];
+            raw_round |= 1u << slot;
+            if (raw_round == ROUND_COMPLETE) {
+                add_round(raw_x, sums);
+                raw_round = 0;
+            }
+
+            float volts = 0.0f;
+            if (!filter_slot(slot, raw, volts)) continue;
+            const float x = (volts - offset) * CHANNELS::SCALES[slot];
+            sums.stats[slot].add(x);
+            if (slot == PRIMARY_CURRENT) i = x;
+
+            // The current is analysed once a round; a round ends once every channel has emitted
+            round |= 1u << slot;
+            if (round != ROUND_COMPLETE) continue;
+            round = 0;
+
+#if ADC_RIPPLE_ANALYSIS == 1
+            if (frame_stride == 1) ripple_analyser.process(i);
+#endif
+
+            if (capture_armed) {
+                const bool over = (current_threshold > 0.0f) && (fabsf(i) > current_threshold);
+                const bool steep = (slope_threshold > 0.0f) && (fabsf(i - prev_i) > slope_threshold);
+                if (over || steep) {
+                    trigger = trigger_t{
+                        .fired = true,
+                        .words_ago = words - 1 - w,
+                        .current = i,
+                        .reason = over ? capture_reason_t::THRESHOLD : capture_reason_t::SLOPE
+                    };
+                    capture_armed = false;
+                }
+            }
+            prev_i = i;
+        }
+        capture_prev_current = prev_i;
+    }
+
+    template <typename CHANNELS>
+    void frame_processor_t<CHANNELS>::update_measurements(const frame_sums_t& sums, data_t& data) {
+
+        const running_stats_t& i_stats = sums.stats[PRIMARY_CURRENT];
+        const running_stats_t& v_stats = sums.stats[PRIMARY_VOLTAGE];
+
+        // Every channel got the same number of samples, one per round
+        const float inv_n = (sums.rounds > 0) ? (1.0f / static_cast<float>(sums.rounds)) : 0.0f;
+
+        data = data_t{};
+        data.channel_count = CHANNEL_COUNT;
+        for (size_t c = 0; c < CHANNEL_COUNT; c++) {
+            data.channels[c] = channel_data_t{
+                .avg = sums.stats[c].mean,
+                .rms = sqrtf(sums.sum_sq[c] * inv_n),
+                .window = sums.stats[c]
+            };
+        }
+
+        data.voltage_avg    = v_stats.mean;
+        data.current_avg    = i_stats.mean;
+        data.voltage_rms    = data.channels[PRIMARY_VOLTAGE].rms;
+        data.current_rms    = data.channels[PRIMARY_CURRENT].rms;
+        data.real_power     = sums.vi * inv_n;
+        data.apparent_power = data.voltage_rms * data.current_rms;
+        data.power_factor   = (data.apparent_power > 0.0f) ? (data.real_power / data.apparent_power) : 0.0f;
+        data.current_window = i_stats;
+        data.voltage_window = v_stats;
+
+        // Ripple figures only change once per analysis block; each frame republishes the latest ones.
+        // Skipped frames break the block up, so there are no ripple figures while frames are being skipped
+        if (frame_stride == 1) {
+            data.current_ripple_rms = ripple_analyser.get_ac_rms();
+            data.current_harmonics  = ripple_analyser.get_amplitudes();
+        } else {
+            data.current_ripple_rms = NAN;
+            data.current_harmonics.fill(NAN);
+        }
+
+        data.valid = true;
+
+#if ADC_OFFSET_TRACKING == 1
+        track_offset(data.current_avg, i_stats.std_dev(), 1.0f / CHANNELS::SCALES[PRIMARY_CURRENT]);
+#endif
+    }
+
+} // namespace adc
+
+
+#endif // _FRAME_PROCESSOR_HPP_
@@ -0,0 +1,131 @@
+#ifndef _GOERTZEL_HPP_
+#define _GOERTZEL_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <array>
+
+
+namespace adc {
+
+    /**
+    * @brief Bank of Goertzel filters evaluating a few DFT bins over fixed length blocks of samples.
+    * Each bin costs one multiply and two adds per sample, so it's cheap enough to run on every sample.
+    * The block also tracks the RMS of the AC part of the signal
+    * @tparam BINS Number of frequencies to track
+    */
+    template <size_t BINS>
+    class goertzel_bank_t {
+    private:
+        std::array<float, BINS> coeffs{};
+        std::array<float, BINS> s1{};
+        std::array<float, BINS> s2{};
+        std::array<float, BINS> amplitudes{};
+
+        uint32_t block_len{};
+        uint32_t count{};
+        float sum{};
+        float sum_sq{};
+        float ac_rms{};
+
+    public:
+        /**
+        * @brief Compute the bin coefficients and block length
+        * @param sample_rate_hz Rate at which `process()` is fed
+        * @param resolution_hz Bin spacing. The block is sample_rate_hz / resolution_hz samples long,
+        *                      so tracked frequencies should be multiples of it to avoid leakage
+        * @param freqs_hz Frequencies to track. Bins at or above Nyquist always read 0
+        * @return false if the parameters don't give a usable block length
+        */
+        bool setup(float sample_rate_hz, float resolution_hz, const std::array<float, BINS>& freqs_hz) {
+
+            if (sample_rate_hz <= 0.0f || resolution_hz <= 0.0f) return false;
+
+            block_len = static_cast<uint32_t>(lroundf(sample_rate_hz / resolution_hz));
+            if (block_len < 2) return false;
+
+            for (size_t b = 0; b < BINS; b++) {
+                if (freqs_hz[b] >= (sample_rate_hz / 2.0f)) {
+                    coeffs[b] = NAN;
+                    continue;
+                }
+                const float k = roundf(freqs_hz[b] / resolution_hz);
+                coeffs[b] = 2.0f * cosf(2.0f * static_cast<float>(M_PI) * k / static_cast<float>(block_len));
+            }
+
+            reset();
+            return true;
+        }
+
+        /**
+        * @brief Feed one sample
+        * @return true when the sample completed a block and fresh results are available
+        */
+        bool process(float x) {
+
+            for (size_t b = 0; b < BINS; b++) {
+                const float s0 = x + coeffs[b] * s1[b] - s2[b];
+                s2[b] = s1[b];
+                s1[b] = s0;
+            }
+            sum += x;
+            sum_sq += x * x;
+
+            if (++count < block_len) return false;
+
+            // |X|^2 = s1^2 + s2^2 - coeff * s1 * s2, and a sinusoid of amplitude A gives |X| = A * N / 2
+            const float scale = 2.0f / static_cast<float>(block_len);
+            for (size_t b = 0; b < BINS; b++) {
+                if (std::isnan(coeffs[b])) {
+                    amplitudes[b] = 0.0f;
+                    continue;
+                }
+                const float power = s1[b] * s1[b] + s2[b] * s2[b] - coeffs[b] * s1[b] * s2[b];
+                amplitudes[b] = scale * sqrtf(power > 0.0f ? power : 0.0f);
+            }
+
+            const float mean = sum / static_cast<float>(block_len);
+            const float variance = (sum_sq / static_cast<float>(block_len)) - (mean * mean);
+            ac_rms = sqrtf(variance > 0.0f ? variance : 0.0f);
+
+            s1.fill(0.0f);
+            s2.fill(0.0f);
+            sum = 0.0f;
+            sum_sq = 0.0f;
+            count = 0;
+
+            return true;
+        }
+
+        /**
+        * @brief Clear the running block without touching the last results
+        */
+        void reset() {
+            s1.fill(0.0f);
+            s2.fill(0.0f);
+            sum = 0.0f;
+            sum_sq = 0.0f;
+            count = 0;
+        }
+
+        /**
+        * @brief Peak amplitude of each tracked frequency over the last complete block
+        */
+        [[nodiscard]] const std::array<float, BINS>& get_amplitudes() const {
+            return amplitudes;
+        }
+
+        /**
+        * @brief RMS of the signal with its mean removed over the last complete block
+        */
+        [[nodiscard]] float get_ac_rms() const {
+            return ac_rms;
+        }
+    };
+
+} // namespace adc
+
+
+#endif // _GOERTZEL_HPP_
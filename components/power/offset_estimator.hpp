@@ -0,0 +1,198 @@
+#ifndef _OFFSET_ESTIMATOR_HPP_
+#define _OFFSET_ESTIMATOR_HPP_
+
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+
+namespace adc {
+
+    /**
+    * @brief Background estimator of the current sensor's zero current output voltage.
+    * Frames where the current is both small and steady are averaged into windows. A window only completes
+    * if every one of its frames passed, so a load switching on mid-window throws the window away.
+    * There is no load disconnect signal, so a small steady load looks just like an offset change. A completed window
+    * is therefore only accepted if its mean is within `MAX_WINDOW_DEVIATION_V` of the model, which starts out as the
+    * boot measurement, plus the most the temperature change since can explain.
+    * Accepted windows feed a weighted least squares fit of offset against temperature with exponential forgetting,
+    * so the model follows the sensor's temperature drift and slowly forgets old data
+    */
+    class offset_estimator_t {
+    public:
+        /**
+        * @brief Complete estimator state. Trivially copyable so it can be stored as is
+        */
+        struct state_t {
+            uint32_t version;
+            uint32_t windows;       // Windows accepted so far. 0 means no estimate yet
+            float offset_v;         // Offset at `ref_temp_c`, in Volts
+            float slope_v_per_c;    // Offset drift, in Volts per degree Celsius
+            float ref_temp_c;       // Weighted mean temperature of the windows
+            // Weighted regression sums, temperatures relative to `ref_temp_c` at the time they were added
+            float sw;
+            float st;
+            float so;
+            float stt;
+            float sto;
+        };
+
+        static constexpr uint32_t STATE_VERSION = 1;
+
+        // Gate for a frame to count as idle. Only as tight as the noise of a single frame allows, the window gate is the fine one
+        static constexpr float MAX_IDLE_CURRENT_A = 0.15f;          // Magnitude of the average current
+        static constexpr float MAX_IDLE_CURRENT_STD_A = 0.15f;      // Standard deviation of the current within the frame
+
+        // Largest distance of a window's mean from the model, on top of the temperature drift. 20mA on the ACS712-20A,
+        // well above the noise of a window's mean, so a steady load any larger is never learnt as an offset
+        static constexpr float MAX_WINDOW_DEVIATION_V = 0.002f;
+
+        // Frames per window. About a second of samples at the full sample rate
+        static constexpr uint32_t WINDOW_FRAMES = 300;
+
+        // Weight kept by older windows each time a new window is added
+        static constexpr float FORGETTING = 0.98f;
+
+        // Temperature spread needed before a slope is fitted, and the largest drift accepted.
+        // The ACS712 drifts well under 1mV/C; anything larger is a fit to noise
+        static constexpr float MIN_TEMP_STD_C = 2.0f;
+        static constexpr float MAX_SLOPE_V_PER_C = 0.001f;
+
+        // Temperature assumed when none has been reported yet
+        static constexpr float DEFAULT_TEMP_C = 25.0f;
+
+        offset_estimator_t() {
+            state.version = STATE_VERSION;
+            state.ref_temp_c = DEFAULT_TEMP_C;
+        }
+
+        /**
+        * @brief Restore a previously saved state
+        * @return false if the state is from another version or corrupt, in which case nothing changes
+        */
+        bool restore(const state_t& saved) {
+            if (saved.version != STATE_VERSION || saved.windows == 0) return false;
+            if (!std::isfinite(saved.offset_v) || !std::isfinite(saved.slope_v_per_c) || !std::isfinite(saved.ref_temp_c)) return false;
+            state = saved;
+            reset_window();
+            return true;
+        }
+
+        /**
+        * @brief Start from a single measurement, e.g. a boot calibration. Discards any previous estimate
+        */
+        void seed(float offset_v, float temp_c) {
+            state = state_t{};
+            state.version = STATE_VERSION;
+            state.offset_v = offset_v;
+            state.ref_temp_c = std::isfinite(temp_c) ? temp_c : DEFAULT_TEMP_C;
+            reset_window();
+        }
+
+        [[nodiscard]] const state_t& get_state() const {
+            return state;
+        }
+
+        [[nodiscard]] bool has_estimate() const {
+            return state.windows > 0;
+        }
+
+        /**
+        * @brief Offset predicted by the model
+        * @param temp_c Sensor temperature, NaN if unknown
+        */
+        [[nodiscard]] float offset_at(float temp_c) const {
+            if (!std::isfinite(temp_c)) return state.offset_v;
+            return state.offset_v + state.slope_v_per_c * (temp_c - state.ref_temp_c);
+        }
+
+        /**
+        * @brief Feed the figures of one frame. Call `seed()` or `restore()` first, windows far from the model are turned down
+        * @param pin_voltage Average sensor output voltage over the frame, in Volts
+        * @param current_avg Average current over the frame, in Amperes
+        * @param current_std Standard deviation of the current over the frame, in Amperes
+        * @param temp_c Sensor temperature, NaN if unknown
+        * @return true if the frame completed a window that was accepted and the model changed
+        */
+        bool observe(float pin_voltage, float current_avg, float current_std, float temp_c) {
+
+            if ((fabsf(current_avg) > MAX_IDLE_CURRENT_A) || (current_std > MAX_IDLE_CURRENT_STD_A) || !std::isfinite(pin_voltage)) {
+                reset_window();
+                return false;
+            }
+
+            window_voltage += pin_voltage;
+            window_temp += std::isfinite(temp_c) ? temp_c : state.ref_temp_c;
+            if (++window_frames < WINDOW_FRAMES) return false;
+
+            const float offset_v = window_voltage / window_frames;
+            const float mean_temp_c = window_temp / window_frames;
+            reset_window();
+
+            if (!explained_by_drift(offset_v, mean_temp_c)) return false;
+
+            add_window(offset_v, mean_temp_c);
+            return true;
+        }
+
+    private:
+        state_t state{};
+
+        float window_voltage{};
+        float window_temp{};
+        uint32_t window_frames{};
+
+        void reset_window() {
+            window_voltage = 0.0f;
+            window_temp = 0.0f;
+            window_frames = 0;
+        }
+
+        // The offset can move from `offset_v` by at most the largest drift times the temperature change. Whatever is left
+        // is current through the sensor
+        [[nodiscard]] bool explained_by_drift(float offset_v, float temp_c) const {
+            const float drift_v = MAX_SLOPE_V_PER_C * fabsf(temp_c - state.ref_temp_c);
+            return fabsf(offset_v - state.offset_v) <= (drift_v + MAX_WINDOW_DEVIATION_V);
+        }
+
+        void add_window(float offset_v, float temp_c) {
+
+            if (state.windows == 0) {
+                // The first window replaces the seed, a single boot measurement close to it
+                state.ref_temp_c = temp_c;
+                state.sw = state.st = state.so = state.stt = state.sto = 0.0f;
+            }
+
+            // Sums are kept around the reference temperature so the squares stay small
+            const float t = temp_c - state.ref_temp_c;
+            state.sw  = state.sw  * FORGETTING + 1.0f;
+            state.st  = state.st  * FORGETTING + t;
+            state.so  = state.so  * FORGETTING + offset_v;
+            state.stt = state.stt * FORGETTING + t * t;
+            state.sto = state.sto * FORGETTING + t * offset_v;
+            state.windows++;
+
+            const float mean_t = state.st / state.sw;
+            const float mean_o = state.so / state.sw;
+            const float var_t = (state.stt / state.sw) - (mean_t * mean_t);
+
+            if (var_t >= (MIN_TEMP_STD_C * MIN_TEMP_STD_C)) {
+                const float slope = ((state.sto / state.sw) - (mean_t * mean_o)) / var_t;
+                state.slope_v_per_c = std::clamp(slope, -MAX_SLOPE_V_PER_C, MAX_SLOPE_V_PER_C);
+            }
+
+            // Re-centre on the weighted mean temperature, where the fitted line passes through the mean offset
+            const float shift = mean_t;
+            state.ref_temp_c += shift;
+            state.stt = state.stt - 2.0f * shift * state.st + shift * shift * state.sw;
+            state.sto = state.sto - shift * state.so;
+            state.st  = state.st - shift * state.sw;
+            state.offset_v = mean_o;
+        }
+    };
+
+} // namespace adc
+
+
+#endif // _OFFSET_ESTIMATOR_HPP_
@@ -1,8 +1,15 @@
 #include "power_monitor.hpp"
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "soc/soc_caps.h"
+#include "esp_system.h"
+#include "nvs.h"
 
 #include <cstring>
+#include <cstdio>
+#include <algorithm>
 
 
 // Debug logging levels
@@ -36,29 +43,87 @@ static constexpr const char* TAG = "ADC";
 #define ADC_LOGI(...)
 #endif
 
+// Set to 1 to log the average time spent processing each sample of a DMA frame, and the processing task's unused stack
+#define ADC_PROC_PROFILING 0
+
+// Set to 1 to log the cycles per sample of the filter chains and the ripple analyser once at init
+#define ADC_DSP_BENCHMARK 0
+
+// Set to 1 to log the cycles per raw sample of the frame processor at 2, 4 and 6 channels once at init
+#define ADC_DEMUX_BENCHMARK 0
+
+#if (ADC_DSP_BENCHMARK == 1) || (ADC_DEMUX_BENCHMARK == 1)
+#include "esp_cpu.h"
+#endif
+
 
 namespace adc {
 
-    // Configuration constants
-    static constexpr uint16_t ADC_SAMPLE_RATE_HZ                = 20000;      // (20,000Hz / 2) per channel
+    // Configuration constants. These are the full rate profile; `reconfigure()` can change them at runtime
+    static constexpr uint16_t ADC_SAMPLE_RATE_HZ                = 20000;      // Shared by all channels, 10,000Hz each with 2
     static constexpr uint16_t ADC_FRAME_SIZE                    = 128;        // DMA buffer size (power of 2)
+    static constexpr uint8_t ADC_POOL_FRAMES                    = 4;          // Frames the driver's internal pool can hold
     static constexpr uint8_t TIMEOUT_MS                         = 20;         // Timeout 
 
+    // Low power profile, used while the inverter is idle. The ESP32 can't convert slower than 20kHz,
+    // so most of the saving there comes from the larger frames and from only processing one frame in ten
+    static constexpr uint16_t ADC_LOW_POWER_SAMPLE_RATE_HZ      = 2000;       // Shared by all channels, 1,000Hz each with 2
+    static constexpr uint16_t ADC_LOW_POWER_FRAME_SIZE          = 512;        // 12.8ms of samples per frame at 20kHz
+    static constexpr float WAKE_CURRENT_STEP_A                  = 0.5f;       // Change from the idle current that restores full rate
+    static constexpr int64_t LOAD_WINDOW_US                     = 1'000'000;  // Processing load measurement window
+
     // Sensor calibration constants
-    static constexpr float ACS712_20A_SENSITIVITY               = 0.1;        // 100mV/A
-    static constexpr float CURRENT_OFFSET_VOLTAGE               = 2.25;       // Volatage reading at 0A
-    static constexpr float VOLTAGE_DIVIDER_RATIO                = 5;          // 1:5 divider
+    static constexpr float CURRENT_OFFSET_VOLTAGE               = channels_t::OFFSETS[channels_t::PRIMARY_CURRENT]; // Nominal reading at 0A
     static constexpr uint8_t TIMES_TO_MEASURE_ACS_OFFSET        = 25;         // Number of times to measure ACS zero current offset voltage
-    static constexpr uint16_t ADC_RESOLUTION                    = 4096;       // 12 bits (2^12)
-    
+    static constexpr float BOOT_OFFSET_MAX_DEVIATION            = 0.03f;      // Boot measurement vs. saved model before the model wins (0.3A)
+    static constexpr uint16_t ADC_RESOLUTION                    = processor_t::ADC_RESOLUTION;
+
+    // Waveform capture defaults. Full scale of the ACS712-20A is 20A
+    static constexpr float CAPTURE_CURRENT_THRESHOLD_A          = 15;
+    static constexpr float CAPTURE_SLOPE_THRESHOLD_A_PER_MS     = 5;
+    static constexpr const char CAPTURE_FILE_FORMAT[]           = "/storage/capture_%u.bin";
+
+    // Zero current offset persistence. Saves are rate limited to spare the flash
+    static constexpr const char NVS_NAMESPACE[]                 = "adc";
+    static constexpr const char NVS_OFFSET_KEY[]                = "offset";
+    static constexpr int64_t OFFSET_SAVE_INTERVAL_US            = 10 * 60 * 1'000'000LL; // 10 minutes
+    static constexpr float OFFSET_SAVE_MIN_CHANGE_V             = 0.0005f;    // 5mA
+
+    // Storage task notification bits
+    static constexpr uint32_t CAPTURE_READY_BIT                 = 1 << 0;
+    static constexpr uint32_t OFFSET_UPDATED_BIT                = 1 << 1;
+
     // Task context
     static constexpr uint8_t PROC_TASK_PRIORITY = 8;
     static constexpr uint8_t PROC_TASK_CORE = 0;
     static constexpr uint16_t PROC_TASK_STACK_SIZE = 3072;
+    // The processing task logs its unused stack once it has processed this many frames, and warns if less than the
+    // margin is left. Size PROC_TASK_STACK_SIZE from that figure
+    static constexpr uint32_t PROC_STACK_CHECK_FRAMES = 1000;
+    static constexpr uint32_t PROC_TASK_STACK_MARGIN = 512;
+
+    static constexpr uint8_t STORAGE_TASK_PRIORITY = 1;
+    static constexpr uint8_t STORAGE_TASK_CORE = 1;
+    static constexpr uint16_t STORAGE_TASK_STACK_SIZE = 3072;
+
+    // Frames must hold whole rounds of the channel pattern for the samples to stay paired by index
+    static constexpr uint32_t PATTERN_ROUND_SIZE                = channels_t::COUNT * sizeof(adc_digi_output_data_t);
+
+    static_assert(ADC_FRAME_SIZE <= driver::MAX_FRAME_SIZE, "ADC_FRAME_SIZE exceeds MAX_FRAME_SIZE");
+    static_assert(ADC_LOW_POWER_FRAME_SIZE <= driver::MAX_FRAME_SIZE, "ADC_LOW_POWER_FRAME_SIZE exceeds MAX_FRAME_SIZE");
+    static_assert((ADC_FRAME_SIZE % PATTERN_ROUND_SIZE) == 0, "ADC_FRAME_SIZE must hold whole rounds of the channel pattern");
+    static_assert((ADC_LOW_POWER_FRAME_SIZE % PATTERN_ROUND_SIZE) == 0, "ADC_LOW_POWER_FRAME_SIZE must hold whole rounds of the channel pattern");
     
-    driver::driver(): zero_current_offset_voltage(0), adc_handle(nullptr), cali_handle(nullptr), data_mutex(nullptr), processing_task_handle(nullptr),
-                      data_ready_flag(false), sample_count(0), measurement_data{}, current_channel{},
-                      voltage_channel{}, initialized(false), running(false) {}
+    driver::driver(): adc_handle(nullptr), cali_handle(nullptr), handle_mutex(nullptr),
+                      sample_rate_hz(ADC_SAMPLE_RATE_HZ), frame_size(ADC_FRAME_SIZE), hw_sample_rate_hz(ADC_SAMPLE_RATE_HZ),
+                      frame_stride(1), low_power(false), profile_request(profile_request_t::NONE), low_power_baseline(NAN),
+                      processing_task_handle(nullptr), storage_task_handle(nullptr), measurement_data{}, last_read_generation(0),
+                      data_ready_task(nullptr), data_ready_interval_us(0), last_notified_seq(0), last_notify_us(0),
+                      windows{}, last_conv_done_us(0), publish_seq(0), charge_in_ah(0), charge_out_ah(0),
+                      energy_in_wh(0), energy_out_wh(0), last_frame_current(0), last_frame_power(0), dropped_frames_integrated(0),
+                      frames_processed(0), frames_dropped(0), max_backlog(0), load_permille(0), channels{},
+                      capture_header{}, capture_count(0), offset_state{}, zero_current_offset(NAN),
+                      offset_restored(false), initialized(false), running(false) {}
 
     driver::~driver() {
         stop();
@@ -71,26 +136,155 @@ namespace adc {
             adc_cali_delete_scheme_line_fitting(cali_handle);
             cali_handle = nullptr;
         }
-        if (data_mutex) {
-            vSemaphoreDelete(data_mutex);
-            data_mutex = nullptr;
-        }
         if (processing_task_handle) {
             vTaskDelete(processing_task_handle);
             processing_task_handle = nullptr;
         }
+        if (storage_task_handle) {
+            vTaskDelete(storage_task_handle);
+            storage_task_handle = nullptr;
+        }
+        if (handle_mutex) {
+            vSemaphoreDelete(handle_mutex);
+            handle_mutex = nullptr;
+        }
+    }
+
+#if ADC_DSP_BENCHMARK == 1
+    // Runs a chain over a synthetic rippled signal and logs the average cycles spent per input sample
+    template <typename CHAIN>
+    static void benchmark_filter_chain(const char* name) {
+
+        static constexpr uint32_t BENCH_SAMPLES = 4096;
+        CHAIN chain{};
+        int32_t out = 0;
+        int32_t sink = 0;
+
+        const uint32_t start = esp_cpu_get_cycle_count();
+        for (uint32_t n = 0; n < BENCH_SAMPLES; n++) {
+            // Triangle ripple plus a little pseudo random noise around mid scale
+            const int32_t ripple = static_cast<int32_t>(n & 127) - 64;
+            const int32_t noise = static_cast<int32_t>((n * 2654435761u) >> 29) - 4;
+            if (chain.process(2048 + ripple + noise, out)) sink += out;
+        }
+        const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+        ESP_LOGI(TAG, "%-28s %6.1f cycles/sample (decimation %lu, checksum %ld)",
+                 name, static_cast<float>(cycles) / BENCH_SAMPLES, CHAIN::DECIMATION, sink);
+    }
+
+    static void benchmark_filters() {
+        benchmark_filter_chain<filter_chain_t<>>("passthrough");
+        benchmark_filter_chain<filter_chain_t<moving_average_t<4>>>("moving_average<4>");
+        benchmark_filter_chain<filter_chain_t<moving_average_t<16>>>("moving_average<16>");
+        benchmark_filter_chain<filter_chain_t<iir_single_pole_t<3>>>("iir_single_pole<3>");
+        benchmark_filter_chain<filter_chain_t<cic_decimator_t<4, 3>>>("cic_decimator<4, 3>");
+        benchmark_filter_chain<filter_chain_t<fir_t<15, 2048, 4096, 8192, 4096, 8192, 4096, 2048>>>("fir<7 taps>");
+        benchmark_filter_chain<filter_chain_t<moving_average_t<4>, iir_single_pole_t<2>>>("moving_average<4> + iir<2>");
+        benchmark_filter_chain<current_filter_t>("current_filter_t");
+        benchmark_filter_chain<voltage_filter_t>("voltage_filter_t");
+    }
+
+    static void benchmark_ripple_analyser() {
+
+        static constexpr uint32_t BENCH_SAMPLES = 4096;
+        constexpr float sample_rate_hz = (ADC_SAMPLE_RATE_HZ / static_cast<float>(channels_t::COUNT)) / channels_t::DECIMATION;
+        goertzel_bank_t<RIPPLE_HARMONICS> bank{};
+        bank.setup(sample_rate_hz, RIPPLE_RESOLUTION_HZ, { 100.0f, 200.0f, 300.0f, 400.0f });
+
+        // Precompute the synthetic signal so only the analyser is timed
+        static float signal[256];
+        for (size_t n = 0; n < 256; n++) {
+            signal[n] = 3.0f + 1.5f * sinf(2.0f * static_cast<float>(M_PI) * RIPPLE_FUNDAMENTAL_HZ * n / sample_rate_hz);
+        }
+
+        const uint32_t start = esp_cpu_get_cycle_count();
+        for (uint32_t n = 0; n < BENCH_SAMPLES; n++) {
+            bank.process(signal[n & 255]);
+        }
+        const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+        ESP_LOGI(TAG, "%-28s %6.1f cycles/sample (%u bins)", "goertzel_bank", static_cast<float>(cycles) / BENCH_SAMPLES, RIPPLE_HARMONICS);
     }
+#endif
 
-    bool driver::init(gpio_num_t current_pin, gpio_num_t voltage_pin) {
+#if ADC_DEMUX_BENCHMARK == 1
+    // Extra channels for the benchmark lists. Same filters as the board's channels, so only the channel count changes
+    template <int GPIO>
+    using bench_voltage_t = channel_t<GPIO, channel_role_t::VOLTAGE, 5.0f, 0.0f, voltage_filter_t>;
+    template <int GPIO>
+    using bench_current_t = channel_t<GPIO, channel_role_t::CURRENT, 10.0f, 2.25f, current_filter_t>;
+
+    using bench_2_channels_t = channel_list_t<bench_current_t<36>, bench_voltage_t<37>>;
+    using bench_4_channels_t = channel_list_t<bench_current_t<36>, bench_voltage_t<37>, bench_current_t<38>, bench_voltage_t<39>>;
+    using bench_6_channels_t = channel_list_t<bench_current_t<36>, bench_voltage_t<37>, bench_current_t<38>, bench_voltage_t<39>,
+                                              bench_voltage_t<32>, bench_voltage_t<33>>;
+
+    // Runs a processor over synthetic round robin frames and logs the average cycles spent per raw sample.
+    // Must run after the calibration table is built
+    template <typename CHANNELS>
+    static void benchmark_frame_processor(const char* name) {
+
+        static constexpr uint32_t BENCH_FRAMES = 32;
+        static constexpr size_t WORDS = frame_processor_base_t::MAX_FRAME_SAMPLES - (frame_processor_base_t::MAX_FRAME_SAMPLES % CHANNELS::COUNT);
+
+        // Too big for the caller's stack
+        static frame_processor_t<CHANNELS> bench_processor;
+        static adc_digi_output_data_t frame[WORDS];
+
+        std::array<adc_channel_t, CHANNELS::COUNT> fields{};
+        for (size_t c = 0; c < CHANNELS::COUNT; c++) fields[c] = static_cast<adc_channel_t>(c);
+        bench_processor.set_channels(fields);
+        bench_processor.set_sample_rate(ADC_SAMPLE_RATE_HZ, 1);
+        bench_processor.set_capture_trigger(0, 0);
+
+        // Mid scale plus a triangle ripple and a little pseudo random noise, channels interleaved as the DMA delivers them
+        for (size_t n = 0; n < WORDS; n++) {
+            const int32_t ripple = static_cast<int32_t>((n / CHANNELS::COUNT) & 63) - 32;
+            const int32_t noise = static_cast<int32_t>((n * 2654435761u) >> 29) - 4;
+            frame[n].type1.channel = n % CHANNELS::COUNT;
+            frame[n].type1.data = static_cast<uint16_t>(2048 + ripple + noise);
+        }
+
+        data_t data{};
+        frame_processor_base_t::trigger_t trigger{};
+        const uint32_t start = esp_cpu_get_cycle_count();
+        for (uint32_t f = 0; f < BENCH_FRAMES; f++) {
+            bench_processor.process_adc_data(frame, WORDS, false, data, trigger);
+        }
+        const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+        ESP_LOGI(TAG, "%-28s %6.1f cycles/sample (checksum %.3f)",
+                 name, static_cast<float>(cycles) / (BENCH_FRAMES * WORDS), data.current_avg + data.voltage_avg);
+    }
+
+    static void benchmark_demux() {
+        benchmark_frame_processor<bench_2_channels_t>("frame_processor<2 channels>");
+        benchmark_frame_processor<bench_4_channels_t>("frame_processor<4 channels>");
+        benchmark_frame_processor<bench_6_channels_t>("frame_processor<6 channels>");
+    }
+#endif
+
+    bool driver::init() {
 
         if (initialized) {
             ADC_LOGW("Already initialized");
             return true;
         }
 
+        handle_mutex = xSemaphoreCreateMutex();
+        if (!handle_mutex) {
+            ADC_LOGE("Failed to create handle mutex");
+            return false;
+        }
+
         // Convert GPIO pins to ADC channels
-        current_channel = gpio_to_adc_channel(current_pin);
-        voltage_channel = gpio_to_adc_channel(voltage_pin);
+        std::array<adc_channel_t, channels_t::COUNT> channel_fields{};
+        for (size_t c = 0; c < channels_t::COUNT; c++) {
+            channels[c] = gpio_to_adc_channel(static_cast<gpio_num_t>(channels_t::GPIOS[c]));
+            channel_fields[c] = channels[c].channel;
+        }
+        processor.set_channels(channel_fields);
 
         // Configure ADC continuous mode
         if (!configure_adc_channels()) {
@@ -101,12 +295,22 @@ namespace adc {
         // Setup calibration
         setup_calibration();
 
-        // Create mutex
-        data_mutex = xSemaphoreCreateMutex();
-        if (!data_mutex) {
-            ADC_LOGE("Failed to create mutex");
-            return false;
-        }
+        processor.set_sample_rate(hw_sample_rate_hz, frame_stride);
+        processor.set_capture_trigger(CAPTURE_CURRENT_THRESHOLD_A, CAPTURE_SLOPE_THRESHOLD_A_PER_MS);
+
+        // Restore the zero current offset model. NVS must already be initialized
+        offset_estimator_t::state_t saved{};
+        offset_restored = load_offset_state(saved) && processor.restore_offset_state(saved);
+        if (offset_restored) offset_state.store(processor.get_offset_state());
+
+#if ADC_DSP_BENCHMARK == 1
+        benchmark_filters();
+        benchmark_ripple_analyser();
+#endif
+
+#if ADC_DEMUX_BENCHMARK == 1
+        benchmark_demux();
+#endif
 
         // Create processing task
         BaseType_t ret = xTaskCreatePinnedToCore(adc_processing_task, "adc_processing_task", PROC_TASK_STACK_SIZE, 
@@ -116,6 +320,14 @@ namespace adc {
             return false;
         }
 
+        // Create capture and offset persistence task
+        ret = xTaskCreatePinnedToCore(adc_storage_task, "adc_storage_task", STORAGE_TASK_STACK_SIZE,
+                                      this, STORAGE_TASK_PRIORITY, &storage_task_handle, STORAGE_TASK_CORE);
+        if (ret != pdPASS) {
+            ADC_LOGE("Failed to create storage task");
+            return false;
+        }
+
         initialized = true;
 
         ADC_LOGI("Initialized successfully");
@@ -126,10 +338,12 @@ namespace adc {
     bool driver::configure_adc_channels() {
 
         // ADC continuous mode configuration
-        constexpr adc_continuous_handle_cfg_t adc_config = {
-            .max_store_buf_size = ADC_FRAME_SIZE * 4,
-            .conv_frame_size = ADC_FRAME_SIZE,
-            .flags = { .flush_pool = 1 }
+        const adc_continuous_handle_cfg_t adc_config = {
+            .max_store_buf_size = frame_size.load(std::memory_order_relaxed) * ADC_POOL_FRAMES,
+            .conv_frame_size = frame_size.load(std::memory_order_relaxed),
+            // Don't flush the pool on overflow: the newest frame is dropped instead,
+            // so every `on_pool_ovf` event accounts for exactly one lost frame
+            .flags = { .flush_pool = 0 }
         };
 
         esp_err_t ret = adc_continuous_new_handle(&adc_config, &adc_handle);
@@ -138,16 +352,16 @@ namespace adc {
             return false;
         }
 
-        // Configure channels
-        adc_digi_pattern_config_t adc_pattern[2] = {
-            { .atten = ADC_ATTEN_DB_12, .channel = current_channel.channel, .unit = current_channel.unit, .bit_width = ADC_BITWIDTH_12 },
-            { .atten = ADC_ATTEN_DB_12, .channel = voltage_channel.channel, .unit = voltage_channel.unit, .bit_width = ADC_BITWIDTH_12 }
-        };
+        // Configure channels, one pattern entry each in channel list order
+        adc_digi_pattern_config_t adc_pattern[channels_t::COUNT] = {};
+        for (size_t c = 0; c < channels_t::COUNT; c++) {
+            adc_pattern[c] = { .atten = ADC_ATTEN_DB_12, .channel = channels[c].channel, .unit = channels[c].unit, .bit_width = ADC_BITWIDTH_12 };
+        }
 
         adc_continuous_config_t dig_cfg = {
-            .pattern_num = 2,
+            .pattern_num = channels_t::COUNT,
             .adc_pattern = adc_pattern,
-            .sample_freq_hz = ADC_SAMPLE_RATE_HZ,
+            .sample_freq_hz = hw_sample_rate_hz,
             .conv_mode = ADC_CONV_SINGLE_UNIT_1,
             .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1
         };
@@ -161,7 +375,7 @@ namespace adc {
         // Register callback
         constexpr adc_continuous_evt_cbs_t cbs = {
             .on_conv_done = adc_conv_done_callback,
-            .on_pool_ovf = nullptr
+            .on_pool_ovf = adc_pool_ovf_callback
         };
 
         ret = adc_continuous_register_event_callbacks(adc_handle, &cbs, this);
@@ -187,6 +401,23 @@ namespace adc {
             ADC_LOGW("Calibration failed, using default");
             cali_handle = nullptr;
         }
+
+        processor.set_calibration(cali_raw_to_millivolts, this);
+    }
+
+    int driver::cali_raw_to_millivolts(uint32_t raw, void* ctx) {
+
+        auto driver = static_cast<adc::driver*>(ctx);
+        int voltage_mv = 0;
+
+        if (driver->cali_handle) {
+            adc_cali_raw_to_voltage(driver->cali_handle, raw, &voltage_mv);
+        } else {
+            // Fallback: linear conversion
+            voltage_mv = (raw * 3300) / ADC_RESOLUTION;
+        }
+
+        return voltage_mv;
     }
     
     adc_channel_config_t driver::gpio_to_adc_channel(gpio_num_t pin) {
@@ -245,202 +476,713 @@ namespace adc {
         return true;
     }
 
+    bool driver::reconfigure(uint32_t new_sample_rate_hz, uint32_t new_frame_size) {
+
+        if (!initialized) {
+            ADC_LOGE("ADC not yet initialized");
+            return false;
+        }
+
+        if ((new_frame_size == 0) || (new_frame_size > MAX_FRAME_SIZE) || ((new_frame_size % PATTERN_ROUND_SIZE) != 0)) {
+            ADC_LOGE("Invalid frame size: %lu bytes", new_frame_size);
+            return false;
+        }
+
+        if ((new_sample_rate_hz == 0) || (new_sample_rate_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH)) {
+            ADC_LOGE("Invalid sample rate: %luHz", new_sample_rate_hz);
+            return false;
+        }
+
+        if (xSemaphoreTake(handle_mutex, portMAX_DELAY) != pdTRUE) {
+            ADC_LOGE("Failed to take handle mutex");
+            return false;
+        }
+
+        const bool was_running = running;
+        if (running) stop();
+
+        adc_continuous_deinit(adc_handle);
+        adc_handle = nullptr;
+
+        const uint32_t old_sample_rate_hz = sample_rate_hz.load(std::memory_order_relaxed);
+        const uint32_t old_frame_size = frame_size.load(std::memory_order_relaxed);
+
+        auto apply = [this](uint32_t rate_hz, uint32_t size) {
+            // Rates the converter can't reach are emulated by skipping whole frames
+            hw_sample_rate_hz = std::clamp<uint32_t>(rate_hz, SOC_ADC_SAMPLE_FREQ_THRES_LOW, SOC_ADC_SAMPLE_FREQ_THRES_HIGH);
+            frame_stride = std::max<uint32_t>(1, hw_sample_rate_hz / rate_hz);
+            sample_rate_hz.store(hw_sample_rate_hz / frame_stride, std::memory_order_relaxed);
+            frame_size.store(size, std::memory_order_relaxed);
+            return configure_adc_channels();
+        };
+
+        bool ok = apply(new_sample_rate_hz, new_frame_size);
+        if (!ok) {
+            ADC_LOGE("Failed to apply %luHz / %lu bytes, restoring previous settings", new_sample_rate_hz, new_frame_size);
+            if (adc_handle) {
+                adc_continuous_deinit(adc_handle);
+                adc_handle = nullptr;
+            }
+            apply(old_sample_rate_hz, old_frame_size);
+        }
+
+        processor.set_sample_rate(hw_sample_rate_hz, frame_stride);
+
+        if (was_running && !start()) ok = false;
+
+        xSemaphoreGive(handle_mutex);
+
+        return ok;
+    }
+
+    void driver::request_low_power(bool enable) {
+        profile_request.store(enable ? profile_request_t::LOW_POWER : profile_request_t::FULL_RATE, std::memory_order_relaxed);
+    }
+
+    bool driver::set_low_power(bool enable) {
+
+        // Only called from the processing task, which owns `low_power_baseline`
+        if (!enable) {
+            low_power.store(false, std::memory_order_relaxed);
+            return reconfigure(ADC_SAMPLE_RATE_HZ, ADC_FRAME_SIZE);
+        }
+
+        if (!reconfigure(ADC_LOW_POWER_SAMPLE_RATE_HZ, ADC_LOW_POWER_FRAME_SIZE)) return false;
+
+        low_power_baseline = NAN;
+        low_power.store(true, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    bool driver::is_low_power() {
+        return low_power.load(std::memory_order_relaxed);
+    }
+
     bool driver::adc_conv_done_callback(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* edata, void* user_data) {
         auto driver = static_cast<adc::driver*>(user_data);
         if (!driver || !driver->processing_task_handle) return false;
+        driver->last_conv_done_us.store(static_cast<uint32_t>(esp_timer_get_time()), std::memory_order_relaxed);
         BaseType_t higher_priority_task_woken = pdFALSE;
         vTaskNotifyGiveFromISR(driver->processing_task_handle, &higher_priority_task_woken);
         return higher_priority_task_woken == pdTRUE;
     }
 
+    bool driver::adc_pool_ovf_callback(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* edata, void* user_data) {
+        auto driver = static_cast<adc::driver*>(user_data);
+        if (!driver) return false;
+        driver->frames_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
     void driver::adc_processing_task(void* arg) {
 
         auto driver = static_cast<adc::driver*>(arg);
-        uint8_t result[ADC_FRAME_SIZE] = {};
+        uint8_t* result = driver->read_buffer.data();
         uint32_t out_length = 0;
 
-        // Calculate the ACS712 zero current offset voltage at startup
-        {
-            if (!driver->running) driver->start();
+        if (!driver->running) driver->start();
 
-            std::array<float, TIMES_TO_MEASURE_ACS_OFFSET> current{};
+        // A warm boot reuses the saved offset model, which skips the boot calibration and gets the first reading out sooner
+        if (driver->offset_restored && is_warm_boot()) {
+            ADC_LOGI("Warm boot, reusing saved zero current offset");
+        } else {
+            driver->calibrate_offset_at_boot();
+        }
+        driver->zero_current_offset.store(driver->processor.get_zero_current_offset(), std::memory_order_relaxed);
+        ADC_LOGI("Zero current offset voltage = %.3fV", driver->processor.get_zero_current_offset());
 
-            for (uint8_t times = 0; times < TIMES_TO_MEASURE_ACS_OFFSET; times++) {
-                // Block till notification received from ISR
-                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#if ADC_PROC_PROFILING == 1
+        int64_t prof_time_us = 0;
+        uint32_t prof_samples = 0;
+        uint32_t prof_frames = 0;
+#endif
 
-                esp_err_t ret = adc_continuous_read(driver->adc_handle, result, ADC_FRAME_SIZE, &out_length, TIMEOUT_MS);
-                if (ret == ESP_OK && out_length > 0) {
-                    auto adc_raw_data_output = reinterpret_cast<adc_digi_output_data_t*>(result);
-                    uint16_t num_samples = out_length / sizeof(adc_digi_output_data_t);
-                    uint16_t current_idx = 0;
+        uint32_t stack_check_frames = 0;
 
-                    for (size_t i = 0; (i < num_samples) && (i < MAX_BUFFER_SIZE); i++) {
-                        if (adc_raw_data_output[i].type1.channel == driver->current_channel.channel) {
-                            driver->current_samples[current_idx++] = driver->raw_to_voltage(adc_raw_data_output[i].type1.data, driver->cali_handle);
-                        }
+        // Processing load bookkeeping, restarted whenever the sample rate changes
+        int64_t load_window_start_us = esp_timer_get_time();
+        int64_t load_busy_us = 0;
+        uint32_t load_sample_rate_hz = driver->sample_rate_hz.load(std::memory_order_relaxed);
+
+        uint32_t frame_phase = 0;
+
+        while (1) {
+            // Block till notification received from ISR
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+            const int64_t busy_start_us = esp_timer_get_time();
+
+            xSemaphoreTake(driver->handle_mutex, portMAX_DELAY);
+
+            // Drain every frame waiting in the pool, not only the one that woke us up,
+            // so a late wake-up costs latency instead of samples
+            uint32_t backlog = 0;
+            const uint32_t length = driver->frame_size.load(std::memory_order_relaxed);
+            while (adc_continuous_read(driver->adc_handle, result, length, &out_length, 0) == ESP_OK) {
+                if (out_length == 0) break;
+                backlog++;
+
+                // Every frame goes into the capture ring so captures stay contiguous at the hardware rate
+                driver->capture.push(reinterpret_cast<const uint16_t*>(result), out_length / sizeof(adc_digi_output_data_t));
+
+                // Below the hardware's minimum rate only one frame in `frame_stride` is processed.
+                // The charge integral still covers the others, at the last processed frame's current
+                if (++frame_phase < driver->frame_stride) {
+                    driver->integrate_charge(out_length / sizeof(adc_digi_output_data_t));
+                    continue;
+                }
+                frame_phase = 0;
+
+#if ADC_PROC_PROFILING == 1
+                int64_t start = esp_timer_get_time();
+#endif
+
+                driver->process_adc_data(result, out_length);
+
+                if ((stack_check_frames < PROC_STACK_CHECK_FRAMES) && (++stack_check_frames == PROC_STACK_CHECK_FRAMES)) {
+                    const UBaseType_t unused = uxTaskGetStackHighWaterMark(nullptr);
+                    if (unused < PROC_TASK_STACK_MARGIN) {
+                        ADC_LOGW("Processing task left only %u of %u bytes of stack unused", unused, PROC_TASK_STACK_SIZE);
+                    } else {
+                        ADC_LOGI("Processing task left %u of %u bytes of stack unused", unused, PROC_TASK_STACK_SIZE);
                     }
-                    current[times] = driver->calculate_average(driver->current_samples);
+                }
 
-                    driver->current_samples.fill(0.0f);
+#if ADC_PROC_PROFILING == 1
+                prof_time_us += esp_timer_get_time() - start;
+                prof_samples += out_length / sizeof(adc_digi_output_data_t);
+                prof_frames++;
+                if (prof_frames >= 100) {
+                    ESP_LOGI(TAG, "Average processing time: %.1fns/sample, %.2fus/frame, %u bytes of stack never used",
+                             (prof_time_us * 1000.0f) / prof_samples, static_cast<float>(prof_time_us) / prof_frames,
+                             uxTaskGetStackHighWaterMark(nullptr));
+                    prof_time_us = 0;
+                    prof_samples = 0;
+                    prof_frames = 0;
                 }
+#endif
             }
-            float current_avg = 0;
-            for (size_t i = 0; i < TIMES_TO_MEASURE_ACS_OFFSET; i++) {
-                current_avg += current[i];
+
+            // Frames the pool lost still took time, so they count towards the charge integral as well.
+            // Still under the mutex, so they're integrated at the rate they were sampled at
+            const uint32_t dropped = driver->frames_dropped.load(std::memory_order_relaxed);
+            if (dropped != driver->dropped_frames_integrated) {
+                driver->integrate_charge((dropped - driver->dropped_frames_integrated) * (length / sizeof(adc_digi_output_data_t)));
+                driver->dropped_frames_integrated = dropped;
             }
-            current_avg /= TIMES_TO_MEASURE_ACS_OFFSET;
 
-            driver->zero_current_offset_voltage = (current_avg > 1.5f && current_avg < 3.0f) ? current_avg : CURRENT_OFFSET_VOLTAGE;
-            ADC_LOGI("Zero current offset voltage = %.3fV", driver->zero_current_offset_voltage);
+            xSemaphoreGive(driver->handle_mutex);
+
+            // Only once the backlog is drained, so the consumer gets the latest measurement
+            driver->notify_data_ready();
+
+            // Hand a completed capture over to be written out. Repeats are harmless, the storage task checks the ring state
+            if (driver->capture.is_frozen() && driver->storage_task_handle) {
+                xTaskNotify(driver->storage_task_handle, CAPTURE_READY_BIT, eSetBits);
+            }
+
+            driver->frames_processed.fetch_add(backlog, std::memory_order_relaxed);
+            if (backlog > driver->max_backlog.load(std::memory_order_relaxed)) {
+                driver->max_backlog.store(backlog, std::memory_order_relaxed);
+            }
+
+            // Profile changes are only applied here, between frames, so nothing else touches the low power state.
+            // A request that fails is dropped; whoever asked for it asks again if it still applies
+            const profile_request_t request = driver->profile_request.exchange(profile_request_t::NONE, std::memory_order_relaxed);
+            if ((request == profile_request_t::LOW_POWER) && !driver->low_power.load(std::memory_order_relaxed)) {
+                if (!driver->set_low_power(true)) {
+                    ADC_LOGE("Failed to switch to low power sampling");
+                }
+            } else if ((request == profile_request_t::FULL_RATE) && driver->low_power.load(std::memory_order_relaxed)) {
+                if (!driver->set_low_power(false)) {
+                    ADC_LOGE("Failed to restore full rate sampling");
+                }
+            }
+
+            const int64_t now_us = esp_timer_get_time();
+            const uint32_t rate_hz = driver->sample_rate_hz.load(std::memory_order_relaxed);
+            if (rate_hz != load_sample_rate_hz) {
+                load_sample_rate_hz = rate_hz;
+                load_window_start_us = now_us;
+                load_busy_us = 0;
+                continue;
+            }
+
+            load_busy_us += now_us - busy_start_us;
+            if ((now_us - load_window_start_us) >= LOAD_WINDOW_US) {
+                driver->load_permille.store(static_cast<uint32_t>((load_busy_us * 1000) / (now_us - load_window_start_us)),
+                                            std::memory_order_relaxed);
+                load_window_start_us = now_us;
+                load_busy_us = 0;
+            }
         }
+    }
 
-        while (1) {
+    void driver::calibrate_offset_at_boot() {
+
+        uint8_t* result = read_buffer.data();
+        uint32_t out_length = 0;
+        float current_sum = 0;
+        uint8_t current_frames = 0;
+
+        for (uint8_t times = 0; times < TIMES_TO_MEASURE_ACS_OFFSET; times++) {
             // Block till notification received from ISR
             ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-            // Read ADC data
-            esp_err_t ret = adc_continuous_read(driver->adc_handle, result, ADC_FRAME_SIZE, &out_length, TIMEOUT_MS);
+            xSemaphoreTake(handle_mutex, portMAX_DELAY);
+            esp_err_t ret = adc_continuous_read(adc_handle, result, ADC_FRAME_SIZE, &out_length, TIMEOUT_MS);
+            xSemaphoreGive(handle_mutex);
             if (ret == ESP_OK && out_length > 0) {
-                driver->process_adc_data(result, out_length);
+                const float frame_avg = processor.current_channel_voltage(reinterpret_cast<adc_digi_output_data_t*>(result),
+                                                                          out_length / sizeof(adc_digi_output_data_t));
+                // Failed reads and frames without current samples are left out rather than averaged in as 0V
+                if (!std::isnan(frame_avg)) {
+                    current_sum += frame_avg;
+                    current_frames++;
+                }
             }
         }
+        const float current_avg = (current_frames > 0) ? (current_sum / current_frames) : NAN;
+
+        const float boot_offset = (current_avg > 1.5f && current_avg < 3.0f) ? current_avg : CURRENT_OFFSET_VOLTAGE;
+
+        if (!offset_restored) {
+            processor.seed_offset(boot_offset);
+            return;
+        }
+
+        // A load connected at power-up skews the boot measurement, so a saved model that disagrees with it wins.
+        // Either way the model itself is kept; the next idle window refines it
+        if (fabsf(boot_offset - processor.predicted_offset()) <= BOOT_OFFSET_MAX_DEVIATION) {
+            processor.set_zero_current_offset(boot_offset);
+        } else {
+            ADC_LOGW("Boot offset %.3fV disagrees with the saved model (%.3fV), keeping the model", boot_offset, processor.predicted_offset());
+        }
     }
 
     void driver::process_adc_data(uint8_t* buffer, uint32_t length) {
 
-        auto adc_raw_data_output = reinterpret_cast<adc_digi_output_data_t*>(buffer);
-        uint16_t num_samples = length / sizeof(adc_digi_output_data_t);
-        size_t voltage_idx = 0, current_idx = 0;
+        data_t data{};
+        processor_t::trigger_t trigger{};
+
+        const uint32_t num_samples = length / sizeof(adc_digi_output_data_t);
 
-        for (size_t i = 0; (i < num_samples) && (i < MAX_BUFFER_SIZE); i++) {
-            if (adc_raw_data_output[i].type1.channel == current_channel.channel) {
-                current_samples[current_idx++] = raw_to_voltage(adc_raw_data_output[i].type1.data, cali_handle);
-            } else if (adc_raw_data_output[i].type1.channel == voltage_channel.channel) {
-                voltage_samples[voltage_idx++] = raw_to_voltage(adc_raw_data_output[i].type1.data, cali_handle);
+        if (!processor.process_adc_data(reinterpret_cast<const adc_digi_output_data_t*>(buffer), num_samples,
+                                        capture.is_armed(), data, trigger)) {
+            integrate_charge(num_samples);
+            return;
+        }
+
+        last_frame_current = data.current_avg;
+        last_frame_power = data.real_power;
+        integrate_charge(num_samples);
+
+        if (trigger.fired) trigger_capture(trigger);
+
+        if (processor.take_offset_update()) {
+            offset_state.store(processor.get_offset_state());
+            zero_current_offset.store(processor.get_zero_current_offset(), std::memory_order_relaxed);
+            if (storage_task_handle) xTaskNotify(storage_task_handle, OFFSET_UPDATED_BIT, eSetBits);
+        }
+
+        // A current step while in low power means the inverter woke up
+        if (low_power.load(std::memory_order_relaxed)) {
+            if (std::isnan(low_power_baseline)) {
+                low_power_baseline = data.current_avg;
+            } else if (fabsf(data.current_avg - low_power_baseline) > WAKE_CURRENT_STEP_A) {
+                request_low_power(false);
             }
         }
 
-        // Use sample count with lower count
-        sample_count = (current_idx < voltage_idx) ? current_idx : voltage_idx;
-        update_measurements();
-        sample_count = 0;
+        // Roll the frame's statistics into the window the readers see. A read racing with this frame leaves the
+        // window running, so the next read overlaps the previous one rather than missing a peak
+        if (measurement_data.get_generation() == last_read_generation.load(std::memory_order_relaxed)) {
+            for (auto& window : windows) window.reset();
+        }
+        for (size_t c = 0; c < channels_t::COUNT; c++) {
+            windows[c].merge(data.channels[c].window);
+            data.channels[c].window = windows[c];
+        }
+        data.current_window = windows[channels_t::PRIMARY_CURRENT];
+        data.voltage_window = windows[channels_t::PRIMARY_VOLTAGE];
+        data.charge_in_ah = charge_in_ah;
+        data.charge_out_ah = charge_out_ah;
+        data.energy_in_wh = energy_in_wh;
+        data.energy_out_wh = energy_out_wh;
+
+        // Frames are read in order right after their interrupt, so the last interrupt time stands in for the frame's.
+        // It's at most a frame late if the next frame completed in the meantime
+        const int64_t now_us = esp_timer_get_time();
+        data.timestamp_us = now_us - static_cast<uint32_t>(static_cast<uint32_t>(now_us) - last_conv_done_us.load(std::memory_order_relaxed));
+        data.seq = ++publish_seq;
+
+        // Publish shared data. Never waits on readers
+        measurement_data.store(data);
     }
 
-    float driver::raw_to_voltage(uint32_t raw, adc_cali_handle_t cali_handle) {
+    void driver::notify_data_ready() {
 
-        int voltage_mv = 0;
+        TaskHandle_t task = data_ready_task.load(std::memory_order_acquire);
+        if (!task || (publish_seq == last_notified_seq)) return;
 
-        if (cali_handle) {
-            adc_cali_raw_to_voltage(cali_handle, raw, &voltage_mv);
+        const int64_t now_us = esp_timer_get_time();
+        if ((now_us - last_notify_us) < data_ready_interval_us.load(std::memory_order_relaxed)) return;
+
+        xTaskNotifyGive(task);
+        last_notified_seq = publish_seq;
+        last_notify_us = now_us;
+    }
+
+    void driver::integrate_charge(uint32_t num_samples) {
+
+        // The frame's duration comes from the sample count, which is exact, unlike the time the frame got processed
+        const double hours = static_cast<double>(num_samples) / (static_cast<double>(hw_sample_rate_hz) * 3600.0);
+        const double ah = static_cast<double>(last_frame_current) * hours;
+        if (ah >= 0.0) {
+            charge_out_ah += ah;
         } else {
-            // Fallback: linear conversion
-            voltage_mv = (raw * 3300) / ADC_RESOLUTION;
+            charge_in_ah -= ah;
+        }
+        const double wh = static_cast<double>(last_frame_power) * hours;
+        if (wh >= 0.0) {
+            energy_out_wh += wh;
+        } else {
+            energy_in_wh -= wh;
         }
+    }
+
+    void driver::trigger_capture(const processor_t::trigger_t& trigger) {
+
+        // The header is only read once the ring freezes, and the ring is armed, so nothing is reading it now
+        capture_header = capture_header_t{
+            .magic = CAPTURE_MAGIC,
+            .sequence = 0,
+            .timestamp_us = esp_timer_get_time(),
+            .sample_rate_hz = hw_sample_rate_hz,
+            .sample_count = 0,
+            .trigger_index = 0,
+            .trigger_current = trigger.current,
+            .zero_current_offset_voltage = processor.get_zero_current_offset(),
+            .current_channel = static_cast<uint8_t>(channels[channels_t::PRIMARY_CURRENT].channel),
+            .voltage_channel = static_cast<uint8_t>(channels[channels_t::PRIMARY_VOLTAGE].channel),
+            .reason = trigger.reason,
+            .channel_count = static_cast<uint8_t>(channels_t::COUNT)
+        };
+
+        capture.trigger(trigger.words_ago);
+    }
+
+    // Reads only the header of a stored capture
+    static bool read_capture_header(uint8_t slot, capture_header_t& header) {
+
+        char path[32]{};
+        snprintf(path, sizeof(path), CAPTURE_FILE_FORMAT, slot);
+
+        FILE* file = fopen(path, "rb");
+        if (!file) return false;
 
-        return static_cast<float>(voltage_mv) / 1000.0f;
+        const bool ok = (fread(&header, sizeof(header), 1, file) == 1) && (header.magic == CAPTURE_MAGIC);
+        fclose(file);
+
+        return ok;
     }
 
-    template <typename T>
-    float driver::calculate_average(const std::array<T, MAX_BUFFER_SIZE>& samples) {
+    bool driver::persist_capture() {
+
+        const uint32_t sequence = capture_count.load(std::memory_order_relaxed);
+        const uint8_t slot = sequence % MAX_CAPTURE_FILES;
+
+        char path[32]{};
+        snprintf(path, sizeof(path), CAPTURE_FILE_FORMAT, slot);
+
+        FILE* file = fopen(path, "wb");
+        if (!file) {
+            ADC_LOGE("Failed to open %s", path);
+            return false;
+        }
+
+        capture_header.sequence = sequence;
+        capture_header.sample_count = capture.size();
+        capture_header.trigger_index = capture.trigger_index();
+
+        // The ring is written oldest sample first, straight from its storage
+        const auto& ring = capture.data();
+        const size_t first = capture.first_slot();
+        const size_t count = capture.size();
+        const size_t head_part = std::min(count, ring.size() - first);
+
+        bool ok = fwrite(&capture_header, sizeof(capture_header), 1, file) == 1;
+        ok = ok && (fwrite(&ring[first], sizeof(uint16_t), head_part, file) == head_part);
+        ok = ok && (fwrite(&ring[0], sizeof(uint16_t), count - head_part, file) == (count - head_part));
+        fclose(file);
+
+        if (!ok) {
+            ADC_LOGE("Failed to write %s", path);
+            return false;
+        }
+
+        capture_count.store(sequence + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    void driver::adc_storage_task(void* arg) {
+
+        auto driver = static_cast<adc::driver*>(arg);
+        bool count_restored = false;
+
+        // Offset saves wait out the rest of the interval instead of being dropped
+        bool offset_save_pending = false;
+        int64_t last_offset_save_us = -OFFSET_SAVE_INTERVAL_US;
+        float saved_offset = NAN;
+        float saved_slope = NAN;
+
+        while (1) {
+            TickType_t wait = portMAX_DELAY;
+            if (offset_save_pending) {
+                const int64_t remaining_us = OFFSET_SAVE_INTERVAL_US - (esp_timer_get_time() - last_offset_save_us);
+                wait = (remaining_us > 0) ? pdMS_TO_TICKS(remaining_us / 1000) + 1 : 0;
+            }
+
+            // Block till the processing task reports a frozen capture or a new offset model
+            uint32_t bits = 0;
+            xTaskNotifyWait(0, UINT32_MAX, &bits, wait);
+
+            if ((bits & CAPTURE_READY_BIT) && driver->capture.is_frozen()) {
+                // The storage partition is mounted after the driver starts, so earlier captures are only counted on first use
+                if (!count_restored) {
+                    uint32_t next_sequence = 0;
+                    capture_header_t header{};
+                    for (uint8_t slot = 0; slot < MAX_CAPTURE_FILES; slot++) {
+                        if (read_capture_header(slot, header) && (header.sequence >= next_sequence)) {
+                            next_sequence = header.sequence + 1;
+                        }
+                    }
+                    driver->capture_count.store(next_sequence, std::memory_order_relaxed);
+                    count_restored = true;
+                }
+
+                if (!driver->persist_capture()) {
+                    ADC_LOGE("Failed to persist waveform capture");
+                }
+
+                driver->capture.rearm();
+            }
 
-        float sum = 0.0f;
-        for (size_t i = 0; i < sample_count; i++) {
-            sum += samples[i];
+            if (bits & OFFSET_UPDATED_BIT) offset_save_pending = true;
+
+            if (offset_save_pending && ((esp_timer_get_time() - last_offset_save_us) >= OFFSET_SAVE_INTERVAL_US)) {
+                offset_estimator_t::state_t state{};
+                driver->offset_state.load(state);
+
+                // Skip saves that wouldn't change the stored model in any way that matters
+                if (std::isnan(saved_offset) || (fabsf(state.offset_v - saved_offset) >= OFFSET_SAVE_MIN_CHANGE_V) ||
+                    (state.slope_v_per_c != saved_slope)) {
+                    if (save_offset_state(state)) {
+                        saved_offset = state.offset_v;
+                        saved_slope = state.slope_v_per_c;
+                    } else {
+                        ADC_LOGE("Failed to save zero current offset");
+                    }
+                }
+                last_offset_save_us = esp_timer_get_time();
+                offset_save_pending = false;
+            }
         }
+    }
+
+    bool driver::load_offset_state(offset_estimator_t::state_t& state) {
+
+        nvs_handle_t handle{};
+        if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return false;
+
+        size_t length = sizeof(state);
+        const esp_err_t ret = nvs_get_blob(handle, NVS_OFFSET_KEY, &state, &length);
+        nvs_close(handle);
 
-        return sum / sample_count;
+        return (ret == ESP_OK) && (length == sizeof(state));
     }
 
-    void driver::update_measurements() {
+    bool driver::save_offset_state(const offset_estimator_t::state_t& state) {
 
-        // Calculate voltage
-        float voltage = calculate_average(voltage_samples);
-        voltage *= VOLTAGE_DIVIDER_RATIO;
+        nvs_handle_t handle{};
+        esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+        if (ret != ESP_OK) {
+            ADC_LOGE("Failed to open NVS namespace: %s", esp_err_to_name(ret));
+            return false;
+        }
 
-        // Calculate current
-        float current = calculate_average(current_samples);
-        current -= zero_current_offset_voltage;
-        current /= ACS712_20A_SENSITIVITY;
+        ret = nvs_set_blob(handle, NVS_OFFSET_KEY, &state, sizeof(state));
+        if (ret == ESP_OK) ret = nvs_commit(handle);
+        nvs_close(handle);
 
-        // Update shared data
-        if (xSemaphoreTake(data_mutex, pdMS_TO_TICKS(TIMEOUT_MS)) == pdTRUE) {
-            measurement_data.current_avg = current;
-            measurement_data.voltage_avg = voltage;
-            measurement_data.apparent_power = voltage * current;
-            measurement_data.valid = true;
-            data_ready_flag = true;
-            xSemaphoreGive(data_mutex);
+        if (ret != ESP_OK) {
+            ADC_LOGE("Failed to write NVS: %s", esp_err_to_name(ret));
+            return false;
         }
 
-        // Clear arrays for next cycle
-        current_samples.fill(0.0f);
-        voltage_samples.fill(0.0f);
+        return true;
+    }
+
+    bool driver::is_warm_boot() {
+
+        // Any reset that didn't cut the power leaves the sensor where it was
+        switch (esp_reset_reason()) {
+            case ESP_RST_SW:
+            case ESP_RST_PANIC:
+            case ESP_RST_INT_WDT:
+            case ESP_RST_TASK_WDT:
+            case ESP_RST_WDT:
+            case ESP_RST_DEEPSLEEP:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void driver::set_temperature(float celsius) {
+        processor.set_temperature(celsius);
+    }
+
+    float driver::get_zero_current_offset() {
+        return zero_current_offset.load(std::memory_order_relaxed);
+    }
+
+    void driver::set_capture_trigger(float current_a, float slope_a_per_ms) {
+        processor.set_capture_trigger(current_a, slope_a_per_ms);
+    }
+
+    uint32_t driver::get_capture_count() {
+        return capture_count.load(std::memory_order_relaxed);
+    }
+
+    bool driver::load_capture(uint8_t slot, capture_header_t& header, std::array<uint16_t, capture_t::LENGTH>& samples) {
+
+        if (slot >= MAX_CAPTURE_FILES) return false;
+
+        char path[32]{};
+        snprintf(path, sizeof(path), CAPTURE_FILE_FORMAT, slot);
+
+        FILE* file = fopen(path, "rb");
+        if (!file) return false;
+
+        const bool ok = (fread(&header, sizeof(header), 1, file) == 1) && (header.magic == CAPTURE_MAGIC) &&
+                        (header.sample_count <= samples.size()) &&
+                        (fread(samples.data(), sizeof(uint16_t), header.sample_count, file) == header.sample_count);
+        fclose(file);
+
+        return ok;
     }
 
     float driver::get_voltage_avg() {
 
-        float value = NAN;
+        data_t data{};
 
-        if (xSemaphoreTake(data_mutex, pdMS_TO_TICKS(TIMEOUT_MS)) == pdTRUE) {
-            if(measurement_data.valid) {
-                value = measurement_data.voltage_avg;
-            }
-            xSemaphoreGive(data_mutex);
+        measurement_data.load(data);
+        if (!data.valid) {
+            return NAN;
         }
-        return value;
+        return data.voltage_avg;
     }
 
     float driver::get_current_avg() {
 
-        float value = NAN;
+        data_t data{};
 
-        if (xSemaphoreTake(data_mutex, pdMS_TO_TICKS(TIMEOUT_MS)) == pdTRUE) {
-            if(measurement_data.valid) {
-                value = measurement_data.current_avg;
-            }
-            xSemaphoreGive(data_mutex);
+        measurement_data.load(data);
+        if (!data.valid) {
+            return NAN;
         }
-        return value;
+        return data.current_avg;
     }
 
     float driver::get_apparent_power() {
 
-        float value = NAN;
+        data_t data{};
 
-        if (xSemaphoreTake(data_mutex, pdMS_TO_TICKS(TIMEOUT_MS)) == pdTRUE) {
-            if(measurement_data.valid) {
-                value = measurement_data.apparent_power;
-            }
-            xSemaphoreGive(data_mutex);
+        measurement_data.load(data);
+        if (!data.valid) {
+            return NAN;
         }
-        return value;
+        return data.apparent_power;
     }
 
-    bool driver::get_measurement_data(data_t& data) {
+    float driver::get_current_rms() {
 
-        bool success = false;
+        data_t data{};
 
-        if (xSemaphoreTake(data_mutex, pdMS_TO_TICKS(TIMEOUT_MS)) == pdTRUE) {
-            if(measurement_data.valid) {
-                data = measurement_data;
-                success = true;
-                data_ready_flag = false;  // Clear flag after read
-            }
-            xSemaphoreGive(data_mutex);
+        measurement_data.load(data);
+        if (!data.valid) {
+            return NAN;
         }
-        return success;
+        return data.current_rms;
     }
 
-    bool driver::is_data_ready() {
+    float driver::get_voltage_rms() {
 
-        bool ready = false;
+        data_t data{};
 
-        if (xSemaphoreTake(data_mutex, pdMS_TO_TICKS(TIMEOUT_MS)) == pdTRUE) {
-            ready = data_ready_flag;
-            xSemaphoreGive(data_mutex);
+        measurement_data.load(data);
+        if (!data.valid) {
+            return NAN;
         }
-        return ready;
+        return data.voltage_rms;
+    }
+
+    float driver::get_real_power() {
+
+        data_t data{};
+
+        measurement_data.load(data);
+        if (!data.valid) {
+            return NAN;
+        }
+        return data.real_power;
+    }
+
+    float driver::get_power_factor() {
+
+        data_t data{};
+
+        measurement_data.load(data);
+        if (!data.valid) {
+            return NAN;
+        }
+        return data.power_factor;
+    }
+
+    bool driver::get_measurement_data(data_t& data) {
+
+        uint32_t generation = 0;
+
+        measurement_data.load(data, generation);
+        if (!data.valid) {
+            return false;
+        }
+        last_read_generation.store(generation, std::memory_order_relaxed);  // Clear ready state after read
+        return true;
+    }
+
+    stats_t driver::get_stats() {
+        return stats_t{
+            .frames_processed = frames_processed.load(std::memory_order_relaxed),
+            .frames_dropped = frames_dropped.load(std::memory_order_relaxed),
+            .max_backlog = max_backlog.load(std::memory_order_relaxed),
+            .sample_rate_hz = sample_rate_hz.load(std::memory_order_relaxed),
+            .frame_size = frame_size.load(std::memory_order_relaxed),
+            .load_permille = load_permille.load(std::memory_order_relaxed),
+            .low_power = low_power.load(std::memory_order_relaxed)
+        };
+    }
+
+    bool driver::is_data_ready() {
+        return measurement_data.get_generation() != last_read_generation.load(std::memory_order_relaxed);
+    }
+
+    void driver::set_data_ready_task(TaskHandle_t task, uint32_t min_interval_us) {
+        data_ready_interval_us.store(min_interval_us, std::memory_order_relaxed);
+        data_ready_task.store(task, std::memory_order_release);
     }
 
 } // namespace adc
@@ -11,21 +11,51 @@
 #include "esp_adc/adc_cali_scheme.h"
 #include "driver/gpio.h"
 
+#include "config.hpp"
+#include "seqlock.hpp"
+#include "channels.hpp"
+#include "frame_processor.hpp"
+#include "capture.hpp"
+
 #include <cstdint>
 #include <cmath>
 #include <array>
+#include <atomic>
 
 
 namespace adc {
 
     /**
-    * @brief Measurement data structure
+    * @brief Channels sampled on this board, in ADC pattern order. All pins must be ADC1 pins.
+    * Scales and offsets convert Volts at the pin to Amperes or Volts. The current channel's offset is only used until
+    * the zero current offset has been measured
+    */
+    using channels_t = channel_list_t<
+        channel_t<config::CURRENT_SENSOR_PIN, channel_role_t::CURRENT, 10.0f, 2.25f, current_filter_t>,    // ACS712-20A, 100mV/A
+        channel_t<config::VOLTAGE_SENSOR_PIN, channel_role_t::VOLTAGE, 5.0f, 0.0f, voltage_filter_t>       // 1:5 divider
+    >;
+
+    using processor_t = frame_processor_t<channels_t>;
+
+    /**
+    * @brief Waveform capture ring: 4096 raw interleaved samples, about 205ms at 20kHz, a quarter of them before the trigger
+    */
+    using capture_t = capture_ring_t<4096, 1024>;
+
+    // Captures kept on the storage partition. The oldest one is overwritten once they're all used
+    static constexpr uint8_t MAX_CAPTURE_FILES = 8;
+
+    /**
+    * @brief Sampling pipeline counters
     */
-    struct data_t {
-        float current_avg;          // Average current in Amperes
-        float voltage_avg;          // Average voltage in Volts
-        float apparent_power;       // Apparent power in VA
-        bool valid;                 // Data validity flag
+    struct stats_t {
+        uint32_t frames_processed;  // DMA frames read and processed since init
+        uint32_t frames_dropped;    // Frames lost to ADC pool overflows since init
+        uint32_t max_backlog;       // Most frames drained in a single wake-up of the processing task
+        uint32_t sample_rate_hz;    // Effective sample rate (all channels) of the current configuration
+        uint32_t frame_size;        // DMA frame size in bytes of the current configuration
+        uint32_t load_permille;     // Share of one core spent in the processing task over the last second, in 0.1%
+        bool low_power;             // true while the low power sampling profile is in use
     };
 
     /**
@@ -38,7 +68,9 @@ namespace adc {
 
     /**
     * @brief Main power monitoring class.
-    * Thread safe power monitoring using the ESP32's ADC continuous mode
+    * Thread safe power monitoring using the ESP32's ADC continuous mode.
+    * Measurements are published through a seqlock, so none of the getters ever block. They never give up on a read
+    * either: a getter only reports NaN, or false, while the latest published measurement isn't valid
     */
     class driver {
     public:
@@ -46,12 +78,10 @@ namespace adc {
         ~driver();
 
         /**
-        * @brief Initialize ADC and GPIO for power monitoring
-        * @param current_pin GPIO pin for current sensor (ADC1 channels only)
-        * @param voltage_pin GPIO pin for voltage sensor (ADC1 channels only)
+        * @brief Initialize ADC and GPIO for power monitoring, on the pins of `channels_t`
         * @return true if initialization successful, false otherwise
         */
-        bool init(gpio_num_t current_pin, gpio_num_t voltage_pin);
+        bool init();
 
         /**
         * @brief Get Average current reading
@@ -73,19 +103,60 @@ namespace adc {
         */
         float get_apparent_power();
 
+        /**
+        * @brief Get true RMS current reading
+        * @return RMS current in Amperes, NaN if data invalid
+        */
+        float get_current_rms();
+
+        /**
+        * @brief Get true RMS voltage reading
+        * @return RMS voltage in Volts, NaN if data invalid
+        */
+        float get_voltage_rms();
+
+        /**
+        * @brief Get real power
+        * @return Real power in Watts, NaN if data invalid
+        */
+        float get_real_power();
+
+        /**
+        * @brief Get power factor
+        * @return Power factor (real power / apparent power), NaN if data invalid
+        */
+        float get_power_factor();
+
         /**
         * @brief Get complete measurement data
+        * Starts a new statistics window, so each call gets the peaks since the previous one
         * @param[out] data Struct reference to store measurement data
-        * @return true if data is valid and fresh
+        * @return true if the latest measurement is valid
         */
         bool get_measurement_data(data_t& data);
 
+        /**
+        * @brief Get sampling pipeline counters
+        * Non-blocking. Can be used to prove the processing task keeps up with the ADC
+        * @return Snapshot of the counters
+        */
+        stats_t get_stats();
+
         /**
         * @brief Check if new data is available
         *@return true if fresh data available since last read
         */
         bool is_data_ready();
 
+        /**
+        * @brief Wake a task through a direct to task notification when a new measurement is published,
+        * so it can block on `ulTaskNotifyTake()` instead of polling
+        * @param task Task to notify, nullptr for none
+        * @param min_interval_us Least time between two notifications. Measurements in between still reach the
+        * statistics window, and the notified task gets the latest one
+        */
+        void set_data_ready_task(TaskHandle_t task, uint32_t min_interval_us);
+
         /**
         * @brief Start continuous ADC sampling
         * @return true if started successfully
@@ -98,30 +169,140 @@ namespace adc {
         */
         bool stop();
 
-    private:
-        float zero_current_offset_voltage;
+        /**
+        * @brief Change the sample rate and DMA frame size at runtime.
+        * Stops continuous mode, recreates the ADC handle with the new settings and restarts it if it was running.
+        * Rates under the hardware minimum are reached by only processing every Nth frame.
+        * The previous settings are restored if the new ones can't be applied
+        * @param sample_rate_hz Total sample rate for all channels
+        * @param frame_size DMA frame size in bytes. Must hold whole rounds of the channel pattern and not exceed `MAX_FRAME_SIZE`
+        * @return true if the new settings are in use
+        */
+        bool reconfigure(uint32_t sample_rate_hz, uint32_t frame_size);
+
+        /**
+        * @brief Ask for the full rate or the low power sampling profile.
+        * The processing task applies the request after its next frame; check `is_low_power()` to see if it took.
+        * While in low power the processing task switches back to full rate by itself on the first current step
+        * @param enable true to enter low power, false to go back to full rate
+        */
+        void request_low_power(bool enable);
 
-        // ADC handles
+        /**
+        * @brief Check if the low power sampling profile is in use
+        */
+        bool is_low_power();
+
+        /**
+        * @brief Set when a waveform capture triggers. A value of 0 disables that condition
+        * @param current_a Absolute current that triggers a capture, in Amperes
+        * @param slope_a_per_ms Current slope that triggers a capture, in Amperes per millisecond
+        */
+        void set_capture_trigger(float current_a, float slope_a_per_ms);
+
+        /**
+        * @brief Get the number of captures stored since the first one ever
+        * Capture `n` lives in slot `n % MAX_CAPTURE_FILES` until it's overwritten
+        */
+        uint32_t get_capture_count();
+
+        /**
+        * @brief Read a stored capture back from the storage partition
+        * @param slot Capture slot, less than `MAX_CAPTURE_FILES`
+        * @param[out] header Capture header
+        * @param[out] samples Raw interleaved samples, in the same format as the DMA frames
+        * @return true if the slot holds a valid capture
+        */
+        static bool load_capture(uint8_t slot, capture_header_t& header, std::array<uint16_t, capture_t::LENGTH>& samples);
+
+        /**
+        * @brief Report the current sensor's temperature, used by the zero current offset model
+        * @param celsius Temperature in degrees Celsius
+        */
+        void set_temperature(float celsius);
+
+        /**
+        * @brief Get the zero current offset voltage in use
+        * @return Offset in Volts
+        */
+        float get_zero_current_offset();
+
+        // Largest DMA frame `reconfigure()` accepts, in bytes
+        static constexpr uint32_t MAX_FRAME_SIZE = processor_t::MAX_FRAME_SAMPLES * sizeof(adc_digi_output_data_t);
+
+    private:
+        // ADC handles. `handle_mutex` keeps `reconfigure()` from replacing the handle while the processing task reads from it
         adc_continuous_handle_t adc_handle;
         adc_cali_handle_t cali_handle;
+        SemaphoreHandle_t handle_mutex;
+
+        // Sampling configuration. Only changed by `reconfigure()` with `handle_mutex` held
+        std::atomic<uint32_t> sample_rate_hz;
+        std::atomic<uint32_t> frame_size;
+        uint32_t hw_sample_rate_hz;
+        uint32_t frame_stride;      // Process one frame in every `frame_stride`
+
+        // Low power profile state. Only the processing task switches profiles, other tasks go through `profile_request`
+        enum class profile_request_t : uint8_t { NONE, FULL_RATE, LOW_POWER };
+        std::atomic<bool> low_power;
+        std::atomic<profile_request_t> profile_request;
+        float low_power_baseline;   // Average current when low power was entered, NaN until the first frame at the low rate
 
-        SemaphoreHandle_t data_mutex;
         TaskHandle_t processing_task_handle;
+        TaskHandle_t storage_task_handle;
+
+        // Measurement data. Written only by the processing task
+        seqlock_t<data_t> measurement_data;
+        // Generation of the last snapshot handed out by `get_measurement_data()`
+        std::atomic<uint32_t> last_read_generation;
+
+        // Consumer woken by new measurements. `last_notified_seq` and `last_notify_us` belong to the processing task
+        std::atomic<TaskHandle_t> data_ready_task;
+        std::atomic<uint32_t> data_ready_interval_us;
+        uint32_t last_notified_seq;
+        int64_t last_notify_us;
 
-        bool data_ready_flag;
-        uint32_t sample_count;
+        // Statistics windows of every channel, published with each measurement. A new one starts once the last published
+        // value has been read
+        std::array<running_stats_t, channels_t::COUNT> windows;
 
-        // Measurement data
-        data_t measurement_data;
+        // Low 32 bits of the esp_timer time of the last conversion done interrupt. 32 bits so the ISR store is lock free
+        std::atomic<uint32_t> last_conv_done_us;
+        uint32_t publish_seq;
 
-        // Channel configuration
-        adc_channel_config_t current_channel;
-        adc_channel_config_t voltage_channel;
+        // Charge and energy integrals. Only touched by the processing task
+        double charge_in_ah;
+        double charge_out_ah;
+        double energy_in_wh;
+        double energy_out_wh;
+        float last_frame_current;   // Average current of the last processed frame, held over frames that aren't processed
+        float last_frame_power;     // Real power of the last processed frame, held the same way
+        uint32_t dropped_frames_integrated;
 
-        // Processing buffers
-        static constexpr size_t MAX_BUFFER_SIZE = 128;
-        std::array<float, MAX_BUFFER_SIZE> current_samples{};
-        std::array<float, MAX_BUFFER_SIZE> voltage_samples{};
+        // Pipeline counters. `frames_dropped` is incremented from ISR context
+        std::atomic<uint32_t> frames_processed;
+        std::atomic<uint32_t> frames_dropped;
+        std::atomic<uint32_t> max_backlog;
+        std::atomic<uint32_t> load_permille;
+
+        // Channel configuration, in `channels_t` order
+        std::array<adc_channel_config_t, channels_t::COUNT> channels;
+
+        // Filters, calibration and reduction of the DMA frames. Only used by the processing task
+        processor_t processor;
+
+        // Waveform capture. The processing task fills and triggers it, the capture task persists and rearms it
+        capture_t capture;
+        capture_header_t capture_header;
+        std::atomic<uint32_t> capture_count;
+
+        // Zero current offset model. Published by the processing task, saved to NVS by the storage task
+        seqlock_t<offset_estimator_t::state_t> offset_state;
+        std::atomic<float> zero_current_offset;
+        bool offset_restored;   // A usable model was loaded from NVS at init
+
+        // DMA read buffer
+        std::array<uint8_t, MAX_FRAME_SIZE> read_buffer{};
 
         // State flags
         bool initialized;
@@ -132,18 +313,29 @@ namespace adc {
         void setup_calibration();
         adc_channel_config_t gpio_to_adc_channel(gpio_num_t pin);
 
-        template <typename T>
-        float calculate_average(const std::array<T, MAX_BUFFER_SIZE>& samples);
-        
         void process_adc_data(uint8_t* buffer, uint32_t length);
-        float raw_to_voltage(uint32_t raw, adc_cali_handle_t cali_handle);
-        void update_measurements();
+        void trigger_capture(const processor_t::trigger_t& trigger);
+        void notify_data_ready();
+        bool persist_capture();
+
+        static bool load_offset_state(offset_estimator_t::state_t& state);
+        static bool save_offset_state(const offset_estimator_t::state_t& state);
+        static bool is_warm_boot();
+        void calibrate_offset_at_boot();
+        bool set_low_power(bool enable);                // Processing task only
+        void integrate_charge(uint32_t num_samples);    // With `handle_mutex` held, it reads the hardware rate
+
+        static int cali_raw_to_millivolts(uint32_t raw, void* ctx);
 
         // Static callback for ADC ISR
         static bool IRAM_ATTR adc_conv_done_callback(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* edata, void* user_data);
+        static bool IRAM_ATTR adc_pool_ovf_callback(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* edata, void* user_data);
 
         // Processing task
         static void adc_processing_task(void* arg);
+
+        // Capture and offset persistence task
+        static void adc_storage_task(void* arg);
     };
 
 } // namespace adc
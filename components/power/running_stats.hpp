@@ -0,0 +1,81 @@
+#ifndef _RUNNING_STATS_HPP_
+#define _RUNNING_STATS_HPP_
+
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+
+namespace adc {
+
+    /**
+    * @brief Single pass statistics of a stream of samples: mean and variance (Welford), minimum and maximum.
+    * Nothing is buffered, and two sets of statistics can be merged exactly, so per frame statistics
+    * can be rolled up into longer windows. Trivially copyable, so it can travel through queues as is
+    */
+    struct running_stats_t {
+        uint32_t count;
+        float mean;
+        float m2;           // Sum of squared deviations from the mean
+        float min;
+        float max;
+
+        void reset() {
+            *this = running_stats_t{};
+        }
+
+        void add(float x) {
+            if (count == 0) {
+                min = x;
+                max = x;
+            } else {
+                min = std::min(min, x);
+                max = std::max(max, x);
+            }
+            count++;
+            const float delta = x - mean;
+            mean += delta / static_cast<float>(count);
+            m2 += delta * (x - mean);
+        }
+
+        /**
+        * @brief Fold in the statistics of another stretch of the same stream (Chan et al.)
+        */
+        void merge(const running_stats_t& other) {
+            if (other.count == 0) return;
+            if (count == 0) {
+                *this = other;
+                return;
+            }
+            const float n_a = static_cast<float>(count);
+            const float n_b = static_cast<float>(other.count);
+            const float n = n_a + n_b;
+            const float delta = other.mean - mean;
+            mean += delta * (n_b / n);
+            m2 += other.m2 + delta * delta * (n_a * n_b / n);
+            min = std::min(min, other.min);
+            max = std::max(max, other.max);
+            count += other.count;
+        }
+
+        /**
+        * @brief Population variance. NaN if there are no samples
+        */
+        [[nodiscard]] float variance() const {
+            return count ? (std::max(m2, 0.0f) / static_cast<float>(count)) : NAN;
+        }
+
+        [[nodiscard]] float std_dev() const {
+            return sqrtf(variance());
+        }
+
+        [[nodiscard]] float peak_to_peak() const {
+            return count ? (max - min) : NAN;
+        }
+    };
+
+} // namespace adc
+
+
+#endif // _RUNNING_STATS_HPP_
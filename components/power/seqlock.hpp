@@ -0,0 +1,79 @@
+#ifndef _SEQLOCK_HPP_
+#define _SEQLOCK_HPP_
+
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+
+namespace adc {
+
+    /**
+    * @brief Single writer, multi reader sequence lock for small trivially copyable structs.
+    * The writer never waits and readers never block. The value is kept twice and written one copy at a time,
+    * so there's always a whole copy to read, even while the writer is preempted halfway through a write.
+    * A reader only retries if the writer got to the copy it was reading before it finished, and never gives up
+    *
+    * @note Only one task may call `store()`
+    */
+    template <typename T>
+    class seqlock_t {
+        static_assert(std::is_trivially_copyable_v<T>, "seqlock_t can only hold trivially copyable types");
+
+    private:
+        // Odd while the first copy is written, even while the second one is or between writes. Every write adds 2
+        std::atomic<uint32_t> sequence{0};
+        std::array<T, 2> copies{};
+
+    public:
+        /**
+        * @brief Publish a new value
+        */
+        void store(const T& data) {
+            const uint32_t seq = sequence.load(std::memory_order_relaxed);
+            // Release, so the second copy of the previous value is whole before readers are sent to it
+            sequence.store(seq + 1, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_release);
+            copies[0] = data;
+            sequence.store(seq + 2, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_release);
+            copies[1] = data;
+        }
+
+        /**
+        * @brief Copy out the latest whole value
+        * @param[out] data Reference to store the value
+        * @param[out] generation Number of values published so far, including the one copied
+        */
+        void load(T& data, uint32_t& generation) const {
+            while (true) {
+                // The copy the writer isn't on: the first one once it's done, the second one while the first is written
+                const uint32_t before = sequence.load(std::memory_order_acquire);
+                data = copies[before & 1];
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence.load(std::memory_order_relaxed) == before) {
+                    generation = before / 2;
+                    return;
+                }
+            }
+        }
+
+        void load(T& data) const {
+            uint32_t generation = 0;
+            load(data, generation);
+        }
+
+        /**
+        * @brief Number of values published so far
+        */
+        [[nodiscard]] uint32_t get_generation() const {
+            return sequence.load(std::memory_order_acquire) / 2;
+        }
+    };
+
+} // namespace adc
+
+
+#endif // _SEQLOCK_HPP_
@@ -1,6 +1,8 @@
 #include "screens.hpp"
 #include "colors.hpp"
 
+#include <cmath>
+
 #include "esp_log.h"
 
 
@@ -28,6 +30,9 @@ namespace display {
     static lv_obj_t* label_s1_current_val                  = nullptr;
     static lv_obj_t* label_s1_voltage_bar                  = nullptr;
     static lv_obj_t* label_s1_current_bar                  = nullptr;
+    static lv_obj_t* label_s1_energy_day_in                = nullptr;
+    static lv_obj_t* label_s1_energy_day_out               = nullptr;
+    static lv_obj_t* label_s1_energy_total_out             = nullptr;
 
     // Screen 2: Environment
     static lv_obj_t* label_s2_temp_val                     = nullptr;
@@ -39,6 +44,7 @@ namespace display {
     static lv_obj_t* label_s2_hmdt_overlay                 = nullptr;
     static lv_obj_t* label_s2_hmdt_tick                    = nullptr;
     static lv_obj_t* label_s2_runtime                      = nullptr;
+    static lv_obj_t* label_s2_runtime_band                 = nullptr;
     static lv_obj_t* label_s2_inv_status                   = nullptr;
 
     // Screen 3: Overview
@@ -78,6 +84,10 @@ namespace display {
     static inline void style_badge(lv_obj_t* lbl, const char* text, lv_color_t bg, lv_color_t fg);
     // Create bar to use for changing values
     static inline lv_obj_t* create_bar(lv_obj_t* parent, int32_t w, int32_t h, int32_t min, int32_t max, uint32_t color);
+    // Blank the label of a field that has no value and dim one held from an earlier reading. true if there's a value to show
+    static inline bool show_field(lv_obj_t* label, const sys::data_t& data, sys::field_t field);
+    // Chart point of a field, a gap unless it's fresh
+    static inline int32_t chart_point(float value, const sys::data_t& data, sys::field_t field);
 
     // Public API
     // Screens Creation
@@ -268,6 +278,31 @@ namespace display {
         lv_obj_align(label_s1_current_bar, LV_ALIGN_TOP_MID, 0, 210);
         // Additional styling or this bar since it uses a negative minimum
         lv_bar_set_mode(label_s1_current_bar, LV_BAR_MODE_SYMMETRICAL);
+
+        // Energy panel
+        lv_obj_t* energy = create_panel(screens[1], 4, 250, 232, 56);
+
+        constexpr const char* energy_hdrs[3] = { "24H IN", "24H OUT", "TOTAL OUT" };
+        constexpr const uint8_t energy_x[3] = { 8, 82, 150 };
+        lv_obj_t* evals[3]{};
+
+        for (uint8_t i = 0; i < 3; i++) {
+            lv_obj_t* hd = lv_label_create(energy);
+            lv_label_set_text(hd, energy_hdrs[i]);
+            lv_obj_set_style_text_color(hd, lv_color_hex(color::GREY), 0);
+            lv_obj_set_style_text_font(hd, &lv_font_montserrat_10, 0);
+            lv_obj_set_pos(hd, energy_x[i], 2);
+
+            evals[i] = lv_label_create(energy);
+            lv_label_set_text(evals[i], "0Wh");
+            lv_obj_set_style_text_color(evals[i], lv_color_hex(color::WHITE), 0);
+            lv_obj_set_style_text_font(evals[i], &lv_font_montserrat_12, 0);
+            lv_obj_set_pos(evals[i], energy_x[i], 20);
+        }
+
+        label_s1_energy_day_in    = evals[0];
+        label_s1_energy_day_out   = evals[1];
+        label_s1_energy_total_out = evals[2];
     }
 
     void create_screen_2() {
@@ -436,6 +471,13 @@ namespace display {
         lv_obj_set_style_text_font(label_s2_runtime, &lv_font_montserrat_12, 0);
         lv_obj_set_pos(label_s2_runtime, 10, 18);
 
+        // Confidence band of the runtime, in hours
+        label_s2_runtime_band = lv_label_create(bot);
+        lv_label_set_text(label_s2_runtime_band, "");
+        lv_obj_set_style_text_color(label_s2_runtime_band, lv_color_hex(color::GREY), 0);
+        lv_obj_set_style_text_font(label_s2_runtime_band, &lv_font_montserrat_10, 0);
+        lv_obj_set_pos(label_s2_runtime_band, 70, 20);
+
         lv_obj_t* inv_hdr = lv_label_create(bot);
         lv_label_set_text(inv_hdr, "INVERTER");
         lv_obj_set_style_text_color(inv_hdr, lv_color_hex(color::GREY), 0);
@@ -625,11 +667,11 @@ namespace display {
         int32_t hmdti32[config::GRAPH_SAMPLES]{};
 
         for (size_t i = 0; i < config::GRAPH_SAMPLES; i++) {
-            tempi32[i] = static_cast<int32_t>(temp[i]);
+            tempi32[i] = std::isfinite(temp[i]) ? static_cast<int32_t>(temp[i]) : LV_CHART_POINT_NONE;
         }
 
         for (size_t i = 0; i < config::GRAPH_SAMPLES; i++) {
-            hmdti32[i] = static_cast<int32_t>(hmdt[i]);
+            hmdti32[i] = std::isfinite(hmdt[i]) ? static_cast<int32_t>(hmdt[i]) : LV_CHART_POINT_NONE;
         }
         
         lv_chart_set_series_values(batt_env_chart, temp_series, tempi32, temp.size());
@@ -697,11 +739,11 @@ namespace display {
         int32_t curri32[config::GRAPH_SAMPLES]{};
 
         for (size_t i = 0; i < config::GRAPH_SAMPLES; i++) {
-            volti32[i] = static_cast<int32_t>(voltage[i]);
+            volti32[i] = std::isfinite(voltage[i]) ? static_cast<int32_t>(voltage[i]) : LV_CHART_POINT_NONE;
         }
 
         for (size_t i = 0; i < config::GRAPH_SAMPLES; i++) {
-            curri32[i] = static_cast<int32_t>(current[i]);
+            curri32[i] = std::isfinite(current[i]) ? static_cast<int32_t>(current[i]) : LV_CHART_POINT_NONE;
         }
         
         lv_chart_set_series_values(power_chart, voltage_series, volti32, voltage.size());
@@ -716,18 +758,24 @@ namespace display {
         char buf[64]{};
 
         // BATT card
-        if (data.battery_percent > 20.0f) {
+        if (!show_field(label_s0_batt_value, data, sys::field_t::BATTERY)) {
+            style_badge(label_s0_batt_badge, "--", lv_color_hex(color::GREY), lv_color_hex(color::WHITE));
+        } else if (data.battery_percent > 20.0f) {
             style_badge(label_s0_batt_badge, "OK", lv_color_hex(color::GREEN), lv_color_hex(color::BLACK));
             lv_obj_set_style_text_color(label_s0_batt_value, lv_color_hex(color::GREEN), 0);
         } else {
             style_badge(label_s0_batt_badge, "WARN", lv_color_hex(color::YELLOW), lv_color_hex(color::BLACK));
             lv_obj_set_style_text_color(label_s0_batt_value, lv_color_hex(color::YELLOW), 0);
         }
-        snprintf(buf, sizeof(buf), "%.0f%%", data.battery_percent);
-        lv_label_set_text(label_s0_batt_value, buf);
+        if (data.is_valid(sys::field_t::BATTERY)) {
+            snprintf(buf, sizeof(buf), "%.0f%%", data.battery_percent);
+            lv_label_set_text(label_s0_batt_value, buf);
+        }
 
         // INV card
-        if (data.inv_status == sys::inv_status_t::ACTIVE) {
+        if (!show_field(label_s0_inv_value, data, sys::field_t::CURRENT)) {
+            style_badge(label_s0_inv_badge, "--", lv_color_hex(color::GREY), lv_color_hex(color::WHITE));
+        } else if (data.inv_status == sys::inv_status_t::ACTIVE) {
             style_badge(label_s0_inv_badge, "ACTIVE", lv_color_hex(0x0066CC), lv_color_hex(color::WHITE));
             lv_label_set_text(label_s0_inv_value, "ON");
             lv_obj_set_style_text_color(label_s0_inv_value, lv_color_hex(color::CYAN), 0);
@@ -738,51 +786,71 @@ namespace display {
         }
 
         // TEMP card
-        if (data.inv_temp >= 45.0f || data.inv_temp <= 10.0f) {
+        if (!show_field(label_s0_temp_value, data, sys::field_t::TEMPERATURE)) {
+            style_badge(label_s0_temp_badge, "--", lv_color_hex(color::GREY), lv_color_hex(color::WHITE));
+        } else if (data.inv_temp >= 45.0f || data.inv_temp <= 10.0f) {
             style_badge(label_s0_temp_badge, "WARN", lv_color_hex(color::YELLOW), lv_color_hex(color::BLACK));
             lv_obj_set_style_text_color(label_s0_temp_value, lv_color_hex(color::YELLOW), 0);
         } else {
             style_badge(label_s0_temp_badge, "OK", lv_color_hex(color::GREEN), lv_color_hex(color::BLACK));
             lv_obj_set_style_text_color(label_s0_temp_value, lv_color_hex(color::GREEN), 0);
         }
-        snprintf(buf, sizeof(buf), "%.0f°C", data.inv_temp);
-        lv_label_set_text(label_s0_temp_value, buf);
+        if (data.is_valid(sys::field_t::TEMPERATURE)) {
+            snprintf(buf, sizeof(buf), "%.0f°C", data.inv_temp);
+            lv_label_set_text(label_s0_temp_value, buf);
+        }
 
         // HMDT card
-        if (data.inv_hmdt >= 70.0f || data.inv_hmdt <= 20.0f) {
+        if (!show_field(label_s0_hmdt_value, data, sys::field_t::HUMIDITY)) {
+            style_badge(label_s0_hmdt_badge, "--", lv_color_hex(color::GREY), lv_color_hex(color::WHITE));
+        } else if (data.inv_hmdt >= 70.0f || data.inv_hmdt <= 20.0f) {
             style_badge(label_s0_hmdt_badge, "WARN", lv_color_hex(color::YELLOW), lv_color_hex(color::BLACK));
             lv_obj_set_style_text_color(label_s0_hmdt_value, lv_color_hex(color::YELLOW), 0);
         } else {
             style_badge(label_s0_hmdt_badge, "OK", lv_color_hex(color::GREEN), lv_color_hex(color::BLACK));
             lv_obj_set_style_text_color(label_s0_hmdt_value, lv_color_hex(color::GREEN), 0);
         }
-        snprintf(buf, sizeof(buf), "%.0f%%", data.inv_hmdt);
-        lv_label_set_text(label_s0_hmdt_value, buf);
+        if (data.is_valid(sys::field_t::HUMIDITY)) {
+            snprintf(buf, sizeof(buf), "%.0f%%", data.inv_hmdt);
+            lv_label_set_text(label_s0_hmdt_value, buf);
+        }
 
         // Live values
-        snprintf(buf, sizeof(buf), "%.2f", data.battery_voltage);
-        lv_label_set_text(label_s0_voltage, buf);
+        if (show_field(label_s0_voltage, data, sys::field_t::VOLTAGE)) {
+            snprintf(buf, sizeof(buf), "%.2f", data.battery_voltage);
+            lv_label_set_text(label_s0_voltage, buf);
+        }
 
-        snprintf(buf, sizeof(buf), "%.2f", data.load_current_drawn);
-        lv_label_set_text(label_s0_current, buf);
+        if (show_field(label_s0_current, data, sys::field_t::CURRENT)) {
+            snprintf(buf, sizeof(buf), "%.2f", data.load_current_drawn);
+            lv_label_set_text(label_s0_current, buf);
+        }
 
-        snprintf(buf, sizeof(buf), "%.2f", data.power_drawn);
-        lv_label_set_text(label_s0_power, buf);
+        if (show_field(label_s0_power, data, sys::field_t::POWER)) {
+            snprintf(buf, sizeof(buf), "%.2f", data.power_drawn);
+            lv_label_set_text(label_s0_power, buf);
+        }
 
         // Bottom row
-        uint8_t hours   = data.runtime_left_s / 3600;
-        uint8_t minutes = (data.runtime_left_s % 3600) / 60;
-        uint8_t seconds = data.runtime_left_s % 60;
+        if (show_field(label_s0_runtime, data, sys::field_t::RUNTIME)) {
+            uint8_t hours   = data.runtime_left_s / 3600;
+            uint8_t minutes = (data.runtime_left_s % 3600) / 60;
+            uint8_t seconds = data.runtime_left_s % 60;
 
-        snprintf(buf, sizeof(buf), "%02u:%02u:%02u", hours, minutes, seconds);
-        lv_label_set_text(label_s0_runtime, buf);
+            snprintf(buf, sizeof(buf), "%02u:%02u:%02u", hours, minutes, seconds);
+            lv_label_set_text(label_s0_runtime, buf);
+        }
         lv_obj_set_style_text_color(label_s0_runtime, lv_color_hex(color::CYAN), 0);
 
-        snprintf(buf, sizeof(buf), "%s", sys::batt_status_to_string(data.batt_status));
-        lv_label_set_text(label_s0_batt_status, buf);
+        if (show_field(label_s0_batt_status, data, sys::field_t::CURRENT)) {
+            snprintf(buf, sizeof(buf), "%s", sys::batt_status_to_string(data.batt_status));
+            lv_label_set_text(label_s0_batt_status, buf);
+        }
         lv_obj_set_style_text_color(label_s0_batt_status, lv_color_hex(color::YELLOW), 0);
 
-        if (data.inv_status == sys::inv_status_t::ACTIVE) {
+        if (!show_field(label_s0_inv_status, data, sys::field_t::CURRENT)) {
+            lv_obj_set_style_text_color(label_s0_inv_status, lv_color_hex(color::GREY), 0);
+        } else if (data.inv_status == sys::inv_status_t::ACTIVE) {
             lv_label_set_text(label_s0_inv_status, "ACTIVE");
             lv_obj_set_style_text_color(label_s0_inv_status, lv_color_hex(color::CYAN), 0);
         } else {
@@ -796,14 +864,18 @@ namespace display {
         char buf[16]{};
 
         // Power label
-        snprintf(buf, sizeof(buf), "%.2fW", data.power_drawn);
-        lv_label_set_text(label_s1_power, buf);
+        if (show_field(label_s1_power, data, sys::field_t::POWER)) {
+            snprintf(buf, sizeof(buf), "%.2fW", data.power_drawn);
+            lv_label_set_text(label_s1_power, buf);
+        }
 
-        // Voltage bar
+        // Voltage bar. Without a value it drops to the bottom of its range
         float voltage = data.battery_voltage;
 
-        snprintf(buf, sizeof(buf), "%.2f V", voltage);
-        lv_label_set_text(label_s1_voltage_val, buf);
+        if (show_field(label_s1_voltage_val, data, sys::field_t::VOLTAGE)) {
+            snprintf(buf, sizeof(buf), "%.2f V", voltage);
+            lv_label_set_text(label_s1_voltage_val, buf);
+        }
 
         // Clamp voltage
         if (voltage < 6.0f) voltage = 6.0f;
@@ -825,8 +897,10 @@ namespace display {
         if (current < -20.0f) current = -20.0f;
         else if (current > 25.0f) current = 25.0f;
 
-        snprintf(buf, sizeof(buf), "%.2f A", current);
-        lv_label_set_text(label_s1_current_val, buf);
+        if (show_field(label_s1_current_val, data, sys::field_t::CURRENT)) {
+            snprintf(buf, sizeof(buf), "%.2f A", current);
+            lv_label_set_text(label_s1_current_val, buf);
+        }
 
         lv_bar_set_value(label_s1_current_bar, static_cast<int32_t>(current), LV_ANIM_ON);
         // Determine color of bar
@@ -837,15 +911,31 @@ namespace display {
         } else {
             lv_obj_set_style_bg_color(label_s1_current_bar, lv_color_hex(color::GREEN), LV_PART_INDICATOR);
         }
+
+        // Energy through the battery
+        if (show_field(label_s1_energy_day_in, data, sys::field_t::BATTERY)) {
+            snprintf(buf, sizeof(buf), "%.0fWh", data.energy_day_in_wh);
+            lv_label_set_text(label_s1_energy_day_in, buf);
+        }
+        if (show_field(label_s1_energy_day_out, data, sys::field_t::BATTERY)) {
+            snprintf(buf, sizeof(buf), "%.0fWh", data.energy_day_out_wh);
+            lv_label_set_text(label_s1_energy_day_out, buf);
+        }
+        if (show_field(label_s1_energy_total_out, data, sys::field_t::BATTERY)) {
+            snprintf(buf, sizeof(buf), "%.1fkWh", data.energy_out_wh / 1000.0f);
+            lv_label_set_text(label_s1_energy_total_out, buf);
+        }
     }
 
     void update_screen_2(const sys::data_t& data) {
 
         char buf[64]{};
 
-        // Temperature
-        snprintf(buf, sizeof(buf), "%.1f°C", data.inv_temp);
-        lv_label_set_text(label_s2_temp_val, buf);
+        // Temperature. Without a value the bar empties
+        if (show_field(label_s2_temp_val, data, sys::field_t::TEMPERATURE)) {
+            snprintf(buf, sizeof(buf), "%.1f°C", data.inv_temp);
+            lv_label_set_text(label_s2_temp_val, buf);
+        }
 
         float temperature = data.inv_temp;
         if (temperature < 0.0f)  temperature = 0.0f;
@@ -862,8 +952,10 @@ namespace display {
         }
 
         // Overlay centered on filled portion
-        snprintf(buf, sizeof(buf), "%.1f", data.inv_temp);
-        lv_label_set_text(label_s2_temp_overlay, buf);
+        if (show_field(label_s2_temp_overlay, data, sys::field_t::TEMPERATURE)) {
+            snprintf(buf, sizeof(buf), "%.1f", data.inv_temp);
+            lv_label_set_text(label_s2_temp_overlay, buf);
+        }
         lv_obj_set_x(label_s2_temp_overlay, (t_px > 30) ? (8 + t_px / 2 - 15) : 8);
 
         lv_obj_set_x(label_s2_temp_tick, 8 + (t_px > 3 ? t_px - 3 : 0));
@@ -873,8 +965,10 @@ namespace display {
         if (humidity < 0.0f) humidity = 0.0f;
         if (humidity > 100.0f) humidity = 100.0f;
 
-        snprintf(buf, sizeof(buf), "%.1f%%", humidity);
-        lv_label_set_text(label_s2_hmdt_val, buf);
+        if (show_field(label_s2_hmdt_val, data, sys::field_t::HUMIDITY)) {
+            snprintf(buf, sizeof(buf), "%.1f%%", humidity);
+            lv_label_set_text(label_s2_hmdt_val, buf);
+        }
 
         int32_t h_px = static_cast<int32_t>((humidity / 100.0f) * 216.0f);
         lv_obj_set_width(bar_s2_hmdt_fill, h_px);
@@ -887,20 +981,33 @@ namespace display {
             lv_obj_set_style_bg_color(bar_s2_hmdt_fill, lv_color_hex(color::RED), 0);
         }
 
-        snprintf(buf, sizeof(buf), "%.0f", humidity);
-        lv_label_set_text(label_s2_hmdt_overlay, buf);
+        if (show_field(label_s2_hmdt_overlay, data, sys::field_t::HUMIDITY)) {
+            snprintf(buf, sizeof(buf), "%.0f", humidity);
+            lv_label_set_text(label_s2_hmdt_overlay, buf);
+        }
         lv_obj_set_x(label_s2_hmdt_overlay, (h_px > 24) ? (8 + h_px / 2 - 12) : 8);
 
         lv_obj_set_x(label_s2_hmdt_tick, 8 + (h_px > 3 ? h_px - 3 : 0));
 
         // Bottom row
-        uint8_t hours   = data.runtime_left_s / 3600;
-        uint8_t minutes = (data.runtime_left_s % 3600) / 60;
-        uint8_t seconds = data.runtime_left_s % 60;
-        snprintf(buf, sizeof(buf), "%02u:%02u:%02u", hours, minutes, seconds);
-        lv_label_set_text(label_s2_runtime, buf);
+        if (show_field(label_s2_runtime, data, sys::field_t::RUNTIME)) {
+            uint8_t hours   = data.runtime_left_s / 3600;
+            uint8_t minutes = (data.runtime_left_s % 3600) / 60;
+            uint8_t seconds = data.runtime_left_s % 60;
+            snprintf(buf, sizeof(buf), "%02u:%02u:%02u", hours, minutes, seconds);
+            lv_label_set_text(label_s2_runtime, buf);
+        }
+
+        if (show_field(label_s2_runtime_band, data, sys::field_t::RUNTIME)) {
+            const float low_h  = data.runtime_low_s / 3600.0f;
+            const float high_h = data.runtime_high_s / 3600.0f;
+            snprintf(buf, sizeof(buf), (high_h < 10.0f) ? "%.1f-%.1fh" : "%.0f-%.0fh", low_h, high_h);
+            lv_label_set_text(label_s2_runtime_band, buf);
+        }
 
-        if (data.inv_status == sys::inv_status_t::ACTIVE) {
+        if (!show_field(label_s2_inv_status, data, sys::field_t::CURRENT)) {
+            lv_obj_set_style_text_color(label_s2_inv_status, lv_color_hex(color::GREY), 0);
+        } else if (data.inv_status == sys::inv_status_t::ACTIVE) {
             lv_label_set_text(label_s2_inv_status, "ACTIVE");
             lv_obj_set_style_text_color(label_s2_inv_status, lv_color_hex(color::CYAN), 0);
         } else {
@@ -919,49 +1026,65 @@ namespace display {
         // Voltage: yellow dot when voltage >12.6V or <= 10.5V
         bool v_warn = (data.battery_voltage <= 10.5f || data.battery_voltage > 12.6f);
         lv_obj_set_style_bg_color(dot_s3_voltage, v_warn ? lv_color_hex(color::YELLOW) : lv_color_hex(color::GREEN), 0);
-        snprintf(buf, sizeof(buf), "%.2f V", data.battery_voltage);
-        lv_label_set_text(label_s3_voltage_val, buf);
+        if (show_field(label_s3_voltage_val, data, sys::field_t::VOLTAGE)) {
+            snprintf(buf, sizeof(buf), "%.2f V", data.battery_voltage);
+            lv_label_set_text(label_s3_voltage_val, buf);
+        }
 
         // Current: yellow dot when current >=20A or <=-15A
         bool i_warn = (data.load_current_drawn >= 20.0f || data.load_current_drawn <= -15.0f);
         lv_obj_set_style_bg_color(dot_s3_current, i_warn ? lv_color_hex(color::YELLOW) : lv_color_hex(color::GREEN), 0);
-        snprintf(buf, sizeof(buf), "%.2f A", data.load_current_drawn);
-        lv_label_set_text(label_s3_current_val, buf);
+        if (show_field(label_s3_current_val, data, sys::field_t::CURRENT)) {
+            snprintf(buf, sizeof(buf), "%.2f A", data.load_current_drawn);
+            lv_label_set_text(label_s3_current_val, buf);
+        }
 
         // Power: yellow dot when power >=250W
         bool p_warn = (data.power_drawn >= 250.0f);
         lv_obj_set_style_bg_color(dot_s3_power, p_warn ? lv_color_hex(color::YELLOW) : lv_color_hex(color::GREEN), 0);
-        snprintf(buf, sizeof(buf), "%.2f W", data.power_drawn);
-        lv_label_set_text(label_s3_power_val, buf);
+        if (show_field(label_s3_power_val, data, sys::field_t::POWER)) {
+            snprintf(buf, sizeof(buf), "%.2f W", data.power_drawn);
+            lv_label_set_text(label_s3_power_val, buf);
+        }
 
         // SoC: yellow dot when ≤20%
         bool soc_warn = (data.battery_percent <= 20.0f);
         lv_obj_set_style_bg_color(dot_s3_soc, soc_warn ? lv_color_hex(color::YELLOW) : lv_color_hex(color::GREEN), 0);
-        snprintf(buf, sizeof(buf), "%.1f %%", data.battery_percent);
-        lv_label_set_text(label_s3_soc_val, buf);
+        if (show_field(label_s3_soc_val, data, sys::field_t::BATTERY)) {
+            snprintf(buf, sizeof(buf), "%.1f %%", data.battery_percent);
+            lv_label_set_text(label_s3_soc_val, buf);
+        }
 
         // Temperature: yellow dot when >=45°C or <=10°C
         bool t_warn = (data.inv_temp >= 45.0f || data.inv_temp <= 10.0f);
         lv_obj_set_style_bg_color(dot_s3_temp, t_warn ? lv_color_hex(color::YELLOW) : lv_color_hex(color::GREEN), 0);
-        snprintf(buf, sizeof(buf), "%.1f °C", data.inv_temp);
-        lv_label_set_text(label_s3_temp_val, buf);
+        if (show_field(label_s3_temp_val, data, sys::field_t::TEMPERATURE)) {
+            snprintf(buf, sizeof(buf), "%.1f °C", data.inv_temp);
+            lv_label_set_text(label_s3_temp_val, buf);
+        }
 
         // Humidity: yellow dot when >=70% or <=20%
         bool h_warn = (data.inv_hmdt >= 70.0f || data.inv_hmdt <= 20.0f);
         lv_obj_set_style_bg_color(dot_s3_hmdt, h_warn ? lv_color_hex(color::YELLOW) : lv_color_hex(color::GREEN), 0);
-        snprintf(buf, sizeof(buf), "%.1f %%", data.inv_hmdt);
-        lv_label_set_text(label_s3_hmdt_val, buf);
+        if (show_field(label_s3_hmdt_val, data, sys::field_t::HUMIDITY)) {
+            snprintf(buf, sizeof(buf), "%.1f %%", data.inv_hmdt);
+            lv_label_set_text(label_s3_hmdt_val, buf);
+        }
 
         // Bottom row
-        snprintf(buf, sizeof(buf), "%s", sys::batt_status_to_string(data.batt_status));
-        lv_label_set_text(label_s3_batt_status, buf);
-        if (data.batt_status == sys::batt_status_t::IDLE) {
+        if (show_field(label_s3_batt_status, data, sys::field_t::CURRENT)) {
+            snprintf(buf, sizeof(buf), "%s", sys::batt_status_to_string(data.batt_status));
+            lv_label_set_text(label_s3_batt_status, buf);
+        }
+        if (!data.is_valid(sys::field_t::CURRENT) || (data.batt_status == sys::batt_status_t::IDLE)) {
             lv_obj_set_style_text_color(label_s3_batt_status, lv_color_hex(color::GREY), 0);
         } else {
             lv_obj_set_style_text_color(label_s3_batt_status, lv_color_hex(color::CYAN), 0);
         }
 
-        if (data.inv_status == sys::inv_status_t::ACTIVE) {
+        if (!show_field(label_s3_inv_status, data, sys::field_t::CURRENT)) {
+            lv_obj_set_style_text_color(label_s3_inv_status, lv_color_hex(color::GREY), 0);
+        } else if (data.inv_status == sys::inv_status_t::ACTIVE) {
             lv_label_set_text(label_s3_inv_status, "ACTIVE");
             lv_obj_set_style_text_color(label_s3_inv_status, lv_color_hex(color::CYAN), 0);
         } else {
@@ -970,25 +1093,27 @@ namespace display {
         }
 
         // Runtime: HH:MM:SS
-        uint32_t hours   = data.runtime_left_s / 3600;
-        uint32_t minutes = (data.runtime_left_s % 3600) / 60;
-        uint32_t seconds = data.runtime_left_s % 60;
+        if (show_field(label_s3_runtime, data, sys::field_t::RUNTIME)) {
+            uint32_t hours   = data.runtime_left_s / 3600;
+            uint32_t minutes = (data.runtime_left_s % 3600) / 60;
+            uint32_t seconds = data.runtime_left_s % 60;
 
-        snprintf(buf, sizeof(buf), "%02lu:%02lu:%02lu", hours, minutes, seconds);
-        
-        lv_label_set_text(label_s3_runtime, buf);
+            snprintf(buf, sizeof(buf), "%02lu:%02lu:%02lu", hours, minutes, seconds);
+
+            lv_label_set_text(label_s3_runtime, buf);
+        }
         lv_obj_set_style_text_color(label_s3_runtime, lv_color_hex(color::CYAN), 0);
     }
 
     void update_screen_4(const sys::data_t& data) {
-        lv_chart_set_next_value(batt_env_chart, temp_series, static_cast<int32_t>(data.inv_temp));
-        lv_chart_set_next_value(batt_env_chart, hmdt_series, static_cast<int32_t>(data.inv_hmdt));
+        lv_chart_set_next_value(batt_env_chart, temp_series, chart_point(data.inv_temp, data, sys::field_t::TEMPERATURE));
+        lv_chart_set_next_value(batt_env_chart, hmdt_series, chart_point(data.inv_hmdt, data, sys::field_t::HUMIDITY));
         lv_chart_refresh(batt_env_chart);
     }
 
     void update_screen_5(const sys::data_t& data) {
-        lv_chart_set_next_value(power_chart, voltage_series, static_cast<int32_t>(data.battery_voltage));
-        lv_chart_set_next_value(power_chart, current_series, static_cast<int32_t>(data.load_current_drawn));
+        lv_chart_set_next_value(power_chart, voltage_series, chart_point(data.battery_voltage, data, sys::field_t::VOLTAGE));
+        lv_chart_set_next_value(power_chart, current_series, chart_point(data.load_current_drawn, data, sys::field_t::CURRENT));
         lv_chart_refresh(power_chart);
     }
 
@@ -1031,6 +1156,20 @@ namespace display {
         lv_obj_set_style_pad_bottom(lbl, 1, 0);
     }
 
+    static inline bool show_field(lv_obj_t* label, const sys::data_t& data, sys::field_t field) {
+        if (!data.is_valid(field)) {
+            lv_label_set_text(label, "--");
+            lv_obj_set_style_text_opa(label, LV_OPA_COVER, 0);
+            return false;
+        }
+        lv_obj_set_style_text_opa(label, data.is_fresh(field) ? LV_OPA_COVER : LV_OPA_50, 0);
+        return true;
+    }
+
+    static inline int32_t chart_point(float value, const sys::data_t& data, sys::field_t field) {
+        return data.is_fresh(field) ? static_cast<int32_t>(value) : LV_CHART_POINT_NONE;
+    }
+
     static inline lv_obj_t* create_bar(lv_obj_t* parent, int32_t w, int32_t h, int32_t min, int32_t max, uint32_t color) {
 
         lv_obj_t* bar = lv_bar_create(parent);
@@ -0,0 +1,235 @@
+#ifndef _BATTERY_HEALTH_HPP_
+#define _BATTERY_HEALTH_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#include "battery_profile.hpp"
+#include "rainflow.hpp"
+
+
+namespace sys {
+
+    /**
+    * @brief Battery state of health from the way it's been used and the way it behaves.
+    * A rainflow count of the state of charge gives the cycles by depth and the share of the cycle life used up.
+    * The capacity is measured between rest periods far enough apart in state of charge: at rest the open circuit
+    * voltage gives the state of charge independently of the charge count, so the charge counted between two of them
+    * over the change in state of charge is the capacity. The internal resistance is averaged over weeks and compared
+    * with its average over the first days, when the battery was taken to be new.
+    * Everything is incremental with fixed memory. Free of ESP-IDF dependencies, persistence is left to the owner
+    * through `get_state()` / `restore()`
+    */
+    class battery_health_t {
+    public:
+        using rainflow_t = rainflow_counter_t<32, 10>;
+
+        struct config_t {
+            float capacity_ah;              // Rated capacity when new
+            float charge_efficiency;        // Share of the charge put in that can be taken out again
+            const config::ocv_curve_t<>* ocv_curve;
+            float resistance_ohm;           // Resistance when new, until the baseline has been measured
+            rainflow_t::config_t rainflow;
+            float rest_current_a;           // Currents below this count as rest
+            int64_t rest_time_us;           // Rest needed before the voltage is taken as the open circuit voltage
+            float min_soc_span;             // Least change in state of charge between two rest points to measure the capacity over
+            int64_t max_anchor_age_us;      // Rest points older than this are too far off in the charge count to measure from
+            float capacity_gain;            // Weight of each new capacity measurement, 0 - 1
+            float resistance_time_constant_s; // Averaging time constant of the resistance trend
+            int64_t baseline_time_us;       // Monitored time the resistance baseline is averaged over
+            int64_t checkpoint_interval_us; // Least time between two checkpoints
+        };
+
+        /**
+        * @brief Persistent state. Trivially copyable so it can be stored as is
+        */
+        struct state_t {
+            uint32_t version;
+            uint32_t capacity_samples;      // Capacity measurements so far
+            int64_t elapsed_us;             // Monitored time since the tracker was started
+            rainflow_t::state_t cycles;
+            float capacity_ah;              // Measured capacity, the rated one until the first measurement
+            double resistance_ohm;          // Long term average. Double, as the per update weight is tiny
+            double baseline_sum;            // Time weighted sum of the resistance over the baseline period
+            double baseline_weight_s;
+        };
+
+        static constexpr uint32_t STATE_VERSION = 1;
+
+        explicit battery_health_t(const config_t& cfg): config(cfg), rainflow(cfg.rainflow) {
+            state.version = STATE_VERSION;
+            state.capacity_ah = cfg.capacity_ah;
+            state.resistance_ohm = cfg.resistance_ohm;
+        }
+
+        /**
+        * @brief Restore a checkpoint. Call before the first `update()`
+        * @return false if the checkpoint is from another version or corrupt, in which case nothing changes
+        */
+        bool restore(const state_t& saved) {
+            if ((saved.version != STATE_VERSION) || (saved.elapsed_us < 0)) return false;
+            if (!std::isfinite(saved.capacity_ah) || (saved.capacity_ah <= 0.0f) || !std::isfinite(saved.resistance_ohm) ||
+                !std::isfinite(saved.baseline_sum) || !std::isfinite(saved.baseline_weight_s)) return false;
+            if (!rainflow.restore(saved.cycles)) return false;
+            state = saved;
+            return true;
+        }
+
+        /**
+        * @brief Advance the tracker
+        * @param soc State of charge, 0 - 1
+        * @param total_in_ah Driver's charge integral while charging, since its start
+        * @param total_out_ah Driver's charge integral while discharging, since its start
+        * @param current_a Present current, positive while discharging
+        * @param voltage_v Present battery terminal voltage
+        * @param temperature_c Battery temperature, NaN if unknown
+        * @param resistance_ohm Present internal resistance measurement
+        * @param now_us Monotonic time
+        */
+        void update(float soc, double total_in_ah, double total_out_ah, float current_a, float voltage_v, float temperature_c,
+                    float resistance_ohm, int64_t now_us) {
+
+            const double net_ah = total_out_ah - total_in_ah * config.charge_efficiency;
+
+            if (!started) {
+                last_us = now_us;
+                rest_since_us = now_us;
+                started = true;
+            }
+
+            const int64_t dt_us = std::max(now_us - last_us, static_cast<int64_t>(0));
+            last_us = now_us;
+            state.elapsed_us += dt_us;
+
+            rainflow.update(soc);
+            track_resistance(resistance_ohm, static_cast<double>(dt_us) / 1'000'000.0);
+            track_capacity(net_ah, current_a, voltage_v, temperature_c, now_us);
+        }
+
+        /**
+        * @brief Measured capacity over the rated one, in percent
+        */
+        [[nodiscard]] float get_soh() const {
+            return std::clamp(state.capacity_ah / config.capacity_ah * 100.0f, 0.0f, 100.0f);
+        }
+
+        [[nodiscard]] float get_capacity_ah() const {
+            return state.capacity_ah;
+        }
+
+        /**
+        * @brief Long term internal resistance over its baseline, 1 when new
+        */
+        [[nodiscard]] float get_resistance_growth() const {
+            return static_cast<float>(state.resistance_ohm / get_baseline_ohm());
+        }
+
+        [[nodiscard]] double get_baseline_ohm() const {
+            return (state.baseline_weight_s > 0.0) ? (state.baseline_sum / state.baseline_weight_s) : config.resistance_ohm;
+        }
+
+        /**
+        * @brief Share of the cycle life used up, in percent
+        */
+        [[nodiscard]] float get_wear() const {
+            return static_cast<float>(rainflow.get_damage() * 100.0);
+        }
+
+        [[nodiscard]] double get_equivalent_cycles() const {
+            return rainflow.get_equivalent_cycles();
+        }
+
+        /**
+        * @brief State to checkpoint
+        */
+        [[nodiscard]] const state_t& get_state() {
+            state.cycles = rainflow.get_state();
+            return state;
+        }
+
+        /**
+        * @brief Whether a checkpoint should be written now. Health moves slowly, so this is only ever bounded by time
+        */
+        [[nodiscard]] bool checkpoint_due(int64_t now_us) const {
+            return started && ((now_us - last_checkpoint_us) >= config.checkpoint_interval_us);
+        }
+
+        /**
+        * @brief Mark the current state as saved
+        */
+        void checkpoint_done(int64_t now_us) {
+            last_checkpoint_us = now_us;
+        }
+
+    private:
+        config_t config;
+        rainflow_t rainflow;
+        state_t state{};
+
+        // Not persisted, as the charge count they refer to restarts at boot
+        bool started{};
+        int64_t last_us{};
+        int64_t rest_since_us{};
+        bool rest_taken{};             // The present rest period has given its rest point
+        bool anchored{};
+        float anchor_soc{};
+        double anchor_net_ah{};
+        int64_t anchor_us{};
+        int64_t last_checkpoint_us{};
+
+        void track_resistance(float resistance_ohm, double dt_s) {
+
+            if (!std::isfinite(resistance_ohm) || (dt_s <= 0.0)) return;
+
+            if (state.elapsed_us <= config.baseline_time_us) {
+                state.baseline_sum += resistance_ohm * dt_s;
+                state.baseline_weight_s += dt_s;
+            }
+            const double alpha = 1.0 - exp(-dt_s / config.resistance_time_constant_s);
+            state.resistance_ohm += alpha * (resistance_ohm - state.resistance_ohm);
+        }
+
+        void track_capacity(double net_ah, float current_a, float voltage_v, float temperature_c, int64_t now_us) {
+
+            if (fabsf(current_a) >= config.rest_current_a) {
+                rest_since_us = now_us;
+                rest_taken = false;
+                return;
+            }
+            if (rest_taken || ((now_us - rest_since_us) < config.rest_time_us)) return;
+            rest_taken = true;
+
+            const float shift = std::isfinite(temperature_c) ? (config.ocv_curve->temp_coeff_v_per_c * (temperature_c - 25.0f)) : 0.0f;
+            const float rest_soc = config.ocv_curve->soc_at(voltage_v - shift);
+
+            // The ends of the curve are clamped, so they don't tell how far past them the battery is
+            if ((rest_soc <= 0.0f) || (rest_soc >= 1.0f)) return;
+
+            if (anchored && ((now_us - anchor_us) <= config.max_anchor_age_us)) {
+                const float span = rest_soc - anchor_soc;
+                if (fabsf(span) < config.min_soc_span) return;
+
+                // Discharging lowers the state of charge, so the counted charge and the span have opposite signs
+                const float measured = static_cast<float>(-(net_ah - anchor_net_ah) / span);
+                if ((measured >= 0.5f * config.capacity_ah) && (measured <= 1.2f * config.capacity_ah)) {
+                    // The rated capacity counts as one measurement, so the first few are averaged before the gain takes over
+                    const float gain = std::max(config.capacity_gain, 1.0f / static_cast<float>(state.capacity_samples + 2));
+                    state.capacity_ah += gain * (measured - state.capacity_ah);
+                    state.capacity_samples++;
+                }
+            }
+
+            anchored = true;
+            anchor_soc = rest_soc;
+            anchor_net_ah = net_ah;
+            anchor_us = now_us;
+        }
+    };
+
+} // namespace sys
+
+
+#endif // _BATTERY_HEALTH_HPP_
@@ -0,0 +1,259 @@
+#ifndef _ENERGY_LEDGER_HPP_
+#define _ENERGY_LEDGER_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <array>
+#include <algorithm>
+
+
+namespace sys {
+
+    /**
+    * @brief Energy and charge accounting in hourly and daily buckets, with lifetime totals.
+    * Fed with the ADC driver's cumulative integrals, of which only the differences are used, so nothing is lost however
+    * seldom it's updated. Each update adds to the open hour, the open day and the lifetime totals; closing an hour clears
+    * a single bucket, so it's O(1) per update. The buckets live in fixed rings, the oldest overwritten first.
+    *
+    * There is no wall clock, so hours and days run on a ledger clock of monitored time, which is saved with the rest
+    * and stands still while the monitor is off. Free of ESP-IDF dependencies, persistence is left to the owner through
+    * `get_state()` / `restore()`
+    * @tparam HOURS Hourly buckets kept, at least a day's worth
+    * @tparam DAYS Daily buckets kept
+    */
+    template <size_t HOURS = 24, size_t DAYS = 31>
+    class energy_ledger_t {
+    public:
+        static constexpr uint32_t HOURS_PER_DAY = 24;
+        static_assert(HOURS >= HOURS_PER_DAY, "The hourly ring must hold at least a day");
+        static_assert(DAYS > 0, "The daily ring can't be empty");
+
+        struct config_t {
+            int64_t checkpoint_interval_us;     // Least time between two checkpoints, unless an hour closed
+            float checkpoint_min_change_wh;     // Least energy through the battery worth a checkpoint
+        };
+
+        /**
+        * @brief Energy and charge through a bucket. Floats, to keep the rings small
+        */
+        struct bucket_t {
+            float wh_in;                // While charging
+            float wh_out;               // While discharging
+            float ah_in;
+            float ah_out;
+        };
+
+        /**
+        * @brief Energy and charge through the battery, accumulated in doubles so small updates aren't rounded away
+        */
+        struct totals_t {
+            double wh_in;
+            double wh_out;
+            double ah_in;
+            double ah_out;
+        };
+
+        /**
+        * @brief Persistent state. Trivially copyable so it can be stored as is
+        */
+        struct state_t {
+            uint32_t version;
+            uint32_t hour;                          // Ledger hour of the open hourly bucket
+            int64_t elapsed_us;                     // Ledger clock, monitored time since the ledger was started
+            totals_t lifetime;
+            totals_t open_hour;                     // Accumulators of the open buckets, copied into the rings
+            totals_t open_day;
+            std::array<bucket_t, HOURS> hours;      // Hour h is at h % HOURS
+            std::array<bucket_t, DAYS> days;        // Day d, covering hours 24d to 24d + 23, is at d % DAYS
+        };
+
+        static constexpr uint32_t STATE_VERSION = 1;
+        static constexpr int64_t HOUR_US = 3'600'000'000LL;
+
+        explicit energy_ledger_t(const config_t& cfg): config(cfg) {}
+
+        /**
+        * @brief Restore a checkpoint. Call before the first `update()`
+        * @return false if the checkpoint is from another version or corrupt, in which case nothing changes
+        */
+        bool restore(const state_t& saved) {
+            if (saved.version != STATE_VERSION) return false;
+            if ((saved.elapsed_us < 0) || (static_cast<int64_t>(saved.hour) != saved.elapsed_us / HOUR_US)) return false;
+            if (!is_finite(saved.lifetime) || !is_finite(saved.open_hour) || !is_finite(saved.open_day)) return false;
+            state = saved;
+            sum_last_day();
+            return true;
+        }
+
+        /**
+        * @brief Add the energy and charge since the last update
+        * @param integrals Cumulative energy and charge through the battery, never decreasing
+        * @param now_us Monotonic time
+        */
+        void update(const totals_t& integrals, int64_t now_us) {
+
+            // The integrals count from boot, so the first reading is only a reference
+            if (!started) {
+                last_integrals = integrals;
+                last_us = now_us;
+                last_checkpoint_us = now_us;
+                checkpoint_wh = state.lifetime.wh_in + state.lifetime.wh_out;
+                started = true;
+                return;
+            }
+
+            const totals_t delta{
+                .wh_in = std::max(integrals.wh_in - last_integrals.wh_in, 0.0),
+                .wh_out = std::max(integrals.wh_out - last_integrals.wh_out, 0.0),
+                .ah_in = std::max(integrals.ah_in - last_integrals.ah_in, 0.0),
+                .ah_out = std::max(integrals.ah_out - last_integrals.ah_out, 0.0)
+            };
+            last_integrals = integrals;
+
+            state.elapsed_us += std::max(now_us - last_us, static_cast<int64_t>(0));
+            last_us = now_us;
+            advance(static_cast<uint32_t>(state.elapsed_us / HOUR_US));
+
+            add(state.open_hour, delta);
+            add(state.open_day, delta);
+            add(last_day, delta);
+            add(state.lifetime, delta);
+            state.hours[state.hour % HOURS] = to_bucket(state.open_hour);
+            state.days[(state.hour / HOURS_PER_DAY) % DAYS] = to_bucket(state.open_day);
+        }
+
+        /**
+        * @brief Totals since the ledger was started
+        */
+        [[nodiscard]] const totals_t& get_lifetime() const {
+            return state.lifetime;
+        }
+
+        /**
+        * @brief Totals of the last 24 hours, the open hour included
+        */
+        [[nodiscard]] const totals_t& get_last_day() const {
+            return last_day;
+        }
+
+        /**
+        * @brief Totals of the open day, since the ledger clock last passed a multiple of 24 hours
+        */
+        [[nodiscard]] const totals_t& get_today() const {
+            return state.open_day;
+        }
+
+        /**
+        * @brief Totals of a past hour
+        * @param ago 0 for the open hour, up to HOURS - 1
+        */
+        [[nodiscard]] bucket_t get_hour(uint32_t ago) const {
+            if ((ago >= HOURS) || (ago > state.hour)) return bucket_t{};
+            return state.hours[(state.hour - ago) % HOURS];
+        }
+
+        /**
+        * @brief Totals of a past day
+        * @param ago 0 for the open day, up to DAYS - 1
+        */
+        [[nodiscard]] bucket_t get_day(uint32_t ago) const {
+            const uint32_t day = state.hour / HOURS_PER_DAY;
+            if ((ago >= DAYS) || (ago > day)) return bucket_t{};
+            return state.days[(day - ago) % DAYS];
+        }
+
+        /**
+        * @brief State to checkpoint
+        */
+        [[nodiscard]] const state_t& get_state() const {
+            return state;
+        }
+
+        /**
+        * @brief Whether a checkpoint should be written now. Bounded by both time and change, to spare the flash, except
+        * that a closed hour is saved straight away so a reset never loses a finished bucket
+        */
+        [[nodiscard]] bool checkpoint_due(int64_t now_us) const {
+            if (!started) return false;
+            if (hour_closed) return true;
+            return ((now_us - last_checkpoint_us) >= config.checkpoint_interval_us) &&
+                   ((state.lifetime.wh_in + state.lifetime.wh_out - checkpoint_wh) >= config.checkpoint_min_change_wh);
+        }
+
+        /**
+        * @brief Mark the current state as saved
+        */
+        void checkpoint_done(int64_t now_us) {
+            last_checkpoint_us = now_us;
+            checkpoint_wh = state.lifetime.wh_in + state.lifetime.wh_out;
+            hour_closed = false;
+        }
+
+    private:
+        config_t config;
+        state_t state{ .version = STATE_VERSION };
+
+        // Not persisted
+        totals_t last_day{};            // Sum of the last HOURS_PER_DAY hourly buckets
+        totals_t last_integrals{};
+        int64_t last_us{};
+        int64_t last_checkpoint_us{};
+        double checkpoint_wh{};
+        bool hour_closed{};
+        bool started{};
+
+        static void add(totals_t& totals, const totals_t& delta) {
+            totals.wh_in += delta.wh_in;
+            totals.wh_out += delta.wh_out;
+            totals.ah_in += delta.ah_in;
+            totals.ah_out += delta.ah_out;
+        }
+
+        static bucket_t to_bucket(const totals_t& totals) {
+            return bucket_t{
+                .wh_in = static_cast<float>(totals.wh_in),
+                .wh_out = static_cast<float>(totals.wh_out),
+                .ah_in = static_cast<float>(totals.ah_in),
+                .ah_out = static_cast<float>(totals.ah_out)
+            };
+        }
+
+        static bool is_finite(const totals_t& totals) {
+            return std::isfinite(totals.wh_in) && std::isfinite(totals.wh_out) && std::isfinite(totals.ah_in) && std::isfinite(totals.ah_out);
+        }
+
+        // Open the buckets up to `hour`. Updates come far more often than hours, so that's one bucket at most
+        void advance(uint32_t hour) {
+
+            if (hour <= state.hour) return;
+
+            // Past a whole turn of the daily ring every bucket is stale
+            const uint32_t steps = std::min(hour - state.hour, static_cast<uint32_t>(DAYS * HOURS_PER_DAY));
+            for (uint32_t h = hour - steps + 1; h <= hour; h++) {
+                state.hours[h % HOURS] = bucket_t{};
+                if ((h % HOURS_PER_DAY) == 0) state.days[(h / HOURS_PER_DAY) % DAYS] = bucket_t{};
+            }
+            if ((hour / HOURS_PER_DAY) != (state.hour / HOURS_PER_DAY)) state.open_day = totals_t{};
+            state.open_hour = totals_t{};
+            state.hour = hour;
+            hour_closed = true;
+
+            // Re-summed rather than adjusted, so rounding doesn't build up. Once an hour
+            sum_last_day();
+        }
+
+        void sum_last_day() {
+            last_day = state.open_hour;
+            for (uint32_t ago = 1; ago < HOURS_PER_DAY; ago++) {
+                const bucket_t bucket = get_hour(ago);
+                add(last_day, totals_t{ bucket.wh_in, bucket.wh_out, bucket.ah_in, bucket.ah_out });
+            }
+        }
+    };
+
+} // namespace sys
+
+
+#endif // _ENERGY_LEDGER_HPP_
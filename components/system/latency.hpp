@@ -0,0 +1,111 @@
+#ifndef _LATENCY_HPP_
+#define _LATENCY_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+
+
+namespace sys {
+
+    /**
+    * @brief Pipeline stages that consume measurements, in pipeline order
+    */
+    enum class stage_t : uint8_t {
+        CALC = 0,
+        DISPLAY,
+        LOG,
+        BLE,
+        COUNT
+    };
+
+    /**
+    * @brief Histogram of the age of the measurements a stage consumes, plus stale and skipped counts from their sequence ids.
+    * Buckets are powers of 2 microseconds from 16µs, fine enough for the sub millisecond hop from the ADC driver to
+    * the calculation. Written by the stage's own task, readable from any task
+    */
+    class latency_histogram_t {
+    public:
+        // Bucket b holds ages in [16 * 2^(b-1), 16 * 2^b) us, bucket 0 below 16us. The last one is open ended (>= 4.194s)
+        static constexpr uint32_t FIRST_BUCKET_US = 16;
+        static constexpr size_t BUCKETS = 20;
+
+        /**
+        * @brief Copy of the histogram. The counts are read one by one, so a snapshot may straddle a `record()`
+        */
+        struct snapshot_t {
+            std::array<uint32_t, BUCKETS> buckets;
+            uint32_t count;         // Fresh measurements recorded
+            uint32_t stale;         // Measurements seen again, i.e. nothing new had arrived
+            uint32_t skipped;       // Measurements that never reached this stage
+            uint32_t max_us;
+        };
+        // Sent over BLE as is, so it must stay a packed run of uint32_t
+        static_assert(sizeof(snapshot_t) == (BUCKETS + 4) * sizeof(uint32_t), "snapshot_t must have no padding");
+
+        /**
+        * @brief Record one consumed measurement
+        * @param age_us Time since the measurement was captured
+        * @param seq Sequence id of the measurement
+        */
+        void record(int64_t age_us, uint32_t seq) {
+
+            if (has_seq && (seq == last_seq)) {
+                stale.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (has_seq) skipped.fetch_add(seq - last_seq - 1, std::memory_order_relaxed);
+            last_seq = seq;
+            has_seq = true;
+
+            const uint32_t age = (age_us <= 0) ? 0 : (age_us >= UINT32_MAX) ? UINT32_MAX : static_cast<uint32_t>(age_us);
+            size_t b = 0;
+            for (uint32_t units = age / FIRST_BUCKET_US; (units > 0) && (b < BUCKETS - 1); units >>= 1) b++;
+            buckets[b].fetch_add(1, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+            if (age > max_us.load(std::memory_order_relaxed)) max_us.store(age, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] snapshot_t snapshot() const {
+            snapshot_t snap{};
+            for (size_t b = 0; b < BUCKETS; b++) snap.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+            snap.count = count.load(std::memory_order_relaxed);
+            snap.stale = stale.load(std::memory_order_relaxed);
+            snap.skipped = skipped.load(std::memory_order_relaxed);
+            snap.max_us = max_us.load(std::memory_order_relaxed);
+            return snap;
+        }
+
+        /**
+        * @brief Upper bound of the bucket holding the given percentile, in microseconds. 0 if nothing was recorded.
+        * The open ended last bucket reports twice its lower bound
+        */
+        static uint32_t percentile_us(const snapshot_t& snap, uint32_t percent) {
+            if (snap.count == 0) return 0;
+            const uint64_t target = (static_cast<uint64_t>(snap.count) * percent + 99) / 100;
+            uint64_t seen = 0;
+            for (size_t b = 0; b < BUCKETS; b++) {
+                seen += snap.buckets[b];
+                if (seen >= target) return FIRST_BUCKET_US << b;
+            }
+            return FIRST_BUCKET_US << (BUCKETS - 1);
+        }
+
+    private:
+        std::array<std::atomic<uint32_t>, BUCKETS> buckets{};
+        std::atomic<uint32_t> count{};
+        std::atomic<uint32_t> stale{};
+        std::atomic<uint32_t> skipped{};
+        std::atomic<uint32_t> max_us{};
+
+        // Only touched by the recording task
+        uint32_t last_seq{};
+        bool has_seq{};
+    };
+
+} // namespace sys
+
+
+#endif // _LATENCY_HPP_
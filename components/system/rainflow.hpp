@@ -0,0 +1,174 @@
+#ifndef _RAINFLOW_HPP_
+#define _RAINFLOW_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <array>
+#include <algorithm>
+
+
+namespace sys {
+
+    /**
+    * @brief Streaming rainflow cycle counter (ASTM E1049 four point method) for a signal in 0 - 1, like the state of charge.
+    * Samples are reduced to turning points with a hysteresis, so noise doesn't count as cycles, and each closed cycle
+    * is binned by its depth and weighed with Miner's rule against a cycle life curve N(d) = N(1) * d^-k.
+    * The residue of open half cycles is held in a fixed stack; should it ever fill up, its oldest half cycle is counted
+    * as is to make room, so memory stays bounded. O(1) amortised per sample. Free of ESP-IDF dependencies
+    * @tparam STACK Turning points kept in the residue
+    * @tparam BINS Depth of discharge bins of the histogram, evenly spread over 0 - 1
+    */
+    template <size_t STACK = 32, size_t BINS = 10>
+    class rainflow_counter_t {
+    public:
+        static_assert(STACK >= 4, "The four point method needs at least four turning points");
+
+        struct config_t {
+            float hysteresis;           // Least reversal counted as a turning point
+            float cycle_life;           // Cycles to end of life at a depth of 1
+            float cycle_life_exponent;  // k of the cycle life curve
+        };
+
+        /**
+        * @brief Persistent state. Trivially copyable so it can be stored as is
+        */
+        struct state_t {
+            std::array<uint32_t, BINS> half_cycles;    // Closed half cycles per depth bin, a full cycle counts twice
+            double damage;                             // Share of the cycle life used up, 1 at end of life
+            double equivalent_cycles;                  // Sum of the depth of every closed cycle
+            std::array<float, STACK> residue;          // Turning points not yet part of a closed cycle
+            float candidate;                           // Extreme since the last turning point
+            uint8_t residue_count;
+            int8_t direction;                          // Of the signal since the last turning point, 0 before the first
+        };
+
+        explicit rainflow_counter_t(const config_t& cfg): config(cfg) {}
+
+        /**
+        * @brief Restore a checkpoint. Call before the first `update()`
+        * @return false if it's corrupt, in which case nothing changes
+        */
+        bool restore(const state_t& saved) {
+            if ((saved.residue_count > STACK) || (saved.direction < -1) || (saved.direction > 1)) return false;
+            if (!std::isfinite(saved.damage) || !std::isfinite(saved.equivalent_cycles) || !std::isfinite(saved.candidate)) return false;
+            state = saved;
+            return true;
+        }
+
+        /**
+        * @brief Add a sample
+        */
+        void update(float value) {
+
+            if (!std::isfinite(value)) return;
+            value = std::clamp(value, 0.0f, 1.0f);
+
+            if (state.residue_count == 0) {
+                push(value);
+                state.candidate = value;
+                return;
+            }
+
+            // The candidate follows the signal while it keeps going the same way, and becomes a turning point once
+            // the signal has come back from it by the hysteresis
+            switch (state.direction) {
+                case 0:
+                    if (fabsf(value - state.candidate) < config.hysteresis) return;
+                    state.direction = (value > state.candidate) ? 1 : -1;
+                    state.candidate = value;
+                    break;
+                case 1:
+                    if (value > state.candidate) {
+                        state.candidate = value;
+                    } else if ((state.candidate - value) >= config.hysteresis) {
+                        push(state.candidate);
+                        state.candidate = value;
+                        state.direction = -1;
+                    }
+                    break;
+                default:
+                    if (value < state.candidate) {
+                        state.candidate = value;
+                    } else if ((value - state.candidate) >= config.hysteresis) {
+                        push(state.candidate);
+                        state.candidate = value;
+                        state.direction = 1;
+                    }
+                    break;
+            }
+        }
+
+        /**
+        * @brief Depth of discharge of each bin's upper edge
+        */
+        static constexpr float bin_depth(size_t bin) {
+            return static_cast<float>(bin + 1) / BINS;
+        }
+
+        [[nodiscard]] const state_t& get_state() const {
+            return state;
+        }
+
+        /**
+        * @brief Share of the cycle life used up by the closed cycles, 1 at end of life
+        */
+        [[nodiscard]] double get_damage() const {
+            return state.damage;
+        }
+
+        /**
+        * @brief Closed cycles as full depth ones, the sum of their depths
+        */
+        [[nodiscard]] double get_equivalent_cycles() const {
+            return state.equivalent_cycles;
+        }
+
+    private:
+        config_t config;
+        state_t state{};
+
+        void push(float point) {
+
+            if (state.residue_count == STACK) {
+                count(fabsf(state.residue[1] - state.residue[0]), 0.5f);
+                drop(0, 1);
+            }
+            state.residue[state.residue_count++] = point;
+
+            // Four point method: an inner range no larger than both of its neighbours is a closed cycle. With only three
+            // points the start of the signal takes part, so the range is a half cycle and only the start drops out
+            while (state.residue_count >= 3) {
+                const uint8_t n = state.residue_count;
+                const float outer = fabsf(state.residue[n - 1] - state.residue[n - 2]);
+                const float inner = fabsf(state.residue[n - 2] - state.residue[n - 3]);
+                if (outer < inner) break;
+                if (n == 3) {
+                    count(inner, 0.5f);
+                    drop(0, 1);
+                } else {
+                    count(inner, 1.0f);
+                    drop(n - 3, 2);
+                }
+            }
+        }
+
+        void drop(uint8_t first, uint8_t length) {
+            std::copy(state.residue.begin() + first + length, state.residue.begin() + state.residue_count, state.residue.begin() + first);
+            state.residue_count -= length;
+        }
+
+        void count(float depth, float cycles) {
+            if (depth <= 0.0f) return;
+            const size_t bin = std::min(static_cast<size_t>(depth * BINS), BINS - 1);
+            state.half_cycles[bin] += static_cast<uint32_t>(cycles * 2.0f);
+            state.equivalent_cycles += depth * cycles;
+            state.damage += cycles / (config.cycle_life * powf(depth, -config.cycle_life_exponent));
+        }
+    };
+
+} // namespace sys
+
+
+#endif // _RAINFLOW_HPP_
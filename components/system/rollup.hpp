@@ -0,0 +1,230 @@
+#ifndef _ROLLUP_HPP_
+#define _ROLLUP_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <array>
+#include <algorithm>
+
+
+namespace sys {
+
+    enum class rollup_tier_t : uint8_t {
+        MINUTE = 0,
+        HOUR,
+        DAY,
+        COUNT
+    };
+
+    /**
+    * @brief One field over one period
+    */
+    struct rollup_stats_t {
+        float min;
+        float max;
+        float mean;
+        float last;
+        uint32_t count;                 // Samples that had the field, 0 if it was missing throughout (the rest are NaN)
+    };
+
+    /**
+    * @brief Aggregates of every field over one period. Trivially copyable so it can be stored as is
+    */
+    template <size_t FIELDS>
+    struct rollup_record_t {
+        uint32_t period;                // Minute, hour or day on the rollup clock
+        uint32_t samples;               // Samples in the period, 0 if there's no record of it
+        std::array<rollup_stats_t, FIELDS> fields;
+    };
+
+    /**
+    * @brief Minute, hour and day aggregates of a set of fields (min, max, mean and last), kept up as samples arrive.
+    * Samples add to the open minute; a closed minute is folded into the open hour and a closed hour into the open day,
+    * so each update is O(FIELDS) whatever the tier. Only closed periods are handed out, for the owner to store.
+    *
+    * There is no wall clock, so periods run on a rollup clock of monitored time that stands still while the monitor
+    * is off. After a restart the owner resumes it from the newest stored period and folds the stored records of the
+    * open hour and day back in. Free of ESP-IDF dependencies
+    * @tparam FIELDS Values per sample
+    */
+    template <size_t FIELDS>
+    class rollup_t {
+    public:
+        using record_t = rollup_record_t<FIELDS>;
+        using values_t = std::array<float, FIELDS>;
+
+        static constexpr size_t TIERS = static_cast<size_t>(rollup_tier_t::COUNT);
+        static constexpr int64_t MINUTE_MS = 60'000;
+        static constexpr uint32_t MINUTES_PER_HOUR = 60;
+        static constexpr uint32_t MINUTES_PER_DAY = 1440;
+
+        /**
+        * @brief Period of `tier` that a minute falls in
+        */
+        static constexpr uint32_t period_of(rollup_tier_t tier, uint32_t minute) {
+            switch (tier) {
+                case rollup_tier_t::HOUR: return minute / MINUTES_PER_HOUR;
+                case rollup_tier_t::DAY: return minute / MINUTES_PER_DAY;
+                default: return minute;
+            }
+        }
+
+        /**
+        * @brief First minute of a period of `tier`
+        */
+        static constexpr uint32_t first_minute(rollup_tier_t tier, uint32_t period) {
+            switch (tier) {
+                case rollup_tier_t::HOUR: return period * MINUTES_PER_HOUR;
+                case rollup_tier_t::DAY: return period * MINUTES_PER_DAY;
+                default: return period;
+            }
+        }
+
+        rollup_t() {
+            resume(0);
+        }
+
+        /**
+        * @brief Restart the clock at `minute`, with every tier open and empty. Call before the first `update()`
+        */
+        void resume(uint32_t minute) {
+            start_minute = minute;
+            elapsed_ms = 0;
+            started = false;
+            for (size_t t = 0; t < TIERS; t++) open(t, period_of(static_cast<rollup_tier_t>(t), minute));
+        }
+
+        /**
+        * @brief Fold a stored record of the tier below back into the open period of `tier`, after `resume()`.
+        * Records outside the open period are ignored, so the owner can pass whatever it has
+        */
+        void fold(rollup_tier_t tier, const record_t& record) {
+            const size_t t = static_cast<size_t>(tier);
+            if ((t == 0) || (t >= TIERS) || (record.samples == 0)) return;
+            if (period_of(tier, first_minute(static_cast<rollup_tier_t>(t - 1), record.period)) != accumulators[t].record.period) return;
+            merge(accumulators[t], record);
+        }
+
+        /**
+        * @brief Add a sample
+        * @param values NaN for fields that are missing
+        * @param now_ms Monotonic time
+        * @return Bitmask of the tiers, 1 << tier, that closed a period with samples, to be fetched with `get_closed()`
+        */
+        uint8_t update(const values_t& values, int64_t now_ms) {
+
+            if (!started) {
+                last_ms = now_ms;
+                started = true;
+            }
+            elapsed_ms += std::max(now_ms - last_ms, static_cast<int64_t>(0));
+            last_ms = now_ms;
+
+            uint8_t closed = 0;
+            const uint32_t minute = start_minute + static_cast<uint32_t>(elapsed_ms / MINUTE_MS);
+            if (minute != accumulators[0].record.period) closed = advance(minute);
+
+            accumulator_t& acc = accumulators[0];
+            for (size_t f = 0; f < FIELDS; f++) {
+                if (!std::isfinite(values[f])) continue;
+                rollup_stats_t& stats = acc.record.fields[f];
+                stats.min = (stats.count == 0) ? values[f] : std::min(stats.min, values[f]);
+                stats.max = (stats.count == 0) ? values[f] : std::max(stats.max, values[f]);
+                stats.last = values[f];
+                stats.count++;
+                acc.sums[f] += values[f];
+            }
+            acc.record.samples++;
+            return closed;
+        }
+
+        /**
+        * @brief Last closed period of a tier
+        */
+        [[nodiscard]] const record_t& get_closed(rollup_tier_t tier) const {
+            return closed_records[static_cast<size_t>(tier)];
+        }
+
+        /**
+        * @brief Aggregates of the open period of a tier so far. Hours and days only hold the minutes closed so far
+        */
+        [[nodiscard]] record_t get_open(rollup_tier_t tier) const {
+            return finish(accumulators[static_cast<size_t>(tier)]);
+        }
+
+        /**
+        * @brief Number of the open period of a tier
+        */
+        [[nodiscard]] uint32_t get_period(rollup_tier_t tier) const {
+            return accumulators[static_cast<size_t>(tier)].record.period;
+        }
+
+    private:
+        struct accumulator_t {
+            record_t record;                    // Mean not filled in until it closes
+            std::array<double, FIELDS> sums;
+        };
+
+        std::array<accumulator_t, TIERS> accumulators{};
+        std::array<record_t, TIERS> closed_records{};
+        uint32_t start_minute{};
+        int64_t elapsed_ms{};
+        int64_t last_ms{};
+        bool started{};
+
+        void open(size_t t, uint32_t period) {
+            accumulators[t] = accumulator_t{};
+            accumulators[t].record.period = period;
+        }
+
+        static record_t finish(const accumulator_t& acc) {
+            record_t record = acc.record;
+            for (size_t f = 0; f < FIELDS; f++) {
+                rollup_stats_t& stats = record.fields[f];
+                if (stats.count == 0) {
+                    stats.min = stats.max = stats.mean = stats.last = NAN;
+                } else {
+                    stats.mean = static_cast<float>(acc.sums[f] / stats.count);
+                }
+            }
+            return record;
+        }
+
+        // Records arrive in time order, so the last one's last value is the latest
+        static void merge(accumulator_t& acc, const record_t& record) {
+            for (size_t f = 0; f < FIELDS; f++) {
+                const rollup_stats_t& from = record.fields[f];
+                if (from.count == 0) continue;
+                rollup_stats_t& stats = acc.record.fields[f];
+                stats.min = (stats.count == 0) ? from.min : std::min(stats.min, from.min);
+                stats.max = (stats.count == 0) ? from.max : std::max(stats.max, from.max);
+                stats.last = from.last;
+                stats.count += from.count;
+                acc.sums[f] += static_cast<double>(from.mean) * from.count;
+            }
+            acc.record.samples += record.samples;
+        }
+
+        // Close the open periods that `minute` is past, each folded into the tier above before that one closes
+        uint8_t advance(uint32_t minute) {
+            uint8_t closed = 0;
+            for (size_t t = 0; t < TIERS; t++) {
+                const uint32_t period = period_of(static_cast<rollup_tier_t>(t), minute);
+                if (period == accumulators[t].record.period) break;
+                if (accumulators[t].record.samples > 0) {
+                    closed_records[t] = finish(accumulators[t]);
+                    closed |= static_cast<uint8_t>(1 << t);
+                    if ((t + 1) < TIERS) merge(accumulators[t + 1], closed_records[t]);
+                }
+                open(t, period);
+            }
+            return closed;
+        }
+    };
+
+} // namespace sys
+
+
+#endif // _ROLLUP_HPP_
@@ -0,0 +1,129 @@
+#ifndef _RUNTIME_PREDICTOR_HPP_
+#define _RUNTIME_PREDICTOR_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <array>
+#include <algorithm>
+
+
+namespace sys {
+
+    /**
+    * @brief Runtime prediction from the load history.
+    * Exponentially weighted averages of the battery current over a few horizons are blended into a typical load,
+    * so the prediction doesn't swing with every load step. How far the horizons disagree, together with the uncertainty
+    * of the charge, sets a confidence band around it. O(1) in memory and per update. Free of ESP-IDF dependencies
+    * @tparam HORIZONS Number of averaging horizons
+    */
+    template <size_t HORIZONS>
+    class runtime_predictor_t {
+    public:
+        struct config_t {
+            std::array<float, HORIZONS> time_constants_s;  // Averaging time constant of each horizon
+            std::array<float, HORIZONS> weights;           // Share of each horizon in the blend, once it has warmed up
+            float min_current_a;                           // Loads below this count as none at all
+            float rated_current_a;                         // Discharge current the battery capacity is rated at
+            float peukert_exponent;                        // 1 for a battery whose capacity doesn't depend on the load
+            uint64_t max_runtime_s;                        // Cap on all predictions, and the prediction without a load
+        };
+
+        /**
+        * @brief Predicted time until the battery is empty, or full while charging, with its confidence band
+        */
+        struct prediction_t {
+            uint64_t estimate_s;
+            uint64_t low_s;
+            uint64_t high_s;
+        };
+
+        explicit runtime_predictor_t(const config_t& cfg): config(cfg) {}
+
+        /**
+        * @brief Add a current reading
+        * @param current_a Battery current, positive while discharging
+        * @param now_us Monotonic time
+        */
+        void update(float current_a, int64_t now_us) {
+
+            if (!std::isfinite(current_a)) return;
+
+            // The averages start from the first reading rather than ramping up from 0
+            if (!started) {
+                averages.fill(current_a);
+                start_us = now_us;
+                last_us = now_us;
+                started = true;
+                return;
+            }
+
+            const float dt_s = static_cast<float>(now_us - last_us) / 1'000'000.0f;
+            last_us = now_us;
+            if (dt_s <= 0.0f) return;
+
+            // Exact for uneven reading intervals
+            for (size_t h = 0; h < HORIZONS; h++) {
+                const float alpha = 1.0f - expf(-dt_s / config.time_constants_s[h]);
+                averages[h] += alpha * (current_a - averages[h]);
+            }
+        }
+
+        /**
+        * @brief Predict the runtime
+        * @param charge_ah Charge left to use, or to fill while charging
+        * @param charge_sigma_ah Uncertainty of `charge_ah`, 1 sigma
+        * @param charging Predict the time to full instead of the time to empty
+        */
+        [[nodiscard]] prediction_t predict(float charge_ah, float charge_sigma_ah, bool charging) const {
+
+            if (!started) return prediction_t{ config.max_runtime_s, 0, config.max_runtime_s };
+
+            // Horizons get their share of the blend as they warm up, so the short ones carry the estimate at first
+            const float elapsed_s = static_cast<float>(last_us - start_us) / 1'000'000.0f;
+            const float sign = charging ? -1.0f : 1.0f;
+            float blended = 0.0f;
+            float total_weight = 0.0f;
+            float lightest = INFINITY;
+            float heaviest = -INFINITY;
+            for (size_t h = 0; h < HORIZONS; h++) {
+                const float load = sign * averages[h];
+                const float weight = config.weights[h] * std::min(elapsed_s / config.time_constants_s[h], 1.0f);
+                blended += weight * load;
+                total_weight += weight;
+                lightest = std::min(lightest, load);
+                heaviest = std::max(heaviest, load);
+            }
+            blended = (total_weight > 0.0f) ? (blended / total_weight) : (sign * averages[0]);
+
+            const float charge = std::max(charge_ah, 0.0f);
+            const float sigma = std::max(charge_sigma_ah, 0.0f);
+            return prediction_t{
+                .estimate_s = runtime_s(charge, blended, charging),
+                .low_s = runtime_s(std::max(charge - sigma, 0.0f), heaviest, charging),
+                .high_s = runtime_s(charge + sigma, lightest, charging)
+            };
+        }
+
+    private:
+        config_t config;
+        std::array<float, HORIZONS> averages{};
+        int64_t start_us{};
+        int64_t last_us{};
+        bool started{};
+
+        [[nodiscard]] uint64_t runtime_s(float charge_ah, float load_a, bool charging) const {
+            if (load_a < config.min_current_a) return config.max_runtime_s;
+            // Peukert's law: loads heavier than the rated one get less of the charge out. Lighter ones are held to the
+            // rated capacity, as the law overstates what they gain
+            if (!charging) charge_ah *= std::min(powf(config.rated_current_a / load_a, config.peukert_exponent - 1.0f), 1.0f);
+            const float seconds = charge_ah / load_a * 3600.0f;
+            return (seconds >= static_cast<float>(config.max_runtime_s)) ? config.max_runtime_s : static_cast<uint64_t>(seconds);
+        }
+    };
+
+} // namespace sys
+
+
+#endif // _RUNTIME_PREDICTOR_HPP_
@@ -0,0 +1,426 @@
+#ifndef _SERIES_CODEC_HPP_
+#define _SERIES_CODEC_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <array>
+#include <limits>
+
+
+namespace sys {
+
+    /**
+    * @brief CRC-32 (IEEE 802.3, reflected, as zlib), table driven. Chain blocks by passing the last result as `crc`
+    */
+    inline uint32_t crc32(const void* data, size_t length, uint32_t crc = 0) {
+
+        static constexpr auto TABLE = [] {
+            std::array<uint32_t, 256> table{};
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int bit = 0; bit < 8; bit++) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+                table[i] = c;
+            }
+            return table;
+        }();
+
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++) crc = TABLE[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    /**
+    * @brief Compressed time series log format, in fixed size blocks that each decode on their own.
+    *
+    * Every block is a header, with a CRC over the rest of the block, followed by a bit stream of samples. A sample is
+    * a timestamp and CHANNELS floats. Timestamps are coded as the change of the interval since the previous sample
+    * (delta of delta), which is 0 and takes a single bit as long as the samples are evenly spaced. Values are
+    * quantised to a fixed step per channel and coded as the change from the previous value of the channel, in the
+    * shortest of a few bucket widths; an unchanged value also takes a single bit. NaN is a value like any other, so
+    * missing readings cost nothing while they stay missing.
+    *
+    * Header layout is little endian and naturally aligned, as on both the ESP32 and the usual hosts, so a block is
+    * written and read as is. Free of ESP-IDF dependencies, so the same code decodes the log on a host
+    * @tparam CHANNELS Values per sample
+    * @tparam BLOCK_SIZE Bytes per block, header included
+    */
+    template <size_t CHANNELS, size_t BLOCK_SIZE>
+    struct series_format_t {
+
+        static_assert((CHANNELS > 0) && (CHANNELS <= 255), "1 - 255 channels");
+
+        static constexpr uint32_t MAGIC = 0x31535253; // "SRS1"
+
+        struct header_t {
+            uint32_t magic;
+            uint32_t crc;                           // Of the rest of the header and the payload
+            int64_t first_ms;                       // Timestamp of the first sample
+            uint32_t seq;                           // Block number, counting up from block to block
+            uint16_t boot;                          // Boot the block was written in. Timestamps restart at every boot
+            uint16_t count;                         // Samples in the block
+            uint16_t payload_bytes;                 // Bytes of the bit stream in use
+            uint8_t channels;
+            uint8_t reserved;
+            std::array<float, CHANNELS> steps;      // Quantisation step of each channel
+        };
+
+        static constexpr size_t PAYLOAD_SIZE = BLOCK_SIZE - sizeof(header_t);
+        static_assert(BLOCK_SIZE > sizeof(header_t) + 64, "Block too small");
+        static_assert(PAYLOAD_SIZE <= std::numeric_limits<uint16_t>::max(), "Block too large");
+
+        // Delta of delta buckets of the timestamps, in ms, after their prefixes 10, 110, 1110 and 1111
+        static constexpr std::array<uint8_t, 4> TIME_BITS = { 7, 12, 20, 64 };
+        // Value change buckets, in steps, after the same prefixes. The last one holds the value itself
+        static constexpr std::array<uint8_t, 4> VALUE_BITS = { 3, 7, 14, 32 };
+        // Value of the last bucket that stands for NaN
+        static constexpr int32_t NAN_CODE = std::numeric_limits<int32_t>::min();
+
+        [[nodiscard]] static uint32_t block_crc(const uint8_t* block, size_t payload_bytes) {
+            constexpr size_t CRC_END = offsetof(header_t, crc) + sizeof(uint32_t);
+            return crc32(block + CRC_END, sizeof(header_t) - CRC_END + payload_bytes);
+        }
+    };
+
+    /**
+    * @brief Encodes samples into one block at a time. O(CHANNELS) per sample, no allocations
+    */
+    template <size_t CHANNELS, size_t BLOCK_SIZE>
+    class series_encoder_t {
+    public:
+        using format_t = series_format_t<CHANNELS, BLOCK_SIZE>;
+        using header_t = typename format_t::header_t;
+        using values_t = std::array<float, CHANNELS>;
+
+        explicit series_encoder_t(const std::array<float, CHANNELS>& channel_steps): steps(channel_steps) {}
+
+        /**
+        * @brief Start a new, empty block
+        * @param seq Block number, one up from the last one written
+        * @param boot Boot the block is written in
+        */
+        void begin(uint32_t seq, uint16_t boot) {
+            block.fill(0);
+            header = header_t{ .magic = format_t::MAGIC, .crc = 0, .first_ms = 0, .seq = seq, .boot = boot, .count = 0, .payload_bytes = 0, .channels = CHANNELS, .reserved = 0, .steps = steps };
+            bit_pos = 0;
+        }
+
+        /**
+        * @brief Add a sample to the block
+        * @param timestamp_ms Not before the previous sample's
+        * @return false if the block is full, in which case it's unchanged: seal it and begin the next one
+        */
+        bool append(int64_t timestamp_ms, const values_t& values) {
+
+            if (header.count == std::numeric_limits<uint16_t>::max()) return false;
+
+            // Encoded against copies, so a sample that doesn't fit leaves no trace
+            const size_t start_pos = bit_pos;
+            int64_t delta_ms = last_delta_ms;
+            std::array<channel_t, CHANNELS> next = channels;
+            overflow = false;
+
+            if (header.count == 0) {
+                header.first_ms = timestamp_ms;
+                delta_ms = 0;
+                for (auto& channel : next) channel = channel_t{};
+            } else {
+                const int64_t delta = timestamp_ms - last_ms;
+                put_bucketed(delta - delta_ms, format_t::TIME_BITS);
+                delta_ms = delta;
+            }
+
+            for (size_t c = 0; c < CHANNELS; c++) put_value(next[c], values[c], steps[c]);
+
+            if (overflow) {
+                clear_bits(start_pos);
+                bit_pos = start_pos;
+                return false;
+            }
+
+            channels = next;
+            last_delta_ms = delta_ms;
+            last_ms = timestamp_ms;
+            header.count++;
+            return true;
+        }
+
+        /**
+        * @brief Fill in the header of the block as it stands. The block can still be added to, and sealed again
+        * @return The block, BLOCK_SIZE bytes
+        */
+        const uint8_t* seal() {
+            header.payload_bytes = static_cast<uint16_t>((bit_pos + 7) / 8);
+            memcpy(block.data(), &header, sizeof(header_t));
+            const uint32_t crc = format_t::block_crc(block.data(), header.payload_bytes);
+            memcpy(block.data() + offsetof(header_t, crc), &crc, sizeof(crc));
+            return block.data();
+        }
+
+        [[nodiscard]] uint16_t get_count() const {
+            return header.count;
+        }
+
+        /**
+        * @brief Bytes of the block in use, header included
+        */
+        [[nodiscard]] size_t get_size() const {
+            return sizeof(header_t) + (bit_pos + 7) / 8;
+        }
+
+    private:
+        struct channel_t {
+            int32_t last;       // Last value that wasn't NaN, in steps
+            bool nan;           // The previous sample was NaN
+        };
+
+        std::array<float, CHANNELS> steps;
+        header_t header{};
+        std::array<uint8_t, BLOCK_SIZE> block{};
+        std::array<channel_t, CHANNELS> channels{};
+        size_t bit_pos{};
+        int64_t last_ms{};
+        int64_t last_delta_ms{};
+        bool overflow{};
+
+        // Most significant bit first, a byte at a time
+        void put_bits(uint64_t bits, uint8_t length) {
+            if (bit_pos + length > format_t::PAYLOAD_SIZE * 8) {
+                overflow = true;
+                return;
+            }
+            uint8_t* payload = block.data() + sizeof(header_t);
+            while (length > 0) {
+                const uint8_t room = 8 - (bit_pos % 8);
+                const uint8_t n = (length < room) ? length : room;
+                const uint8_t chunk = static_cast<uint8_t>((bits >> (length - n)) & ((1u << n) - 1));
+                payload[bit_pos / 8] |= static_cast<uint8_t>(chunk << (room - n));
+                bit_pos += n;
+                length -= n;
+            }
+        }
+
+        void clear_bits(size_t from) {
+            uint8_t* payload = block.data() + sizeof(header_t);
+            for (size_t pos = from; pos < bit_pos; pos++) payload[pos / 8] &= static_cast<uint8_t>(~(0x80 >> (pos % 8)));
+        }
+
+        // 0 for 0, or the prefix of the narrowest bucket the value fits in followed by the value, two's complement
+        void put_bucketed(int64_t value, const std::array<uint8_t, 4>& widths) {
+            if (value == 0) {
+                put_bits(0, 1);
+                return;
+            }
+            for (uint8_t bucket = 0; bucket < widths.size(); bucket++) {
+                const uint8_t width = widths[bucket];
+                const int64_t limit = (width >= 64) ? std::numeric_limits<int64_t>::max() : (int64_t{1} << (width - 1));
+                if ((width >= 64) || ((value >= -limit) && (value < limit))) {
+                    put_prefix(bucket);
+                    put_bits(static_cast<uint64_t>(value), width);
+                    return;
+                }
+            }
+        }
+
+        // 10, 110, 1110 or 1111
+        void put_prefix(uint8_t bucket) {
+            if (bucket < 3) {
+                put_bits(((1u << (bucket + 1)) - 1) << 1, bucket + 2);
+            } else {
+                put_bits(0b1111, 4);
+            }
+        }
+
+        void put_value(channel_t& channel, float value, float step) {
+
+            const auto& widths = format_t::VALUE_BITS;
+            const bool nan = !std::isfinite(value);
+
+            if (nan) {
+                if (!channel.nan) {
+                    put_prefix(3);
+                    put_bits(static_cast<uint32_t>(format_t::NAN_CODE), widths[3]);
+                } else {
+                    put_bits(0, 1);
+                }
+                channel.nan = true;
+                return;
+            }
+
+            const double scaled = std::round(static_cast<double>(value) / step);
+            const int32_t q = static_cast<int32_t>(std::fmin(std::fmax(scaled, format_t::NAN_CODE + 1.0), std::numeric_limits<int32_t>::max()));
+            const int64_t delta = static_cast<int64_t>(q) - channel.last;
+
+            if ((delta == 0) && !channel.nan) {
+                put_bits(0, 1);
+            } else {
+                // A change after NaN can be 0, which only the buckets can hold
+                bool done = false;
+                for (uint8_t bucket = 0; (bucket < 3) && !done; bucket++) {
+                    const int64_t limit = int64_t{1} << (widths[bucket] - 1);
+                    if ((delta >= -limit) && (delta < limit)) {
+                        put_prefix(bucket);
+                        put_bits(static_cast<uint64_t>(delta), widths[bucket]);
+                        done = true;
+                    }
+                }
+                if (!done) {
+                    put_prefix(3);
+                    put_bits(static_cast<uint32_t>(q), widths[3]);
+                }
+            }
+            channel.last = q;
+            channel.nan = false;
+        }
+    };
+
+    /**
+    * @brief Decodes the samples of one block
+    */
+    template <size_t CHANNELS, size_t BLOCK_SIZE>
+    class series_decoder_t {
+    public:
+        using format_t = series_format_t<CHANNELS, BLOCK_SIZE>;
+        using header_t = typename format_t::header_t;
+        using values_t = std::array<float, CHANNELS>;
+
+        /**
+        * @brief Read the header of a block, without checking the payload
+        * @return false if it isn't a block of this format
+        */
+        [[nodiscard]] static bool peek(const uint8_t* data, header_t& header) {
+            memcpy(&header, data, sizeof(header_t));
+            return (header.magic == format_t::MAGIC) && (header.channels == CHANNELS) &&
+                   (header.payload_bytes <= format_t::PAYLOAD_SIZE);
+        }
+
+        /**
+        * @brief Start decoding a block
+        * @param data BLOCK_SIZE bytes, kept until the last sample has been read
+        * @return false if it isn't a block of this format or its CRC doesn't match
+        */
+        bool open(const uint8_t* data) {
+            block = nullptr;
+            if (!peek(data, header)) return false;
+            if (format_t::block_crc(data, header.payload_bytes) != header.crc) return false;
+            block = data;
+            bit_pos = 0;
+            read = 0;
+            return true;
+        }
+
+        [[nodiscard]] const header_t& get_header() const {
+            return header;
+        }
+
+        /**
+        * @brief Next sample of the block
+        * @return false once every sample has been read, or if the payload is malformed
+        */
+        bool next(int64_t& timestamp_ms, values_t& values) {
+
+            if (!block || (read >= header.count)) return false;
+            underflow = false;
+
+            if (read == 0) {
+                last_ms = header.first_ms;
+                last_delta_ms = 0;
+                channels.fill(channel_t{});
+            } else {
+                last_delta_ms += get_bucketed(format_t::TIME_BITS);
+                last_ms += last_delta_ms;
+            }
+            timestamp_ms = last_ms;
+
+            for (size_t c = 0; c < CHANNELS; c++) values[c] = get_value(channels[c], header.steps[c]);
+
+            if (underflow) {
+                block = nullptr;
+                return false;
+            }
+            read++;
+            return true;
+        }
+
+    private:
+        struct channel_t {
+            int32_t last;
+            bool nan;
+        };
+
+        header_t header{};
+        const uint8_t* block{};
+        std::array<channel_t, CHANNELS> channels{};
+        size_t bit_pos{};
+        uint16_t read{};
+        int64_t last_ms{};
+        int64_t last_delta_ms{};
+        bool underflow{};
+
+        uint64_t get_bits(uint8_t length) {
+            if (bit_pos + length > static_cast<size_t>(header.payload_bytes) * 8) {
+                underflow = true;
+                return 0;
+            }
+            const uint8_t* payload = block + sizeof(header_t);
+            uint64_t bits = 0;
+            while (length > 0) {
+                const uint8_t room = 8 - (bit_pos % 8);
+                const uint8_t n = (length < room) ? length : room;
+                bits = (bits << n) | ((payload[bit_pos / 8] >> (room - n)) & ((1u << n) - 1));
+                bit_pos += n;
+                length -= n;
+            }
+            return bits;
+        }
+
+        // -1 for a single 0 bit, else the bucket of the prefix
+        int8_t get_prefix() {
+            for (int8_t ones = 0; ones < 4; ones++) {
+                if (get_bits(1) == 0) return ones - 1;
+            }
+            return 3;
+        }
+
+        static int64_t sign_extend(uint64_t bits, uint8_t width) {
+            if (width >= 64) return static_cast<int64_t>(bits);
+            const uint64_t sign = uint64_t{1} << (width - 1);
+            return static_cast<int64_t>((bits ^ sign) - sign);
+        }
+
+        int64_t get_bucketed(const std::array<uint8_t, 4>& widths) {
+            const int8_t bucket = get_prefix();
+            if (bucket < 0) return 0;
+            return sign_extend(get_bits(widths[bucket]), widths[bucket]);
+        }
+
+        float get_value(channel_t& channel, float step) {
+
+            const auto& widths = format_t::VALUE_BITS;
+            const int8_t bucket = get_prefix();
+
+            if (bucket < 0) {
+                return channel.nan ? NAN : static_cast<float>(channel.last * static_cast<double>(step));
+            }
+            if (bucket == 3) {
+                const int32_t q = static_cast<int32_t>(get_bits(widths[3]));
+                if (q == format_t::NAN_CODE) {
+                    channel.nan = true;
+                    return NAN;
+                }
+                channel.last = q;
+            } else {
+                channel.last += static_cast<int32_t>(sign_extend(get_bits(widths[bucket]), widths[bucket]));
+            }
+            channel.nan = false;
+            return static_cast<float>(channel.last * static_cast<double>(step));
+        }
+    };
+
+} // namespace sys
+
+
+#endif // _SERIES_CODEC_HPP_
@@ -0,0 +1,302 @@
+#ifndef _SOC_ESTIMATOR_HPP_
+#define _SOC_ESTIMATOR_HPP_
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#include "battery_profile.hpp"
+
+
+namespace sys {
+
+    /**
+    * @brief Battery state of charge from an extended Kalman filter over a single state, the state of charge.
+    * The prediction is coulomb counting on the ADC driver's charge integrals. Only their differences are used, so nothing
+    * is lost however seldom it's updated. The correction compares the terminal voltage with the open circuit voltage table
+    * minus the drop across the internal resistance, which is itself measured online from the voltage change over current steps.
+    *
+    * A load step makes the voltage jump and then slowly settle as the battery polarises, which this model doesn't cover,
+    * so voltage corrections are held off for a while after every step and weighted down under load. The estimate only
+    * moves as fast as the evidence warrants, instead of following every step.
+    * Free of ESP-IDF dependencies, persistence is left to the owner through `get_state()` / `restore()`
+    */
+    class soc_estimator_t {
+    public:
+        struct config_t {
+            float capacity_ah;
+            float charge_efficiency;        // Share of the charge put in that can be taken out again
+            const config::ocv_curve_t<>* ocv_curve; // Open circuit voltage curve of the battery chemistry
+            float resistance_ohm;           // Internal resistance until it has been measured
+            float min_resistance_ohm;       // Plausible range of a resistance measurement, anything outside is noise
+            float max_resistance_ohm;
+            float resistance_step_a;        // Least current step the resistance is measured from
+            float resistance_gain;          // Weight of each new resistance measurement, 0 - 1
+            int64_t settle_time_us;         // Voltage corrections held off after a current step
+            float voltage_noise_v;          // Voltage measurement noise at rest, 1 sigma
+            float load_noise_v_per_a;       // Extra voltage uncertainty per Ampere of recent load, from the unmodelled polarisation
+            int64_t polarisation_time_us;   // Time the polarisation takes to fade. Voltage readings within it share their error
+            float count_noise;              // Relative error of the charge count, 1 sigma
+            float drift_per_hour;           // State of charge drift of the charge count per hour, 1 sigma, 0 - 1
+            int64_t checkpoint_interval_us; // Least time between two checkpoints
+            float checkpoint_min_change_ah; // Least change in charge worth a checkpoint
+        };
+
+        /**
+        * @brief Persistent state. Trivially copyable so it can be stored as is
+        */
+        struct state_t {
+            uint32_t version;
+            float soc;                      // 0 - 1
+            float variance;                 // Of `soc`
+            float resistance_ohm;
+            double ah_in;                   // Lifetime charge into the battery
+            double ah_out;                  // Lifetime charge taken out of the battery
+        };
+
+        // Version 1 was the plain coulomb counter's checkpoint
+        static constexpr uint32_t STATE_VERSION = 2;
+
+        explicit soc_estimator_t(const config_t& cfg): config(cfg) {
+            state.version = STATE_VERSION;
+            state.resistance_ohm = cfg.resistance_ohm;
+        }
+
+        /**
+        * @brief Restore a checkpoint. Call before the first `update()`
+        * @return false if the checkpoint is from another version or corrupt, in which case nothing changes
+        */
+        bool restore(const state_t& saved) {
+            if (saved.version != STATE_VERSION) return false;
+            if (!std::isfinite(saved.soc) || !std::isfinite(saved.variance) || !std::isfinite(saved.resistance_ohm) ||
+                !std::isfinite(saved.ah_in) || !std::isfinite(saved.ah_out)) return false;
+            state = saved;
+            state.soc = std::clamp(state.soc, 0.0f, 1.0f);
+            state.variance = std::clamp(state.variance, MIN_VARIANCE, INITIAL_VARIANCE);
+            state.resistance_ohm = std::clamp(state.resistance_ohm, config.min_resistance_ohm, config.max_resistance_ohm);
+            restored = true;
+            return true;
+        }
+
+        /**
+        * @brief Advance the estimate
+        * @param total_in_ah Driver's charge integral while charging, since its start
+        * @param total_out_ah Driver's charge integral while discharging, since its start
+        * @param current_a Present current, positive while discharging
+        * @param voltage_v Present battery terminal voltage
+        * @param temperature_c Battery temperature, NaN if unknown. Shifts the open circuit voltage curve
+        * @param now_us Monotonic time
+        */
+        void update(double total_in_ah, double total_out_ah, float current_a, float voltage_v, float temperature_c, int64_t now_us) {
+
+            if (std::isfinite(temperature_c)) last_temperature_c = temperature_c;
+
+            if (!started) {
+                // Without a checkpoint the voltage is the only clue. The drop across the internal resistance is added back,
+                // and the variance is left large so the filter keeps correcting it
+                if (!restored) {
+                    state.soc = soc_at(voltage_v + current_a * state.resistance_ohm);
+                    state.variance = INITIAL_VARIANCE;
+                }
+                last_update_us = now_us;
+                last_current_a = current_a;
+                last_voltage_v = voltage_v;
+                settle_until_us = now_us;
+                last_correction_us = now_us - CORRECTION_INTERVAL_US;
+                last_checkpoint_us = now_us;
+                checkpoint_soc = state.soc;
+                started = true;
+                // The driver's integrals start at its boot too, so what they counted before this call is still added below
+            }
+
+            predict(total_in_ah, total_out_ah, now_us);
+            track_load(current_a, now_us);
+            track_resistance(current_a, voltage_v, now_us);
+            if ((now_us >= settle_until_us) && ((now_us - last_correction_us) >= CORRECTION_INTERVAL_US)) {
+                correct(current_a, voltage_v);
+                last_correction_us = now_us;
+            }
+
+            last_update_us = now_us;
+        }
+
+        /**
+        * @brief State of charge, in percent
+        */
+        [[nodiscard]] float get_soc() const {
+            return state.soc * 100.0f;
+        }
+
+        /**
+        * @brief Standard deviation of the state of charge, in percent
+        */
+        [[nodiscard]] float get_soc_sigma() const {
+            return sqrtf(state.variance) * 100.0f;
+        }
+
+        [[nodiscard]] float get_remaining_ah() const {
+            return state.soc * config.capacity_ah;
+        }
+
+        [[nodiscard]] float get_resistance() const {
+            return state.resistance_ohm;
+        }
+
+        [[nodiscard]] double get_ah_in() const {
+            return state.ah_in;
+        }
+
+        [[nodiscard]] double get_ah_out() const {
+            return state.ah_out;
+        }
+
+        [[nodiscard]] const state_t& get_state() const {
+            return state;
+        }
+
+        /**
+        * @brief Whether a checkpoint should be written now. Bounded by both time and change, to spare the flash
+        */
+        [[nodiscard]] bool checkpoint_due(int64_t now_us) const {
+            return started && ((now_us - last_checkpoint_us) >= config.checkpoint_interval_us) &&
+                   (fabsf(state.soc - checkpoint_soc) * config.capacity_ah >= config.checkpoint_min_change_ah);
+        }
+
+        /**
+        * @brief Record that the current state was written
+        */
+        void checkpoint_done(int64_t now_us) {
+            last_checkpoint_us = now_us;
+            checkpoint_soc = state.soc;
+        }
+
+    private:
+        static constexpr float INITIAL_VARIANCE = 0.2f * 0.2f;     // 20% sigma when all there is to go on is a voltage
+        static constexpr float MIN_VARIANCE = 0.002f * 0.002f;     // Keeps the filter from ever ignoring the voltage for good
+        static constexpr float INNOVATION_GATE = 3.0f * 3.0f;      // Voltage readings further off than 3 sigma are discarded
+        static constexpr int64_t MAX_STEP_INTERVAL_US = 1'000'000; // Longer gaps let the voltage drift on its own between the readings
+        // Voltage readings closer together than this share most of their error. Using each of them would make the filter
+        // overconfident and let the unmodelled polarisation pull the estimate around
+        static constexpr int64_t CORRECTION_INTERVAL_US = 1'000'000;
+        static constexpr float US_PER_HOUR = 3600.0f * 1'000'000.0f;
+
+        config_t config;
+        state_t state{};
+
+        bool restored{};
+        bool started{};
+        double last_in_ah{};
+        double last_out_ah{};
+
+        int64_t last_update_us{};
+        float last_current_a{};
+        float last_voltage_v{};
+        int64_t settle_until_us{};
+        int64_t last_correction_us{};
+        float last_temperature_c{ NAN };
+        float recent_load_a{};
+
+        int64_t last_checkpoint_us{};
+        float checkpoint_soc{};
+
+        /**
+        * @brief Coulomb counting. The uncertainty grows with the charge moved and with time
+        */
+        void predict(double total_in_ah, double total_out_ah, int64_t now_us) {
+
+            const double delta_in = std::max(total_in_ah - last_in_ah, 0.0);
+            const double delta_out = std::max(total_out_ah - last_out_ah, 0.0);
+            last_in_ah = total_in_ah;
+            last_out_ah = total_out_ah;
+
+            state.ah_in += delta_in;
+            state.ah_out += delta_out;
+
+            const float moved = static_cast<float>(delta_in + delta_out) / config.capacity_ah;
+            const float delta_soc = static_cast<float>(delta_in * config.charge_efficiency - delta_out) / config.capacity_ah;
+            const float hours = static_cast<float>(now_us - last_update_us) / US_PER_HOUR;
+
+            state.soc = std::clamp(state.soc + delta_soc, 0.0f, 1.0f);
+            state.variance += (config.count_noise * moved) * (config.count_noise * moved) +
+                              config.drift_per_hour * config.drift_per_hour * hours;
+        }
+
+        /**
+        * @brief Follow the largest recent load, fading with the polarisation it left behind
+        */
+        void track_load(float current_a, int64_t now_us) {
+            const float fade = expf(-static_cast<float>(now_us - last_update_us) / static_cast<float>(config.polarisation_time_us));
+            recent_load_a = std::max(fabsf(current_a), recent_load_a * fade);
+        }
+
+        /**
+        * @brief Measure the internal resistance from the voltage change over a current step, and start a settling hold off
+        */
+        void track_resistance(float current_a, float voltage_v, int64_t now_us) {
+
+            const float delta_i = current_a - last_current_a;
+            if ((fabsf(delta_i) >= config.resistance_step_a) && ((now_us - last_update_us) <= MAX_STEP_INTERVAL_US)) {
+                // V = OCV - I * R, and the OCV doesn't move over a single step
+                const float resistance = -(voltage_v - last_voltage_v) / delta_i;
+                if ((resistance >= config.min_resistance_ohm) && (resistance <= config.max_resistance_ohm)) {
+                    state.resistance_ohm += config.resistance_gain * (resistance - state.resistance_ohm);
+                }
+            }
+            if (fabsf(delta_i) >= config.resistance_step_a) settle_until_us = now_us + config.settle_time_us;
+
+            last_current_a = current_a;
+            last_voltage_v = voltage_v;
+        }
+
+        /**
+        * @brief Kalman correction from the terminal voltage
+        */
+        void correct(float current_a, float voltage_v) {
+
+            float slope = 0.0f;
+            const float predicted_v = ocv_at(state.soc, slope) - current_a * state.resistance_ohm;
+            // The polarisation is still there a while after the load is gone, and all readings within its time share it,
+            // so together they only count as one
+            const float load_noise = config.load_noise_v_per_a * recent_load_a;
+            const float shared = static_cast<float>(config.polarisation_time_us) / static_cast<float>(CORRECTION_INTERVAL_US);
+            const float noise = (config.voltage_noise_v * config.voltage_noise_v + load_noise * load_noise) * std::max(shared, 1.0f);
+
+            const float innovation = voltage_v - predicted_v;
+            const float innovation_var = slope * slope * state.variance + noise;
+            if (innovation * innovation > INNOVATION_GATE * innovation_var) return;
+
+            const float gain = state.variance * slope / innovation_var;
+            state.soc = std::clamp(state.soc + gain * innovation, 0.0f, 1.0f);
+            state.variance = std::max((1.0f - gain * slope) * state.variance, MIN_VARIANCE);
+        }
+
+        /**
+        * @brief Shift of the open circuit voltage curve at the last reported temperature
+        */
+        [[nodiscard]] float temperature_shift() const {
+            return std::isfinite(last_temperature_c) ? (config.ocv_curve->temp_coeff_v_per_c * (last_temperature_c - 25.0f)) : 0.0f;
+        }
+
+        /**
+        * @brief Open circuit voltage at a state of charge
+        * @param[out] slope Change in voltage per unit of state of charge there
+        */
+        [[nodiscard]] float ocv_at(float soc, float& slope) const {
+            return config.ocv_curve->ocv_at(soc, slope) + temperature_shift();
+        }
+
+        /**
+        * @brief State of charge of an open circuit voltage. The inverse of `ocv_at()`, clamped to the curve
+        */
+        [[nodiscard]] float soc_at(float voltage_v) const {
+            if (!std::isfinite(voltage_v)) return 0.0f;
+            return config.ocv_curve->soc_at(voltage_v - temperature_shift());
+        }
+    };
+
+} // namespace sys
+
+
+#endif // _SOC_ESTIMATOR_HPP_
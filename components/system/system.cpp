@@ -1,17 +1,584 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "system.hpp"
+#include "soc_estimator.hpp"
+#include "runtime_predictor.hpp"
+#include "energy_ledger.hpp"
+#include "battery_health.hpp"
+#include "seqlock.hpp"
 #include "config.hpp"
 
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_log.h"
+#include "nvs.h"
 
+#include <cstdio>
 #include <cstring>
+#include <array>
+#include <algorithm>
+#include <unistd.h>
+
+
+// Set to 1 to log the time a state of charge update takes once at init
+#define SOC_EKF_BENCHMARK 0
+
+// Set to 1 to log the time a battery health update takes once at init
+#define HEALTH_BENCHMARK 0
 
 
 namespace sys {
 
+    static constexpr const char* TAG = "SYS";
+
+    // Battery charge and energy ledger checkpoints
+    static constexpr const char NVS_NAMESPACE[] = "sys";
+    static constexpr const char NVS_SOC_KEY[] = "soc";
+    static constexpr const char NVS_ENERGY_KEY[] = "energy";
+
+    using ledger_t = energy_ledger_t<config::ENERGY_LEDGER_HOURS, config::ENERGY_LEDGER_DAYS>;
+
+    static soc_estimator_t soc_estimator({
+        .capacity_ah = config::BATTERY_CAPACITY_AH,
+        .charge_efficiency = config::BATTERY_CHARGE_EFFICIENCY,
+        .ocv_curve = &config::BATTERY_OCV_CURVE,
+        .resistance_ohm = config::BATTERY_INTERNAL_RESISTANCE,
+        .min_resistance_ohm = config::BATTERY_MIN_RESISTANCE,
+        .max_resistance_ohm = config::BATTERY_MAX_RESISTANCE,
+        .resistance_step_a = config::BATTERY_RESISTANCE_STEP_CURRENT,
+        .resistance_gain = 0.1f,
+        .settle_time_us = config::BATTERY_SETTLE_TIME_US,
+        .voltage_noise_v = 0.02f,           // ADC noise and the OCV table's own error
+        .load_noise_v_per_a = 0.03f,        // 0.3V of unmodelled polarisation at 10A
+        .polarisation_time_us = config::BATTERY_POLARISATION_TIME_US,
+        .count_noise = 0.02f,
+        .drift_per_hour = 0.005f,           // About 175mA of offset error on 35Ah
+        .checkpoint_interval_us = config::SOC_CHECKPOINT_INTERVAL_US,
+        .checkpoint_min_change_ah = config::SOC_CHECKPOINT_MIN_CHANGE_AH
+    });
+
+    // Charge as of its last checkpoint, for log_task to write. Written by runtime_calc_task
+    static adc::seqlock_t<soc_estimator_t::state_t> soc_snapshot{};
+
+    static runtime_predictor_t<config::RUNTIME_HORIZONS_S.size()> runtime_predictor({
+        .time_constants_s = config::RUNTIME_HORIZONS_S,
+        .weights = config::RUNTIME_HORIZON_WEIGHTS,
+        .min_current_a = 0.05f,             // Below the current sensor's resolution
+        .rated_current_a = config::BATTERY_RATED_CURRENT,
+        .peukert_exponent = config::battery_profile_t::PEUKERT_EXPONENT,
+        .max_runtime_s = config::RUNTIME_MAX_S
+    });
+
+    static ledger_t energy_ledger({
+        .checkpoint_interval_us = config::ENERGY_CHECKPOINT_INTERVAL_US,
+        .checkpoint_min_change_wh = config::ENERGY_CHECKPOINT_MIN_CHANGE_WH
+    });
+
+    // Ledger as of its last checkpoint, for log_task to write and log. Written by runtime_calc_task
+    static adc::seqlock_t<ledger_t::state_t> energy_snapshot{};
+
+    // Generations of the snapshots last written to NVS. Only touched by log_task, and by init() before it starts
+    static uint32_t soc_saved_generation = 0;
+    static uint32_t energy_saved_generation = 0;
+
+    static battery_health_t battery_health({
+        .capacity_ah = config::BATTERY_CAPACITY_AH,
+        .charge_efficiency = config::BATTERY_CHARGE_EFFICIENCY,
+        .ocv_curve = &config::BATTERY_OCV_CURVE,
+        .resistance_ohm = config::BATTERY_INTERNAL_RESISTANCE,
+        .rainflow = {
+            .hysteresis = 0.03f,            // Well above the wobble of the state of charge estimate
+            .cycle_life = config::battery_profile_t::CYCLE_LIFE,
+            .cycle_life_exponent = config::battery_profile_t::CYCLE_LIFE_EXPONENT
+        },
+        .rest_current_a = config::HEALTH_REST_CURRENT,
+        .rest_time_us = config::HEALTH_REST_TIME_US,
+        .min_soc_span = 0.3f,               // Keeps the OCV table's error under a tenth of the capacity measured
+        .max_anchor_age_us = 3 * 86'400 * 1'000'000LL,
+        .capacity_gain = 0.2f,
+        .resistance_time_constant_s = 30 * 86'400.0f,
+        .baseline_time_us = 7 * 86'400 * 1'000'000LL,
+        .checkpoint_interval_us = config::HEALTH_CHECKPOINT_INTERVAL_US
+    });
+
+    // Battery health file: the tracker's state behind a magic number
+    static constexpr uint32_t HEALTH_MAGIC = 0x48544C48; // "HLTH"
+
+    struct health_file_t {
+        uint32_t magic;
+        battery_health_t::state_t state;
+    };
+
+    // Health as of its last checkpoint, for log_task to write and log. Written by runtime_calc_task
+    static adc::seqlock_t<battery_health_t::state_t> health_snapshot{};
+
+    // Generation of the snapshot last written to the storage partition. Only touched by log_task, and by load_health()
+    // before it starts
+    static uint32_t health_saved_generation = 0;
+
+    // Written to a temporary file renamed over the old one, so a reset mid write leaves the old history intact
+    static bool save_health(const battery_health_t::state_t& state) {
+
+        const health_file_t file_data{ .magic = HEALTH_MAGIC, .state = state };
+
+        FILE* file = fopen(config::HEALTH_TEMP_FILE_NAME, "wb");
+        if (!file) {
+            ESP_LOGE(TAG, "Failed to open %s", config::HEALTH_TEMP_FILE_NAME);
+            return false;
+        }
+        const bool ok = (fwrite(&file_data, sizeof(file_data), 1, file) == 1);
+        fclose(file);
+
+        if (!ok || (rename(config::HEALTH_TEMP_FILE_NAME, config::HEALTH_FILE_NAME) != 0)) {
+            ESP_LOGE(TAG, "Failed to save the battery health");
+            return false;
+        }
+        return true;
+    }
+
+    // Rollups, a table per tier on the storage partition with the record of period `p` in slot `p % slots`
+    using rollups_t = rollup_t<ROLLUP_FIELDS>;
+
+    struct rollup_table_t {
+        const char* file_name;
+        size_t slots;
+    };
+
+    static constexpr std::array<rollup_table_t, rollups_t::TIERS> ROLLUP_TABLES = {{
+        { config::ROLLUP_MINUTE_FILE_NAME, config::ROLLUP_MINUTES },
+        { config::ROLLUP_HOUR_FILE_NAME, config::ROLLUP_HOURS },
+        { config::ROLLUP_DAY_FILE_NAME, config::ROLLUP_DAYS }
+    }};
+
+    static rollups_t rollups{};
+    // Closed minutes not written yet, to spare the flash
+    static std::array<rollup_entry_t, config::ROLLUP_FLUSH_MINUTES> rollup_minutes{};
+    static size_t rollup_minutes_count = 0;
+    // Guards the rollups between log_task and the readers of the tables
+    static SemaphoreHandle_t rollup_mutex = nullptr;
+
+    static constexpr uint8_t tier_bit(rollup_tier_t tier) {
+        return static_cast<uint8_t>(1 << static_cast<uint8_t>(tier));
+    }
+
+    static bool write_rollups(rollup_tier_t tier, const rollup_entry_t* records, size_t count) {
+
+        const rollup_table_t& table = ROLLUP_TABLES[static_cast<size_t>(tier)];
+        FILE* file = fopen(table.file_name, "rb+");
+        if (!file) file = fopen(table.file_name, "wb+");
+        if (!file) {
+            ESP_LOGE(TAG, "Failed to open %s", table.file_name);
+            return false;
+        }
+
+        bool ok = true;
+        for (size_t i = 0; (i < count) && ok; i++) {
+            ok = (fseek(file, (records[i].period % table.slots) * sizeof(rollup_entry_t), SEEK_SET) == 0) &&
+                 (fwrite(&records[i], sizeof(rollup_entry_t), 1, file) == 1);
+        }
+        ok = ok && (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+        fclose(file);
+
+        if (!ok) ESP_LOGE(TAG, "Failed to write %s", table.file_name);
+        return ok;
+    }
+
+    // Records of periods `first` to `first + count - 1`, in at most two runs of slots. Slots holding another period,
+    // an older one or one overwritten since, come back empty
+    static void read_rollup_table(rollup_tier_t tier, uint32_t first, size_t count, rollup_entry_t* records) {
+
+        for (size_t i = 0; i < count; i++) records[i] = rollup_entry_t{ .period = static_cast<uint32_t>(first + i) };
+
+        const rollup_table_t& table = ROLLUP_TABLES[static_cast<size_t>(tier)];
+        FILE* file = fopen(table.file_name, "rb");
+        if (!file) return;
+
+        for (size_t done = 0; done < count; ) {
+            const size_t slot = (first + done) % table.slots;
+            const size_t run = std::min(count - done, table.slots - slot);
+            const size_t read = (fseek(file, slot * sizeof(rollup_entry_t), SEEK_SET) == 0) ?
+                                fread(records + done, sizeof(rollup_entry_t), run, file) : 0;
+            for (size_t i = done; i < done + read; i++) {
+                if (records[i].period != first + i) records[i] = rollup_entry_t{ .period = static_cast<uint32_t>(first + i) };
+            }
+            done += run;
+        }
+        fclose(file);
+    }
+
+    // Newest period with samples in a table. false if there's none
+    static bool find_newest_rollup(rollup_tier_t tier, uint32_t& newest) {
+
+        const rollup_table_t& table = ROLLUP_TABLES[static_cast<size_t>(tier)];
+        FILE* file = fopen(table.file_name, "rb");
+        if (!file) return false;
+
+        // Static, only ever called at boot
+        static std::array<rollup_entry_t, 16> chunk{};
+        bool found = false;
+        size_t slot = 0;
+        size_t read = 0;
+        while ((read = fread(chunk.data(), sizeof(rollup_entry_t), chunk.size(), file)) > 0) {
+            for (size_t i = 0; i < read; i++, slot++) {
+                const rollup_entry_t& record = chunk[i];
+                if ((record.samples == 0) || ((record.period % table.slots) != slot)) continue;
+                if (!found || (record.period > newest)) {
+                    newest = record.period;
+                    found = true;
+                }
+            }
+        }
+        fclose(file);
+        return found;
+    }
+
+    template <typename T>
+    static bool save_checkpoint(const char* key, const T& state) {
+
+        nvs_handle_t handle{};
+        esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+        if (ret == ESP_OK) {
+            ret = nvs_set_blob(handle, key, &state, sizeof(state));
+            if (ret == ESP_OK) ret = nvs_commit(handle);
+            nvs_close(handle);
+        }
+
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to save the %s checkpoint: %s", key, esp_err_to_name(ret));
+            return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    static bool load_checkpoint(nvs_handle_t handle, const char* key, T& state) {
+        size_t length = sizeof(state);
+        return (nvs_get_blob(handle, key, &state, &length) == ESP_OK) && (length == sizeof(state));
+    }
+
+    // End to end latency of each pipeline stage
+    static std::array<latency_histogram_t, static_cast<size_t>(stage_t::COUNT)> latency{};
+
+    const char* stage_to_string(stage_t stage) {
+        switch (stage) {
+            case stage_t::CALC: return "CALC";
+            case stage_t::DISPLAY: return "DISPLAY";
+            case stage_t::LOG: return "LOG";
+            case stage_t::BLE: return "BLE";
+            default: return "UNKNOWN";
+        }
+    }
+
+    void record_latency(stage_t stage, int64_t timestamp_us, uint32_t seq) {
+        if (stage >= stage_t::COUNT) return;
+        latency[static_cast<size_t>(stage)].record(esp_timer_get_time() - timestamp_us, seq);
+    }
+
+    latency_histogram_t::snapshot_t get_latency(stage_t stage) {
+        if (stage >= stage_t::COUNT) return latency_histogram_t::snapshot_t{};
+        return latency[static_cast<size_t>(stage)].snapshot();
+    }
+
+    void log_latency() {
+
+        for (size_t s = 0; s < static_cast<size_t>(stage_t::COUNT); s++) {
+            const auto snap = latency[s].snapshot();
+            ESP_LOGI(TAG, "Latency %-8s n=%lu p50<=%luus p90<=%luus p99<=%luus max=%luus stale=%lu skipped=%lu",
+                     stage_to_string(static_cast<stage_t>(s)), snap.count, latency_histogram_t::percentile_us(snap, 50),
+                     latency_histogram_t::percentile_us(snap, 90), latency_histogram_t::percentile_us(snap, 99),
+                     snap.max_us, snap.stale, snap.skipped);
+        }
+    }
+
+    void save_checkpoints() {
+
+        // Static, the ledger's state is over a kilobyte. Only ever called from log_task
+        static ledger_t::state_t ledger_state{};
+        uint32_t generation = 0;
+
+        // A snapshot that fails to write is tried again on the next call
+        if (soc_snapshot.get_generation() != soc_saved_generation) {
+            soc_estimator_t::state_t state{};
+            soc_snapshot.load(state, generation);
+            if (save_checkpoint(NVS_SOC_KEY, state)) soc_saved_generation = generation;
+        }
+        if (energy_snapshot.get_generation() != energy_saved_generation) {
+            energy_snapshot.load(ledger_state, generation);
+            if (save_checkpoint(NVS_ENERGY_KEY, ledger_state)) energy_saved_generation = generation;
+        }
+        if (health_snapshot.get_generation() != health_saved_generation) {
+            battery_health_t::state_t state{};
+            health_snapshot.load(state, generation);
+            if (save_health(state)) health_saved_generation = generation;
+        }
+    }
+
+    void log_energy() {
+
+        // Static, the ledger's state is over a kilobyte. Only ever called from log_task
+        static ledger_t::state_t state{};
+        uint32_t generation = 0;
+        energy_snapshot.load(state, generation);
+        if (generation == 0) {
+            ESP_LOGI(TAG, "Energy ledger not saved yet");
+            return;
+        }
+
+        ESP_LOGI(TAG, "Energy lifetime in=%.2fkWh out=%.2fkWh (%.1fAh / %.1fAh), ledger at %.1fh",
+                 state.lifetime.wh_in / 1000.0, state.lifetime.wh_out / 1000.0, state.lifetime.ah_in, state.lifetime.ah_out,
+                 static_cast<double>(state.elapsed_us) / ledger_t::HOUR_US);
+
+        // The last week, newest first
+        const uint32_t today = state.hour / ledger_t::HOURS_PER_DAY;
+        for (uint32_t ago = 0; (ago < 7) && (ago < config::ENERGY_LEDGER_DAYS) && (ago <= today); ago++) {
+            const auto& day = state.days[(today - ago) % config::ENERGY_LEDGER_DAYS];
+            ESP_LOGI(TAG, "Energy day %-3lu in=%.0fWh out=%.0fWh", today - ago, day.wh_in, day.wh_out);
+        }
+    }
+
+    void log_health() {
+
+        battery_health_t::state_t state{};
+        uint32_t generation = 0;
+        health_snapshot.load(state, generation);
+        if (generation == 0) {
+            ESP_LOGI(TAG, "Battery health not saved yet");
+            return;
+        }
+
+        const auto& cycles = state.cycles;
+        ESP_LOGI(TAG, "Health capacity=%.1fAh (%lu measurements) resistance=%.1fmOhm equivalent cycles=%.1f wear=%.1f%%",
+                 state.capacity_ah, state.capacity_samples, state.resistance_ohm * 1000.0, cycles.equivalent_cycles, cycles.damage * 100.0);
+
+        // Full cycles by depth of discharge, each bin up to its depth
+        char line[128]{};
+        int length = 0;
+        for (size_t b = 0; (b < cycles.half_cycles.size()) && (length < static_cast<int>(sizeof(line))); b++) {
+            length += snprintf(line + length, sizeof(line) - length, " %.0f%%:%.1f",
+                               battery_health_t::rainflow_t::bin_depth(b) * 100.0f, cycles.half_cycles[b] / 2.0f);
+        }
+        ESP_LOGI(TAG, "Health cycles by depth%s", line);
+    }
+
+    void update_rollups(const data_t& data, int64_t now_ms) {
+
+        if (!rollup_mutex) return;
+
+        // Indexed by field_t
+        const rollups_t::values_t values = {
+            data.is_fresh(field_t::TEMPERATURE) ? data.inv_temp : NAN,
+            data.is_fresh(field_t::HUMIDITY) ? data.inv_hmdt : NAN,
+            data.is_fresh(field_t::VOLTAGE) ? data.battery_voltage : NAN,
+            data.is_fresh(field_t::CURRENT) ? data.load_current_drawn : NAN,
+            data.is_fresh(field_t::POWER) ? data.power_drawn : NAN
+        };
+
+        xSemaphoreTake(rollup_mutex, portMAX_DELAY);
+
+        const uint8_t closed = rollups.update(values, now_ms);
+        if (closed & tier_bit(rollup_tier_t::MINUTE)) rollup_minutes[rollup_minutes_count++] = rollups.get_closed(rollup_tier_t::MINUTE);
+
+        // Minutes go out in batches, and before any hour or day, so the tables never run ahead of the minutes
+        const bool flush = (rollup_minutes_count == rollup_minutes.size()) || (closed & ~tier_bit(rollup_tier_t::MINUTE));
+        if (flush && (rollup_minutes_count > 0)) {
+            write_rollups(rollup_tier_t::MINUTE, rollup_minutes.data(), rollup_minutes_count);
+            rollup_minutes_count = 0;
+        }
+        for (const rollup_tier_t tier : { rollup_tier_t::HOUR, rollup_tier_t::DAY }) {
+            if (closed & tier_bit(tier)) write_rollups(tier, &rollups.get_closed(tier), 1);
+        }
+
+        xSemaphoreGive(rollup_mutex);
+    }
+
+    size_t read_rollups(rollup_tier_t tier, size_t count, rollup_entry_t* records) {
+
+        if (!rollup_mutex || (tier >= rollup_tier_t::COUNT)) return 0;
+
+        xSemaphoreTake(rollup_mutex, portMAX_DELAY);
+
+        const uint32_t open = rollups.get_period(tier);
+        count = std::min(count, static_cast<size_t>(open));
+        const uint32_t first = open - count;
+        read_rollup_table(tier, first, count, records);
+
+        // Minutes closed but not written yet
+        if (tier == rollup_tier_t::MINUTE) {
+            for (size_t i = 0; i < rollup_minutes_count; i++) {
+                const uint32_t period = rollup_minutes[i].period;
+                if ((period >= first) && (period < open)) records[period - first] = rollup_minutes[i];
+            }
+        }
+
+        xSemaphoreGive(rollup_mutex);
+        return count;
+    }
+
+    void log_history() {
+
+        // Static, only ever called from log_task
+        static std::array<rollup_entry_t, 7> days{};
+        const size_t count = read_rollups(rollup_tier_t::DAY, days.size(), days.data());
+
+        // Newest first
+        for (size_t i = count; i-- > 0; ) {
+            const rollup_entry_t& day = days[i];
+            if (day.samples == 0) continue;
+            const auto& current = day.fields[static_cast<size_t>(field_t::CURRENT)];
+            const auto& voltage = day.fields[static_cast<size_t>(field_t::VOLTAGE)];
+            const auto& power = day.fields[static_cast<size_t>(field_t::POWER)];
+            const auto& temp = day.fields[static_cast<size_t>(field_t::TEMPERATURE)];
+            ESP_LOGI(TAG, "History day %-3lu load mean=%.2fA max=%.2fA %.0fW, voltage min=%.2fV, temperature max=%.1fC",
+                     day.period, current.mean, current.max, power.mean, voltage.min, temp.max);
+        }
+    }
+
+#if HEALTH_BENCHMARK == 1
+    // Runs a scratch tracker through daily cycles with load steps and logs the average time per update
+    static void benchmark_battery_health() {
+
+        static constexpr uint32_t BENCH_UPDATES = 10000;
+        battery_health_t health = battery_health;
+        double ah_in = 0;
+        double ah_out = 0;
+        float soc = 1.0f;
+
+        const int64_t start = esp_timer_get_time();
+        for (uint32_t n = 0; n < BENCH_UPDATES; n++) {
+            const float current = ((n / 2000) & 1) ? -5.0f : (((n / 500) & 1) ? 10.0f : 2.0f);
+            const double ah = current * (1.0 / 3600.0);
+            if (ah >= 0.0) {
+                ah_out += ah;
+            } else {
+                ah_in -= ah;
+            }
+            soc = std::clamp(soc - static_cast<float>(ah) / config::BATTERY_CAPACITY_AH * 50.0f, 0.0f, 1.0f);
+            health.update(soc, ah_in, ah_out, current, 12.4f - current * 0.02f, 25.0f, 0.02f, static_cast<int64_t>(n) * 1'000'000);
+        }
+        const int64_t elapsed_us = esp_timer_get_time() - start;
+
+        ESP_LOGI(TAG, "battery_health %.2fus/update (%.1f cycles)", static_cast<float>(elapsed_us) / BENCH_UPDATES, health.get_equivalent_cycles());
+    }
+#endif
+
+#if SOC_EKF_BENCHMARK == 1
+    // Runs a scratch estimator through a synthetic discharge with load steps and logs the average time per update
+    static void benchmark_soc_estimator() {
+
+        static constexpr uint32_t BENCH_UPDATES = 10000;
+        soc_estimator_t estimator = soc_estimator;
+        double ah_out = 0;
+        float sink = 0;
+
+        const int64_t start = esp_timer_get_time();
+        for (uint32_t n = 0; n < BENCH_UPDATES; n++) {
+            const float current = ((n / 500) & 1) ? 10.0f : 2.0f;
+            ah_out += current * (0.02 / 3600.0);
+            estimator.update(0.0, ah_out, current, 12.4f - current * 0.02f, 25.0f, static_cast<int64_t>(n) * 20'000);
+            sink += estimator.get_soc();
+        }
+        const int64_t elapsed_us = esp_timer_get_time() - start;
+
+        ESP_LOGI(TAG, "soc_estimator %.2fus/update (checksum %.1f)", static_cast<float>(elapsed_us) / BENCH_UPDATES, sink);
+    }
+#endif
+
+    bool init() {
+
+#if SOC_EKF_BENCHMARK == 1
+        benchmark_soc_estimator();
+#endif
+#if HEALTH_BENCHMARK == 1
+        benchmark_battery_health();
+#endif
+
+        nvs_handle_t handle{};
+        if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+            ESP_LOGW(TAG, "No battery charge checkpoint. Estimating the charge from the voltage");
+            ESP_LOGW(TAG, "No energy ledger checkpoint. Starting a new ledger");
+            return false;
+        }
+
+        // Static, the ledger's state is over a kilobyte
+        static ledger_t::state_t ledger_state{};
+        if (load_checkpoint(handle, NVS_ENERGY_KEY, ledger_state) && energy_ledger.restore(ledger_state)) {
+            energy_snapshot.store(energy_ledger.get_state());
+            energy_saved_generation = energy_snapshot.get_generation();
+        } else {
+            ESP_LOGW(TAG, "No usable energy ledger checkpoint. Starting a new ledger");
+        }
+
+        soc_estimator_t::state_t state{};
+        const bool loaded = load_checkpoint(handle, NVS_SOC_KEY, state);
+        nvs_close(handle);
+
+        if (!loaded || !soc_estimator.restore(state)) {
+            ESP_LOGW(TAG, "No usable battery charge checkpoint. Estimating the charge from the voltage");
+            return false;
+        }
+        return true;
+    }
+
+    bool load_health() {
+
+        health_file_t file_data{};
+        FILE* file = fopen(config::HEALTH_FILE_NAME, "rb");
+        if (!file) {
+            ESP_LOGW(TAG, "No battery health history. Taking the battery to be new");
+            return false;
+        }
+        const bool ok = (fread(&file_data, sizeof(file_data), 1, file) == 1);
+        fclose(file);
+
+        if (!ok || (file_data.magic != HEALTH_MAGIC) || !battery_health.restore(file_data.state)) {
+            ESP_LOGW(TAG, "No usable battery health history. Taking the battery to be new");
+            return false;
+        }
+        health_snapshot.store(file_data.state);
+        health_saved_generation = health_snapshot.get_generation();
+        return true;
+    }
+
+    bool load_rollups() {
+
+        rollup_mutex = xSemaphoreCreateMutex();
+        ASSERT(rollup_mutex, "Failed to create the rollup mutex");
+
+        // Carry on after the newest period of any tier. Minutes lost to a reset may leave the hours or days ahead
+        uint32_t minute = 0;
+        bool found = false;
+        for (size_t t = 0; t < rollups_t::TIERS; t++) {
+            const rollup_tier_t tier = static_cast<rollup_tier_t>(t);
+            uint32_t newest = 0;
+            if (find_newest_rollup(tier, newest)) {
+                minute = std::max(minute, rollups_t::first_minute(tier, newest + 1));
+                found = true;
+            }
+        }
+        rollups.resume(minute);
+        if (!found) {
+            ESP_LOGW(TAG, "No rollups. Starting new tables");
+            return false;
+        }
+
+        // Fold the stored minutes of the open hour and the stored hours of the open day back in.
+        // Static, only ever called at boot
+        static std::array<rollup_entry_t, rollups_t::MINUTES_PER_HOUR> records{};
+        const uint32_t hour = rollups.get_period(rollup_tier_t::HOUR);
+        const uint32_t hour_start = rollups_t::first_minute(rollup_tier_t::HOUR, hour);
+        read_rollup_table(rollup_tier_t::MINUTE, hour_start, minute - hour_start, records.data());
+        for (size_t i = 0; i < minute - hour_start; i++) rollups.fold(rollup_tier_t::HOUR, records[i]);
+
+        const uint32_t day_start = rollups.get_period(rollup_tier_t::DAY) * (rollups_t::MINUTES_PER_DAY / rollups_t::MINUTES_PER_HOUR);
+        read_rollup_table(rollup_tier_t::HOUR, day_start, hour - day_start, records.data());
+        for (size_t i = 0; i < hour - day_start; i++) rollups.fold(rollup_tier_t::DAY, records[i]);
+
+        ESP_LOGI(TAG, "Rollups resumed at minute %lu", minute);
+        return true;
+    }
+
     const char* inv_status_to_string(inv_status_t status) {
         switch (status) {
             case inv_status_t::IDLE: return "IDLE";
@@ -29,94 +596,180 @@ namespace sys {
         }
     }
 
-    bool calc_total_runtime_stats(const aht20_data_t& aht_data, const adc::data_t& power_data, data_t& final) {
+    // Last calculated data. Fields whose reading fails are held from it
+    static data_t last_data{};
+    static bool counted = false;    // The estimators have counted at least one measurement
+
+    static void accept(data_t& final, field_t field, bool fresh = true) {
+        final.valid_mask |= data_t::bit(field);
+        if (!fresh) final.stale_mask |= data_t::bit(field);
+    }
+
+    // Marks a field held from `last_data` as stale. false if there's nothing to hold, leaving it invalid
+    static bool hold(data_t& final, field_t field) {
+        if (!last_data.is_valid(field)) return false;
+        final.valid_mask |= data_t::bit(field);
+        final.stale_mask |= data_t::bit(field);
+        return true;
+    }
+
+    bool calc_total_runtime_stats(const aht20_data_t& aht_data, int64_t aht_timestamp_us, const adc::data_t& power_data, data_t& final) {
 
         memset(&final, 0, sizeof(data_t));
-        
-        // Copy temperature and humidity values
-        final.inv_temp = aht_data.temperature;
-        final.inv_hmdt = aht_data.humidity;
 
-        // Range validation for the temperature and humidity
-        if (final.inv_temp > 85.0f || final.inv_temp < -40.0f) {
-            return false;
+        const int64_t now_us = esp_timer_get_time();
+
+        // Carry the measurement's identity through, so later stages can tell its age and spot stale or skipped ones
+        final.timestamp_us = power_data.timestamp_us;
+        final.seq = power_data.seq;
+
+        // Temperature and humidity, with range validation. They're only read every AHT_READ_PERIOD_MS, so a reading
+        // turns stale once a few in a row have been missed
+        const bool have_aht = (aht_timestamp_us != 0);
+        const bool aht_fresh = have_aht && ((now_us - aht_timestamp_us) <= config::AHT_DATA_TIMEOUT_US);
+        if (have_aht && (aht_data.temperature <= 85.0f) && (aht_data.temperature >= -40.0f)) {
+            final.inv_temp = aht_data.temperature;
+            accept(final, field_t::TEMPERATURE, aht_fresh);
+        } else if (hold(final, field_t::TEMPERATURE)) {
+            final.inv_temp = last_data.inv_temp;
         }
-        if (final.inv_hmdt > 100.0f || final.inv_hmdt < 0.0f) {
-            return false;
+        if (have_aht && (aht_data.humidity <= 100.0f) && (aht_data.humidity >= 0.0f)) {
+            final.inv_hmdt = aht_data.humidity;
+            accept(final, field_t::HUMIDITY, aht_fresh);
+        } else if (hold(final, field_t::HUMIDITY)) {
+            final.inv_hmdt = last_data.inv_hmdt;
         }
+        const float temperature_c = final.is_valid(field_t::TEMPERATURE) ? final.inv_temp : NAN;
 
-        // Check to see if data from the ADC is valid
-        if (!power_data.valid) {
-            return false;
-        }
+        // Count charge first, so a rejected reading below doesn't leave a gap in the count. The integrals are
+        // cumulative, so a stale reading just adds nothing
+        if (power_data.valid) {
+            soc_estimator.update(power_data.charge_in_ah, power_data.charge_out_ah, power_data.current_avg, power_data.voltage_avg,
+                                 temperature_c, now_us);
+            runtime_predictor.update(power_data.current_avg, now_us);
+            // A flash write stalls for milliseconds, so checkpoints are handed to log_task to write
+            if (soc_estimator.checkpoint_due(now_us)) {
+                soc_snapshot.store(soc_estimator.get_state());
+                soc_estimator.checkpoint_done(now_us);
+            }
 
-        // Copy voltage, current and voltage values
-        final.battery_voltage = power_data.voltage_avg;
-        final.load_current_drawn = power_data.current_avg;
-        final.power_drawn = power_data.apparent_power;
+            energy_ledger.update(ledger_t::totals_t{
+                .wh_in = power_data.energy_in_wh,
+                .wh_out = power_data.energy_out_wh,
+                .ah_in = power_data.charge_in_ah,
+                .ah_out = power_data.charge_out_ah
+            }, now_us);
+            if (energy_ledger.checkpoint_due(now_us)) {
+                energy_snapshot.store(energy_ledger.get_state());
+                energy_ledger.checkpoint_done(now_us);
+            }
 
-        // Range validation for the voltage and curent
-        if (final.battery_voltage > 16.0f || final.battery_voltage < 0.0f) {
-            return false;
+            battery_health.update(soc_estimator.get_soc() / 100.0f, power_data.charge_in_ah, power_data.charge_out_ah,
+                                  power_data.current_avg, power_data.voltage_avg, temperature_c,
+                                  soc_estimator.get_resistance(), now_us);
+            if (battery_health.checkpoint_due(now_us)) {
+                health_snapshot.store(battery_health.get_state());
+                battery_health.checkpoint_done(now_us);
+            }
+
+            counted = true;
         }
-        if (final.load_current_drawn > 30.0f || final.load_current_drawn < -30.0f) {
-            return false;
+
+        // Peaks of the window, falling back to the averages if the window is empty
+        const bool have_window = (power_data.current_window.count > 0) && (power_data.voltage_window.count > 0);
+
+        // Voltage, with range validation
+        const bool voltage_ok = power_data.valid && (power_data.voltage_avg <= 16.0f) && (power_data.voltage_avg >= 0.0f);
+        if (voltage_ok) {
+            final.battery_voltage = power_data.voltage_avg;
+            final.battery_voltage_max = have_window ? power_data.voltage_window.max : final.battery_voltage;
+            accept(final, field_t::VOLTAGE);
+        } else if (hold(final, field_t::VOLTAGE)) {
+            final.battery_voltage = last_data.battery_voltage;
+            final.battery_voltage_max = last_data.battery_voltage_max;
         }
 
-        // Calculate battery percentage
-        final.battery_percent = (final.battery_voltage - config::BATT_ZERO_PERCENT_VOLTAGE) /                               \
-                                (config::BATT_MAX_PERCENT_VOLTAGE - config::BATT_ZERO_PERCENT_VOLTAGE) * 100.0f;
-        
-        // Clamp battery percent to known values if above or below the threshold for battery soc
-        if (final.battery_percent > 100.0f) {
-            final.battery_percent = 100.0f;
-        } else if (final.battery_percent < 0.0f) {
-            final.battery_percent = 0.0f;
-        }
-    
-        // Get inverter status
-        if (final.load_current_drawn >= config::INVERTER_ACTIVE_THRESHOLD) {
-            final.inv_status = inv_status_t::ACTIVE;
-        } else {
-            final.inv_status = inv_status_t::IDLE;
+        // Current and the statuses that follow from it, with range validation
+        const bool current_ok = power_data.valid && (power_data.current_avg <= 30.0f) && (power_data.current_avg >= -30.0f);
+        if (current_ok) {
+            final.load_current_drawn = power_data.current_avg;
+            final.load_current_max = have_window ? power_data.current_window.max : final.load_current_drawn;
+            final.load_current_min = have_window ? power_data.current_window.min : final.load_current_drawn;
+
+            // Get inverter status
+            if (final.load_current_drawn >= config::INVERTER_ACTIVE_THRESHOLD) {
+                final.inv_status = inv_status_t::ACTIVE;
+            } else {
+                final.inv_status = inv_status_t::IDLE;
+            }
+
+            // Get battery status
+            if (final.load_current_drawn < config::BATTERY_RECHARGING_THRESHOLD) {
+                final.batt_status = batt_status_t::RECHARGING;
+            } else if (final.load_current_drawn > config::BATTERY_DISCHARGING_THRESHOLD) {
+                final.batt_status = batt_status_t::DISCHARGING;
+            } else {
+                final.batt_status = batt_status_t::IDLE;
+            }
+
+            accept(final, field_t::CURRENT);
+        } else if (hold(final, field_t::CURRENT)) {
+            final.load_current_drawn = last_data.load_current_drawn;
+            final.load_current_max = last_data.load_current_max;
+            final.load_current_min = last_data.load_current_min;
+            final.inv_status = last_data.inv_status;
+            final.batt_status = last_data.batt_status;
         }
 
-        // Get battery status
-        if (final.load_current_drawn < config::BATTERY_RECHARGING_THRESHOLD) {
-            final.batt_status = batt_status_t::RECHARGING;
-        } else if (final.load_current_drawn > config::BATTERY_DISCHARGING_THRESHOLD) {
-            final.batt_status = batt_status_t::DISCHARGING;
-        } else {
-            final.batt_status = batt_status_t::IDLE;
+        // Power is only as good as both of its factors
+        if (voltage_ok && current_ok) {
+            final.power_drawn = power_data.real_power;
+            accept(final, field_t::POWER);
+        } else if (hold(final, field_t::POWER)) {
+            final.power_drawn = last_data.power_drawn;
         }
 
-        // Find charge time left if battery status is recharging
-        if (final.batt_status == batt_status_t::RECHARGING) {
-            float capacity_left_to_full_ah = config::BATTERY_CAPACITY_AH * ((100.0f - final.battery_percent) / 100.0f);
-            float charge_current = -1.0f * final.load_current_drawn; // Make positive
-            float charge_time_hrs = capacity_left_to_full_ah / charge_current;
+        // The estimators hold their state between measurements, so their figures are only stale while nothing is counted
+        if (counted) {
+            // Battery percentage from the state of charge estimator, which is already clamped to 0 - 100%
+            final.battery_percent = soc_estimator.get_soc();
+            final.battery_percent_sigma = soc_estimator.get_soc_sigma();
+            final.battery_resistance = soc_estimator.get_resistance();
+            final.battery_ah_in = static_cast<float>(soc_estimator.get_ah_in());
+            final.battery_ah_out = static_cast<float>(soc_estimator.get_ah_out());
 
-            final.runtime_left_s = charge_time_hrs * 3600; // Convert to seconds
-        }
-        
-        // Calculate estimated runtime left if battery is not recharging
-        else if ((final.batt_status == batt_status_t::DISCHARGING || final.batt_status == batt_status_t::IDLE) && (final.load_current_drawn != 0.0f)) {
-            float remaining_capacity_ah = config::BATTERY_CAPACITY_AH * (final.battery_percent / 100.0f);
-            float runtime_hrs = remaining_capacity_ah / final.load_current_drawn;
+            // State of health from the measured capacity, and the cycle life used up
+            final.battery_soh = battery_health.get_soh();
+            final.battery_wear = battery_health.get_wear();
+            final.battery_cycles = static_cast<float>(battery_health.get_equivalent_cycles());
 
-            final.runtime_left_s = runtime_hrs * 3600; // Convert to seconds
+            // Energy through the battery, over its lifetime and over the last 24 hours
+            final.energy_in_wh = static_cast<float>(energy_ledger.get_lifetime().wh_in);
+            final.energy_out_wh = static_cast<float>(energy_ledger.get_lifetime().wh_out);
+            final.energy_day_in_wh = static_cast<float>(energy_ledger.get_last_day().wh_in);
+            final.energy_day_out_wh = static_cast<float>(energy_ledger.get_last_day().wh_out);
 
-            // Cap on how high the estimated runtime value can get: 7 days
-            if (final.runtime_left_s > 86400 * 7) {
-                final.runtime_left_s = 86400 * 7;
-            }
-        }
-        // Assign value if load current is 0
-        else if (final.load_current_drawn == 0.0f) {
-            final.runtime_left_s = UINT64_MAX;
+            accept(final, field_t::BATTERY, power_data.valid);
+
+            // Runtime from the load history rather than the present current, so it doesn't swing with every load step.
+            // While recharging it's the time to full
+            const bool recharging = (final.batt_status == batt_status_t::RECHARGING);
+            const float charge_sigma_ah = soc_estimator.get_soc_sigma() / 100.0f * config::BATTERY_CAPACITY_AH;
+            // A cold battery gives out less of its charge. Without a temperature it's taken as warm
+            const float derating = std::isfinite(temperature_c) ?
+                std::clamp(1.0f - config::battery_profile_t::CAPACITY_TEMP_COEFF_PER_C * (25.0f - temperature_c), 0.5f, 1.0f) : 1.0f;
+            const float charge_ah = recharging ? (config::BATTERY_CAPACITY_AH - soc_estimator.get_remaining_ah()) : (soc_estimator.get_remaining_ah() * derating);
+            const auto runtime = runtime_predictor.predict(charge_ah, charge_sigma_ah, recharging);
+            final.runtime_left_s = runtime.estimate_s;
+            final.runtime_low_s = runtime.low_s;
+            final.runtime_high_s = runtime.high_s;
+
+            accept(final, field_t::RUNTIME, final.is_fresh(field_t::CURRENT));
         }
 
-        return true;
+        last_data = final;
+
+        return (final.valid_mask == ALL_FIELDS) && (final.stale_mask == 0);
     }
 
     [[noreturn]] void handle_error(void) {
@@ -4,6 +4,9 @@
 
 #include "aht20.h"
 #include "power_monitor.hpp"
+#include "latency.hpp"
+#include "telemetry_bus.hpp"
+#include "rollup.hpp"
 
 
 #define ASSERT(exp, msg)                                                       \
@@ -39,18 +42,77 @@ namespace sys {
         RECHARGING
     };
 
+    /**
+     * @brief Fields of `data_t` with their own validity, one bit each in its masks
+     */
+    enum class field_t : uint8_t {
+        TEMPERATURE = 0,    // inv_temp
+        HUMIDITY,           // inv_hmdt
+        VOLTAGE,            // battery_voltage and its peak
+        CURRENT,            // load_current_drawn, its peaks, inv_status and batt_status
+        POWER,              // power_drawn
+        BATTERY,            // State of charge, resistance, charge, energy and health
+        RUNTIME,            // runtime_left_s and its band
+        COUNT
+    };
+
     struct data_t {
         float battery_voltage;
+        float battery_voltage_max;      // Highest sample since the previous measurement
         float load_current_drawn;
+        float load_current_max;         // Highest load (discharge) current sample since the previous measurement
+        float load_current_min;         // Lowest current sample since the previous measurement. Most negative is the peak charge current
         float inv_temp;
         float inv_hmdt;
-        float battery_percent;
+        float battery_percent;          // Kalman filtered fusion of coulomb counting and the battery voltage
+        float battery_percent_sigma;    // Standard deviation of `battery_percent`
+        float battery_resistance;       // Battery internal resistance in Ohms, measured from current steps
+        float battery_ah_in;            // Lifetime charge into the battery
+        float battery_ah_out;           // Lifetime charge taken out of the battery
+        float battery_soh;              // Measured capacity over the rated one, in percent
+        float battery_wear;             // Share of the cycle life used up by the cycles so far, in percent
+        float battery_cycles;           // Equivalent full cycles, from a rainflow count of the state of charge
+        float energy_in_wh;             // Lifetime energy into the battery
+        float energy_out_wh;            // Lifetime energy taken out of the battery
+        float energy_day_in_wh;         // Energy into the battery over the last 24 hours
+        float energy_day_out_wh;        // Energy taken out of the battery over the last 24 hours
         float power_drawn;
         inv_status_t inv_status;
         batt_status_t batt_status;
-        uint64_t runtime_left_s;
+        uint64_t runtime_left_s;        // Predicted time until empty, or full while recharging, from the load history
+        uint64_t runtime_low_s;         // Confidence band of `runtime_left_s`
+        uint64_t runtime_high_s;
+        int64_t timestamp_us;           // Capture time of the ADC measurement this is derived from (esp_timer)
+        uint32_t seq;                   // Sequence id of that ADC measurement
+        // A field that's valid holds a plausible value. One that's also stale holds the last plausible value, as its
+        // source failed, glitched out of range or stopped delivering. One that's never been valid is 0
+        uint32_t valid_mask;
+        uint32_t stale_mask;
+
+        static constexpr uint32_t bit(field_t field) {
+            return static_cast<uint32_t>(1) << static_cast<uint8_t>(field);
+        }
+
+        [[nodiscard]] bool is_valid(field_t field) const {
+            return (valid_mask & bit(field)) != 0;
+        }
+
+        [[nodiscard]] bool is_fresh(field_t field) const {
+            return ((valid_mask & ~stale_mask) & bit(field)) != 0;
+        }
     };
 
+    static constexpr uint32_t ALL_FIELDS = (static_cast<uint32_t>(1) << static_cast<uint8_t>(field_t::COUNT)) - 1;
+
+    // Fields kept in the rollups, indexed by `field_t`: temperature, humidity, voltage, current and power
+    static constexpr size_t ROLLUP_FIELDS = static_cast<size_t>(field_t::POWER) + 1;
+    using rollup_entry_t = rollup_record_t<ROLLUP_FIELDS>;
+
+    /**
+     * @brief Broadcast of the latest calculated monitoring data, from runtime_calc_task to the display, log and BLE
+     */
+    using data_bus_t = telemetry_bus_t<data_t>;
+
 
     /**
      * @brief Convert inverter status to string
@@ -63,15 +125,117 @@ namespace sys {
     const char* batt_status_to_string(batt_status_t status);
 
     /**
-     * @brief Calculates all the necessary runtime parameters required for a complete measurement of the inverter and battery statuses
+     * @brief Convert pipeline stage to string
+     */
+    const char* stage_to_string(stage_t stage);
+
+    /**
+     * @brief Record the age of a measurement as a pipeline stage consumes it
+     * 
+     * @note Each stage must only be recorded from a single task
+     * 
+     * @param[in] stage Consuming stage
+     * @param[in] timestamp_us Capture time of the measurement
+     * @param[in] seq Sequence id of the measurement
+     */
+    void record_latency(stage_t stage, int64_t timestamp_us, uint32_t seq);
+
+    /**
+     * @brief Get a copy of a stage's latency histogram
+     */
+    latency_histogram_t::snapshot_t get_latency(stage_t stage);
+
+    /**
+     * @brief Log the end to end latency of every stage
+     */
+    void log_latency();
+
+    /**
+     * @brief Write the checkpoints that `calc_total_runtime_stats()` handed over, if there are new ones: the battery charge
+     * and energy ledger to NVS, and the battery health history to the storage partition. Ones that fail are written on
+     * a later call
+     * 
+     * @note Only call from a single task, the one doing the storage I/O
+     */
+    void save_checkpoints();
+
+    /**
+     * @brief Log the lifetime energy totals and the daily ones of the last week, as of the last ledger checkpoint
+     * 
+     * @note Only call from a single task
+     */
+    void log_energy();
+
+    /**
+     * @brief Log the battery capacity, resistance and cycles by depth, as of the last health checkpoint
+     */
+    void log_health();
+
+    /**
+     * @brief Restore the battery health history from the storage partition
+     * 
+     * @note The storage partition must be mounted. Call before the first `calc_total_runtime_stats()`
+     * 
+     * @return true if the history was restored, false if the battery is taken to be new
+     */
+    bool load_health();
+
+    /**
+     * @brief Resume the minute, hour and day rollups from their tables on the storage partition
+     * 
+     * @note The storage partition must be mounted. Call before the first `update_rollups()`
+     * 
+     * @return true if there were tables to resume from, false if new ones are started
+     */
+    bool load_rollups();
+
+    /**
+     * @brief Add a sample to the minute, hour and day rollups and store the periods it closes
+     * 
+     * @note Only call from a single task
+     * 
+     * @param[in] data Fields that aren't fresh are left out
+     * @param[in] now_ms Monotonic time of the sample
+     */
+    void update_rollups(const data_t& data, int64_t now_ms);
+
+    /**
+     * @brief Read the last closed periods of a rollup tier, oldest first. Only `count` records are read from flash
+     * 
+     * @param[in] tier Minutes, hours or days
+     * @param[in] count Periods to read. Those older than the table holds come back empty
+     * @param[out] records At least `count` of them. Periods without samples have `samples` 0
+     * 
+     * @return Records read, fewer than `count` if the rollups don't go back that far
+     */
+    size_t read_rollups(rollup_tier_t tier, size_t count, rollup_entry_t* records);
+
+    /**
+     * @brief Log the daily load, voltage and temperature of the last week from the day rollups
+     */
+    void log_history();
+
+    /**
+     * @brief Restore the battery charge and energy ledger checkpoints
+     * 
+     * @note NVS must be initialized. Call before the first `calc_total_runtime_stats()`
+     * 
+     * @return true if the charge checkpoint was restored, false if the charge has to be estimated from the voltage
+     */
+    bool init();
+
+    /**
+     * @brief Calculates all the necessary runtime parameters required for a complete measurement of the inverter and battery statuses.
+     * Every field that can be worked out is, whatever happened to the others; `final`'s masks tell which are usable
      * 
      * @param[in] aht_data Struct reference containing sensor information from the AHT20 sensor
+     * @param[in] aht_timestamp_us esp_timer time `aht_data` was read, 0 if it never was
      * @param[in] power_data Struct reference containing measurement data from the voltage and current sensors
      * @param[out] final Struct reference containing the calculated monitoring data of the inverter and the betteries
      * 
-     * @return true if all calculations were made without errors, false otherwise
+     * @return true if every field is valid and fresh, false otherwise
      */
-    bool calc_total_runtime_stats(const aht20_data_t& aht_data, const adc::data_t& power_data, data_t& final);
+    bool calc_total_runtime_stats(const aht20_data_t& aht_data, int64_t aht_timestamp_us, const adc::data_t& power_data, data_t& final);
 
     /**
      * @brief Function to handle irrecoverable errors by rebooting the system
@@ -0,0 +1,161 @@
+#ifndef _TELEMETRY_BUS_HPP_
+#define _TELEMETRY_BUS_HPP_
+
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+#include "seqlock.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+
+namespace sys {
+
+    /**
+    * @brief Single writer, multi reader broadcast of the latest value of a trivially copyable struct.
+    * Every published value gets a version. Each consumer reads through its own `subscriber_t`, which remembers the
+    * last version it saw, so it can wait for the next one and tells how many it missed in between. Reads go through
+    * a seqlock and never take a lock; waiting uses one event group bit per subscriber, set on every publish
+    *
+    * @note Only one task may call `publish()`. Each `subscriber_t` must only be used by the task that owns it
+    */
+    template <typename T>
+    class telemetry_bus_t {
+    public:
+        // Bits of an event group usable by tasks, with the FreeRTOS 32 bit tick type
+        static constexpr uint8_t MAX_SUBSCRIBERS = 24;
+
+        /**
+        * @brief A consumer's read cursor
+        */
+        class subscriber_t {
+        public:
+            subscriber_t() = default;
+
+            /**
+            * @brief Block till a version newer than the last one read is published, then read the latest
+            * @param[out] data Latest value
+            * @param[out] missed Versions published since the last read that were never read
+            * @param timeout Longest wait
+            * @return true if a new value was read, false on timeout or if every read retry overlapped a write
+            */
+            bool wait(T& data, uint32_t& missed, TickType_t timeout) {
+
+                if (!bus) return false;
+
+                // Cleared before the version check, so a publish racing with the check leaves the bit set instead of being lost
+                xEventGroupClearBits(bus->event_group, bit);
+                if (bus->value.get_generation() == version) {
+                    xEventGroupWaitBits(bus->event_group, bit, pdTRUE, pdFALSE, timeout);
+                    if (bus->value.get_generation() == version) return false;
+                }
+
+                return read(data, missed);
+            }
+
+            /**
+            * @brief Read the latest value without waiting
+            * @param[out] data Latest value
+            * @param[out] missed Versions published since the last read that were never read
+            * @return true if a value newer than the last one read was copied
+            */
+            bool read(T& data, uint32_t& missed) {
+
+                if (!bus) return false;
+
+                uint32_t generation = 0;
+                bus->value.load(data, generation);
+                if (generation == version) return false;
+
+                missed = generation - version - 1;
+                version = generation;
+                return true;
+            }
+
+            /**
+            * @brief Version of the last value read, 0 before the first
+            */
+            [[nodiscard]] uint32_t get_version() const {
+                return version;
+            }
+
+        private:
+            friend class telemetry_bus_t;
+
+            subscriber_t(telemetry_bus_t* owner, EventBits_t event_bit, uint32_t start_version): bus(owner), bit(event_bit), version(start_version) {}
+
+            telemetry_bus_t* bus{};
+            EventBits_t bit{};
+            uint32_t version{};
+        };
+
+        /**
+        * @brief Create the event group the subscribers wait on. Call before anything else
+        * @return true on success
+        */
+        bool init() {
+            event_group = xEventGroupCreate();
+            return event_group != nullptr;
+        }
+
+        /**
+        * @brief Get a read cursor. It starts at the latest version, so its first `wait()` returns the next one.
+        * Call once per consumer, typically at the start of its task
+        * @param[out] subscriber Read cursor
+        * @return false if all MAX_SUBSCRIBERS are taken or `init()` wasn't called
+        */
+        bool subscribe(subscriber_t& subscriber) {
+
+            if (!event_group) return false;
+
+            const uint8_t index = subscriber_count.fetch_add(1, std::memory_order_relaxed);
+            if (index >= MAX_SUBSCRIBERS) {
+                subscriber_count.store(MAX_SUBSCRIBERS, std::memory_order_relaxed);
+                return false;
+            }
+
+            const EventBits_t bit = static_cast<EventBits_t>(1) << index;
+            subscriber_bits.fetch_or(bit, std::memory_order_release);
+            subscriber = subscriber_t(this, bit, value.get_generation());
+            return true;
+        }
+
+        /**
+        * @brief Publish a new value and wake every subscriber waiting for one. Never waits on readers
+        */
+        void publish(const T& data) {
+            value.store(data);
+            const EventBits_t bits = subscriber_bits.load(std::memory_order_acquire);
+            if (bits) xEventGroupSetBits(event_group, bits);
+        }
+
+        /**
+        * @brief Read the latest value without a cursor, for readers that only ever want the present value
+        * @return true if a value has been published
+        */
+        bool peek(T& data) const {
+            uint32_t generation = 0;
+            value.load(data, generation);
+            return generation > 0;
+        }
+
+        /**
+        * @brief Number of values published so far
+        */
+        [[nodiscard]] uint32_t get_version() const {
+            return value.get_generation();
+        }
+
+    private:
+        adc::seqlock_t<T> value{};
+        EventGroupHandle_t event_group{};
+        std::atomic<EventBits_t> subscriber_bits{0};
+        std::atomic<uint8_t> subscriber_count{0};
+    };
+
+} // namespace sys
+
+
+#endif // _TELEMETRY_BUS_HPP_
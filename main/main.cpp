@@ -7,6 +7,7 @@
 #include "ble.hpp"
 #include "config.hpp"
 #include "system.hpp"
+#include "series_codec.hpp"
 #include "display.hpp"
 #include "button_handler.hpp"
 #include "aht20.h"
@@ -14,6 +15,7 @@
 
 #include "esp_task_wdt.h"
 #include "esp_littlefs.h"
+#include "nvs_flash.h"
 #include "esp_heap_caps.h"
 #include "esp_timer.h"
 #include "esp_err.h"
@@ -21,6 +23,7 @@
 
 #include <cstdio>
 #include <array>
+#include <unistd.h>
 
 
 #define DEBUG 1
@@ -55,7 +58,6 @@ static const char* TAG = "MAIN";
     } while (0)
 
 
-#define ADC_TASK_PROFILING                           0
 #define AHT_TASK_PROFILING                           0
 #define LOG_TASK_PROFILING                           0
 #define CALC_TASK_PROFILING                          0
@@ -63,12 +65,14 @@ static const char* TAG = "MAIN";
 #define LVGL_TASK_PROFILING                          0
 #define BLE_TASK_PROFILING                           0
 
+// Set to 0 to stop log_task from reporting the end to end latency of each pipeline stage
+#define LATENCY_REPORT                               1
+
 using namespace config;
 
 // Task handles
 static TaskHandle_t calc_runtime_task_handle         = nullptr;
 static TaskHandle_t display_task_handle              = nullptr;
-static TaskHandle_t adc_task_handle                  = nullptr;
 static TaskHandle_t aht_task_handle                  = nullptr;
 static TaskHandle_t lvgl_task_handle                 = nullptr;
 static TaskHandle_t log_task_handle                  = nullptr;
@@ -76,19 +80,16 @@ static TaskHandle_t ble_task_handle                  = nullptr;
 
 //  Queue parameters
 static QueueHandle_t aht_queue                       = nullptr;
-static QueueHandle_t power_queue                     = nullptr;
-static QueueHandle_t final_data_queue                = nullptr;
+
+// Latest calculated data, published by runtime_calc_task
+static sys::data_bus_t data_bus{};
 
 // Mutex for thread safety between lvgl_handler_task and display_task
 SemaphoreHandle_t lvgl_display_mutex                 = nullptr;
 
-// File data
-struct file_data_t {
-    float voltage;
-    float current;
-    float temperature;
-    float humidity;
-};
+// Compressed log of the voltage, current, temperature and humidity, a ring of LOG_BLOCK_COUNT blocks in DATA_FILE_NAME
+using log_encoder_t = sys::series_encoder_t<LOG_STEPS.size(), LOG_BLOCK_SIZE>;
+using log_decoder_t = sys::series_decoder_t<LOG_STEPS.size(), LOG_BLOCK_SIZE>;
 
 static esp_timer_handle_t display_led_timer_handle   = nullptr;
 static ili9341_handle_t display_handle               = nullptr;
@@ -104,15 +105,29 @@ static void init_all() {
         sys::handle_error();
     }
 
+    // NVS Initialization. The ADC driver restores its zero current offset model from it
+    esp_err_t result = nvs_flash_init();
+    if (result == ESP_ERR_NVS_NO_FREE_PAGES || result == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        result = nvs_flash_init();
+    }
+    if (result != ESP_OK) {
+        LOGE("Failed to initialize nvs flash: %s", esp_err_to_name(result));
+        sys::handle_error();
+    }
+
+    // Battery charge checkpoint. Missing on first boot, which isn't an error
+    sys::init();
+
     // ADC Initialization
-    bool chk = power.init(CURRENT_SENSOR_PIN, VOLTAGE_SENSOR_PIN);
+    bool chk = power.init();
     if (!chk) {
         LOGE("Failed to initialize ADC");
         sys::handle_error();
     }
 
     // Button handler initialization
-    esp_err_t result = button::init(display_led_timer_handle);
+    result = button::init(display_led_timer_handle);
     if (result != ESP_OK) {
         LOGE("Failed to initialize button handler: %s", esp_err_to_name(result));
         sys::handle_error();
@@ -174,7 +189,11 @@ static void init_all() {
         sys::handle_error();
     }
 
-    result = ble::init(final_data_queue);
+    // Battery health history and rollups. Missing on first boot, which isn't an error
+    sys::load_health();
+    sys::load_rollups();
+
+    result = ble::init(data_bus);
     if (result != ESP_OK) {
         LOGE("Failed to initialize BLE GATT server: %s", esp_err_to_name(result));
         sys::handle_error();
@@ -191,15 +210,8 @@ static void queue_create() {
         sys::handle_error();
     }
 
-    power_queue = xQueueCreate(1, sizeof(adc::data_t));
-    if (!power_queue) {
-        LOGE("Failed to create queue for power readings");
-        sys::handle_error();
-    }
-
-    final_data_queue = xQueueCreate(QUEUE_LENGTH, sizeof(sys::data_t));
-    if (!final_data_queue) {
-        LOGE("Failed to create queue to store final data");
+    if (!data_bus.init()) {
+        LOGE("Failed to create the data bus");
         sys::handle_error();
     }
 }
@@ -305,6 +317,36 @@ static void queue_create() {
     } 
 }
 
+// Finds the newest block of the log. false if there is none
+static bool find_last_log_block(FILE* file, log_decoder_t::header_t& last, size_t& last_slot) {
+
+    bool found = false;
+    std::array<uint8_t, sizeof(log_decoder_t::header_t)> buffer{};
+
+    for (size_t slot = 0; slot < LOG_BLOCK_COUNT; slot++) {
+        if (fseek(file, slot * LOG_BLOCK_SIZE, SEEK_SET) != 0) break;
+        // The file only grows as far as the slots written so far
+        if (fread(buffer.data(), buffer.size(), 1, file) != 1) break;
+
+        log_decoder_t::header_t header{};
+        if (!log_decoder_t::peek(buffer.data(), header)) continue;
+        // Block numbers wrap, so newer is a positive difference
+        if (!found || (static_cast<int32_t>(header.seq - last.seq) > 0)) {
+            last = header;
+            last_slot = slot;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Writes the part of a block in use over its slot. Committed straight away, so a reset leaves either the old or the new block
+static bool write_log_block(FILE* file, size_t slot, const uint8_t* block, size_t size) {
+    if (fseek(file, slot * LOG_BLOCK_SIZE, SEEK_SET) != 0) return false;
+    if (fwrite(block, size, 1, file) != 1) return false;
+    return (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+}
+
 // Log task
 [[noreturn]] void log_task(void* arg) {
 
@@ -324,45 +366,44 @@ static void queue_create() {
         ASSERT(f_data_file, "f_data_file cannot be null");
     }
 
-    // Open f_meta_data_file for reading and writing in binary format
-    // We first check if the file exists with rb+. If it exists, we proceed
-    FILE* f_meta_data_file = fopen(META_DATA_FILE_NAME, "rb+");
-    size_t data_file_idx = 0;
-    if (!f_meta_data_file) {
-        // If the file doesn't exist, we create it with wb+
-        f_meta_data_file = fopen(META_DATA_FILE_NAME, "wb+");
-        ASSERT(f_meta_data_file, "f_meta_data_file cannot be null");
-        // We then write data_file_idx's initial 0 value to it
-        ASSERT((fwrite(&data_file_idx, sizeof(data_file_idx), 1, f_meta_data_file) == 1),
-                "Failed to write data_file_idx to metadata file");
-    } else {
-        // Since the file exists, we read from it to get the data file index
-        int ret = fread(&data_file_idx, sizeof(data_file_idx), 1, f_meta_data_file);
-        // We also have to check if the return value is 0 as that means the file is empty
-        // as `fread()` returns the number of elements it was able to read
-        ASSERT((ret == 1) || (ret == 0), "Failed to read file index");
-        // Write the index of zero to the file if it is empty
-        if (ret == 0) {
-            data_file_idx = 0;
-            ASSERT((fwrite(&data_file_idx, sizeof(data_file_idx), 1, f_meta_data_file) == 1),
-                    "Failed to write data_file_idx to metadata file when it exists but is empty");
-        }
-        // Bounds check if we were able to read from the file
-        else if ((data_file_idx >= MAX_SAMPLES_TO_LOG) && (ret == 1)) {
-            data_file_idx = 0;
-        }
+    // The blocks carry their own numbers, so the index file of the raw log isn't needed anymore
+    remove(META_DATA_FILE_NAME);
+
+    // Static, the encoder holds a whole block
+    static log_encoder_t log_encoder(LOG_STEPS);
+
+    // Carry on in the slot after the newest block. Every boot starts a block of its own, as the timestamps restart
+    log_decoder_t::header_t last_block{};
+    size_t log_slot = 0;
+    uint32_t log_seq = 0;
+    uint16_t log_boot = 0;
+    if (find_last_log_block(f_data_file, last_block, log_slot)) {
+        log_slot = (log_slot + 1) % LOG_BLOCK_COUNT;
+        log_seq = last_block.seq + 1;
+        log_boot = last_block.boot + 1;
     }
-
-    // Position f_data_file at the next write location (resume from where we left off on last boot)
-    ASSERT(fseek(f_data_file, data_file_idx * sizeof(file_data_t), SEEK_SET) == 0, "Failed to set file index for writing");
+    log_encoder.begin(log_seq, log_boot);
+    LOGI("Logging from block %lu in slot %u", log_seq, log_slot);
     
     sys::data_t data{};
-    file_data_t file_data{};
-    uint8_t ret = 0;
+    sys::data_bus_t::subscriber_t data_sub{};
+    uint32_t missed = 0;
+    ASSERT(data_bus.subscribe(data_sub), "Failed to subscribe to the data bus");
     size_t err_count = 0;
+    size_t unsaved = 0;
+
+    // Samples are timestamped with the scheduled wake up time, whole ticks apart, so evenly spaced ones cost a bit each
+    TickType_t last_wake = xTaskGetTickCount();
+    TickType_t logged_wake = last_wake;
+    int64_t log_time_ms = esp_timer_get_time() / 1000;
+
+    uint32_t frames_dropped = 0;
+    uint32_t sample_rate_hz = power.get_stats().sample_rate_hz;
 
-    std::array<file_data_t, NUM_OF_ITEMS_TO_STORE_TEMP> data_buffer_temp{};
-    size_t temp_buffer_idx = 0;
+#if LATENCY_REPORT == 1
+    int64_t last_latency_report_us = esp_timer_get_time();
+#endif
+    int64_t last_energy_report_us = esp_timer_get_time();
 
 #if LOG_TASK_PROFILING == 1
     int64_t end[100]{};
@@ -377,45 +418,76 @@ static void queue_create() {
 
         TWDT_RESET_FROM_TASK(log_task);
 
-        if (xQueuePeek(final_data_queue, &data, pdMS_TO_TICKS(TIMEOUT_MS)) != pdTRUE) {
-            LOGW("Failed to receive data from final_data_queue (log_task)");
-            vTaskDelay(pdMS_TO_TICKS(LOG_TASK_PERIOD_MS));
+        // Report samples lost because the processing task fell behind the ADC
+        adc::stats_t stats = power.get_stats();
+        if (stats.frames_dropped != frames_dropped) {
+            LOGW("ADC dropped %lu frames so far. Processed: %lu, max backlog: %lu frames",
+                 stats.frames_dropped, stats.frames_processed, stats.max_backlog);
+            frames_dropped = stats.frames_dropped;
+        }
+
+        // Report the processing load of each sampling profile, so the saving of the low power one shows up in the logs
+        if (stats.sample_rate_hz != sample_rate_hz) {
+            LOGI("ADC now sampling at %luHz with %lu byte frames. Processing load at %luHz was %.1f%%",
+                 stats.sample_rate_hz, stats.frame_size, sample_rate_hz, stats.load_permille / 10.0f);
+            sample_rate_hz = stats.sample_rate_hz;
+        }
+
+        // Only one update in every LOG_TASK_PERIOD_MS is logged, so the ones missed in between are expected
+        if (!data_sub.wait(data, missed, pdMS_TO_TICKS(TIMEOUT_MS))) {
+            LOGW("No new data on the data bus (log_task)");
+            vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(LOG_TASK_PERIOD_MS));
             continue;
         }
 
-        file_data.voltage     = data.battery_voltage;
-        file_data.current     = data.load_current_drawn;
-        file_data.temperature = data.inv_temp;
-        file_data.humidity    = data.inv_hmdt;
+        sys::record_latency(sys::stage_t::LOG, data.timestamp_us, data.seq);
 
-        // Store the received data in temporary buffer and increment index
-        data_buffer_temp[temp_buffer_idx++] = file_data;
-        
-        if (temp_buffer_idx >= NUM_OF_ITEMS_TO_STORE_TEMP) {
-            // Write samples to flash after our temporary buffer is full
-            ret = fwrite(data_buffer_temp.data(), sizeof(file_data_t), NUM_OF_ITEMS_TO_STORE_TEMP, f_data_file);
-            if (ret != NUM_OF_ITEMS_TO_STORE_TEMP) err_count++;
-            temp_buffer_idx = 0;
+#if LATENCY_REPORT == 1
+        if ((esp_timer_get_time() - last_latency_report_us) >= LATENCY_REPORT_PERIOD_US) {
+            sys::log_latency();
+            last_latency_report_us = esp_timer_get_time();
+        }
+#endif
 
-            // Increment data_file_idx by NUM_OF_ITEMS_TO_STORE_TEMP because we stored that number of items
-            data_file_idx += NUM_OF_ITEMS_TO_STORE_TEMP;
+        if ((esp_timer_get_time() - last_energy_report_us) >= ENERGY_REPORT_PERIOD_US) {
+            sys::log_energy();
+            sys::log_health();
+            sys::log_history();
+            last_energy_report_us = esp_timer_get_time();
+        }
 
-            // Set f_meta_data_file back to the beginning of the file before writing to the file
-            // to overwrite the old data index present because we don't need to store different indices
-            rewind(f_meta_data_file);
+        // Fields that aren't fresh are logged as NaN, so held values don't pass for measurements
+        const log_encoder_t::values_t values = {
+            data.is_fresh(sys::field_t::VOLTAGE) ? data.battery_voltage : NAN,
+            data.is_fresh(sys::field_t::CURRENT) ? data.load_current_drawn : NAN,
+            data.is_fresh(sys::field_t::TEMPERATURE) ? data.inv_temp : NAN,
+            data.is_fresh(sys::field_t::HUMIDITY) ? data.inv_hmdt : NAN
+        };
+        log_time_ms += static_cast<int64_t>(last_wake - logged_wake) * portTICK_PERIOD_MS;
+        logged_wake = last_wake;
 
-            ret = fwrite(&data_file_idx, sizeof(data_file_idx), 1, f_meta_data_file);
-            if (ret != 1) err_count++;
+        sys::update_rollups(data, log_time_ms);
 
-            // No need to call `fflush()` as `fwrite()` writes to flash immediately
+        // Checkpoints handed over by runtime_calc_task, so their flash writes stall this task instead of the calculation
+        sys::save_checkpoints();
+
+        if (!log_encoder.append(log_time_ms, values)) {
+            // The block is full. Write it out for good and start the next one, over the oldest block once the ring is full
+            const uint16_t count = log_encoder.get_count();
+            if (!write_log_block(f_data_file, log_slot, log_encoder.seal(), log_encoder.get_size())) err_count++;
+            LOGI("Log block %lu done: %u samples in %u bytes, %.1fx smaller than raw", log_seq, count, log_encoder.get_size(),
+                 static_cast<float>(count * sizeof(values)) / log_encoder.get_size());
+
+            log_slot = (log_slot + 1) % LOG_BLOCK_COUNT;
+            log_encoder.begin(++log_seq, log_boot);
+            log_encoder.append(log_time_ms, values);
+            unsaved = 0;
         }
 
-        // Wrap around to the beginning of the file if data_file_idx gets to MAX_SAMPLES_TO_LOG
-        if (data_file_idx >= MAX_SAMPLES_TO_LOG) {
-            data_file_idx = 0;
-            // Move f_data_file to the beginning of the file so we can overwrite the oldest data
-            // since we have gotten to MAX_SAMPLES_TO_LOG 
-            rewind(f_data_file);
+        // The open block is written over its slot every NUM_OF_ITEMS_TO_STORE_TEMP samples, so a reset loses no more than that
+        if (++unsaved >= NUM_OF_ITEMS_TO_STORE_TEMP) {
+            if (!write_log_block(f_data_file, log_slot, log_encoder.seal(), log_encoder.get_size())) err_count++;
+            unsaved = 0;
         }
 
         if (err_count >= MAX_FILE_IO_ERRORS) {
@@ -439,61 +511,10 @@ static void queue_create() {
         }
 #endif
     
-        vTaskDelay(pdMS_TO_TICKS(LOG_TASK_PERIOD_MS));
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(LOG_TASK_PERIOD_MS));
     } 
 }
 
-// ADC read task
-[[noreturn]] void adc_task(void* arg) {
-
-    LOGI("Starting adc_task");
-
-    TWDT_ADD_TASK(adc_task);
-
-    adc::data_t data{};
-    bool ret = false;
-
-#if ADC_TASK_PROFILING == 1
-    int64_t end[100]{};
-    size_t i = 0;
-#endif
-
-    while (1) {
-
-#if ADC_TASK_PROFILING == 1
-        int64_t start = esp_timer_get_time();
-#endif
-
-        TWDT_RESET_FROM_TASK(adc_task);
-
-        ret = power.get_measurement_data(data);
-        if (!ret) {
-            LOGW("Failed to read ADC data.");
-            continue;
-        }
-
-        xQueueOverwrite(power_queue, &data);
-
-#if ADC_TASK_PROFILING == 1
-        end[i] = esp_timer_get_time() - start;
-        LOGI("Time for adc_task: %.3fus", static_cast<float>(end[i]));
-
-        i++;
-        if (i >= 100) {
-            double average = 0;
-            for (size_t j = 0; j < 100; j++) {
-                average += end[j];
-            }
-            average /= 100;
-            LOGI("Average execution time for adc_task: %.3fus", average);
-            i = 0;
-        }
-#endif
-
-        vTaskDelay(pdMS_TO_TICKS(ADC_READ_PERIOD_MS));
-    }
-}
-
 // Task to calculate runtime parameters
 [[noreturn]] void runtime_calc_task(void* arg) {
      
@@ -504,6 +525,13 @@ static void queue_create() {
     aht20_data_t aht_data{};
     adc::data_t power_data{};
     sys::data_t final_data{};
+    int64_t aht_timestamp_us = 0;
+    uint32_t last_valid_mask = sys::ALL_FIELDS;
+    uint32_t last_stale_mask = 0;
+    int64_t idle_since_us = 0;
+
+    // Woken by the ADC driver for each new measurement, at most once every CALC_TASK_PERIOD_MS
+    power.set_data_ready_task(xTaskGetCurrentTaskHandle(), CALC_TASK_PERIOD_MS * 1'000);
 
 #if CALC_TASK_PROFILING == 1
     int64_t end[100]{};
@@ -512,37 +540,66 @@ static void queue_create() {
 
     while (1) {
 
+        TWDT_RESET_FROM_TASK(runtime_calc_task);
+
+        // Block till the ADC driver publishes a new measurement
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ADC_DATA_TIMEOUT_MS)) == 0) {
+            LOGW("No new ADC data in %ums", ADC_DATA_TIMEOUT_MS);
+            continue;
+        }
+
 #if CALC_TASK_PROFILING == 1
         int64_t start = esp_timer_get_time();
 #endif
 
-        TWDT_RESET_FROM_TASK(runtime_calc_task);
-
         if (xQueueReceive(aht_queue, &aht_data, 0) != pdTRUE) {
             // This is commented out because the AHT20 can only be read from at certain intevals, so we
             // will get a lot of stale reads, so logging each one would flood the logs
             // LOGW("Data not received from aht data queue. Using stale data");
+        } else {
+            aht_timestamp_us = esp_timer_get_time();
+            // The AHT20 sits next to the current sensor, close enough for its offset drift model
+            power.set_temperature(aht_data.temperature);
         }
 
-        if (xQueueReceive(power_queue, &power_data, 0) != pdTRUE) {
-            LOGW("Data not received from power data queue. Using stale data");
-        }
-
-        bool ret = sys::calc_total_runtime_stats(aht_data, power_data, final_data);
-        if (!ret) {
-            LOGW("Failed to calculate all run time parameters successfully");
+        if (!power.get_measurement_data(power_data)) {
+            LOGW("Failed to read ADC data");
             continue;
         }
+        sys::record_latency(sys::stage_t::CALC, power_data.timestamp_us, power_data.seq);
 
-        if (xQueueSend(final_data_queue, &final_data, 0) != pdTRUE) {
-            // Removing oldest data
-            sys::data_t dummy{};
-            xQueueReceive(final_data_queue, &dummy, 0);
-            // Sending latest data again
-            xQueueSend(final_data_queue, &final_data, 0);
+        // Published whatever fails, so one bad sensor doesn't freeze the others. Only changes in what failed are logged
+        bool ret = sys::calc_total_runtime_stats(aht_data, aht_timestamp_us, power_data, final_data);
+        if ((final_data.valid_mask != last_valid_mask) || (final_data.stale_mask != last_stale_mask)) {
+            if (!ret) {
+                LOGW("Run time parameters incomplete. Valid fields: 0x%02lx, stale: 0x%02lx", final_data.valid_mask, final_data.stale_mask);
+            } else {
+                LOGI("All run time parameters valid again");
+            }
+            last_valid_mask = final_data.valid_mask;
+            last_stale_mask = final_data.stale_mask;
+        }
+
+        // Drop the ADC to its low power profile once the inverter has been idle for a while.
+        // The driver goes back to full rate by itself on a current step; this only catches what it misses
+        // Without a fresh current the inverter's state is unknown, so the profile stays as it is.
+        // The driver's processing task applies the request and logs if it fails, so a failed switch is retried a full idle period later
+        if (!final_data.is_fresh(sys::field_t::CURRENT)) {
+            idle_since_us = 0;
+        } else if (final_data.inv_status == sys::inv_status_t::IDLE) {
+            const int64_t now_us = esp_timer_get_time();
+            if (idle_since_us == 0) idle_since_us = now_us;
+            if (!power.is_low_power() && ((now_us - idle_since_us) >= ADC_LOW_POWER_IDLE_TIME_US)) {
+                power.request_low_power(true);
+                idle_since_us = now_us;
+            }
+        } else {
+            idle_since_us = 0;
+            if (power.is_low_power()) power.request_low_power(false);
         }
 
-        xTaskNotifyGive(display_task_handle);
+        // Wakes every consumer waiting for new data
+        data_bus.publish(final_data);
 
 #if CALC_TASK_PROFILING == 1
         end[i] = esp_timer_get_time() - start;
@@ -559,8 +616,6 @@ static void queue_create() {
             i = 0;
         }
 #endif
-
-        vTaskDelay(pdMS_TO_TICKS(CALC_TASK_PERIOD_MS));
     }
 }
 
@@ -581,6 +636,11 @@ static void queue_create() {
     // Initialize local variables being used
     button::event_t event = button::event_t::NO_EVENT;
     sys::data_t data{};
+    sys::data_bus_t::subscriber_t data_sub{};
+    uint32_t missed = 0;
+    uint32_t missed_since_report = 0;
+    int64_t last_miss_report_us = esp_timer_get_time();
+    ASSERT(data_bus.subscribe(data_sub), "Failed to subscribe to the data bus");
     esp_err_t ret = ESP_OK;
     bool is_ble_active = false;
 
@@ -706,15 +766,21 @@ static void queue_create() {
             }
         }
 
-        // Block till runtime_calc_task tells us we have fresh data to update the current screen
-        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TIMEOUT_MS));
-
-        if (xQueueReceive(final_data_queue, &data, 0) != pdTRUE) {
-            LOGW("Failed to receive data from final_data_queue (display_task)");
+        // Block till runtime_calc_task publishes fresh data to update the current screen
+        if (!data_sub.wait(data, missed, pdMS_TO_TICKS(TIMEOUT_MS))) {
+            LOGW("No new data on the data bus (display_task)");
             continue;
         }
+        // Summed up rather than logged per update, a slow redraw would otherwise log at the data rate
+        missed_since_report += missed;
+        if ((missed_since_report > 0) && ((esp_timer_get_time() - last_miss_report_us) >= DISPLAY_MISS_REPORT_PERIOD_US)) {
+            LOGW("Display fell behind, %lu updates missed", missed_since_report);
+            missed_since_report = 0;
+            last_miss_report_us = esp_timer_get_time();
+        }
 
         display::update_screen_data(data);
+        sys::record_latency(sys::stage_t::DISPLAY, data.timestamp_us, data.seq);
         
 #if DISPLAY_TASK_PROFILING == 1
         end[i] = esp_timer_get_time() - start;
@@ -740,6 +806,9 @@ static void queue_create() {
     LOGI("ble_task started");
     
     sys::data_t data{};
+    sys::data_bus_t::subscriber_t data_sub{};
+    uint32_t missed = 0;
+    ASSERT(data_bus.subscribe(data_sub), "Failed to subscribe to the data bus");
     esp_err_t ret = ESP_OK;
 
 #if BLE_TASK_PROFILING == 1
@@ -758,14 +827,16 @@ static void queue_create() {
             continue;
         }
 
-        if (xQueuePeek(final_data_queue, &data, pdMS_TO_TICKS(BLE_TASK_PERIOD_MS)) != pdTRUE) {
-            LOGW("Failed to receive data from final_data_queue (ble_task)");
+        // Notifications go out every BLE_TASK_PERIOD_MS, so the updates missed in between are expected
+        if (!data_sub.wait(data, missed, pdMS_TO_TICKS(BLE_TASK_PERIOD_MS))) {
+            LOGW("No new data on the data bus (ble_task)");
             vTaskDelay(pdMS_TO_TICKS(BLE_TASK_PERIOD_MS));
             continue;
         }
 
         ret = ble::notify_data(data);
         if (ret == ESP_OK) {
+            sys::record_latency(sys::stage_t::BLE, data.timestamp_us, data.seq);
             LOGI("Data sent via BLE notification successfully");
         } else if (ret == ESP_ERR_INVALID_STATE) {
             LOGW("BLE client not connected or subscribed");
@@ -823,12 +894,6 @@ extern "C" {
             sys::handle_error();
         }
 
-        ret = xTaskCreate(adc_task, "ADCTask", ADC_TASK_STACK_SIZE, nullptr, ADC_TASK_PRIORITY, &adc_task_handle);
-        if (ret != pdPASS) {
-            LOGE("Failed to create adc_task");
-            sys::handle_error();
-        }
-
         ret = xTaskCreate(display_task, "DisplayTask", DISPLAY_TASK_STACK_SIZE, nullptr, DISPLAY_TASK_PRIORITY, &display_task_handle);
         if (ret != pdPASS) {
             LOGE("Failed to create display_task");
@@ -0,0 +1,826 @@
+// Host replay and benchmark of the ADC hot path (components/power/frame_processor.hpp), the same code the ESP32 runs.
+//
+// Build:   g++ -std=c++20 -O2 -pthread -Icomponents/power -Icomponents/system tools/adc_replay.cpp components/power/frame_processor.cpp -o adc_replay
+// Replay:  ./adc_replay replay capture_0.bin [frame_words] > frames.csv
+// Synth:   ./adc_replay synth synthetic.bin
+// Bench:   ./adc_replay bench [frames]
+// Latency: ./adc_replay latency [seconds]
+//
+// Add -DADC_CALI_LUT_IN_IRAM=1 to the build for the calibration table layout used in IRAM, or -DADC_USE_CALI_LUT=0 to
+// call the calibration function per sample, and compare the timings with the default DRAM table. The host has no IRAM,
+// so only the wider entries and the doubled table size are emulated, not the ESP32's slower IRAM loads.
+//
+// `replay` feeds a file of raw ADC words through `frame_processor_t` in frames of `frame_words` words, as the DMA delivers
+// them. The file is either a waveform capture pulled off the storage partition (`/storage/capture_N.bin`), whose header
+// gives the channel fields, sample rate and zero current offset, or a headerless dump of raw words in the board's
+// channel pattern at ADC_SAMPLE_RATE_HZ. The measurements of every frame of the first pass go to stdout as CSV, which
+// is deterministic and can be diffed against a stored run. The file is then replayed until about 2 million words went
+// through, to time the processor: samples per second, the time per sample against the time between two samples at the
+// recording's sample rate, and the p50, p90 and p99 time per frame against the time between two frames go to stderr.
+// `synth` writes the synthetic signal of `bench` as a capture file.
+// `bench` runs synthetic frames with a known DC level, ripple and phase on both channels, reports the same timings and
+// checks every measurement against the values put in. It returns nonzero if any is off, or if the p99 frame takes longer
+// than the DMA takes to fill one. Host times are a regression reference only; ADC_PROC_PROFILING in power_monitor.cpp
+// logs the same figure on the ESP32.
+// `bench` also runs the frames through a buffered reduction modelled on the processor before it reduced frames straight
+// from the DMA buffer: scattered into per channel buffers first, then filtered, converted and reduced channel by channel.
+// It reports the buffers, the stack depth and the time per sample of both, and fails if their measurements differ.
+// Finally it times the processor on channel lists of 2, 4 and 6 channels with the board's filters, as ADC_DEMUX_BENCHMARK
+// does on the ESP32, to show what each extra channel costs.
+// `latency` replays the synthetic signal in real time, a frame each time the DMA would have filled one, through the
+// processor on one thread and publishes every measurement through `adc::seqlock_t`, stamped with the frame's capture
+// time, as the driver does. A second thread stands in for runtime_calc_task and records the age of what it reads in the
+// firmware's own `sys::latency_histogram_t`. It's run twice: woken by the publisher at most every CALC_TASK_PERIOD_MS,
+// as `driver::notify_data_ready()` does, and through the chain this replaced, adc_task copying the measurement to a one
+// slot queue every tick and the calculation polling it every two ticks of the 100Hz FreeRTOS tick. Threads on the host
+// stand in for the tasks, so the figures are a reference for the difference, not for the ESP32's own; the CALC line of
+// LATENCY_REPORT in main.cpp logs those. It returns nonzero unless the woken calculation's p90 is below the polled one's
+// median; the host's own wake-up jitter shows in the p99.
+//
+// The ESP32's eFuse calibration isn't available here, so codes are converted with the linear fallback.
+
+#include "frame_processor.hpp"
+#include "seqlock.hpp"
+#include "latency.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+#include <pthread.h>
+
+
+using namespace adc;
+
+// Keep in step with adc::channels_t in components/power/power_monitor.hpp, ADC_SAMPLE_RATE_HZ and ADC_FRAME_SIZE in
+// components/power/power_monitor.cpp, and the pins in components/config/config.hpp
+using channels_t = channel_list_t<
+    channel_t<33, channel_role_t::CURRENT, 10.0f, 2.25f, current_filter_t>,
+    channel_t<32, channel_role_t::VOLTAGE, 5.0f, 0.0f, voltage_filter_t>
+>;
+static constexpr std::array<adc_channel_t, channels_t::COUNT> CHANNEL_FIELDS = { ADC_CHANNEL_5, ADC_CHANNEL_4 };  // GPIO33, GPIO32
+static constexpr uint32_t SAMPLE_RATE_HZ = 20000;
+static constexpr size_t FRAME_WORDS = 128 / sizeof(adc_digi_output_data_t);
+
+using processor_t = frame_processor_t<channels_t>;
+
+// Words replayed to time the processor
+static constexpr size_t TIMED_WORDS = 2'000'000;
+
+/**
+* @brief A stream of raw words and how it was sampled
+*/
+struct recording_t {
+    std::vector<adc_digi_output_data_t> words;
+    std::array<adc_channel_t, channels_t::COUNT> fields;
+    uint32_t sample_rate_hz;
+    float zero_current_offset;      // NaN to start from the channel list's offset
+};
+
+/**
+* @brief Time spent on each frame, in nanoseconds
+*/
+struct timing_t {
+    std::vector<double> frame_ns;
+    size_t words;
+};
+
+// Too big for the stack
+static processor_t processor;
+
+static void setup_processor(const recording_t& recording) {
+    processor.set_channels(recording.fields);
+    processor.set_calibration(nullptr, nullptr);
+    processor.set_sample_rate(recording.sample_rate_hz, 1);
+    processor.set_capture_trigger(0, 0);
+    processor.set_zero_current_offset(std::isnan(recording.zero_current_offset) ? channels_t::OFFSETS[channels_t::PRIMARY_CURRENT]
+                                                                                : recording.zero_current_offset);
+}
+
+/**
+* @brief Run the recording through the processor once, in frames of `frame_words`
+* @param frames[out] Measurements of every frame that produced some
+* @param timing[out] Time spent on every frame is appended, if given
+*/
+static void run_pass(const recording_t& recording, size_t frame_words, std::vector<data_t>& frames, timing_t* timing) {
+
+    processor_t::trigger_t trigger{};
+    data_t data{};
+    for (size_t w = 0; w < recording.words.size(); w += frame_words) {
+        const size_t count = std::min(frame_words, recording.words.size() - w);
+
+        const auto start = std::chrono::steady_clock::now();
+        const bool produced = processor.process_adc_data(&recording.words[w], count, false, data, trigger);
+        const auto end = std::chrono::steady_clock::now();
+
+        if (timing) {
+            timing->frame_ns.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+            timing->words += count;
+        }
+        if (produced) frames.push_back(data);
+    }
+}
+
+static timing_t time_processor(const recording_t& recording, size_t frame_words) {
+
+    timing_t timing{};
+    std::vector<data_t> frames;
+    const size_t passes = std::max<size_t>(1, TIMED_WORDS / std::max<size_t>(1, recording.words.size()));
+    timing.frame_ns.reserve(passes * (recording.words.size() / frame_words + 1));
+    for (size_t pass = 0; pass < passes; pass++) {
+        frames.clear();
+        run_pass(recording, frame_words, frames, &timing);
+    }
+    return timing;
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return NAN;
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(p * (values.size() - 1) + 0.5));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+/**
+* @brief Print the timings against the real time budget: the processor has to keep up with the ADC
+* @return true if the p99 frame is done before the DMA has filled the next one
+*/
+static bool print_timing(FILE* out, const timing_t& timing, size_t frame_words, uint32_t sample_rate_hz) {
+
+#if ADC_USE_CALI_LUT == 0
+    fprintf(out, "Calibration:        function call per sample\n");
+#elif ADC_CALI_LUT_IN_IRAM == 1
+    fprintf(out, "Calibration:        IRAM layout table, %zu bytes of 32 bit entries\n", sizeof(uint32_t) * processor_t::ADC_RESOLUTION);
+#else
+    fprintf(out, "Calibration:        DRAM table, %zu bytes of 16 bit entries\n", sizeof(uint16_t) * processor_t::ADC_RESOLUTION);
+#endif
+
+    double total_ns = 0;
+    for (const double ns : timing.frame_ns) total_ns += ns;
+
+    const double sample_budget_ns = 1e9 / sample_rate_hz;
+    const double frame_budget_ns = sample_budget_ns * frame_words;
+    const double ns_per_sample = total_ns / timing.words;
+    const double p99_ns = percentile(timing.frame_ns, 0.99);
+
+    fprintf(out, "Frames:             %zu of %zu words\n", timing.frame_ns.size(), frame_words);
+    fprintf(out, "Throughput:         %.1f Msamples/s\n", timing.words / total_ns * 1e3);
+    fprintf(out, "Time per sample:    %.2f ns, %.3f%% of the %.0f ns between samples at %uHz\n", ns_per_sample,
+            100.0 * ns_per_sample / sample_budget_ns, sample_budget_ns, sample_rate_hz);
+    fprintf(out, "Time per frame:     p50 %.2f us, p90 %.2f us, p99 %.2f us, max %.2f us\n",
+            percentile(timing.frame_ns, 0.5) / 1e3, percentile(timing.frame_ns, 0.9) / 1e3,
+            p99_ns / 1e3, *std::max_element(timing.frame_ns.begin(), timing.frame_ns.end()) / 1e3);
+    fprintf(out, "Frame budget:       %.0f us, p99 uses %.3f%%\n", frame_budget_ns / 1e3, 100.0 * p99_ns / frame_budget_ns);
+
+    return p99_ns <= frame_budget_ns;
+}
+
+static bool load_recording(const char* path, recording_t& recording) {
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+
+    capture_header_t header{};
+    const bool is_capture = (fread(&header, sizeof(header), 1, file) == 1) && (header.magic == CAPTURE_MAGIC);
+    if (is_capture) {
+        // Captures taken before the channel count was recorded always had 2 channels
+        if ((header.channel_count != 0) && (header.channel_count != channels_t::COUNT)) {
+            fprintf(stderr, "Capture has %u channels, the replay's channel list has %zu\n", header.channel_count, channels_t::COUNT);
+            fclose(file);
+            return false;
+        }
+        recording.fields[channels_t::PRIMARY_CURRENT] = static_cast<adc_channel_t>(header.current_channel);
+        recording.fields[channels_t::PRIMARY_VOLTAGE] = static_cast<adc_channel_t>(header.voltage_channel);
+        recording.sample_rate_hz = header.sample_rate_hz;
+        recording.zero_current_offset = header.zero_current_offset_voltage;
+        recording.words.resize(header.sample_count);
+        const bool ok = fread(recording.words.data(), sizeof(adc_digi_output_data_t), header.sample_count, file) == header.sample_count;
+        fclose(file);
+        if (!ok) fprintf(stderr, "Capture is truncated\n");
+        else fprintf(stderr, "Capture %u: %u words at %uHz, triggered at word %u by %.2fA\n", header.sequence, header.sample_count,
+                     header.sample_rate_hz, header.trigger_index, header.trigger_current);
+        return ok;
+    }
+
+    // Raw dump: the whole file is words
+    rewind(file);
+    recording.fields = CHANNEL_FIELDS;
+    recording.sample_rate_hz = SAMPLE_RATE_HZ;
+    recording.zero_current_offset = NAN;
+    adc_digi_output_data_t word{};
+    while (fread(&word, sizeof(word), 1, file) == 1) recording.words.push_back(word);
+    fclose(file);
+    fprintf(stderr, "Raw dump: %zu words, assumed %uHz\n", recording.words.size(), SAMPLE_RATE_HZ);
+    return !recording.words.empty();
+}
+
+static int replay(const char* path, size_t frame_words) {
+
+    recording_t recording{};
+    if (!load_recording(path, recording)) return 1;
+    frame_words = std::clamp<size_t>(frame_words, channels_t::COUNT, processor_t::MAX_FRAME_SAMPLES);
+
+    setup_processor(recording);
+    std::vector<data_t> frames;
+    run_pass(recording, frame_words, frames, nullptr);
+
+    printf("frame,current_avg,voltage_avg,current_rms,voltage_rms,real_power,power_factor,current_min,current_max,ripple_rms");
+    for (size_t k = 0; k < RIPPLE_HARMONICS; k++) printf(",harmonic_%zu", k + 1);
+    printf("\n");
+    for (size_t f = 0; f < frames.size(); f++) {
+        const data_t& data = frames[f];
+        printf("%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f", f, data.current_avg, data.voltage_avg, data.current_rms,
+               data.voltage_rms, data.real_power, data.power_factor, data.current_window.min, data.current_window.max,
+               data.current_ripple_rms);
+        for (const float amplitude : data.current_harmonics) printf(",%.4f", amplitude);
+        printf("\n");
+    }
+
+    setup_processor(recording);
+    (void)print_timing(stderr, time_processor(recording, frame_words), frame_words, recording.sample_rate_hz);
+    return 0;
+}
+
+/**
+* @brief The frame reduction as it was before `frame_processor_t` worked straight from the DMA buffer. The frame is first
+* scattered into per channel buffers, which are then filtered and converted a channel at a time, and reduced in a pass
+* over the paired samples. Same filter chains, calibration and pairing as the processor, without the ripple analysis and
+* capture trigger, so it doubles as an independent check of the processor's figures
+*/
+template <typename CHANNELS>
+class buffered_reduction_t {
+public:
+    static constexpr size_t COUNT = CHANNELS::COUNT;
+    static constexpr size_t MAX_FRAME_SAMPLES = frame_processor_base_t::MAX_FRAME_SAMPLES;
+
+    void setup(const std::array<adc_channel_t, COUNT>& fields) {
+        slot_lut.fill(COUNT);
+        for (size_t c = 0; c < COUNT; c++) slot_lut[fields[c] & (slot_lut.size() - 1)] = static_cast<uint8_t>(c);
+        std::apply([](auto&... filter) { (filter.reset(), ...); }, filters);
+    }
+
+    /**
+    * @param calibration Processor whose calibration and zero current offset are used
+    */
+    bool process(frame_processor_t<CHANNELS>& calibration, const adc_digi_output_data_t* frame, size_t words, data_t& data) {
+
+        words = std::min(words, MAX_FRAME_SAMPLES);
+        raw_counts.fill(0);
+        for (size_t w = 0; w < words; w++) {
+            const size_t slot = slot_lut[frame[w].type1.channel];
+            size_t& count = raw_counts[slot];
+            raw[slot][count] = frame[w].type1.data;
+            count = std::min(count + 1, SLOT_CAPACITY);
+        }
+
+        std::array<float, COUNT> offsets = CHANNELS::OFFSETS;
+        offsets[CHANNELS::PRIMARY_CURRENT] = calibration.get_zero_current_offset();
+
+        // Unfiltered samples, converted in place
+        const size_t raw_pairs = *std::min_element(raw_counts.begin(), raw_counts.begin() + COUNT);
+        for (size_t c = 0; c < COUNT; c++) {
+            for (size_t n = 0; n < raw_pairs; n++) {
+                unfiltered[c][n] = (calibration.raw_to_voltage(raw[c][n]) - offsets[c]) * CHANNELS::SCALES[c];
+            }
+        }
+
+        // Filtered samples
+        [&]<size_t... C>(std::index_sequence<C...>) {
+            (filter_channel<C>(calibration, offsets[C]), ...);
+        }(std::make_index_sequence<COUNT>{});
+        const size_t pairs = *std::min_element(sample_counts.begin(), sample_counts.end());
+        if (pairs == 0) return false;
+
+        data = data_t{};
+        data.channel_count = COUNT;
+        float vi = 0.0f;
+        for (size_t n = 0; n < raw_pairs; n++) {
+            vi += unfiltered[CHANNELS::PRIMARY_VOLTAGE][n] * unfiltered[CHANNELS::PRIMARY_CURRENT][n];
+        }
+        for (size_t c = 0; c < COUNT; c++) {
+            running_stats_t stats{};
+            for (size_t n = 0; n < pairs; n++) stats.add(filtered[c][n]);
+            float sum_sq = 0.0f;
+            for (size_t n = 0; n < raw_pairs; n++) sum_sq += unfiltered[c][n] * unfiltered[c][n];
+            data.channels[c] = channel_data_t{ .avg = stats.mean, .rms = sqrtf(sum_sq / raw_pairs), .window = stats };
+        }
+        data.current_avg = data.channels[CHANNELS::PRIMARY_CURRENT].avg;
+        data.voltage_avg = data.channels[CHANNELS::PRIMARY_VOLTAGE].avg;
+        data.current_rms = data.channels[CHANNELS::PRIMARY_CURRENT].rms;
+        data.voltage_rms = data.channels[CHANNELS::PRIMARY_VOLTAGE].rms;
+        data.real_power = vi / raw_pairs;
+        data.current_window = data.channels[CHANNELS::PRIMARY_CURRENT].window;
+        data.voltage_window = data.channels[CHANNELS::PRIMARY_VOLTAGE].window;
+        data.valid = true;
+        return true;
+    }
+
+private:
+    // The ADC pattern is round robin, so no channel gets more than its share of a frame
+    static constexpr size_t SLOT_CAPACITY = (MAX_FRAME_SAMPLES + COUNT - 1) / COUNT;
+
+    std::array<uint8_t, 16> slot_lut{};
+    typename CHANNELS::filters_t filters{};
+
+public:
+    // Raw counts of every slot, discard slot included, and the unfiltered and filtered samples in Amperes or Volts
+    std::array<std::array<uint16_t, SLOT_CAPACITY + 1>, COUNT + 1> raw{};
+    std::array<size_t, COUNT + 1> raw_counts{};
+    std::array<std::array<float, SLOT_CAPACITY>, COUNT> unfiltered{};
+    std::array<std::array<float, SLOT_CAPACITY>, COUNT> filtered{};
+    std::array<size_t, COUNT> sample_counts{};
+
+    static constexpr size_t BUFFER_BYTES = sizeof(raw) + sizeof(raw_counts) + sizeof(unfiltered) + sizeof(filtered) + sizeof(sample_counts);
+
+private:
+    template <size_t C>
+    void filter_channel(frame_processor_t<CHANNELS>& calibration, float offset) {
+        int32_t out = 0;
+        size_t count = 0;
+        for (size_t n = 0; n < raw_counts[C]; n++) {
+            if (!std::get<C>(filters).process(raw[C][n], out)) continue;
+            const uint32_t code = static_cast<uint32_t>(std::clamp<int32_t>(out, 0, frame_processor_base_t::ADC_RESOLUTION - 1));
+            filtered[C][count++] = (calibration.raw_to_voltage(code) - offset) * CHANNELS::SCALES[C];
+        }
+        sample_counts[C] = count;
+    }
+};
+
+// Painted stack of the measuring thread. Big enough for anything the reductions do
+static constexpr size_t STACK_SIZE = 256 * 1024;
+static constexpr uint8_t STACK_PAINT = 0xA5;
+alignas(64) static uint8_t stack_area[STACK_SIZE];
+
+/**
+* @brief Run `fn(arg)` on a thread with a painted stack
+* @return Deepest the stack got, in bytes, thread start up included
+*/
+static size_t stack_depth(void* (*fn)(void*), void* arg) {
+
+    memset(stack_area, STACK_PAINT, sizeof(stack_area));
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack_area, sizeof(stack_area));
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, fn, arg) != 0) {
+        pthread_attr_destroy(&attr);
+        return 0;
+    }
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+
+    // The stack grows down, so the lowest byte that lost its paint marks the depth
+    size_t untouched = 0;
+    while ((untouched < sizeof(stack_area)) && (stack_area[untouched] == STACK_PAINT)) untouched++;
+    return sizeof(stack_area) - untouched;
+}
+
+/**
+* @brief The synthetic signal: DC plus a 100Hz ripple and its second harmonic on the current, and a smaller 100Hz ripple
+* lagging by `VOLTAGE_LAG_RAD` on the voltage, with a couple of codes of noise
+*/
+struct synthetic_t {
+    static constexpr float CURRENT_DC = 3.0f;
+    static constexpr float CURRENT_RIPPLE = 1.0f;           // Peak, at 100Hz
+    static constexpr float CURRENT_HARMONIC = 0.3f;         // Peak, at 200Hz
+    static constexpr float VOLTAGE_DC = 12.0f;
+    static constexpr float VOLTAGE_RIPPLE = 0.5f;           // Peak, at 100Hz
+    static constexpr float VOLTAGE_LAG_RAD = 0.6f;
+
+    static float current_rms() {
+        return sqrtf(CURRENT_DC * CURRENT_DC + (CURRENT_RIPPLE * CURRENT_RIPPLE + CURRENT_HARMONIC * CURRENT_HARMONIC) / 2.0f);
+    }
+
+    static float voltage_rms() {
+        return sqrtf(VOLTAGE_DC * VOLTAGE_DC + VOLTAGE_RIPPLE * VOLTAGE_RIPPLE / 2.0f);
+    }
+
+    static float real_power() {
+        return VOLTAGE_DC * CURRENT_DC + CURRENT_RIPPLE * VOLTAGE_RIPPLE * cosf(VOLTAGE_LAG_RAD) / 2.0f;
+    }
+
+    static recording_t make(size_t words) {
+
+        recording_t recording{};
+        recording.fields = CHANNEL_FIELDS;
+        recording.sample_rate_hz = SAMPLE_RATE_HZ;
+        recording.zero_current_offset = NAN;
+
+        std::mt19937 rng(3);
+        std::uniform_int_distribution<int> noise(-2, 2);
+        const float round_rate_hz = static_cast<float>(SAMPLE_RATE_HZ) / channels_t::COUNT;
+        recording.words.resize(words);
+        for (size_t w = 0; w < words; w++) {
+            const size_t slot = w % channels_t::COUNT;
+            const float t = static_cast<float>(w / channels_t::COUNT) / round_rate_hz;
+            const float phase = 2.0f * static_cast<float>(M_PI) * 100.0f * t;
+
+            float value = 0.0f;
+            if (slot == channels_t::PRIMARY_CURRENT) {
+                value = CURRENT_DC + CURRENT_RIPPLE * sinf(phase) + CURRENT_HARMONIC * sinf(2.0f * phase);
+            } else {
+                value = VOLTAGE_DC + VOLTAGE_RIPPLE * sinf(phase - VOLTAGE_LAG_RAD);
+            }
+            const float pin_v = value / channels_t::SCALES[slot] + channels_t::OFFSETS[slot];
+            const int code = static_cast<int>(lroundf(pin_v / 3.3f * processor_t::ADC_RESOLUTION)) + noise(rng);
+
+            recording.words[w].type1.channel = recording.fields[slot];
+            recording.words[w].type1.data = static_cast<uint16_t>(std::clamp(code, 0, processor_t::ADC_RESOLUTION - 1));
+        }
+        return recording;
+    }
+};
+
+static int synth(const char* path) {
+
+    const recording_t recording = synthetic_t::make(4096);
+
+    const capture_header_t header{
+        .magic = CAPTURE_MAGIC,
+        .sequence = 0,
+        .timestamp_us = 0,
+        .sample_rate_hz = recording.sample_rate_hz,
+        .sample_count = static_cast<uint32_t>(recording.words.size()),
+        .trigger_index = 0,
+        .trigger_current = 0,
+        .zero_current_offset_voltage = channels_t::OFFSETS[channels_t::PRIMARY_CURRENT],
+        .current_channel = static_cast<uint8_t>(recording.fields[channels_t::PRIMARY_CURRENT]),
+        .voltage_channel = static_cast<uint8_t>(recording.fields[channels_t::PRIMARY_VOLTAGE]),
+        .reason = capture_reason_t::THRESHOLD,
+        .channel_count = static_cast<uint8_t>(channels_t::COUNT)
+    };
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+    const bool ok = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+                    (fwrite(recording.words.data(), sizeof(adc_digi_output_data_t), recording.words.size(), file) == recording.words.size());
+    fclose(file);
+    return ok ? 0 : 1;
+}
+
+// Prints a measurement against the expected value and whether it's within the tolerance
+static size_t check(const char* name, float measured, float expected, float tolerance) {
+    const bool ok = fabsf(measured - expected) <= tolerance;
+    printf("%-20s %9.4f, expected %9.4f +- %.4f %s\n", name, measured, expected, tolerance, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+// Frames handed to the stack measuring threads
+struct stack_job_t {
+    const recording_t* recording;
+    buffered_reduction_t<channels_t>* buffered;
+};
+
+static void* idle_job(void*) {
+    return nullptr;
+}
+
+static void* processor_job(void* arg) {
+    const auto* job = static_cast<const stack_job_t*>(arg);
+    data_t data{};
+    processor_t::trigger_t trigger{};
+    for (size_t w = 0; w + FRAME_WORDS <= job->recording->words.size(); w += FRAME_WORDS) {
+        (void)processor.process_adc_data(&job->recording->words[w], FRAME_WORDS, false, data, trigger);
+    }
+    return nullptr;
+}
+
+static void* buffered_job(void* arg) {
+    const auto* job = static_cast<const stack_job_t*>(arg);
+    data_t data{};
+    for (size_t w = 0; w + FRAME_WORDS <= job->recording->words.size(); w += FRAME_WORDS) {
+        (void)job->buffered->process(processor, &job->recording->words[w], FRAME_WORDS, data);
+    }
+    return nullptr;
+}
+
+/**
+* @brief Compare the single pass reduction with the buffered one it replaced
+* @return Number of measurements that differ
+*/
+static size_t compare_buffered(const recording_t& recording) {
+
+    static buffered_reduction_t<channels_t> buffered;
+
+    // Figures of every frame, and the time spent on the whole recording
+    auto run = [&](bool single_pass, std::vector<data_t>& results) {
+        setup_processor(recording);
+        buffered.setup(recording.fields);
+        processor_t::trigger_t trigger{};
+        data_t data{};
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t w = 0; w + FRAME_WORDS <= recording.words.size(); w += FRAME_WORDS) {
+            const bool produced = single_pass ? processor.process_adc_data(&recording.words[w], FRAME_WORDS, false, data, trigger)
+                                              : buffered.process(processor, &recording.words[w], FRAME_WORDS, data);
+            if (produced) results.push_back(data);
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / recording.words.size();
+    };
+
+    std::vector<data_t> single_results;
+    std::vector<data_t> buffered_results;
+    const double single_ns = run(true, single_results);
+    const double buffered_ns = run(false, buffered_results);
+
+    size_t mismatches = (single_results.size() == buffered_results.size()) ? 0 : 1;
+    auto differs = [](float a, float b) { return fabsf(a - b) > (1e-4f * std::max(1.0f, fabsf(b))); };
+    for (size_t f = 0; f < std::min(single_results.size(), buffered_results.size()); f++) {
+        const data_t& a = single_results[f];
+        const data_t& b = buffered_results[f];
+        if (differs(a.current_avg, b.current_avg) || differs(a.voltage_avg, b.voltage_avg) || differs(a.current_rms, b.current_rms) ||
+            differs(a.voltage_rms, b.voltage_rms) || differs(a.real_power, b.real_power) ||
+            differs(a.current_window.min, b.current_window.min) || differs(a.current_window.max, b.current_window.max)) {
+            mismatches++;
+        }
+    }
+
+    // Stack beyond what an idle thread needs
+    stack_job_t job{ &recording, &buffered };
+    const size_t idle_stack = stack_depth(idle_job, &job);
+    setup_processor(recording);
+    const size_t single_stack = stack_depth(processor_job, &job) - idle_stack;
+    buffered.setup(recording.fields);
+    const size_t buffered_stack = stack_depth(buffered_job, &job) - idle_stack;
+
+    printf("Reduction          Buffers    Stack   Time per sample\n");
+    printf("single pass        %5zu B  %5zu B   %6.2f ns\n", static_cast<size_t>(0), single_stack, single_ns);
+    printf("buffered (before)  %5zu B  %5zu B   %6.2f ns\n", buffered_reduction_t<channels_t>::BUFFER_BYTES, buffered_stack, buffered_ns);
+    printf("Processor object:  %zu B\n", sizeof(processor_t));
+    printf("Frames compared:   %zu, %zu differ%s\n", single_results.size(), mismatches, (mismatches == 0) ? "" : " FAILED");
+    return mismatches;
+}
+
+// Extra channels for the channel count benchmark. Same filters as the board's channels, so only the channel count changes
+template <int GPIO>
+using bench_voltage_t = channel_t<GPIO, channel_role_t::VOLTAGE, 5.0f, 0.0f, voltage_filter_t>;
+template <int GPIO>
+using bench_current_t = channel_t<GPIO, channel_role_t::CURRENT, 10.0f, 2.25f, current_filter_t>;
+
+using bench_2_channels_t = channel_list_t<bench_current_t<36>, bench_voltage_t<37>>;
+using bench_4_channels_t = channel_list_t<bench_current_t<36>, bench_voltage_t<37>, bench_current_t<38>, bench_voltage_t<39>>;
+using bench_6_channels_t = channel_list_t<bench_current_t<36>, bench_voltage_t<37>, bench_current_t<38>, bench_voltage_t<39>,
+                                          bench_voltage_t<32>, bench_voltage_t<33>>;
+
+/**
+* @brief Time a processor over full size round robin frames of a triangle ripple around mid scale
+*/
+template <typename CHANNELS>
+static void bench_channels(size_t frames) {
+
+    static constexpr size_t WORDS = frame_processor_base_t::MAX_FRAME_SAMPLES - (frame_processor_base_t::MAX_FRAME_SAMPLES % CHANNELS::COUNT);
+    static frame_processor_t<CHANNELS> bench_processor;
+    static std::array<adc_digi_output_data_t, WORDS> frame{};
+
+    std::array<adc_channel_t, CHANNELS::COUNT> fields{};
+    for (size_t c = 0; c < CHANNELS::COUNT; c++) fields[c] = static_cast<adc_channel_t>(c);
+    bench_processor.set_channels(fields);
+    bench_processor.set_calibration(nullptr, nullptr);
+    bench_processor.set_sample_rate(SAMPLE_RATE_HZ, 1);
+    bench_processor.set_capture_trigger(0, 0);
+
+    for (size_t n = 0; n < WORDS; n++) {
+        const int32_t ripple = static_cast<int32_t>((n / CHANNELS::COUNT) & 63) - 32;
+        const int32_t noise = static_cast<int32_t>((static_cast<uint32_t>(n) * 2654435761u) >> 29) - 4;
+        frame[n].type1.channel = n % CHANNELS::COUNT;
+        frame[n].type1.data = static_cast<uint16_t>(2048 + ripple + noise);
+    }
+
+    data_t data{};
+    typename frame_processor_t<CHANNELS>::trigger_t trigger{};
+    float checksum = 0.0f;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t f = 0; f < frames; f++) {
+        (void)bench_processor.process_adc_data(frame.data(), WORDS, false, data, trigger);
+        checksum += data.current_avg;
+    }
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%zu channels:        %6.2f ns/sample, %.2f us per %zu word frame (checksum %.1f)\n", CHANNELS::COUNT,
+           ns / (frames * WORDS), ns / frames / 1e3, WORDS, checksum);
+}
+
+static int bench(size_t frames) {
+
+    const recording_t recording = synthetic_t::make(frames * FRAME_WORDS);
+
+    setup_processor(recording);
+    std::vector<data_t> results;
+    run_pass(recording, FRAME_WORDS, results, nullptr);
+    if (results.empty()) {
+        fprintf(stderr, "No measurements\n");
+        return 1;
+    }
+
+    // Averaged over the frames, as the driver does between reads. The last ripple block is complete by then
+    float current_avg = 0, voltage_avg = 0, current_rms_sq = 0, voltage_rms_sq = 0, real_power = 0;
+    for (const data_t& data : results) {
+        current_avg += data.current_avg / results.size();
+        voltage_avg += data.voltage_avg / results.size();
+        current_rms_sq += data.current_rms * data.current_rms / results.size();
+        voltage_rms_sq += data.voltage_rms * data.voltage_rms / results.size();
+        real_power += data.real_power / results.size();
+    }
+    const float power_factor = real_power / (sqrtf(voltage_rms_sq) * sqrtf(current_rms_sq));
+    const float expected_pf = synthetic_t::real_power() / (synthetic_t::voltage_rms() * synthetic_t::current_rms());
+    const data_t& last = results.back();
+
+    // A code is 8mA on the current channel and 4mV on the voltage channel, and the linear fallback truncates
+    size_t failures = 0;
+    failures += check("current_avg", current_avg, synthetic_t::CURRENT_DC, 0.02f);
+    failures += check("voltage_avg", voltage_avg, synthetic_t::VOLTAGE_DC, 0.02f);
+    failures += check("current_rms", sqrtf(current_rms_sq), synthetic_t::current_rms(), 0.02f);
+    failures += check("voltage_rms", sqrtf(voltage_rms_sq), synthetic_t::voltage_rms(), 0.02f);
+    failures += check("real_power", real_power, synthetic_t::real_power(), 0.3f);
+    failures += check("power_factor", power_factor, expected_pf, 0.001f);
+    failures += check("harmonic_1", last.current_harmonics[0], synthetic_t::CURRENT_RIPPLE, 0.03f);
+    failures += check("harmonic_2", last.current_harmonics[1], synthetic_t::CURRENT_HARMONIC, 0.03f);
+
+    setup_processor(recording);
+    if (!print_timing(stdout, time_processor(recording, FRAME_WORDS), FRAME_WORDS, recording.sample_rate_hz)) {
+        printf("p99 frame time over budget FAILED\n");
+        failures++;
+    }
+
+    failures += compare_buffered(recording);
+
+    bench_channels<bench_2_channels_t>(frames * 4);
+    bench_channels<bench_4_channels_t>(frames * 4);
+    bench_channels<bench_6_channels_t>(frames * 4);
+
+    printf("%s\n", (failures == 0) ? "All checks passed" : "Checks FAILED");
+    return (failures == 0) ? 0 : 1;
+}
+
+// Keep in step with CALC_TASK_PERIOD_MS in components/config/config.hpp and CONFIG_FREERTOS_HZ. The polled chain's
+// periods are those of adc_task and runtime_calc_task before the calculation was woken by the driver
+static constexpr int64_t CALC_PERIOD_US = 20'000;
+static constexpr int64_t TICK_US = 10'000;
+static constexpr int64_t ADC_TASK_TICKS = 1;            // pdMS_TO_TICKS(ADC_READ_PERIOD_MS), 15ms at 100Hz
+static constexpr int64_t CALC_TASK_TICKS = 2;           // pdMS_TO_TICKS(CALC_TASK_PERIOD_MS)
+// adc_task outranked runtime_calc_task, so on a shared tick it ran first
+static constexpr int64_t PRIORITY_DELAY_US = 200;
+
+using latency_t = sys::latency_histogram_t;
+
+static int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void sleep_until_us(int64_t time_us) {
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(time_us)));
+}
+
+// Like vTaskDelay(): the given number of tick boundaries after the present tick
+static int64_t after_ticks(int64_t time_us, int64_t ticks) {
+    return (time_us / TICK_US + ticks) * TICK_US;
+}
+
+/**
+* @brief Replay the recording in real time and record the age of what the calculation reads
+* @param notify Woken by the publisher if true, else through the polled chain
+*/
+static latency_t::snapshot_t run_latency(const recording_t& recording, bool notify, double seconds) {
+
+    // Fresh for every run, and on the heap as the lock holds a whole measurement
+    auto published_ptr = std::make_unique<adc::seqlock_t<data_t>>();
+    auto histogram_ptr = std::make_unique<latency_t>();
+    adc::seqlock_t<data_t>& published = *published_ptr;
+    latency_t& histogram = *histogram_ptr;
+
+    std::atomic<bool> running{true};
+    std::counting_semaphore<1> data_ready(0);
+    setup_processor(recording);
+
+    const int64_t frame_us = static_cast<int64_t>(FRAME_WORDS) * 1'000'000 / recording.sample_rate_hz;
+    const int64_t start_us = now_us();
+    const int64_t end_us = start_us + static_cast<int64_t>(seconds * 1e6);
+
+    // The processing task: a frame every time the DMA fills one, published with the time it was complete
+    std::thread producer([&]() {
+        processor_t::trigger_t trigger{};
+        data_t data{};
+        uint32_t seq = 0;
+        uint32_t notified_seq = 0;
+        int64_t notified_us = start_us - CALC_PERIOD_US;
+        size_t w = 0;
+        for (int64_t capture_us = start_us + frame_us; capture_us < end_us; capture_us += frame_us) {
+            sleep_until_us(capture_us);
+            if (w + FRAME_WORDS > recording.words.size()) w = 0;
+            const bool produced = processor.process_adc_data(&recording.words[w], FRAME_WORDS, false, data, trigger);
+            w += FRAME_WORDS;
+            if (!produced) continue;
+            data.timestamp_us = capture_us;
+            data.seq = ++seq;
+            published.store(data);
+            if (notify && (seq != notified_seq) && ((now_us() - notified_us) >= CALC_PERIOD_US)) {
+                notified_seq = seq;
+                notified_us = now_us();
+                data_ready.release();
+            }
+        }
+        running.store(false);
+        data_ready.release();
+    });
+
+    if (notify) {
+        std::thread calc([&]() {
+            data_t data{};
+            uint32_t generation = 0;
+            while (true) {
+                data_ready.acquire();
+                if (!running.load()) break;
+                published.load(data, generation);
+                histogram.record(now_us() - data.timestamp_us, data.seq);
+            }
+        });
+        calc.join();
+    } else {
+        std::mutex queue_mutex;
+        data_t queued{};
+        bool queue_full = false;
+
+        std::thread adc_task([&]() {
+            data_t data{};
+            uint32_t generation = 0;
+            while (running.load()) {
+                sleep_until_us(after_ticks(now_us(), ADC_TASK_TICKS));
+                published.load(data, generation);
+                if (generation == 0) continue;
+                const std::lock_guard<std::mutex> lock(queue_mutex);
+                queued = data;
+                queue_full = true;
+            }
+        });
+        std::thread calc([&]() {
+            data_t data{};
+            bool have_data = false;
+            while (running.load()) {
+                sleep_until_us(after_ticks(now_us(), CALC_TASK_TICKS) + PRIORITY_DELAY_US);
+                {
+                    const std::lock_guard<std::mutex> lock(queue_mutex);
+                    if (queue_full) {
+                        data = queued;
+                        queue_full = false;
+                        have_data = true;
+                    }
+                }
+                // An empty queue left the calculation on the measurement it had, which counts as stale
+                if (have_data) histogram.record(now_us() - data.timestamp_us, data.seq);
+            }
+        });
+        adc_task.join();
+        calc.join();
+    }
+    producer.join();
+    return histogram.snapshot();
+}
+
+static void print_latency(const char* name, const latency_t::snapshot_t& snap) {
+    printf("%-22s n=%u p50<=%uus p90<=%uus p99<=%uus max=%uus stale=%u skipped=%u\n", name, snap.count,
+           latency_t::percentile_us(snap, 50), latency_t::percentile_us(snap, 90), latency_t::percentile_us(snap, 99),
+           snap.max_us, snap.stale, snap.skipped);
+}
+
+static int latency(double seconds) {
+
+    const recording_t recording = synthetic_t::make(1000 * FRAME_WORDS);
+
+    printf("Frames of %zu words every %lldus, %.1f seconds each\n", FRAME_WORDS,
+           static_cast<long long>(FRAME_WORDS) * 1'000'000 / recording.sample_rate_hz, seconds);
+    const latency_t::snapshot_t polled = run_latency(recording, false, seconds);
+    print_latency("Polled through adc_task", polled);
+    const latency_t::snapshot_t woken = run_latency(recording, true, seconds);
+    print_latency("Woken by the driver", woken);
+
+    const bool ok = (woken.count > 0) && (polled.count > 0) &&
+                    (latency_t::percentile_us(woken, 90) < latency_t::percentile_us(polled, 50));
+    printf("%s\n", ok ? "Woken p90 below polled median" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+
+    if ((argc >= 3) && (strcmp(argv[1], "replay") == 0)) return replay(argv[2], (argc >= 4) ? strtoul(argv[3], nullptr, 10) : FRAME_WORDS);
+    if ((argc >= 3) && (strcmp(argv[1], "synth") == 0)) return synth(argv[2]);
+    if ((argc >= 2) && (strcmp(argv[1], "bench") == 0)) return bench((argc >= 3) ? strtoul(argv[2], nullptr, 10) : 1000);
+    if ((argc >= 2) && (strcmp(argv[1], "latency") == 0)) return latency((argc >= 3) ? atof(argv[2]) : 10.0);
+
+    fprintf(stderr, "Usage: %s replay <file> [frame_words] | synth <file> | bench [frames] | latency [seconds]\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,726 @@
+// Host simulation of the battery estimators (components/system/soc_estimator.hpp) against a battery model, and known
+// answer checks of the runtime predictor (components/system/runtime_predictor.hpp).
+//
+// Build:   g++ -std=c++20 -O2 -Icomponents/system -Icomponents/config tools/battery_sim.cpp -o battery_sim
+// SoC:     ./battery_sim soc [hours]
+// Runtime: ./battery_sim runtime
+// Health:  ./battery_sim health [months]
+//
+// `soc` runs `soc_estimator_t` at the calculation task's 50Hz over a day of inverter loads and solar charging on a
+// simulated bank: the profile's open circuit voltage curve, a series resistance the estimator doesn't know, a slow
+// polarisation it doesn't model, sensor noise and a current offset that the charge count integrates. Every run closes
+// with two and a half hours on standby. It starts once from the voltage alone and once from a checkpoint 30% off,
+// and reports the error against the true state of charge, after the first hour, after two hours of rest and at the end,
+// how often the truth lies within the estimator's 2 sigma, which should be about 95%, and the time per update against
+// the 100µs budget.
+//
+// `runtime` feeds `runtime_predictor_t` load steps and steady loads at uneven intervals and checks its estimate and
+// band against the closed form of its averages: the horizons following a step, their shares while they warm up,
+// Peukert's law above and below the rated current and while charging, and the band a known charge sigma gives.
+//
+// `health` checks the rainflow counter (components/system/rainflow.hpp) against sequences with known counts, then runs
+// `battery_health_t` once a second through months of daily cycles of random depth on a bank whose capacity fades and
+// whose resistance grows, rebooting it from its checkpoint every month. It reports the cycles and wear counted against
+// the ones in the trace, the capacity measured against the true one, the resistance growth against the true growth,
+// and the time per update.
+// All return nonzero if an estimate strays too far or an update is too slow.
+
+#include "soc_estimator.hpp"
+#include "battery_health.hpp"
+#include "rainflow.hpp"
+#include "runtime_predictor.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+
+// Keep in step with the battery section of components/config/config.hpp and the estimator's setup in system.cpp
+using profile_t = config::battery::agm_12v_40ah_t;
+static constexpr auto OCV_CURVE = config::make_ocv_curve<profile_t>();
+
+static constexpr sys::soc_estimator_t::config_t SOC_CONFIG = {
+    .capacity_ah = profile_t::CAPACITY_AH,
+    .charge_efficiency = profile_t::CHARGE_EFFICIENCY,
+    .ocv_curve = &OCV_CURVE,
+    .resistance_ohm = profile_t::INTERNAL_RESISTANCE,
+    .min_resistance_ohm = 0.002f,
+    .max_resistance_ohm = 0.5f,
+    .resistance_step_a = 2.0f,
+    .resistance_gain = 0.1f,
+    .settle_time_us = 60 * 1'000'000LL,
+    .voltage_noise_v = 0.02f,
+    .load_noise_v_per_a = 0.03f,
+    .polarisation_time_us = 150 * 1'000'000LL,
+    .count_noise = 0.02f,
+    .drift_per_hour = 0.005f,
+    .checkpoint_interval_us = 5 * 60 * 1'000'000LL,
+    .checkpoint_min_change_ah = 0.1f
+};
+
+static constexpr int64_t STEP_US = 20'000;              // CALC_TASK_PERIOD_MS
+static constexpr double UPDATE_BUDGET_US = 100.0;
+// Heavy load polarises the bank past what the estimator models, which may pull it off by a couple of percent until the
+// next rest. At rest it should be back on the count
+static constexpr float MAX_SETTLED_ERROR = 0.04f;       // After the first hour
+static constexpr float MAX_REST_ERROR = 0.03f;          // After two hours of rest
+static constexpr float MAX_FINAL_ERROR = 0.03f;         // At the end of the closing rest
+static constexpr double REST_TIME_S = 7200.0;
+static constexpr double CLOSING_REST_S = REST_TIME_S + 1800.0;
+static constexpr float STANDBY_A = 0.2f;                // Of the closing rest
+static constexpr float CONVERGED_ERROR = 0.02f;
+// The truth should lie within 2 sigma about 95% of the time. Less means the filter trusts itself more than it should,
+// and everything built on its sigma, like the runtime band, is too narrow
+static constexpr float MIN_WITHIN_2_SIGMA = 0.9f;
+
+/**
+* @brief The simulated bank: OCV curve, series resistance and one RC pair for the polarisation
+*/
+struct battery_model_t {
+    float soc;
+    float capacity_ah = profile_t::CAPACITY_AH;
+    float resistance_ohm = profile_t::INTERNAL_RESISTANCE * 1.3f;  // Aged a little past the profile's starting point
+    float polarisation_ohm = 0.012f;
+    float polarisation_tau_s = 180.0f;
+    float polarisation_v = 0.0f;
+
+    // Positive current discharges
+    float step(float current_a, double dt_s, float temperature_c = 25.0f) {
+        const double ah = current_a * dt_s / 3600.0;
+        soc -= static_cast<float>((ah >= 0.0) ? ah : ah * profile_t::CHARGE_EFFICIENCY) / capacity_ah;
+        soc = std::clamp(soc, 0.0f, 1.0f);
+        const float alpha = 1.0f - expf(-static_cast<float>(dt_s) / polarisation_tau_s);
+        polarisation_v += alpha * (current_a * polarisation_ohm - polarisation_v);
+        float slope = 0.0f;
+        const float shift = OCV_CURVE.temp_coeff_v_per_c * (temperature_c - 25.0f);
+        return OCV_CURVE.ocv_at(soc, slope) + shift - current_a * resistance_ohm - polarisation_v;
+    }
+};
+
+/**
+* @brief A day off grid: a few hundred mA of standby, inverter loads switching every few minutes through the evening,
+* solar charging around midday and rests in between
+*/
+static float load_at(double t_s, std::mt19937& rng, float& load, double& next_change_s) {
+    if (t_s >= next_change_s) {
+        const double hour = fmod(t_s / 3600.0, 24.0);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        if ((hour >= 10.0) && (hour < 15.0)) {
+            load = -4.0f - unit(rng) * 4.0f;                            // Charging
+        } else if ((hour >= 18.0) && (hour < 23.0)) {
+            load = (unit(rng) < 0.3f) ? 0.4f : (2.0f + unit(rng) * 10.0f); // Inverter on and off
+        } else if ((hour >= 6.0) && (hour < 10.0)) {
+            load = (unit(rng) < 0.5f) ? 0.2f : (1.0f + unit(rng) * 4.0f);
+        } else {
+            load = 0.2f;                                                // Standby through the night
+        }
+        next_change_s = t_s + 60.0 + unit(rng) * 600.0;
+    }
+    return load;
+}
+
+struct timing_t {
+    double mean_us;
+    double p99_us;
+    double max_us;
+};
+
+static timing_t summarize(std::vector<float>& update_us) {
+    timing_t timing{};
+    if (update_us.empty()) return timing;
+    double total_us = 0.0;
+    for (const float us : update_us) total_us += us;
+    std::sort(update_us.begin(), update_us.end());
+    timing.mean_us = total_us / update_us.size();
+    timing.p99_us = update_us[update_us.size() * 99 / 100];
+    timing.max_us = update_us.back();
+    return timing;
+}
+
+static void print_timing(const timing_t& timing) {
+    printf("  Time per update:  %.3fus mean, %.3fus p99, %.3fus max (budget %.0fus)\n", timing.mean_us, timing.p99_us,
+           timing.max_us, UPDATE_BUDGET_US);
+}
+
+struct soc_run_t {
+    double converged_s;         // First time the error came within CONVERGED_ERROR, negative if it never did
+    float settled_max_error;
+    float rest_max_error;       // Negative if the battery never rested for REST_TIME_S
+    float final_error;
+    float within_2_sigma;       // Share of the settled updates with the truth inside 2 sigma
+    float final_resistance;
+    timing_t timing;
+    size_t updates;
+};
+
+static soc_run_t run_soc(double hours, float start_soc, const float* checkpoint_soc) {
+
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    static constexpr float CURRENT_OFFSET_A = 0.05f;    // Residual offset of the current sensor
+
+    battery_model_t battery{ .soc = start_soc };
+    sys::soc_estimator_t estimator(SOC_CONFIG);
+    if (checkpoint_soc) {
+        sys::soc_estimator_t::state_t state = estimator.get_state();
+        state.soc = *checkpoint_soc;
+        state.variance = 0.1f * 0.1f;
+        (void)estimator.restore(state);
+    }
+
+    // Start in the morning, so the first hour is a mix of loads and rest. However long the run, it closes with a rest
+    // on standby, so every run is checked where the voltage can be trusted again
+    const double start_s = 6.0 * 3600.0;
+    const double rest_from_s = start_s + hours * 3600.0;
+    const size_t steps = static_cast<size_t>((hours * 3600.0 + CLOSING_REST_S) * 1e6 / STEP_US);
+    const double dt_s = STEP_US / 1e6;
+
+    double ah_in = 0.0;
+    double ah_out = 0.0;
+    float load = 0.0f;
+    double next_change_s = 0.0;
+
+    std::vector<float> update_us;
+    update_us.reserve(steps);
+    soc_run_t run{};
+    run.converged_s = -1.0;
+    run.rest_max_error = -1.0f;
+    double rest_since_s = start_s;
+    size_t settled = 0;
+    size_t inside = 0;
+
+    for (size_t n = 0; n < steps; n++) {
+        const double t_s = start_s + n * dt_s;
+        const float current = (t_s < rest_from_s) ? load_at(t_s, rng, load, next_change_s) : STANDBY_A;
+        if (fabsf(current) > 0.3f) rest_since_s = t_s;
+        const float voltage = battery.step(current, dt_s);
+
+        // What the driver reports: averaged over the 20ms, so little noise, and a counted charge with the offset in it
+        const float measured_i = current + CURRENT_OFFSET_A + noise(rng) * 0.02f;
+        const float measured_v = voltage + noise(rng) * 0.005f;
+        const double counted_ah = measured_i * dt_s / 3600.0;
+        if (counted_ah >= 0.0) {
+            ah_out += counted_ah;
+        } else {
+            ah_in -= counted_ah;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        estimator.update(ah_in, ah_out, measured_i, measured_v, 25.0f, static_cast<int64_t>(n) * STEP_US);
+        const auto end = std::chrono::steady_clock::now();
+        update_us.push_back(std::chrono::duration<float, std::micro>(end - start).count());
+
+        const float error = fabsf(estimator.get_soc() / 100.0f - battery.soc);
+        if (!std::isfinite(error)) {
+            run.settled_max_error = INFINITY;
+            break;
+        }
+        if ((run.converged_s < 0.0) && (error <= CONVERGED_ERROR)) run.converged_s = t_s - start_s;
+        if (t_s - start_s >= 3600.0) {
+            run.settled_max_error = std::max(run.settled_max_error, error);
+            settled++;
+            if (error <= 2.0f * estimator.get_soc_sigma() / 100.0f) inside++;
+        }
+        if ((t_s - start_s >= 3600.0) && (t_s - rest_since_s >= REST_TIME_S)) run.rest_max_error = std::max(run.rest_max_error, error);
+        run.final_error = error;
+    }
+
+    run.updates = update_us.size();
+    run.within_2_sigma = settled ? static_cast<float>(inside) / settled : 0.0f;
+    run.final_resistance = estimator.get_resistance();
+    run.timing = summarize(update_us);
+    return run;
+}
+
+static bool print_soc_run(const char* name, const soc_run_t& run, float true_resistance) {
+
+    // A run without a rest can't show the estimate finds its way back, so it fails too
+    const bool rested = run.rest_max_error >= 0.0f;
+    const bool accurate = (run.converged_s >= 0.0) && (run.settled_max_error <= MAX_SETTLED_ERROR) && rested &&
+                          (run.rest_max_error <= MAX_REST_ERROR) && (run.final_error <= MAX_FINAL_ERROR);
+    const bool calibrated = run.within_2_sigma >= MIN_WITHIN_2_SIGMA;
+    const bool fast = run.timing.p99_us <= UPDATE_BUDGET_US;
+
+    printf("%s\n", name);
+    printf("  Updates:          %zu at %lldms, the last %.1f hours at rest\n", run.updates, static_cast<long long>(STEP_US / 1000),
+           CLOSING_REST_S / 3600.0);
+    if (run.converged_s >= 0.0) {
+        printf("  Converged:        within %.0f%% after %.1f minutes\n", CONVERGED_ERROR * 100.0f, run.converged_s / 60.0);
+    } else {
+        printf("  Converged:        never within %.0f%%\n", CONVERGED_ERROR * 100.0f);
+    }
+    printf("  Error:            %.2f%% max after the first hour (limit %.0f%%), %.2f%% at the end (limit %.0f%%)\n",
+           run.settled_max_error * 100.0f, MAX_SETTLED_ERROR * 100.0f, run.final_error * 100.0f, MAX_FINAL_ERROR * 100.0f);
+    if (run.rest_max_error >= 0.0f) {
+        printf("  At rest:          %.2f%% max after %.0f hours of rest (limit %.0f%%)\n", run.rest_max_error * 100.0f,
+               REST_TIME_S / 3600.0, MAX_REST_ERROR * 100.0f);
+    } else {
+        printf("  At rest:          never rested for %.0f hours\n", REST_TIME_S / 3600.0);
+    }
+    printf("  Within 2 sigma:   %.1f%% of the updates after the first hour (least %.0f%%)\n", run.within_2_sigma * 100.0f,
+           MIN_WITHIN_2_SIGMA * 100.0f);
+    printf("  Resistance:       %.1fmOhm measured, %.1fmOhm true\n", run.final_resistance * 1000.0f, true_resistance * 1000.0f);
+    print_timing(run.timing);
+    const char* verdict = "OK";
+    if (!rested) {
+        verdict = "FAILED, never rested";
+    } else if (!accurate) {
+        verdict = "FAILED, estimate too far off";
+    } else if (!calibrated) {
+        verdict = "FAILED, sigma too small";
+    } else if (!fast) {
+        verdict = "FAILED, too slow";
+    }
+    printf("  %s\n", verdict);
+    return accurate && calibrated && fast;
+}
+
+static int soc(double hours) {
+
+    const float true_resistance = battery_model_t{}.resistance_ohm;
+    const float wrong_checkpoint = 0.5f;
+
+    printf("%s, %.0fAh, %.1f hours and %.1f hours of rest\n", profile_t::NAME, profile_t::CAPACITY_AH, hours, CLOSING_REST_S / 3600.0);
+    bool ok = print_soc_run("From the voltage alone, true start 80%", run_soc(hours, 0.8f, nullptr), true_resistance);
+    ok &= print_soc_run("From a checkpoint at 50%, true start 80%", run_soc(hours, 0.8f, &wrong_checkpoint), true_resistance);
+    return ok ? 0 : 1;
+}
+
+// Keep in step with the predictor's setup in system.cpp and the runtime section of components/config/config.hpp
+using runtime_predictor_t = sys::runtime_predictor_t<3>;
+static constexpr runtime_predictor_t::config_t RUNTIME_CONFIG = {
+    .time_constants_s = { 60.0f, 900.0f, 3600.0f },
+    .weights = { 0.2f, 0.3f, 0.5f },
+    .min_current_a = 0.05f,
+    .rated_current_a = profile_t::CAPACITY_AH / profile_t::RATED_HOURS,
+    .peukert_exponent = profile_t::PEUKERT_EXPONENT,
+    .max_runtime_s = 7 * 86'400
+};
+
+static constexpr float RUNTIME_CHARGE_AH = 20.0f;
+static constexpr float RUNTIME_SIGMA_AH = 2.0f;
+
+/**
+* @brief What the predictor should make of a charge and a load: Peukert's law above the rated current, the rated
+* capacity below it and none of it while charging
+*/
+static double expected_runtime_s(double charge_ah, double load_a, bool charging) {
+    if (load_a < RUNTIME_CONFIG.min_current_a) return static_cast<double>(RUNTIME_CONFIG.max_runtime_s);
+    const double usable = charging ? 1.0 : std::min(pow(RUNTIME_CONFIG.rated_current_a / load_a, RUNTIME_CONFIG.peukert_exponent - 1.0), 1.0);
+    return std::min(charge_ah * usable / load_a * 3600.0, static_cast<double>(RUNTIME_CONFIG.max_runtime_s));
+}
+
+// Within 0.1% and the truncation to whole seconds
+static bool runtime_matches(uint64_t runtime_s, double expected_s) {
+    return fabs(static_cast<double>(runtime_s) - expected_s) <= (0.001 * expected_s + 1.0);
+}
+
+static bool print_runtime_check(const char* name, const runtime_predictor_t::prediction_t& p, double estimate_s, double low_s, double high_s) {
+    const bool ok = runtime_matches(p.estimate_s, estimate_s) && runtime_matches(p.low_s, low_s) && runtime_matches(p.high_s, high_s);
+    printf("  %-20s%llus in %llus - %llus (expected %.0fs in %.0fs - %.0fs)%s\n", name, static_cast<unsigned long long>(p.estimate_s),
+           static_cast<unsigned long long>(p.low_s), static_cast<unsigned long long>(p.high_s), estimate_s, low_s, high_s,
+           ok ? "" : ", FAILED");
+    return ok;
+}
+
+/**
+* @brief Feed a constant current for a while, at intervals as uneven as the calculation task's under load
+*/
+static void feed(runtime_predictor_t& predictor, float current_a, double seconds, int64_t& now_us) {
+    static constexpr int64_t INTERVALS_US[] = { 20'000, 500'000, 1'480'000 };
+    const int64_t end_us = now_us + static_cast<int64_t>(seconds * 1e6);
+    for (size_t k = 0; now_us < end_us; k++) {
+        now_us = std::min(now_us + INTERVALS_US[k % std::size(INTERVALS_US)], end_us);
+        predictor.update(current_a, now_us);
+    }
+}
+
+/**
+* @brief Known answers: the averages of a load step against their closed form, the horizons' shares while they warm up,
+* Peukert's law on either side of the rated current and the band for a known charge sigma
+*/
+static int runtime() {
+
+    bool ok = true;
+    const double rated = RUNTIME_CONFIG.rated_current_a;
+    printf("Runtime predictor, %s, rated at %.1fA, Peukert exponent %.2f\n", profile_t::NAME, rated, RUNTIME_CONFIG.peukert_exponent);
+
+    // Each horizon follows a step from `before` to `after` as after - (after - before) * e^(-t / tau). The blend weighs
+    // them by their share times how far they've warmed up; the band takes the heaviest and lightest of them
+    const auto step_answer = [](float before, float after, double before_s, double after_s, double& blended, double& heaviest, double& lightest) {
+        double total_weight = 0.0;
+        blended = 0.0;
+        heaviest = -INFINITY;
+        lightest = INFINITY;
+        for (size_t h = 0; h < RUNTIME_CONFIG.time_constants_s.size(); h++) {
+            const double tau = RUNTIME_CONFIG.time_constants_s[h];
+            const double average = after - (after - before) * exp(-after_s / tau);
+            const double weight = RUNTIME_CONFIG.weights[h] * std::min((before_s + after_s) / tau, 1.0);
+            blended += weight * average;
+            total_weight += weight;
+            heaviest = std::max(heaviest, average);
+            lightest = std::min(lightest, average);
+        }
+        blended /= total_weight;
+    };
+
+    // Warmed up: four hours at 2A, then ten minutes at 8A
+    {
+        runtime_predictor_t predictor(RUNTIME_CONFIG);
+        int64_t now_us = 0;
+        predictor.update(2.0f, now_us);
+        feed(predictor, 2.0f, 4 * 3600.0, now_us);
+        feed(predictor, 8.0f, 600.0, now_us);
+        double blended, heaviest, lightest;
+        step_answer(2.0f, 8.0f, 4 * 3600.0, 600.0, blended, heaviest, lightest);
+        ok &= print_runtime_check("Load step:", predictor.predict(RUNTIME_CHARGE_AH, RUNTIME_SIGMA_AH, false),
+                                  expected_runtime_s(RUNTIME_CHARGE_AH, blended, false),
+                                  expected_runtime_s(RUNTIME_CHARGE_AH - RUNTIME_SIGMA_AH, heaviest, false),
+                                  expected_runtime_s(RUNTIME_CHARGE_AH + RUNTIME_SIGMA_AH, lightest, false));
+    }
+
+    // Warming up: 30s at 2A then 30s at 8A, where the hour long horizon has less than 2% of its share
+    {
+        runtime_predictor_t predictor(RUNTIME_CONFIG);
+        int64_t now_us = 0;
+        predictor.update(2.0f, now_us);
+        feed(predictor, 2.0f, 30.0, now_us);
+        feed(predictor, 8.0f, 30.0, now_us);
+        double blended, heaviest, lightest;
+        step_answer(2.0f, 8.0f, 30.0, 30.0, blended, heaviest, lightest);
+        ok &= print_runtime_check("Warming up:", predictor.predict(RUNTIME_CHARGE_AH, RUNTIME_SIGMA_AH, false),
+                                  expected_runtime_s(RUNTIME_CHARGE_AH, blended, false),
+                                  expected_runtime_s(RUNTIME_CHARGE_AH - RUNTIME_SIGMA_AH, heaviest, false),
+                                  expected_runtime_s(RUNTIME_CHARGE_AH + RUNTIME_SIGMA_AH, lightest, false));
+    }
+
+    // Peukert: a steady load five times the rated one gets less than the charge out, one at half of it no more than
+    // the charge, and charging none of the law at all. With a steady load the band is only the charge sigma wide
+    static constexpr struct {
+        const char* name;
+        float load_a;
+        bool charging;
+    } STEADY[] = {
+        { "5x rated:", 5.0f, false },
+        { "Half rated:", 0.5f, false },
+        { "Charging 5x:", 5.0f, true },
+        { "No load:", 0.01f, false },
+    };
+    for (const auto& steady : STEADY) {
+        const float load_a = static_cast<float>(rated) * steady.load_a;
+        runtime_predictor_t predictor(RUNTIME_CONFIG);
+        int64_t now_us = 0;
+        predictor.update(steady.charging ? -load_a : load_a, now_us);
+        feed(predictor, steady.charging ? -load_a : load_a, 2 * 3600.0, now_us);
+        ok &= print_runtime_check(steady.name, predictor.predict(RUNTIME_CHARGE_AH, RUNTIME_SIGMA_AH, steady.charging),
+                                  expected_runtime_s(RUNTIME_CHARGE_AH, load_a, steady.charging),
+                                  expected_runtime_s(RUNTIME_CHARGE_AH - RUNTIME_SIGMA_AH, load_a, steady.charging),
+                                  expected_runtime_s(RUNTIME_CHARGE_AH + RUNTIME_SIGMA_AH, load_a, steady.charging));
+    }
+
+    // A sigma larger than the charge can't take the low end below empty, and no sigma closes the band
+    {
+        runtime_predictor_t predictor(RUNTIME_CONFIG);
+        int64_t now_us = 0;
+        predictor.update(4.0f, now_us);
+        feed(predictor, 4.0f, 2 * 3600.0, now_us);
+        ok &= print_runtime_check("Sigma over charge:", predictor.predict(1.0f, 3.0f, false), expected_runtime_s(1.0, 4.0, false),
+                                  0.0, expected_runtime_s(4.0, 4.0, false));
+        const double estimate_s = expected_runtime_s(RUNTIME_CHARGE_AH, 4.0, false);
+        ok &= print_runtime_check("No sigma:", predictor.predict(RUNTIME_CHARGE_AH, 0.0f, false), estimate_s, estimate_s, estimate_s);
+    }
+
+    printf("  %s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+// Keep in step with the tracker's setup in system.cpp
+static constexpr sys::battery_health_t::config_t HEALTH_CONFIG = {
+    .capacity_ah = profile_t::CAPACITY_AH,
+    .charge_efficiency = profile_t::CHARGE_EFFICIENCY,
+    .ocv_curve = &OCV_CURVE,
+    .resistance_ohm = profile_t::INTERNAL_RESISTANCE,
+    .rainflow = {
+        .hysteresis = 0.03f,
+        .cycle_life = profile_t::CYCLE_LIFE,
+        .cycle_life_exponent = profile_t::CYCLE_LIFE_EXPONENT
+    },
+    .rest_current_a = 0.3f,
+    .rest_time_us = 30 * 60 * 1'000'000LL,
+    .min_soc_span = 0.3f,
+    .max_anchor_age_us = 3 * 86'400 * 1'000'000LL,
+    .capacity_gain = 0.2f,
+    .resistance_time_constant_s = 30 * 86'400.0f,
+    .baseline_time_us = 7 * 86'400 * 1'000'000LL,
+    .checkpoint_interval_us = 3'600'000'000LL
+};
+
+using rainflow_t = sys::battery_health_t::rainflow_t;
+
+static constexpr int64_t HEALTH_STEP_US = 1'000'000;
+static constexpr double DAY_S = 86'400.0;
+static constexpr float CAPACITY_FADE = 0.1f;            // Over the whole trace
+static constexpr float RESISTANCE_GROWTH = 0.3f;
+static constexpr float MAX_CAPACITY_ERROR = 0.03f;
+static constexpr double MAX_CYCLE_ERROR = 0.02;
+
+static double expected_damage(float depth, double cycles) {
+    return cycles / (profile_t::CYCLE_LIFE * pow(depth, -profile_t::CYCLE_LIFE_EXPONENT));
+}
+
+// Samples from `from` to `to` in steps of 0.01, with a wobble below the hysteresis on the way, so the ends stay exact
+static void ramp(rainflow_t& counter, float from, float to, uint32_t& n) {
+    const int steps = static_cast<int>(fabsf(to - from) * 100.0f + 0.5f);
+    for (int i = 1; i <= steps; i++) {
+        const float wobble = ((i < steps) && ((n++ % 3) == 0)) ? -0.01f : 0.0f;
+        counter.update(from + (to - from) * static_cast<float>(i) / steps + wobble);
+    }
+}
+
+/**
+* @brief Known answers: nested cycles inside deep ones, and a signal that never closes a cycle overflowing the residue
+*/
+static bool check_rainflow() {
+
+    bool ok = true;
+    uint32_t n = 0;
+
+    // 0.10 -> 0.65 -> 0.40 -> 0.95 -> 0.10 ... Each round closes the 0.25 cycle inside, and every turn at either end
+    // after the first top closes a 0.85 half cycle with the one before
+    static constexpr uint32_t ROUNDS = 50;
+    rainflow_t nested(HEALTH_CONFIG.rainflow);
+    nested.update(0.10f);
+    for (uint32_t r = 0; r < ROUNDS; r++) {
+        ramp(nested, 0.10f, 0.65f, n);
+        ramp(nested, 0.65f, 0.40f, n);
+        ramp(nested, 0.40f, 0.95f, n);
+        ramp(nested, 0.95f, 0.10f, n);
+    }
+    const auto& counts = nested.get_state();
+    const double halves = 2.0 * ROUNDS - 2.0;
+    const double cycles = ROUNDS * 0.25 + halves * 0.5 * 0.85;
+    const double damage = expected_damage(0.25f, ROUNDS) + expected_damage(0.85f, halves * 0.5);
+    const bool nested_ok = (counts.half_cycles[2] == 2 * ROUNDS) && (counts.half_cycles[8] == halves) &&
+                           (fabs(nested.get_equivalent_cycles() - cycles) <= 0.01 * cycles) &&
+                           (fabs(nested.get_damage() - damage) <= 0.02 * damage);
+    printf("  Nested cycles:    %u and %u half cycles at 25%% and 85%% (expected %u and %.0f), %.2f cycles (expected %.2f), "
+           "wear %.3f%% (expected %.3f%%)\n", counts.half_cycles[2], counts.half_cycles[8], 2 * ROUNDS, halves,
+           nested.get_equivalent_cycles(), cycles, nested.get_damage() * 100.0, damage * 100.0);
+    ok &= nested_ok;
+
+    // Each swing a little shallower than the one before, so no cycle closes and the residue fills up. Past the residue's
+    // size its oldest half cycle is counted to make room
+    static constexpr uint32_t TURNS = 40;
+    rainflow_t shrinking(HEALTH_CONFIG.rainflow);
+    float last = 0.05f;
+    shrinking.update(last);
+    for (uint32_t k = 1; k <= TURNS; k++) {
+        const float amplitude = 0.45f - 0.005f * static_cast<float>(k);
+        const float next = 0.5f + (((k & 1) != 0) ? amplitude : -amplitude);
+        ramp(shrinking, last, next, n);
+        last = next;
+    }
+    const auto& residue = shrinking.get_state();
+    uint32_t counted = 0;
+    for (const uint32_t h : residue.half_cycles) counted += h;
+    // The last turn is still a candidate, so TURNS points have been pushed
+    const uint32_t expected_overflow = TURNS - static_cast<uint32_t>(residue.residue.size());
+    const bool shrinking_ok = (residue.residue_count == residue.residue.size()) && (counted == expected_overflow);
+    printf("  Residue overflow: %u of %zu turning points held, %u half cycles counted (expected %u)\n",
+           residue.residue_count, residue.residue.size(), counted, expected_overflow);
+    ok &= shrinking_ok;
+
+    return ok;
+}
+
+/**
+* @brief Months of days: the inverter through the evening down to a random depth, standby overnight, solar charging
+* to a random level (full on sunny days) and standby again
+*/
+struct day_plan_t {
+    float bottom;
+    float top;
+};
+
+struct health_run_t {
+    double expected_cycles;
+    double counted_cycles;
+    double wear;
+    double wear_bound;          // The wear if every cycle were a full one, `cycles / CYCLE_LIFE`
+    float true_capacity_ah;
+    float capacity_ah;
+    uint32_t capacity_samples;
+    float true_growth;
+    float lagged_growth;        // True growth a few averaging time constants ago
+    float growth;
+    uint32_t reboots;
+    timing_t timing;
+    size_t updates;
+};
+
+static health_run_t run_health(double months) {
+
+    std::mt19937 rng(11);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    const uint32_t days = static_cast<uint32_t>(months * 30.0);
+    const float start_capacity = profile_t::CAPACITY_AH;
+    const float start_resistance = profile_t::INTERNAL_RESISTANCE;
+
+    battery_model_t battery{ .soc = 0.95f };
+    auto tracker = std::make_unique<sys::battery_health_t>(HEALTH_CONFIG);
+
+    health_run_t run{};
+    std::vector<float> update_us;
+    update_us.reserve(static_cast<size_t>(days * DAY_S));
+
+    // The trace's turning points, for the cycles the counter should find: the top when a discharge starts after
+    // charging, and the bottom when charging starts after a discharge
+    std::vector<float> turns = { battery.soc };
+    int phase = 0;
+    float running_max = battery.soc;
+    float running_min = battery.soc;
+    double ah_in = 0.0;
+    double ah_out = 0.0;
+    int64_t now_us = 0;
+
+    for (uint32_t day = 0; day < days; day++) {
+
+        // A new month: reboot from the checkpoint, with the driver's charge integrals starting over
+        if ((day > 0) && ((day % 30) == 0)) {
+            const auto state = tracker->get_state();
+            tracker = std::make_unique<sys::battery_health_t>(HEALTH_CONFIG);
+            (void)tracker->restore(state);
+            ah_in = ah_out = 0.0;
+            run.reboots++;
+        }
+
+        const float age = static_cast<float>(day) / days;
+        battery.capacity_ah = start_capacity * (1.0f - CAPACITY_FADE * age);
+        battery.resistance_ohm = start_resistance * (1.0f + RESISTANCE_GROWTH * age);
+
+        const day_plan_t plan = {
+            .bottom = 0.25f + unit(rng) * 0.35f,
+            .top = (unit(rng) < 0.6f) ? 1.0f : (0.75f + unit(rng) * 0.2f)
+        };
+        float load = 0.0f;
+        double next_change_s = 0.0;
+
+        for (uint32_t second = 0; second < DAY_S; second++) {
+            const double hour = second / 3600.0;
+            float current = 0.1f;                                      // Standby, rest for the tracker
+            if ((hour >= 18.0) && (battery.soc > plan.bottom)) {
+                if (second >= next_change_s) {
+                    load = 2.0f + unit(rng) * 8.0f;
+                    next_change_s = second + 60.0 + unit(rng) * 600.0;
+                }
+                current = load;
+            } else if ((hour >= 9.0) && (hour < 17.0) && (battery.soc < plan.top)) {
+                current = -6.0f;
+            }
+
+            const float temperature = 25.0f + 5.0f * sinf(static_cast<float>((hour - 9.0) / 24.0 * 2.0 * M_PI));
+            const float voltage = battery.step(current, 1.0, temperature);
+            const double counted_ah = current / 3600.0;
+            if (counted_ah >= 0.0) {
+                ah_out += counted_ah;
+            } else {
+                ah_in -= counted_ah;
+            }
+
+            if ((current < 0.0f) && (phase != 1)) {
+                if (phase == -1) turns.push_back(running_min);
+                phase = 1;
+                running_max = battery.soc;
+            } else if ((current > 1.0f) && (phase != -1)) {
+                if (phase == 1) turns.push_back(running_max);
+                phase = -1;
+                running_min = battery.soc;
+            }
+            running_max = std::max(running_max, battery.soc);
+            running_min = std::min(running_min, battery.soc);
+
+            // The estimator's state of charge, with a slow wobble below the hysteresis, and its resistance measurements
+            const float soc = battery.soc + 0.003f * sinf(static_cast<float>(now_us % 5'400'000'000LL) / 5.4e9f * 2.0f * static_cast<float>(M_PI));
+            const float resistance = battery.resistance_ohm * (1.0f + noise(rng) * 0.05f);
+
+            const auto start = std::chrono::steady_clock::now();
+            tracker->update(soc, ah_in, ah_out, current + noise(rng) * 0.01f, voltage + noise(rng) * 0.002f, temperature,
+                            resistance, now_us);
+            const auto end = std::chrono::steady_clock::now();
+            update_us.push_back(std::chrono::duration<float, std::micro>(end - start).count());
+            now_us += HEALTH_STEP_US;
+        }
+    }
+
+    // Every range between turning points ends up in a closed cycle, half cycle or the residue, so the closed ones
+    // add up to half of the path through the turning points less the path through the residue
+    const auto& cycles = tracker->get_state().cycles;
+    double path = 0.0;
+    for (size_t t = 1; t < turns.size(); t++) path += fabsf(turns[t] - turns[t - 1]);
+    for (size_t t = 1; t < cycles.residue_count; t++) path -= fabsf(cycles.residue[t] - cycles.residue[t - 1]);
+    run.expected_cycles = 0.5 * path;
+
+    run.updates = update_us.size();
+    run.timing = summarize(update_us);
+    run.counted_cycles = tracker->get_equivalent_cycles();
+    run.wear = tracker->get_wear() / 100.0;
+    run.wear_bound = run.counted_cycles / profile_t::CYCLE_LIFE;
+    run.true_capacity_ah = battery.capacity_ah;
+    run.capacity_ah = tracker->get_capacity_ah();
+    run.capacity_samples = tracker->get_state().capacity_samples;
+    run.true_growth = battery.resistance_ohm / start_resistance;
+    run.growth = tracker->get_resistance_growth();
+    const float lag_age = std::max(1.0f - 2.0f * HEALTH_CONFIG.resistance_time_constant_s / static_cast<float>(days * DAY_S), 0.0f);
+    run.lagged_growth = 1.0f + RESISTANCE_GROWTH * lag_age;
+    return run;
+}
+
+static int health(double months) {
+
+    printf("%s, %.0fAh, %.1f months\n", profile_t::NAME, profile_t::CAPACITY_AH, months);
+
+    printf("Rainflow counter\n");
+    const bool rainflow_ok = check_rainflow();
+    printf("  %s\n", rainflow_ok ? "OK" : "FAILED");
+
+    const health_run_t run = run_health(months);
+    const double cycle_error = fabs(run.counted_cycles - run.expected_cycles) / std::max(run.expected_cycles, 1.0);
+    const float capacity_error = fabsf(run.capacity_ah - run.true_capacity_ah) / run.true_capacity_ah;
+    const bool cycles_ok = (cycle_error <= MAX_CYCLE_ERROR) && (run.wear > 0.0) && (run.wear <= run.wear_bound);
+    const bool capacity_ok = (run.capacity_samples > 0) && (capacity_error <= MAX_CAPACITY_ERROR);
+    const bool growth_ok = (run.growth >= run.lagged_growth * 0.97f) && (run.growth <= run.true_growth * 1.03f);
+    const bool fast = run.timing.p99_us <= UPDATE_BUDGET_US;
+
+    printf("Daily cycles, %.0f%% capacity fade and %.0f%% resistance growth, a reboot every month\n",
+           CAPACITY_FADE * 100.0f, RESISTANCE_GROWTH * 100.0f);
+    printf("  Updates:          %zu at %llds, %u reboots\n", run.updates, static_cast<long long>(HEALTH_STEP_US / 1'000'000), run.reboots);
+    printf("  Cycles:           %.2f counted, %.2f in the trace (%.2f%% off, limit %.0f%%)\n", run.counted_cycles,
+           run.expected_cycles, cycle_error * 100.0, MAX_CYCLE_ERROR * 100.0);
+    printf("  Wear:             %.3f%%, %.3f%% if every cycle were a full one\n", run.wear * 100.0, run.wear_bound * 100.0);
+    printf("  Capacity:         %.2fAh measured %u times, %.2fAh true (%.2f%% off, limit %.0f%%)\n", run.capacity_ah,
+           run.capacity_samples, run.true_capacity_ah, capacity_error * 100.0f, MAX_CAPACITY_ERROR * 100.0f);
+    printf("  Resistance:       %.3fx growth, %.3fx true, %.3fx true two time constants ago\n", run.growth, run.true_growth,
+           run.lagged_growth);
+    print_timing(run.timing);
+    const bool ok = cycles_ok && capacity_ok && growth_ok && fast;
+    printf("  %s\n", ok ? "OK" : (fast ? "FAILED, estimate too far off" : "FAILED, too slow"));
+    return (rainflow_ok && ok) ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+
+    if ((argc >= 2) && (strcmp(argv[1], "soc") == 0)) return soc((argc >= 3) ? atof(argv[2]) : 24.0);
+    if ((argc >= 2) && (strcmp(argv[1], "runtime") == 0)) return runtime();
+    if ((argc >= 2) && (strcmp(argv[1], "health") == 0)) return health((argc >= 3) ? atof(argv[2]) : 6.0);
+
+    fprintf(stderr, "Usage: %s soc [hours] | runtime | health [months]\n", argv[0]);
+    return 2;
+}
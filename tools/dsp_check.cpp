@@ -0,0 +1,264 @@
+// Host checks and benchmark of the ADC filter stages (components/power/dsp_filter.hpp) and of the ripple analyser
+// (components/power/goertzel.hpp).
+//
+// Build:   g++ -std=c++20 -O2 -Icomponents/power tools/dsp_check.cpp -o dsp_check
+// Test:    ./dsp_check test
+// Bench:   ./dsp_check bench [samples]
+//
+// `test` runs every stage over a fixed input and compares the output sample by sample with outputs precomputed by an
+// independent model of the same integer arithmetic, then checks the unity DC gain and `reset()`. It returns nonzero on
+// any mismatch. The ripple analyser is fed DC plus 100 or 120Hz ripple and its harmonics, with noise, and every bin and the
+// AC RMS must come out within 2% of the amplitudes put in. `bench` reports the time per input sample of the stages,
+// of the board's default chains and of the analyser.
+
+#include "dsp_filter.hpp"
+#include "goertzel.hpp"
+#include "frame_processor.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+using namespace adc;
+
+// Steps, a full scale spike and small wiggles around mid scale
+static constexpr std::array<int32_t, 32> INPUT = {
+    2048, 2048, 2100, 2200, 1900, 1800, 2048, 4095, 0, 1000, 3000, 2048, 2048, 2050, 2046, 2049,
+    2600, 2600, 2600, 2600, 1500, 1500, 1500, 1500, 2048, 2047, 2049, 2048, 4095, 4095, 0, 0
+};
+
+static const std::vector<int32_t> MA4_EXPECTED = {
+    2048, 2048, 2061, 2099, 2062, 2000, 1987, 2460, 1985, 1785, 2023, 1512, 2024, 2286, 2048, 2048,
+    2186, 2323, 2462, 2600, 2325, 2050, 1775, 1500, 1637, 1773, 1911, 2048, 2559, 3071, 2559, 2047
+};
+
+static const std::vector<int32_t> IIR3_EXPECTED = {
+    2048, 2048, 2054, 2072, 2051, 2019, 2023, 2282, 1996, 1872, 2013, 2017, 2021, 2024, 2027, 2030,
+    2101, 2163, 2218, 2266, 2170, 2086, 2013, 1949, 1961, 1972, 1981, 1989, 2253, 2483, 2172, 1901
+};
+
+// The integrators start from 0, so the first output is still settling
+static const std::vector<int32_t> CIC_4_2_EXPECTED = { 1296, 2127, 1826, 2101, 2393, 1912, 1842, 2559 };
+
+// Taps 8, 4, 2, 2 (newest sample first) over a zeroed delay line
+static const std::vector<int32_t> FIR_EXPECTED = {
+    1024, 1536, 1818, 2137, 2018, 1912, 1986, 3022, 1504, 1267, 2261, 1899, 2036, 2168, 2047, 2048,
+    2324, 2461, 2531, 2600, 2050, 1775, 1637, 1500, 1774, 1910, 1979, 2048, 3071, 3583, 1791, 1023
+};
+
+static const std::vector<int32_t> CHAIN_EXPECTED = {
+    2048, 2112, 1950, 2497, 1273, 2262, 2048, 2047, 2462, 2600, 1775, 1500, 1910, 2048, 3583, 1023
+};
+
+template <typename STAGE>
+static std::vector<int32_t> run(STAGE& stage) {
+    std::vector<int32_t> outputs;
+    for (const int32_t in : INPUT) {
+        int32_t out = 0;
+        if (stage.process(in, out)) outputs.push_back(out);
+    }
+    return outputs;
+}
+
+// Compares against the precomputed outputs, then checks a reset stage repeats them
+template <typename STAGE>
+static size_t check(const char* name, const std::vector<int32_t>& expected) {
+
+    STAGE stage{};
+    const std::vector<int32_t> first = run(stage);
+    stage.reset();
+    const std::vector<int32_t> second = run(stage);
+
+    size_t mismatches = (first.size() == expected.size()) ? 0 : 1;
+    for (size_t n = 0; n < std::min(first.size(), expected.size()); n++) {
+        if (first[n] != expected[n]) {
+            if (mismatches == 0) fprintf(stderr, "%s: output %zu is %d, expected %d\n", name, n, first[n], expected[n]);
+            mismatches++;
+        }
+    }
+    if (second != first) {
+        fprintf(stderr, "%s: output differs after reset()\n", name);
+        mismatches++;
+    }
+
+    printf("%-36s %zu outputs, %s\n", name, first.size(), (mismatches == 0) ? "ok" : "FAILED");
+    return mismatches;
+}
+
+// A constant input must come out unchanged once the stage has settled
+template <typename STAGE>
+static size_t check_dc_gain(const char* name) {
+
+    static constexpr int32_t LEVEL = 2345;
+    STAGE stage{};
+    int32_t out = 0;
+    for (size_t n = 0; n < 256; n++) (void)stage.process(LEVEL, out);
+
+    // Truncating shifts may lose a count
+    const bool ok = (out <= LEVEL) && (out >= (LEVEL - 1));
+    printf("%-36s DC %d -> %d, %s\n", name, LEVEL, out, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+// Tolerance on the analyser's amplitudes, relative to the fundamental put in
+static constexpr float RIPPLE_TOLERANCE = 0.02f;
+
+/**
+* DC plus a ripple fundamental and harmonics at the given peak amplitudes and phases, with white noise, fed at the rate of
+* one current channel of the board. Every bin must match its amplitude and the AC RMS the RMS of the harmonics
+*/
+static size_t check_ripple(const char* name, float fundamental_hz, const std::array<float, RIPPLE_HARMONICS>& amplitudes,
+                           float noise_rms) {
+
+    static constexpr float SAMPLE_RATE_HZ = 10'000;
+    static constexpr std::array<float, RIPPLE_HARMONICS> PHASES = { 0.3f, 1.9f, 4.0f, 5.5f };
+
+    std::array<float, RIPPLE_HARMONICS> freqs_hz{};
+    for (size_t k = 0; k < RIPPLE_HARMONICS; k++) freqs_hz[k] = fundamental_hz * (k + 1);
+
+    goertzel_bank_t<RIPPLE_HARMONICS> bank{};
+    if (!bank.setup(SAMPLE_RATE_HZ, RIPPLE_RESOLUTION_HZ, freqs_hz)) {
+        printf("%-36s setup FAILED\n", name);
+        return 1;
+    }
+
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, noise_rms);
+    size_t blocks = 0;
+    for (size_t n = 0; blocks < 3; n++) {
+        const float t = static_cast<float>(n) / SAMPLE_RATE_HZ;
+        float x = 4.0f + noise(rng);
+        for (size_t k = 0; k < RIPPLE_HARMONICS; k++) {
+            x += amplitudes[k] * sinf(2.0f * static_cast<float>(M_PI) * freqs_hz[k] * t + PHASES[k]);
+        }
+        if (bank.process(x)) blocks++;
+    }
+
+    size_t failures = 0;
+    float sum_sq = noise_rms * noise_rms;
+    printf("%-36s", name);
+    for (size_t k = 0; k < RIPPLE_HARMONICS; k++) {
+        const float measured = bank.get_amplitudes()[k];
+        const bool ok = fabsf(measured - amplitudes[k]) <= (RIPPLE_TOLERANCE * amplitudes[0]);
+        printf(" %.0fHz %.3f/%.3f%s", freqs_hz[k], measured, amplitudes[k], ok ? "" : " FAILED");
+        failures += ok ? 0 : 1;
+        sum_sq += amplitudes[k] * amplitudes[k] / 2.0f;
+    }
+    const float expected_rms = sqrtf(sum_sq);
+    const bool rms_ok = fabsf(bank.get_ac_rms() - expected_rms) <= (RIPPLE_TOLERANCE * expected_rms);
+    printf(" AC %.3f/%.3f%s\n", bank.get_ac_rms(), expected_rms, rms_ok ? "" : " FAILED");
+    return failures + (rms_ok ? 0 : 1);
+}
+
+static int test() {
+
+    size_t failures = 0;
+    failures += check<moving_average_t<4>>("moving_average<4>", MA4_EXPECTED);
+    failures += check<iir_single_pole_t<3>>("iir_single_pole<3>", IIR3_EXPECTED);
+    failures += check<cic_decimator_t<4, 2>>("cic_decimator<4, 2>", CIC_4_2_EXPECTED);
+    failures += check<fir_t<4, 8, 4, 2, 2>>("fir<4 taps>", FIR_EXPECTED);
+    failures += check<filter_chain_t<moving_average_t<2>, cic_decimator_t<2, 1>>>("moving_average<2> + cic<2, 1>", CHAIN_EXPECTED);
+    failures += check<filter_chain_t<>>("passthrough", std::vector<int32_t>(INPUT.begin(), INPUT.end()));
+
+    failures += check_dc_gain<moving_average_t<16>>("moving_average<16>");
+    failures += check_dc_gain<iir_single_pole_t<6>>("iir_single_pole<6>");
+    failures += check_dc_gain<cic_decimator_t<8, 3>>("cic_decimator<8, 3>");
+    failures += check_dc_gain<fir_t<15, 2048, 4096, 8192, 4096, 8192, 4096, 2048>>("fir<7 taps>");
+    failures += check_dc_gain<current_filter_t>("current_filter_t");
+    failures += check_dc_gain<voltage_filter_t>("voltage_filter_t");
+
+    failures += check_ripple("goertzel 100Hz ripple", 100.0f, { 1.5f, 0.4f, 0.2f, 0.1f }, 0.0f);
+    failures += check_ripple("goertzel 120Hz ripple", 120.0f, { 1.5f, 0.4f, 0.2f, 0.1f }, 0.0f);
+    failures += check_ripple("goertzel 100Hz ripple, noisy", 100.0f, { 0.8f, 0.3f, 0.0f, 0.05f }, 0.1f);
+    failures += check_ripple("goertzel 120Hz ripple, noisy", 120.0f, { 0.8f, 0.0f, 0.25f, 0.05f }, 0.1f);
+
+    printf("%s\n", (failures == 0) ? "All checks passed" : "Checks FAILED");
+    return (failures == 0) ? 0 : 1;
+}
+
+static uint64_t cycle_count() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Same synthetic signal as ADC_DSP_BENCHMARK in power_monitor.cpp: a triangle ripple plus a little noise around mid scale
+template <typename CHAIN>
+static void bench_chain(const char* name, size_t samples) {
+
+    CHAIN chain{};
+    int32_t out = 0;
+    int64_t sink = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t start_cycles = cycle_count();
+    for (size_t n = 0; n < samples; n++) {
+        const int32_t ripple = static_cast<int32_t>(n & 127) - 64;
+        const int32_t noise = static_cast<int32_t>((static_cast<uint32_t>(n) * 2654435761u) >> 29) - 4;
+        if (chain.process(2048 + ripple + noise, out)) sink += out;
+    }
+    const uint64_t cycles = cycle_count() - start_cycles;
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-36s %6.2f ns/sample %6.2f TSC cycles/sample (decimation %u, checksum %lld)\n", name, ns / samples,
+           static_cast<double>(cycles) / samples, CHAIN::DECIMATION, static_cast<long long>(sink));
+}
+
+static void bench_ripple(size_t samples) {
+
+    static constexpr float SAMPLE_RATE_HZ = 10'000;
+    goertzel_bank_t<RIPPLE_HARMONICS> bank{};
+    (void)bank.setup(SAMPLE_RATE_HZ, RIPPLE_RESOLUTION_HZ, { 100.0f, 200.0f, 300.0f, 400.0f });
+
+    // Precompute the signal so only the analyser is timed
+    std::array<float, 256> signal{};
+    for (size_t n = 0; n < signal.size(); n++) {
+        signal[n] = 3.0f + 1.5f * sinf(2.0f * static_cast<float>(M_PI) * RIPPLE_FUNDAMENTAL_HZ * n / SAMPLE_RATE_HZ);
+    }
+
+    size_t blocks = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t start_cycles = cycle_count();
+    for (size_t n = 0; n < samples; n++) {
+        if (bank.process(signal[n & 255])) blocks++;
+    }
+    const uint64_t cycles = cycle_count() - start_cycles;
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-36s %6.2f ns/sample %6.2f TSC cycles/sample (%zu bins, %zu blocks)\n", "goertzel_bank", ns / samples,
+           static_cast<double>(cycles) / samples, RIPPLE_HARMONICS, blocks);
+}
+
+static int bench(size_t samples) {
+    bench_chain<filter_chain_t<>>("passthrough", samples);
+    bench_chain<filter_chain_t<moving_average_t<4>>>("moving_average<4>", samples);
+    bench_chain<filter_chain_t<moving_average_t<16>>>("moving_average<16>", samples);
+    bench_chain<filter_chain_t<iir_single_pole_t<3>>>("iir_single_pole<3>", samples);
+    bench_chain<filter_chain_t<cic_decimator_t<4, 3>>>("cic_decimator<4, 3>", samples);
+    bench_chain<filter_chain_t<fir_t<15, 2048, 4096, 8192, 4096, 8192, 4096, 2048>>>("fir<7 taps>", samples);
+    bench_chain<filter_chain_t<moving_average_t<4>, iir_single_pole_t<2>>>("moving_average<4> + iir<2>", samples);
+    bench_chain<current_filter_t>("current_filter_t", samples);
+    bench_chain<voltage_filter_t>("voltage_filter_t", samples);
+    bench_ripple(samples);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+
+    if ((argc >= 2) && (strcmp(argv[1], "test") == 0)) return test();
+    if ((argc >= 2) && (strcmp(argv[1], "bench") == 0)) return bench((argc >= 3) ? strtoul(argv[2], nullptr, 10) : 10'000'000);
+
+    fprintf(stderr, "Usage: %s test | bench [samples]\n", argv[0]);
+    return 2;
+}
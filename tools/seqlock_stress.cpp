@@ -0,0 +1,128 @@
+// Host stress test of the measurement snapshot lock (components/power/seqlock.hpp).
+//
+// Build:   g++ -std=c++20 -O2 -pthread -Icomponents/power tools/seqlock_stress.cpp -o seqlock_stress
+// Run:     ./seqlock_stress [readers] [seconds]
+//
+// One writer thread publishes a multi-word payload as fast as it can, each word derived from a running counter and the
+// last word a checksum of the others, while the reader threads copy it out. A copy mixing two writes fails the checksum
+// or the counter pattern. Every load must be whole, generations must never go backwards for a reader, and since loads
+// never give up, every reader must keep completing them; the slowest one is reported. With fewer cores than threads
+// the writer gets preempted mid write, which is what used to starve the readers. It returns nonzero on any torn read
+// or on a reader that stopped making progress.
+
+#include "seqlock.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+// About the size of adc::data_t, so a copy takes long enough to overlap writes
+static constexpr size_t PAYLOAD_WORDS = 64;
+
+struct payload_t {
+    std::array<uint32_t, PAYLOAD_WORDS> words;
+};
+
+static uint32_t checksum(const payload_t& payload) {
+    uint32_t sum = 0x9E3779B9;
+    for (size_t w = 0; w + 1 < PAYLOAD_WORDS; w++) {
+        sum = (sum ^ payload.words[w]) * 16777619u;
+    }
+    return sum;
+}
+
+static payload_t make_payload(uint32_t counter) {
+    payload_t payload{};
+    for (size_t w = 0; w + 1 < PAYLOAD_WORDS; w++) {
+        payload.words[w] = counter * 2654435761u + static_cast<uint32_t>(w);
+    }
+    payload.words[PAYLOAD_WORDS - 1] = checksum(payload);
+    return payload;
+}
+
+// Whole if every word comes from the same counter and the checksum matches
+static bool is_whole(const payload_t& payload) {
+    const uint32_t base = payload.words[0];
+    for (size_t w = 1; w + 1 < PAYLOAD_WORDS; w++) {
+        if (payload.words[w] != base + static_cast<uint32_t>(w)) return false;
+    }
+    return payload.words[PAYLOAD_WORDS - 1] == checksum(payload);
+}
+
+struct reader_stats_t {
+    uint64_t loads;
+    uint64_t torn;
+    uint64_t backwards;
+    int64_t slowest_ns;
+};
+
+// A load slower than this means the reader was stuck, not just preempted for a scheduler slice or two
+static constexpr int64_t MAX_LOAD_NS = 500'000'000;
+
+int main(int argc, char** argv) {
+
+    const size_t reader_count = (argc >= 2) ? strtoul(argv[1], nullptr, 10) : 4;
+    const double seconds = (argc >= 3) ? atof(argv[2]) : 3.0;
+
+    static adc::seqlock_t<payload_t> lock;
+    lock.store(make_payload(0));
+
+    std::atomic<bool> running{true};
+    std::vector<reader_stats_t> stats(reader_count, reader_stats_t{});
+    std::vector<std::thread> readers;
+
+    for (size_t r = 0; r < reader_count; r++) {
+        readers.emplace_back([&, r]() {
+            reader_stats_t& own = stats[r];
+            uint32_t last_generation = 0;
+            payload_t payload{};
+            while (running.load(std::memory_order_relaxed)) {
+                uint32_t generation = 0;
+                const auto start = std::chrono::steady_clock::now();
+                lock.load(payload, generation);
+                const int64_t load_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                if (load_ns > own.slowest_ns) own.slowest_ns = load_ns;
+                own.loads++;
+                if (!is_whole(payload)) own.torn++;
+                if (generation < last_generation) own.backwards++;
+                last_generation = generation;
+            }
+        });
+    }
+
+    uint32_t writes = 0;
+    const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    while (std::chrono::steady_clock::now() < end) {
+        for (size_t n = 0; n < 1000; n++) lock.store(make_payload(++writes));
+    }
+    running.store(false);
+    for (auto& reader : readers) reader.join();
+
+    reader_stats_t total{};
+    uint64_t fewest_loads = UINT64_MAX;
+    for (const auto& own : stats) {
+        total.loads += own.loads;
+        total.torn += own.torn;
+        total.backwards += own.backwards;
+        if (own.slowest_ns > total.slowest_ns) total.slowest_ns = own.slowest_ns;
+        if (own.loads < fewest_loads) fewest_loads = own.loads;
+    }
+
+    printf("Readers:            %zu, %zu byte payload\n", reader_count, sizeof(payload_t));
+    printf("Writes:             %u, generation %u\n", writes, lock.get_generation());
+    printf("Loads:              %llu, fewest by one reader %llu, slowest %.1fus\n", static_cast<unsigned long long>(total.loads),
+           static_cast<unsigned long long>(fewest_loads), total.slowest_ns / 1000.0);
+    printf("Torn reads:         %llu\n", static_cast<unsigned long long>(total.torn));
+    printf("Generation reverts: %llu\n", static_cast<unsigned long long>(total.backwards));
+
+    const bool ok = (total.torn == 0) && (total.backwards == 0) && (fewest_loads > 0) && (total.slowest_ns <= MAX_LOAD_NS) &&
+                    (lock.get_generation() == writes + 1);
+    printf("%s\n", ok ? "No torn reads" : "FAILED");
+    return ok ? 0 : 1;
+}
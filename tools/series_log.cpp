@@ -0,0 +1,185 @@
+// Host side companion of the compressed log (components/system/series_codec.hpp).
+//
+// Build:   g++ -std=c++20 -O2 -Icomponents/system tools/series_log.cpp -o series_log
+// Decode:  ./series_log decode file_data.log > log.csv
+// Bench:   ./series_log bench [samples]
+//
+// `decode` reads a copy of DATA_FILE_NAME pulled off the storage partition and prints its samples as CSV, oldest
+// block first. `bench` runs the codec over a synthetic log and reports the compression ratio against the raw 16 byte
+// records and the encode and decode throughput.
+
+#include "series_codec.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+
+// Keep in step with LOG_BLOCK_SIZE and LOG_STEPS in components/config/config.hpp
+static constexpr size_t BLOCK_SIZE = 2048;
+static constexpr std::array<float, 4> STEPS = { 0.001f, 0.01f, 0.01f, 0.1f };
+
+using encoder_t = sys::series_encoder_t<STEPS.size(), BLOCK_SIZE>;
+using decoder_t = sys::series_decoder_t<STEPS.size(), BLOCK_SIZE>;
+using values_t = encoder_t::values_t;
+
+static constexpr size_t RAW_SAMPLE_SIZE = sizeof(values_t);
+
+static int decode(const char* path) {
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+
+    std::vector<std::vector<uint8_t>> blocks;
+    std::vector<uint8_t> block(BLOCK_SIZE);
+    size_t read = 0;
+    size_t corrupt = 0;
+    // The last block may be short, as only the part in use is written
+    while ((read = fread(block.data(), 1, BLOCK_SIZE, file)) > 0) {
+        std::fill(block.begin() + read, block.end(), 0);
+        decoder_t::header_t header{};
+        if (!decoder_t::peek(block.data(), header)) continue;
+        decoder_t decoder{};
+        if (!decoder.open(block.data())) {
+            corrupt++;
+            continue;
+        }
+        blocks.push_back(block);
+    }
+    fclose(file);
+
+    std::sort(blocks.begin(), blocks.end(), [](const auto& a, const auto& b) {
+        decoder_t::header_t ha{}, hb{};
+        (void)decoder_t::peek(a.data(), ha);
+        (void)decoder_t::peek(b.data(), hb);
+        return ha.seq < hb.seq;
+    });
+
+    printf("boot,block,timestamp_ms,voltage_v,current_a,temperature_c,humidity_pct\n");
+    size_t samples = 0;
+    for (const auto& data : blocks) {
+        decoder_t decoder{};
+        (void)decoder.open(data.data());
+        const auto& header = decoder.get_header();
+        int64_t timestamp_ms = 0;
+        values_t values{};
+        while (decoder.next(timestamp_ms, values)) {
+            printf("%u,%u,%lld,%.3f,%.2f,%.2f,%.1f\n", header.boot, header.seq, static_cast<long long>(timestamp_ms),
+                   values[0], values[1], values[2], values[3]);
+            samples++;
+        }
+    }
+
+    fprintf(stderr, "%zu samples in %zu blocks, %zu corrupt blocks skipped\n", samples, blocks.size(), corrupt);
+    return 0;
+}
+
+// A 5s log of a battery under a load switching every hour, with sensor noise, and the AHT20 missing for a while
+static void synthesize(size_t count, std::vector<int64_t>& timestamps, std::vector<values_t>& samples) {
+
+    std::mt19937 rng(1);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    int64_t timestamp_ms = 1000;
+    float temperature = 25.0f;
+    float humidity = 50.0f;
+    float load = 0.0f;
+
+    for (size_t i = 0; i < count; i++) {
+        timestamp_ms += ((i % 5000) == 7) ? 5010 : 5000;
+        if ((i % 720) == 0) load = ((rng() % 3) == 0) ? 0.0f : ((rng() % 2) ? 5.0f : 12.0f);
+        temperature += noise(rng) * 0.005f;
+        humidity += noise(rng) * 0.03f;
+
+        values_t values = {
+            12.7f - load * 0.03f + noise(rng) * 0.003f,
+            load + noise(rng) * ((load > 0.0f) ? 0.3f : 0.01f),
+            temperature + noise(rng) * 0.01f,
+            humidity + noise(rng) * 0.05f
+        };
+        if ((i % 20000) < 100) values[2] = values[3] = NAN;
+
+        timestamps.push_back(timestamp_ms);
+        samples.push_back(values);
+    }
+}
+
+static int bench(size_t count) {
+
+    std::vector<int64_t> timestamps;
+    std::vector<values_t> samples;
+    synthesize(count, timestamps, samples);
+
+    encoder_t encoder(STEPS);
+    std::vector<std::vector<uint8_t>> blocks;
+    uint32_t seq = 0;
+
+    const auto encode_start = std::chrono::steady_clock::now();
+    encoder.begin(seq++, 0);
+    for (size_t i = 0; i < count; i++) {
+        if (encoder.append(timestamps[i], samples[i])) continue;
+        const uint8_t* block = encoder.seal();
+        blocks.emplace_back(block, block + BLOCK_SIZE);
+        encoder.begin(seq++, 0);
+        (void)encoder.append(timestamps[i], samples[i]);
+    }
+    const uint8_t* block = encoder.seal();
+    blocks.emplace_back(block, block + BLOCK_SIZE);
+    const auto encode_end = std::chrono::steady_clock::now();
+
+    size_t decoded = 0;
+    size_t mismatches = 0;
+    std::array<float, STEPS.size()> max_error{};
+    decoder_t decoder{};
+    for (const auto& data : blocks) {
+        if (!decoder.open(data.data())) {
+            fprintf(stderr, "Block failed its CRC\n");
+            return 1;
+        }
+        int64_t timestamp_ms = 0;
+        values_t values{};
+        while (decoder.next(timestamp_ms, values) && (decoded < count)) {
+            if (timestamp_ms != timestamps[decoded]) mismatches++;
+            for (size_t c = 0; c < STEPS.size(); c++) {
+                const float expected = samples[decoded][c];
+                if (std::isnan(expected) != std::isnan(values[c])) {
+                    mismatches++;
+                } else if (!std::isnan(expected)) {
+                    max_error[c] = std::max(max_error[c], fabsf(values[c] - expected));
+                }
+            }
+            decoded++;
+        }
+    }
+    const auto decode_end = std::chrono::steady_clock::now();
+
+    const double raw_mb = static_cast<double>(count * RAW_SAMPLE_SIZE) / 1e6;
+    const double encoded_bytes = static_cast<double>(blocks.size() * BLOCK_SIZE);
+    const double encode_s = std::chrono::duration<double>(encode_end - encode_start).count();
+    const double decode_s = std::chrono::duration<double>(decode_end - encode_end).count();
+
+    printf("Samples:            %zu, %zu decoded, %zu mismatches\n", count, decoded, mismatches);
+    printf("Blocks:             %zu of %zu bytes\n", blocks.size(), BLOCK_SIZE);
+    printf("Bytes per sample:   %.2f (raw %zu)\n", encoded_bytes / count, RAW_SAMPLE_SIZE);
+    printf("Compression ratio:  %.2fx\n", static_cast<double>(count * RAW_SAMPLE_SIZE) / encoded_bytes);
+    printf("Encode:             %.1f MB/s\n", raw_mb / encode_s);
+    printf("Decode:             %.1f MB/s\n", raw_mb / decode_s);
+    printf("Max error:          %.4f V, %.4f A, %.4f C, %.4f %%\n", max_error[0], max_error[1], max_error[2], max_error[3]);
+    return (mismatches == 0) ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+
+    if ((argc >= 3) && (strcmp(argv[1], "decode") == 0)) return decode(argv[2]);
+    if ((argc >= 2) && (strcmp(argv[1], "bench") == 0)) return bench((argc >= 3) ? strtoul(argv[2], nullptr, 10) : 200'000);
+
+    fprintf(stderr, "Usage: %s decode <file> | bench [samples]\n", argv[0]);
+    return 2;
+}